@@ -0,0 +1,7 @@
+#include "Benchmark.h"
+
+// 无窗口基准测试程序，参数同 VideoEditor --bench
+// 例: VideoEditor-bench --clip-size 1920x1080 --clip-seconds 20 --seeks 100 --output bench.json
+int main(int argc, char* argv[]) {
+    return runBenchmark(argc, argv, 1);
+}
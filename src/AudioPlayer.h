@@ -0,0 +1,615 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+#include "AudioRing.h"
+#include "MediaQueue.h"
+#include "Profiler.h"
+
+// 音频播放：解复用线程送来的数据包 -> 音频解码线程（解码 + swresample重采样为S16）-> 无锁环形缓冲区 -> SDL音频回调
+// 音频时钟由回调实际取走的样本推算，播放时作为主时钟驱动视频显示
+// 回调中不加锁也不分配内存：只读环形缓冲区和原子变量，数据不足时补静音并记一次欠载
+// seek时UI线程只递增代数，由解码线程锁住音频设备（此时回调不运行）清空缓冲区并重新对齐时钟
+// 设备暂停期间（暂停、穿梭、逐帧）数据包队列满了就丢弃新的数据包，解复用线程不会被音频卡住；
+// 丢过数据包之后needsResync()为true，恢复正放时调用方重新seek音频
+// 缓冲区满时解码线程在条件变量上等待，由回调取走样本、恢复播放、seek和关闭唤醒；暂停期间不会空转
+class AudioPlayer {
+public:
+    AudioPlayer() : m_stream(nullptr), m_codecContext(nullptr), m_swr(nullptr), m_frame(nullptr), m_device(0),
+                    m_frameBytes(0), m_bytesPerSecond(0), m_bufferSeconds(0.0), m_quit(false), m_serial(0),
+                    m_generation(0), m_ringGeneration(0), m_pendingFlush(false), m_target(0.0), m_primed(false),
+                    m_basePts(0.0), m_baseBytes(0), m_callbackPts(0.0), m_callbackTime(0.0), m_finished(false),
+                    m_underruns(0), m_skipUntil(std::numeric_limits<double>::lowest()),
+                    m_nextPts(std::numeric_limits<double>::quiet_NaN()), m_deviceRunning(false), m_dropped(false),
+                    m_playing(false), m_pauseTime(0.0),
+                    m_clockFloor(std::numeric_limits<double>::lowest()) {
+        std::memset(&m_spec, 0, sizeof(m_spec));
+    }
+
+    ~AudioPlayer() {
+        close();
+    }
+
+    AudioPlayer(const AudioPlayer&) = delete;
+    AudioPlayer& operator=(const AudioPlayer&) = delete;
+
+    // 打开音频流的解码器和SDL音频设备（初始为暂停），启动音频解码线程
+    // 需要SDL音频子系统已经初始化；失败时返回false，调用方按无音频继续
+    bool open(AVStream* stream, size_t packetQueueSize, int serial) {
+        close();
+
+        const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+        if (!codec) {
+            std::cerr << "音频: 未找到解码器" << std::endl;
+            return false;
+        }
+        m_codecContext = avcodec_alloc_context3(codec);
+        if (!m_codecContext || avcodec_parameters_to_context(m_codecContext, stream->codecpar) < 0 ||
+            avcodec_open2(m_codecContext, codec, nullptr) < 0) {
+            std::cerr << "音频: 无法打开解码器" << std::endl;
+            close();
+            return false;
+        }
+        m_frame = av_frame_alloc();
+        if (!m_frame) {
+            close();
+            return false;
+        }
+
+        // 输出固定为S16，最多两个声道；设备实际的采样率和声道数由SDL决定，重采样器按它配置
+        SDL_AudioSpec wanted;
+        std::memset(&wanted, 0, sizeof(wanted));
+        wanted.freq = m_codecContext->sample_rate;
+        wanted.format = AUDIO_S16SYS;
+        wanted.channels = (Uint8)std::max(1, std::min(2, m_codecContext->ch_layout.nb_channels));
+        wanted.samples = deviceBufferSamples(wanted.freq);
+        wanted.callback = &AudioPlayer::audioCallback;
+        wanted.userdata = this;
+        m_device = SDL_OpenAudioDevice(nullptr, 0, &wanted, &m_spec,
+                                       SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+        if (m_device == 0) {
+            std::cerr << "音频: 无法打开音频设备: " << SDL_GetError() << std::endl;
+            close();
+            return false;
+        }
+
+        AVChannelLayout inLayout;
+        if (m_codecContext->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+            av_channel_layout_default(&inLayout, m_codecContext->ch_layout.nb_channels);
+        } else {
+            av_channel_layout_copy(&inLayout, &m_codecContext->ch_layout);
+        }
+        AVChannelLayout outLayout;
+        av_channel_layout_default(&outLayout, m_spec.channels);
+        int ret = swr_alloc_set_opts2(&m_swr, &outLayout, AV_SAMPLE_FMT_S16, m_spec.freq,
+                                      &inLayout, m_codecContext->sample_fmt, m_codecContext->sample_rate, 0, nullptr);
+        av_channel_layout_uninit(&inLayout);
+        av_channel_layout_uninit(&outLayout);
+        if (ret < 0 || swr_init(m_swr) < 0) {
+            std::cerr << "音频: 无法创建重采样器" << std::endl;
+            close();
+            return false;
+        }
+
+        m_stream = stream;
+        m_frameBytes = (size_t)m_spec.channels * sizeof(int16_t);
+        m_bytesPerSecond = (size_t)m_spec.freq * m_frameBytes;
+        m_bufferSeconds = (double)m_spec.samples / m_spec.freq;
+        m_ring.allocate((size_t)(kRingSeconds * m_bytesPerSecond));
+
+        m_quit = false;
+        m_serial = serial;
+        m_generation = 0;
+        m_ringGeneration = 0;
+        m_pendingFlush = false;
+        m_primed = false;
+        m_finished = false;
+        m_underruns = 0;
+        m_callbackTime = 0.0;
+        m_skipUntil = std::numeric_limits<double>::lowest();
+        m_nextPts = std::numeric_limits<double>::quiet_NaN();
+        m_playing = false;
+        m_deviceRunning = false;
+        m_dropped = false;
+        m_clockFloor = std::numeric_limits<double>::lowest();
+        m_packets.setCapacity(packetQueueSize);
+        m_packets.start();
+        m_thread = std::thread(&AudioPlayer::decodeLoop, this);
+
+        std::cout << "音频: " << codec->name << " " << m_codecContext->sample_rate << "Hz -> "
+                  << m_spec.freq << "Hz " << (int)m_spec.channels << "声道，设备缓冲 "
+                  << (int)(m_bufferSeconds * 1000) << "ms（" << SDL_GetCurrentAudioDriver() << "）" << std::endl;
+        return true;
+    }
+
+    // 中止数据包队列，让阻塞在pushPacket上的解复用线程返回
+    void abort() {
+        m_quit = true;
+        m_packets.abort();
+        wakeWriter();
+    }
+
+    void close() {
+        abort();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        if (m_device) {
+            SDL_CloseAudioDevice(m_device);
+            m_device = 0;
+        }
+        if (m_swr) {
+            swr_free(&m_swr);
+        }
+        if (m_frame) {
+            av_frame_free(&m_frame);
+        }
+        if (m_codecContext) {
+            avcodec_free_context(&m_codecContext);
+        }
+        m_stream = nullptr;
+        m_convertBuffer.clear();
+        m_convertBuffer.shrink_to_fit();
+    }
+
+    // 片段切到后台：关闭SDL音频设备，把系统的音频流让给前台片段；解码线程、缓冲区和重采样器保留
+    void releaseDevice() {
+        if (!isOpen()) {
+            return;
+        }
+        setPlaying(false);
+        std::lock_guard<std::mutex> lock(m_deviceMutex);
+        SDL_CloseAudioDevice(m_device);
+        m_device = 0;
+    }
+
+    // 切回前台：按原来的格式重新打开设备（初始为暂停）；格式不允许改变，缓冲区里的样本可以直接续上
+    bool reopenDevice() {
+        if (isOpen() || !m_stream) {
+            return isOpen();
+        }
+        SDL_AudioSpec wanted = m_spec;
+        wanted.callback = &AudioPlayer::audioCallback;
+        wanted.userdata = this;
+        SDL_AudioSpec obtained;
+        SDL_AudioDeviceID device = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained, 0);
+        if (device == 0) {
+            std::cerr << "音频: 无法重新打开音频设备: " << SDL_GetError() << std::endl;
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_deviceMutex);
+        m_device = device;
+        m_callbackTime = 0.0;
+        return true;
+    }
+
+    bool isOpen() const {
+        return m_device != 0;
+    }
+
+    // 由解复用线程调用，packet为空表示文件结束；队列被中止时返回false
+    // 设备暂停时不等待：队列满了就丢弃这个数据包并记下需要重新定位
+    bool pushPacket(PacketPtr packet, int serial) {
+        QueuedPacket item;
+        item.packet = std::move(packet);
+        item.serial = serial;
+        PacketQueue::PushResult result =
+            m_packets.pushUnless(std::move(item), [this]() { return !m_deviceRunning.load(); });
+        if (result == PacketQueue::PushResult::GaveUp && serial == m_serial.load()) {
+            m_dropped = true;
+        }
+        return result != PacketQueue::PushResult::Aborted;
+    }
+
+    // 暂停期间丢过当前序号的数据包，缓冲区之后的音频不连续，恢复播放前需要seek
+    bool needsResync() const {
+        return m_dropped.load();
+    }
+
+    // 重新定位解复用器的seek：旧序号的数据包全部丢弃，从target开始输出
+    void seek(double target, int serial) {
+        m_serial = serial;
+        m_dropped = false;
+        m_packets.flush();
+        m_pendingFlush = true;
+        requestSync(target);
+    }
+
+    // 不重新定位解复用器的向前seek：缓冲区中target之前的样本丢弃，之后的保留
+    void skipTo(double target) {
+        requestSync(target);
+    }
+
+    // 缓冲区中最早的样本不晚于target时才能用skipTo，否则需要seek
+    bool canSkipTo(double target) const {
+        if (!m_primed.load() || m_ringGeneration.load() != m_generation.load() || m_dropped.load()) {
+            return false;
+        }
+        return target >= ptsAt(m_ring.readPosition());
+    }
+
+    // 由UI线程调用：只在正常速度正放时播放
+    void setPlaying(bool playing) {
+        if (!isOpen() || playing == m_playing) {
+            return;
+        }
+        m_playing = playing;
+        m_deviceRunning = playing;
+        if (playing) {
+            // 暂停期间设备缓冲的样本已经作废，恢复后从缓冲区中下一个未播放的样本推算
+            m_callbackTime = 0.0;
+            SDL_PauseAudioDevice(m_device, 0);
+        } else {
+            m_pauseTime = now();
+            SDL_PauseAudioDevice(m_device, 1);
+            // 阻塞在满队列上的解复用线程改为丢弃
+            m_packets.wakeProducers();
+        }
+        // 暂停时回调已经停止，之前回调的唤醒可能被错过；恢复时让解码线程换成按设备缓冲区等待
+        wakeWriter();
+    }
+
+    // 由UI线程调用：当前正在播放的样本的时间，seek之后缓冲区还没有数据时返回false
+    // 精度约为一个设备缓冲区：按回调时刻取走的样本减去仍在设备中排队的一个缓冲区，再按真实时间推进
+    bool clock(double& time) {
+        if (!isOpen() || m_ringGeneration.load() != m_generation.load() || !m_primed.load()) {
+            return false;
+        }
+
+        double callbackTime = m_callbackTime.load();
+        double pts;
+        if (callbackTime <= 0.0) {
+            pts = ptsAt(m_ring.readPosition());
+        } else {
+            double reference = m_playing ? now() : m_pauseTime;
+            double elapsed = std::min(std::max(reference - callbackTime, 0.0), m_bufferSeconds);
+            pts = m_callbackPts.load() - m_bufferSeconds + elapsed;
+        }
+
+        // 时钟不后退：回调刚开始时减去设备缓冲会比起始位置略早
+        time = std::max(pts, m_clockFloor);
+        m_clockFloor = time;
+        return true;
+    }
+
+    // 音频流已经解码到结尾且缓冲区已播放完
+    bool finished() const {
+        return m_finished.load() && m_ring.readable() == 0;
+    }
+
+    // 播放中回调需要数据而缓冲区不足的次数
+    uint64_t underruns() const {
+        return m_underruns.load();
+    }
+
+    double bufferedSeconds() const {
+        return m_bytesPerSecond ? (double)m_ring.readable() / m_bytesPerSecond : 0.0;
+    }
+
+    int sampleRate() const {
+        return m_spec.freq;
+    }
+
+    int channels() const {
+        return m_spec.channels;
+    }
+
+    int deviceBufferSamples() const {
+        return m_spec.samples;
+    }
+
+private:
+    static constexpr double kRingSeconds = 0.5;      // 环形缓冲区时长
+    static constexpr double kPtsContinuity = 0.05;   // 与上一帧末尾相差不超过该值（秒）视为连续
+
+    static double now() {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 约30次回调每秒，取2的幂
+    static Uint16 deviceBufferSamples(int freq) {
+        int samples = 512;
+        while (samples * 2 <= freq / 30 && samples < 8192) {
+            samples *= 2;
+        }
+        return (Uint16)samples;
+    }
+
+    double ptsAt(uint64_t position) const {
+        return m_basePts.load() + (double)(int64_t)(position - m_baseBytes.load()) / m_bytesPerSecond;
+    }
+
+    void requestSync(double target) {
+        m_target = target;
+        m_finished = false;
+        m_clockFloor = std::numeric_limits<double>::lowest();
+        m_generation.fetch_add(1, std::memory_order_release);
+        wakeWriter();
+    }
+
+    // 状态改变后唤醒等待缓冲区空间的解码线程；加锁保证等待方检查条件和进入等待之间不会错过
+    void wakeWriter() {
+        {
+            std::lock_guard<std::mutex> lock(m_spaceMutex);
+        }
+        m_spaceChanged.notify_all();
+    }
+
+    static void audioCallback(void* userdata, Uint8* stream, int len) {
+        ((AudioPlayer*)userdata)->fill(stream, (size_t)len);
+    }
+
+    // SDL音频线程：只读环形缓冲区和原子变量
+    void fill(uint8_t* out, size_t len) {
+        size_t copied = 0;
+        bool wasFull = false;
+        if (m_ringGeneration.load(std::memory_order_acquire) == m_generation.load(std::memory_order_acquire) &&
+            m_primed.load(std::memory_order_acquire)) {
+            uint64_t position = m_ring.readPosition();
+            wasFull = m_ring.writable() < m_frameBytes;
+            copied = m_ring.read(out, len);
+            if (copied < len && !m_finished.load()) {
+                m_underruns.fetch_add(1, std::memory_order_relaxed);
+            }
+            m_callbackPts = ptsAt(position);
+            m_callbackTime = now();
+        }
+        std::memset(out + copied, m_spec.silence, len - copied);
+        // 解码线程只在缓冲区满时等待，只在由满变为不满时通知；不加锁通知可能错过一次唤醒，等待方最多多等一个设备缓冲区
+        if (copied > 0 && wasFull) {
+            m_spaceChanged.notify_one();
+        }
+    }
+
+    // 在回调不运行时处理UI线程的seek请求；返回true表示是重新定位的seek，手头的旧数据应当丢弃
+    bool syncGeneration(uint32_t& generation) {
+        uint32_t current = m_generation.load(std::memory_order_acquire);
+        if (current == generation) {
+            return false;
+        }
+        generation = current;
+        bool flush = m_pendingFlush.exchange(false);
+        double target = m_target.load();
+
+        std::lock_guard<std::mutex> deviceLock(m_deviceMutex);  // 设备可能正被UI线程关闭或重新打开
+        SDL_LockAudioDevice(m_device);
+        bool inRing = false;
+        if (!flush && m_primed.load()) {
+            double start = ptsAt(m_ring.readPosition());
+            double end = ptsAt(m_ring.writePosition());
+            if (target >= start && target <= end) {
+                size_t samples = (size_t)((target - start) * m_spec.freq);
+                m_ring.skip(samples * m_frameBytes);
+                inRing = true;
+            }
+        }
+        if (!inRing) {
+            m_ring.clear();
+            m_primed = false;
+            m_skipUntil = target;
+            m_nextPts = std::numeric_limits<double>::quiet_NaN();
+        }
+        m_callbackTime = 0.0;
+        m_ringGeneration.store(generation, std::memory_order_release);
+        SDL_UnlockAudioDevice(m_device);
+        return flush;
+    }
+
+    void decodeLoop() {
+        Profiler::setThreadName("audio");
+        int decoderSerial = -1;
+        uint32_t generation = m_generation.load();
+        QueuedPacket item;
+
+        while (m_packets.pop(item)) {
+            syncGeneration(generation);
+            if (item.serial != m_serial.load()) {
+                continue;
+            }
+
+            // seek之后第一个数据包：清空解码器和重采样器中残留的样本
+            if (item.serial != decoderSerial) {
+                avcodec_flush_buffers(m_codecContext);
+                swr_init(m_swr);
+                m_nextPts = std::numeric_limits<double>::quiet_NaN();
+                decoderSerial = item.serial;
+            }
+
+            int ret;
+            {
+                ProfileScope scope("audio_decode");
+                ret = avcodec_send_packet(m_codecContext, item.packet.get());
+            }
+            if (ret < 0 && ret != AVERROR_EOF) {
+                continue;
+            }
+
+            while (true) {
+                ret = avcodec_receive_frame(m_codecContext, m_frame);
+                if (ret < 0) {
+                    break;
+                }
+                bool keep = writeFrame(m_frame, generation);
+                av_frame_unref(m_frame);
+                if (!keep) {
+                    break;
+                }
+            }
+
+            if (ret == AVERROR_EOF) {
+                // 解码器已输出全部样本；清空状态以便之后seek回来继续解码
+                avcodec_flush_buffers(m_codecContext);
+                decoderSerial = -1;
+                if (generation == m_generation.load()) {
+                    m_finished = true;
+                }
+            }
+        }
+    }
+
+    // 重采样一帧并写入缓冲区；返回false表示应当放弃当前数据包剩余的帧（退出或seek）
+    bool writeFrame(AVFrame* frame, uint32_t& generation) {
+        int maxSamples = swr_get_out_samples(m_swr, frame->nb_samples);
+        if (maxSamples <= 0) {
+            return true;
+        }
+        size_t needed = (size_t)maxSamples * m_frameBytes;
+        if (m_convertBuffer.size() < needed) {
+            m_convertBuffer.resize(needed);
+        }
+
+        uint8_t* out = m_convertBuffer.data();
+        int samples;
+        {
+            ProfileScope scope("swr_convert");
+            samples = swr_convert(m_swr, &out, maxSamples, (const uint8_t**)frame->extended_data, frame->nb_samples);
+        }
+        if (samples <= 0) {
+            return true;
+        }
+
+        // 时间戳缺失或与上一帧末尾几乎连续时按样本数推算，避免时间戳抖动在缓冲区中留下空隙
+        double pts = m_nextPts;
+        if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+            double framePts = frame->best_effort_timestamp * av_q2d(m_stream->time_base);
+            if (std::isnan(pts) || std::abs(framePts - pts) > kPtsContinuity) {
+                pts = framePts;
+            }
+        }
+        if (std::isnan(pts)) {
+            pts = 0.0;
+        }
+        m_nextPts = pts + (double)samples / m_spec.freq;
+
+        return writeSamples(out, (size_t)samples, pts, generation);
+    }
+
+    bool writeSamples(const uint8_t* data, size_t samples, double pts, uint32_t& generation) {
+        while (samples > 0) {
+            if (m_quit.load()) {
+                return false;
+            }
+            if (syncGeneration(generation)) {
+                return false;
+            }
+
+            // seek目标之前的样本不写入
+            if (pts < m_skipUntil) {
+                size_t drop = std::min(samples, (size_t)std::ceil((m_skipUntil - pts) * m_spec.freq));
+                data += drop * m_frameBytes;
+                samples -= drop;
+                pts += (double)drop / m_spec.freq;
+                if (samples == 0) {
+                    return true;
+                }
+            }
+
+            // 清空之后的第一批样本确定缓冲区位置和时间的对应关系，回调在m_primed之后才会读取
+            if (!m_primed.load()) {
+                m_baseBytes = m_ring.writePosition();
+                m_basePts = pts;
+                m_primed.store(true, std::memory_order_release);
+            }
+
+            // 只写整数个采样帧
+            size_t space = m_ring.writable() / m_frameBytes;
+            size_t count = std::min(samples, space);
+            if (count == 0) {
+                waitForSpace(generation);
+                continue;
+            }
+            m_ring.write(data, count * m_frameBytes);
+            data += count * m_frameBytes;
+            samples -= count;
+            pts += (double)count / m_spec.freq;
+        }
+        return true;
+    }
+
+    // 等缓冲区腾出空间：设备播放时回调每个缓冲区周期唤醒一次，最多等一个设备缓冲区；
+    // 设备暂停时回调不运行，一直等到恢复播放、seek或关闭
+    void waitForSpace(uint32_t generation) {
+        auto ready = [&]() {
+            return m_quit.load() || m_generation.load() != generation || m_ring.writable() >= m_frameBytes;
+        };
+        std::unique_lock<std::mutex> lock(m_spaceMutex);
+        if (m_deviceRunning.load()) {
+            m_spaceChanged.wait_for(lock, std::chrono::duration<double>(m_bufferSeconds), ready);
+        } else {
+            m_spaceChanged.wait(lock, [&]() { return ready() || m_deviceRunning.load(); });
+        }
+    }
+
+    AVStream* m_stream;
+    AVCodecContext* m_codecContext;
+    SwrContext* m_swr;
+    AVFrame* m_frame;
+    SDL_AudioDeviceID m_device;  // UI线程写；解码线程在m_deviceMutex内读
+    std::mutex m_deviceMutex;
+    SDL_AudioSpec m_spec;       // 设备实际使用的格式
+    size_t m_frameBytes;        // 一个采样帧（所有声道）的字节数
+    size_t m_bytesPerSecond;
+    double m_bufferSeconds;     // 一个设备缓冲区的时长
+
+    PacketQueue m_packets;
+    std::thread m_thread;
+    std::atomic<bool> m_quit;
+    std::atomic<int> m_serial;  // 当前有效的数据包序号，与VideoDecoder的serial一致
+
+    // seek请求：UI线程递增m_generation，解码线程处理后把m_ringGeneration设为同一值
+    // 两者不相等期间回调只输出静音、时钟无效
+    std::atomic<uint32_t> m_generation;
+    std::atomic<uint32_t> m_ringGeneration;
+    std::atomic<bool> m_pendingFlush;
+    std::atomic<double> m_target;
+
+    // 缓冲区位置与时间的对应：位置m_baseBytes处的样本时间为m_basePts
+    AudioRing m_ring;
+    std::atomic<bool> m_primed;
+    std::atomic<double> m_basePts;
+    std::atomic<uint64_t> m_baseBytes;
+
+    // 回调写、UI线程读
+    std::atomic<double> m_callbackPts;   // 最近一次回调取走的第一个样本的时间
+    std::atomic<double> m_callbackTime;  // 最近一次回调的真实时刻，0表示尚未回调
+    std::atomic<bool> m_finished;
+    std::atomic<uint64_t> m_underruns;
+
+    // 解码线程专用
+    double m_skipUntil;
+    double m_nextPts;
+    std::vector<uint8_t> m_convertBuffer;
+
+    std::atomic<bool> m_deviceRunning;  // 设备正在播放（UI线程写，解复用线程读）
+    std::atomic<bool> m_dropped;        // 设备暂停期间丢弃过当前序号的数据包
+
+    // 解码线程等缓冲区空间
+    std::mutex m_spaceMutex;
+    std::condition_variable m_spaceChanged;
+
+    // UI线程专用
+    bool m_playing;
+    double m_pauseTime;
+    double m_clockFloor;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// 单生产者/单消费者无锁环形缓冲区（字节）
+// 音频解码线程写入，SDL音频回调读取；两端各自只推进自己的位置，不加锁也不分配内存
+// 读写位置是累计字节数，只增不减，相减即为缓冲的数据量
+class AudioRing {
+public:
+    AudioRing() : m_mask(0), m_readPos(0), m_writePos(0) {}
+
+    AudioRing(const AudioRing&) = delete;
+    AudioRing& operator=(const AudioRing&) = delete;
+
+    // 容量向上取整到2的幂；只能在生产者和消费者都停止时调用
+    void allocate(size_t bytes) {
+        size_t capacity = 1;
+        while (capacity < bytes) {
+            capacity <<= 1;
+        }
+        m_buffer.assign(capacity, 0);
+        m_mask = capacity - 1;
+        m_readPos.store(0);
+        m_writePos.store(0);
+    }
+
+    size_t capacity() const {
+        return m_buffer.size();
+    }
+
+    // 可读的字节数
+    size_t readable() const {
+        return (size_t)(m_writePos.load(std::memory_order_acquire) - m_readPos.load(std::memory_order_acquire));
+    }
+
+    // 可写的字节数
+    size_t writable() const {
+        return capacity() - readable();
+    }
+
+    uint64_t readPosition() const {
+        return m_readPos.load(std::memory_order_acquire);
+    }
+
+    uint64_t writePosition() const {
+        return m_writePos.load(std::memory_order_acquire);
+    }
+
+    // 生产者：写入不超过可写空间的部分，返回实际写入的字节数
+    size_t write(const uint8_t* data, size_t bytes) {
+        uint64_t write = m_writePos.load(std::memory_order_relaxed);
+        uint64_t read = m_readPos.load(std::memory_order_acquire);
+        bytes = std::min(bytes, capacity() - (size_t)(write - read));
+        copyIn(write, data, bytes);
+        m_writePos.store(write + bytes, std::memory_order_release);
+        return bytes;
+    }
+
+    // 消费者：读出不超过可读数据的部分，返回实际读出的字节数
+    size_t read(uint8_t* out, size_t bytes) {
+        uint64_t read = m_readPos.load(std::memory_order_relaxed);
+        uint64_t write = m_writePos.load(std::memory_order_acquire);
+        bytes = std::min(bytes, (size_t)(write - read));
+        copyOut(read, out, bytes);
+        m_readPos.store(read + bytes, std::memory_order_release);
+        return bytes;
+    }
+
+    // 消费者：丢弃不超过可读数据的部分
+    size_t skip(size_t bytes) {
+        uint64_t read = m_readPos.load(std::memory_order_relaxed);
+        uint64_t write = m_writePos.load(std::memory_order_acquire);
+        bytes = std::min(bytes, (size_t)(write - read));
+        m_readPos.store(read + bytes, std::memory_order_release);
+        return bytes;
+    }
+
+    // 消费者：丢弃全部已写入的数据
+    void clear() {
+        m_readPos.store(m_writePos.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    void copyIn(uint64_t position, const uint8_t* data, size_t bytes) {
+        size_t offset = (size_t)(position & m_mask);
+        size_t first = std::min(bytes, capacity() - offset);
+        std::memcpy(m_buffer.data() + offset, data, first);
+        std::memcpy(m_buffer.data(), data + first, bytes - first);
+    }
+
+    void copyOut(uint64_t position, uint8_t* out, size_t bytes) const {
+        size_t offset = (size_t)(position & m_mask);
+        size_t first = std::min(bytes, capacity() - offset);
+        std::memcpy(out, m_buffer.data() + offset, first);
+        std::memcpy(out + first, m_buffer.data(), bytes - first);
+    }
+
+    std::vector<uint8_t> m_buffer;
+    size_t m_mask;
+    std::atomic<uint64_t> m_readPos;   // 只由消费者写
+    std::atomic<uint64_t> m_writePos;  // 只由生产者写
+};
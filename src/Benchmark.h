@@ -0,0 +1,1425 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "DecoderThreading.h"
+#include "TestClip.h"
+#include "TrimExporter.h"
+#include "ChunkedExporter.h"
+#include "ColorEffects.h"
+#include "Compositor.h"
+#include "ProxyGenerator.h"
+#include "WaveformTrack.h"
+#include "ProbeCache.h"
+#include "SceneDetector.h"
+#include "VideoDecoder.h"
+
+struct BenchmarkOptions {
+    std::string input;       // 为空时生成测试视频
+    std::string output;      // JSON报告路径，为空时写到标准输出
+    std::string workDir;     // 生成测试视频的目录，为空时使用系统临时目录
+    std::string trace;       // 非空时打开分段计时，结束后导出Chrome trace
+    bool render = true;      // 使用SDL dummy视频驱动 + 软件渲染器走完整的上传路径
+    int seeks = 50;          // 随机seek次数
+    unsigned int seed = 1;   // 随机seek目标的种子，固定后多次运行可比较
+    int previewWidth = 960;  // 模拟的预览区域尺寸
+    int previewHeight = 540;
+    bool previewScaling = true;
+    bool zeroCopy = false;
+    size_t frameCacheBytes = 256 * 1024 * 1024;
+    int coreBudget = 0;
+    double audioSeconds = 0.0;          // 大于0时按音频时钟实时播放这么长时间，测量欠载和音画偏差
+    std::string audioDriver = "dummy";  // SDL音频驱动：dummy 或 disk（写入工作目录下的文件）
+    double trimSeconds = 0.0;           // 大于0时从视频中段裁剪导出这么长的片段，测量智能裁剪的耗时
+    int compositeLayers = 0;            // 大于0时测量这么多图层在1080p/4K上的合成耗时
+    bool colorEffects = false;          // 测量各调色效果在1080p/4K上的每帧耗时，并与标量内核对照
+    int exportWorkers = -1;             // 不小于0时整段并行重编码导出（0为按核心预算），并与串行编码对照
+    bool proxy = false;                 // 生成预览代理，并在代理上重复同一组精确seek
+    bool waveform = false;              // 测量波形金字塔的冷/热生成和各缩放级别的查询耗时
+    IOMode ioMode = IOMode::Auto;       // 主解码/seek测试读取输入的方式
+    bool probeCache = false;            // 比较有无探测缓存时从打开到第一帧的时间
+    bool scenes = false;                // 用不同的工作线程数做镜头切换分析，测量吞吐和加速比
+    DecoderThreadingConfig threading;
+    TestClipSpec clip;
+};
+
+// 无窗口基准测试：打开 -> 顺序解码到结尾 -> 随机精确/关键帧seek，输出JSON报告
+// 全部走VideoDecoder的真实路径（解复用/解码/转换线程、帧队列、上传），只是不打开可见窗口
+class Benchmark {
+public:
+    explicit Benchmark(const BenchmarkOptions& options)
+        : m_options(options), m_window(nullptr), m_renderer(nullptr), m_sdlStarted(false) {}
+
+    ~Benchmark() {
+        if (m_renderer) {
+            SDL_DestroyRenderer(m_renderer);
+        }
+        if (m_window) {
+            SDL_DestroyWindow(m_window);
+        }
+        if (m_sdlStarted) {
+            SDL_Quit();
+        }
+    }
+
+    Benchmark(const Benchmark&) = delete;
+    Benchmark& operator=(const Benchmark&) = delete;
+
+    // 解析基准测试参数，从argv[first]开始
+    static bool parseArgs(int argc, char* argv[], int first, BenchmarkOptions& options) {
+        for (int i = first; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--input" && hasValue) {
+                options.input = argv[++i];
+            } else if (arg == "--output" && hasValue) {
+                options.output = argv[++i];
+            } else if (arg == "--work-dir" && hasValue) {
+                options.workDir = argv[++i];
+            } else if (arg == "--trace" && hasValue) {
+                options.trace = argv[++i];
+            } else if (arg == "--no-render") {
+                options.render = false;
+            } else if (arg == "--seeks" && hasValue) {
+                options.seeks = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--seed" && hasValue) {
+                options.seed = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+            } else if (arg == "--preview-size" && hasValue) {
+                if (std::sscanf(argv[++i], "%dx%d", &options.previewWidth, &options.previewHeight) != 2) {
+                    std::cerr << "预览尺寸格式应为 宽x高: " << argv[i] << std::endl;
+                    return false;
+                }
+            } else if (arg == "--full-res-preview") {
+                options.previewScaling = false;
+            } else if (arg == "--zero-copy") {
+                options.zeroCopy = true;
+            } else if (arg == "--frame-cache-mb" && hasValue) {
+                options.frameCacheBytes = (size_t)std::max(0L, std::atol(argv[++i])) * 1024 * 1024;
+            } else if (arg == "--decode-threads" && hasValue) {
+                options.threading.threadCount = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--thread-type" && hasValue) {
+                if (!ThreadBudget::parseThreadType(argv[++i], options.threading.type)) {
+                    std::cerr << "未知的线程类型: " << argv[i] << std::endl;
+                    return false;
+                }
+            } else if (arg == "--core-budget" && hasValue) {
+                options.coreBudget = std::atoi(argv[++i]);
+            } else if (arg == "--autotune-threads") {
+                options.threading.autoTune = true;
+            } else if (arg == "--audio-seconds" && hasValue) {
+                options.audioSeconds = std::max(0.0, std::atof(argv[++i]));
+                options.clip.audio = options.audioSeconds > 0.0;
+            } else if (arg == "--audio-driver" && hasValue) {
+                options.audioDriver = argv[++i];
+            } else if (arg == "--trim-seconds" && hasValue) {
+                options.trimSeconds = std::max(0.0, std::atof(argv[++i]));
+            } else if (arg == "--composite-layers" && hasValue) {
+                options.compositeLayers = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--color-effects") {
+                options.colorEffects = true;
+            } else if (arg == "--proxy") {
+                options.proxy = true;
+            } else if (arg == "--io" && hasValue) {
+                if (!MediaIO::parseMode(argv[++i], options.ioMode)) {
+                    std::cerr << "未知的读取方式: " << argv[i] << std::endl;
+                    return false;
+                }
+            } else if (arg == "--probe-cache") {
+                options.probeCache = true;
+            } else if (arg == "--scenes") {
+                options.scenes = true;
+                if (options.clip.sceneSeconds <= 0.0) {
+                    options.clip.sceneSeconds = kBenchSceneSeconds;
+                }
+            } else if (arg == "--waveform") {
+                options.waveform = true;
+                options.clip.audio = true;
+            } else if (arg == "--export-workers" && hasValue) {
+                options.exportWorkers = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--clip-size" && hasValue) {
+                if (std::sscanf(argv[++i], "%dx%d", &options.clip.width, &options.clip.height) != 2) {
+                    std::cerr << "测试视频尺寸格式应为 宽x高: " << argv[i] << std::endl;
+                    return false;
+                }
+            } else if (arg == "--clip-seconds" && hasValue) {
+                options.clip.seconds = std::max(1.0, std::atof(argv[++i]));
+            } else if (arg == "--clip-fps" && hasValue) {
+                options.clip.fps = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--clip-gop" && hasValue) {
+                options.clip.gopSize = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--clip-encoder" && hasValue) {
+                options.clip.encoder = argv[++i];
+            } else {
+                std::cerr << "未知的基准测试参数: " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int run() {
+        if (m_options.coreBudget > 0) {
+            ThreadBudget::instance().setTotalCores(m_options.coreBudget);
+        }
+        if (!m_options.trace.empty()) {
+            Profiler::setThreadName("bench");
+            Profiler::instance().setEnabled(true);
+        }
+
+        std::string path = m_options.input;
+        double generateSeconds = 0.0;
+        if (path.empty()) {
+            path = clipPath();
+            auto begin = Clock::now();
+            if (!generateTestClip(path, m_options.clip)) {
+                return 1;
+            }
+            generateSeconds = secondsSince(begin);
+        }
+
+        if (m_options.render) {
+            createRenderer();
+        }
+
+        VideoDecoder decoder;
+        decoder.setThreading(m_options.threading);
+        decoder.setPreviewScaling(m_options.previewScaling);
+        // 没有渲染器时零拷贝路径的转换发生在上传阶段，会被整个跳过，结果没有可比性
+        decoder.setZeroCopyUpload(m_options.zeroCopy && m_renderer);
+        decoder.setFrameCacheSize(m_options.frameCacheBytes);
+        decoder.setOutputSize(m_options.previewWidth, m_options.previewHeight);
+        decoder.setIOMode(m_options.ioMode);
+
+        auto openBegin = Clock::now();
+        if (!decoder.openFile(path, m_renderer)) {
+            return 1;
+        }
+        double openSeconds = secondsSince(openBegin);
+
+        // 顺序解码：每一帧从上一帧交付到这一帧交付的时间
+        std::vector<double> frameLatencies;
+        double firstFrameSeconds = 0.0;
+        auto decodeBegin = Clock::now();
+        auto last = decodeBegin;
+        // 预热之后的稳定播放阶段：数据包、帧结构体和缓冲区都应该来自池，申请次数应为0
+        auto steadyBegin = decodeBegin;
+        uint64_t steadyAllocationBase = 0;
+        while (decoder.nextFrame() == VideoDecoder::FrameStatus::Presented) {
+            auto now = Clock::now();
+            if (frameLatencies.empty()) {
+                firstFrameSeconds = secondsSince(openBegin);
+            }
+            frameLatencies.push_back(std::chrono::duration<double>(now - last).count());
+            last = now;
+            if (frameLatencies.size() == kSteadyWarmupFrames) {
+                steadyBegin = now;
+                steadyAllocationBase = pooledAllocations(decoder);
+            }
+        }
+        double decodeSeconds = secondsSince(decodeBegin);
+        size_t steadyFrames = frameLatencies.size() > kSteadyWarmupFrames ? frameLatencies.size() - kSteadyWarmupFrames : 0;
+        uint64_t steadyAllocations = steadyFrames ? pooledAllocations(decoder) - steadyAllocationBase : 0;
+        double steadySeconds = steadyFrames ? std::chrono::duration<double>(last - steadyBegin).count() : 0.0;
+        MediaPoolStats mediaPool = MediaPool::instance().stats();
+
+        // seek的代价估算依赖关键帧索引，等它建好再测
+        auto indexBegin = Clock::now();
+        while (!decoder.isIndexReady() && secondsSince(indexBegin) < kIndexTimeout) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double indexWaitSeconds = secondsSince(indexBegin);
+
+        double duration = decoder.getDuration();
+        std::vector<double> targets;
+        std::mt19937 random(m_options.seed);
+        std::uniform_real_distribution<double> distribution(0.0, std::max(0.0, duration - kTailMargin));
+        for (int i = 0; i < m_options.seeks; i++) {
+            targets.push_back(distribution(random));
+        }
+        int exactTimeouts = 0;
+        int keyframeTimeouts = 0;
+        std::vector<double> exactLatencies = measureSeeks(decoder, targets, VideoDecoder::SeekMode::Exact, exactTimeouts);
+        std::vector<double> keyframeLatencies = measureSeeks(decoder, targets, VideoDecoder::SeekMode::Keyframe, keyframeTimeouts);
+
+        // 音频播放用单独的解码器，上面的统计仍然读取第一个解码器
+        AudioReport audio;
+        if (m_options.audioSeconds > 0.0 && !measureAudio(path, audio)) {
+            return 1;
+        }
+
+        // 裁剪导出：入点和出点都避开关键帧，两端各有一个GOP需要重编码
+        TrimExportStats trim;
+        std::string trimPath;
+        if (m_options.trimSeconds > 0.0) {
+            double inPoint = duration / 3 + 0.5 / std::max(1, m_options.clip.fps);
+            trimPath = (std::filesystem::path(clipPath()).parent_path() / "videoeditor_bench_trim.mp4").string();
+            TrimExporter exporter;
+            if (!exporter.exportRange(path, inPoint, std::min(duration, inPoint + m_options.trimSeconds), trimPath, trim)) {
+                return 1;
+            }
+        }
+
+        // 并行重编码导出，校验与串行编码的帧数和时间戳一致
+        ChunkedExportStats encodeExport;
+        if (m_options.exportWorkers >= 0) {
+            ChunkedExportOptions exportOptions;
+            exportOptions.workers = m_options.exportWorkers;
+            exportOptions.verify = true;
+            std::string exportPath = (std::filesystem::path(clipPath()).parent_path() / "videoeditor_bench_export.mp4").string();
+            ChunkedExporter exporter;
+            if (!exporter.exportRange(path, 0.0, 0.0, exportPath, exportOptions, encodeExport)) {
+                return 1;
+            }
+        }
+
+        std::vector<CompositeReport> composite;
+        if (m_options.compositeLayers > 0 && !measureComposite(composite)) {
+            return 1;
+        }
+
+        // 片段叠加图层：预览和导出的画面必须逐字节相同
+        LayerParityReport layerParity;
+        if (m_options.compositeLayers > 0 && !measureLayerParity(path, layerParity)) {
+            return 1;
+        }
+
+        std::vector<ColorEffectReport> colorEffects;
+        if (m_options.colorEffects && !measureColorEffects(colorEffects)) {
+            return 1;
+        }
+
+        ProxyReport proxyReport;
+        if (m_options.proxy && !measureProxy(path, targets, proxyReport)) {
+            return 1;
+        }
+
+        WaveformReport waveform;
+        if (m_options.waveform && !measureWaveform(path, waveform)) {
+            return 1;
+        }
+
+        ProbeReport probeReport;
+        if (m_options.probeCache && !measureProbeCache(path, probeReport)) {
+            return 1;
+        }
+
+        SceneReport scenes;
+        if (m_options.scenes && !measureScenes(path, scenes)) {
+            return 1;
+        }
+
+        // 多个线程同时登记解码器，分出去的核心数不能超过预算
+        BudgetReport budgetCheck;
+        measureThreadBudget(budgetCheck);
+
+        std::ostringstream json;
+        json << "{\n";
+        json << "  \"clip\": {\"path\": \"" << escape(path) << "\", \"generated\": " << (m_options.input.empty() ? "true" : "false")
+             << ", \"generate_seconds\": " << generateSeconds
+             << ", \"width\": " << decoder.getWidth() << ", \"height\": " << decoder.getHeight()
+             << ", \"duration\": " << duration << ", \"frames\": " << frameLatencies.size() << "},\n";
+        json << "  \"renderer\": \"" << (m_renderer ? "software" : "none") << "\",\n";
+        json << "  \"preview\": {\"width\": " << m_options.previewWidth << ", \"height\": " << m_options.previewHeight
+             << ", \"scaling\": " << (m_options.previewScaling ? "true" : "false")
+             << ", \"zero_copy\": " << (m_options.zeroCopy && m_renderer ? "true" : "false") << "},\n";
+        json << "  \"threading\": {\"decode_threads\": " << decoder.getDecodeThreadCount()
+             << ", \"thread_type\": \"" << decoder.getDecodeThreadType() << "\""
+             << ", \"requested_threads\": " << m_options.threading.threadCount
+             << ", \"policy\": \"" << policyName(m_options.threading.type) << "\""
+             << ", \"core_budget\": " << ThreadBudget::instance().totalCores()
+             << ", \"autotune\": " << (m_options.threading.autoTune ? "true" : "false")
+             << ", \"autotuned_fps\": " << decoder.getAutoTunedFps()
+             << ",\n    \"budget_check\": {\"leases\": " << budgetCheck.leases << ", \"peak_granted\": " << budgetCheck.peakGranted
+             << ", \"granted\": " << budgetCheck.granted << ", \"after_shrink\": " << budgetCheck.afterShrink
+             << ", \"within_budget\": " << (budgetCheck.withinBudget ? "true" : "false") << "}},\n";
+        json << "  \"decode\": {\"open_ms\": " << openSeconds * 1000
+             << ", \"first_frame_ms\": " << firstFrameSeconds * 1000
+             << ", \"seconds\": " << decodeSeconds
+             << ", \"fps\": " << (decodeSeconds > 0.0 ? frameLatencies.size() / decodeSeconds : 0.0)
+             << ", \"frame_latency_ms\": " << percentiles(frameLatencies)
+             << ", \"bytes_copied_per_frame\": " << decoder.getBytesCopiedPerFrame()
+             << ", \"scaler_rebuilds\": " << decoder.getScalerRebuilds() << "},\n";
+        json << "  \"seek\": {\"index_ready\": " << (decoder.isIndexReady() ? "true" : "false")
+             << ", \"index_wait_ms\": " << indexWaitSeconds * 1000
+             << ", \"seed\": " << m_options.seed
+             << ",\n    \"exact_ms\": " << percentiles(exactLatencies) << ", \"exact_timeouts\": " << exactTimeouts
+             << ",\n    \"keyframe_ms\": " << percentiles(keyframeLatencies) << ", \"keyframe_timeouts\": " << keyframeTimeouts
+             << ",\n    \"keyframe_seeks\": " << decoder.getKeyframeSeeks()
+             << ", \"forward_seeks\": " << decoder.getForwardSeeks() << "},\n";
+        json << "  \"memory\": {\"peak_rss_kb\": " << peakRssKB()
+             << ", \"frame_cache_bytes\": " << decoder.getFrameCache().bytes()
+             << ", \"pool_allocations\": " << decoder.getPoolAllocations()
+             << ", \"pool_requests\": " << decoder.getPoolRequests() << ", \"pool_peak\": " << decoder.getPoolPeak()
+             << ",\n    \"decode_buffer_allocations\": " << decoder.getDecodeBufferAllocations()
+             << ", \"decode_buffer_requests\": " << decoder.getDecodeBufferRequests()
+             << ", \"decode_buffer_peak\": " << decoder.getDecodeBufferPeak()
+             << ",\n    \"packet_allocations\": " << mediaPool.packetAllocations
+             << ", \"packet_requests\": " << mediaPool.packetRequests << ", \"packets_peak\": " << mediaPool.packetsPeak
+             << ", \"frame_allocations\": " << mediaPool.frameAllocations
+             << ", \"frame_requests\": " << mediaPool.frameRequests << ", \"frames_peak\": " << mediaPool.framesPeak
+             << ",\n    \"steady_frames\": " << steadyFrames << ", \"steady_allocations\": " << steadyAllocations
+             << ", \"steady_allocations_per_second\": " << (steadySeconds > 0.0 ? steadyAllocations / steadySeconds : 0.0)
+             << ", \"steady_allocations_per_frame\": " << (steadyFrames ? (double)steadyAllocations / steadyFrames : 0.0) << "},\n";
+        // 整个顺序解码和seek过程的读取统计；stall_ms是解复用线程等待存储的累计时间
+        MediaIOStats io = decoder.getIOStats();
+        json << "  \"io\": {\"mode\": \"" << MediaIO::modeName(decoder.getIOMode()) << "\""
+             << ", \"requested\": \"" << MediaIO::modeName(m_options.ioMode) << "\""
+             << ", \"bytes_read\": " << io.bytesRead << ", \"bytes_fetched\": " << io.bytesFetched
+             << ", \"stall_ms\": " << io.stallSeconds * 1000 << ", \"reads\": " << io.reads
+             << ", \"hit_rate\": " << io.hitRate() << ", \"seeks\": " << io.seeks << "}";
+        if (m_options.audioSeconds > 0.0) {
+            json << ",\n  \"audio\": {\"driver\": \"" << escape(m_options.audioDriver) << "\""
+                 << ", \"sample_rate\": " << audio.sampleRate << ", \"channels\": " << audio.channels
+                 << ", \"device_buffer_samples\": " << audio.bufferSamples
+                 << ", \"seconds\": " << audio.wallSeconds << ", \"audio_seconds\": " << audio.audioSeconds
+                 << ", \"clock_rate\": " << (audio.wallSeconds > 0.0 ? audio.audioSeconds / audio.wallSeconds : 0.0)
+                 << ", \"underruns\": " << audio.underruns
+                 << ",\n    \"presented_frames\": " << audio.drift.size() << ", \"dropped_frames\": " << audio.droppedFrames
+                 << ", \"av_drift_ms\": " << percentiles(audio.drift) << "}";
+        }
+        if (!composite.empty()) {
+            json << ",\n  \"composite\": {\"layers\": " << m_options.compositeLayers << ", \"threads\": " << composite.front().threads
+                 << ", \"runs\": [";
+            for (size_t i = 0; i < composite.size(); i++) {
+                const CompositeReport& run = composite[i];
+                json << (i ? "," : "") << "\n    {\"format\": \"" << run.format << "\", \"width\": " << run.width
+                     << ", \"height\": " << run.height << ", \"kernels\": \"" << run.kernels << "\""
+                     << ", \"frame_ms\": " << run.frameMs
+                     << ", \"layers_per_second\": " << (run.frameMs > 0.0 ? m_options.compositeLayers * 1000.0 / run.frameMs : 0.0)
+                     << ", \"matches_scalar\": " << (run.matchesScalar ? "true" : "false") << "}";
+            }
+            json << "\n  ],\n    \"layer_parity\": {\"frames\": " << layerParity.frames
+                 << ", \"mismatched_frames\": " << layerParity.mismatched
+                 << ", \"preview_matches_export\": " << (layerParity.mismatched ? "false" : "true") << "}}";
+        }
+        if (!colorEffects.empty()) {
+            json << ",\n  \"color_effects\": {\"threads\": " << colorEffects.front().threads << ", \"runs\": [";
+            for (size_t i = 0; i < colorEffects.size(); i++) {
+                const ColorEffectReport& run = colorEffects[i];
+                json << (i ? "," : "") << "\n    {\"effect\": \"" << run.effect << "\", \"width\": " << run.width
+                     << ", \"height\": " << run.height << ", \"kernels\": \"" << run.kernels << "\""
+                     << ", \"frame_ms\": " << run.frameMs << ", \"single_thread_ms\": " << run.singleThreadMs
+                     << ", \"megapixels_per_second\": " << (run.frameMs > 0.0 ? run.width * run.height / (run.frameMs * 1000.0) : 0.0)
+                     << ", \"matches_scalar\": " << (run.matchesScalar ? "true" : "false") << "}";
+            }
+            json << "\n  ]}";
+        }
+        if (m_options.proxy) {
+            json << ",\n  \"proxy\": {\"width\": " << proxyReport.stats.width << ", \"height\": " << proxyReport.stats.height
+                 << ", \"frames\": " << proxyReport.stats.frames << ", \"ms\": " << proxyReport.stats.elapsedSeconds * 1000
+                 << ", \"realtime_factor\": " << (proxyReport.stats.elapsedSeconds > 0.0 ? duration / proxyReport.stats.elapsedSeconds : 0.0)
+                 << ", \"output_bytes\": " << proxyReport.stats.outputBytes
+                 << ",\n    \"exact_seek_ms\": " << percentiles(proxyReport.exactLatencies) << ", \"timeouts\": " << proxyReport.timeouts
+                 << ",\n    \"original_exact_seek_ms\": " << percentiles(exactLatencies) << "}";
+        }
+        if (m_options.waveform) {
+            json << ",\n  \"waveform\": {\"peaks\": " << waveform.peaks << ", \"levels\": " << waveform.levels
+                 << ", \"cold_build_ms\": " << waveform.coldSeconds * 1000 << ", \"warm_open_ms\": " << waveform.warmSeconds * 1000
+                 << ", \"realtime_factor\": " << (waveform.coldSeconds > 0.0 ? duration / waveform.coldSeconds : 0.0)
+                 << ",\n    \"reduce_kernel\": \"" << waveform.kernel << "\""
+                 << ", \"reduce_msamples_per_second\": {\"scalar\": " << waveform.scalarRate << ", \"simd\": " << waveform.simdRate << "}"
+                 << ",\n    \"queries\": [";
+            for (size_t i = 0; i < waveform.queries.size(); i++) {
+                const WaveformQuery& query = waveform.queries[i];
+                json << (i ? ", " : "") << "{\"window_seconds\": " << query.windowSeconds << ", \"level\": " << query.level
+                     << ", \"columns\": " << query.columns << ", \"us\": " << query.microseconds << "}";
+            }
+            json << "]}";
+        }
+        if (m_options.probeCache) {
+            double uncached = median(probeReport.uncached);
+            double cached = median(probeReport.cached);
+            json << ",\n  \"probe_cache\": {\"runs\": " << kProbeRuns << ", \"hit\": " << (probeReport.hit ? "true" : "false")
+                 << ", \"cache_bytes\": " << probeReport.cacheBytes
+                 << ", \"exact_duration\": " << probeReport.duration << ", \"frames\": " << probeReport.frames
+                 << ",\n    \"uncached_first_frame_ms\": " << percentiles(probeReport.uncached)
+                 << ",\n    \"cached_first_frame_ms\": " << percentiles(probeReport.cached)
+                 << ",\n    \"speedup\": " << (cached > 0.0 ? uncached / cached : 0.0) << "}";
+        }
+        if (m_options.scenes) {
+            json << ",\n  \"scenes\": {\"frames\": " << scenes.frames << ", \"markers\": " << scenes.markers
+                 << ", \"expected_cuts\": ";
+            if (scenes.expectedCuts >= 0) {
+                json << scenes.expectedCuts << ", \"matched_cuts\": " << scenes.matchedCuts;
+            } else {
+                json << "null, \"matched_cuts\": null";
+            }
+            json << ",\n    \"thumbnail_kernel\": \"" << scenes.kernel << "\""
+                 << ", \"thumbnails_per_second_1080p\": {\"scalar\": " << scenes.scalarRate << ", \"simd\": " << scenes.simdRate << "}"
+                 << ",\n    \"runs\": [";
+            double serial = scenes.runs.empty() ? 0.0 : scenes.runs.front().seconds;
+            for (size_t i = 0; i < scenes.runs.size(); i++) {
+                const SceneRun& run = scenes.runs[i];
+                double speedup = run.seconds > 0.0 ? serial / run.seconds : 0.0;
+                json << (i ? "," : "") << "\n      {\"workers\": " << run.workers << ", \"segments\": " << run.segments
+                     << ", \"seconds\": " << run.seconds << ", \"fps\": " << run.fps << ", \"speedup\": " << speedup
+                     << ", \"efficiency\": " << (run.workers > 0 ? speedup / run.workers : 0.0) << "}";
+            }
+            json << "\n    ]}";
+        }
+        if (m_options.exportWorkers >= 0) {
+            json << ",\n  \"chunked_export\": {\"workers\": " << encodeExport.workers << ", \"segments\": " << encodeExport.segments
+                 << ", \"frames\": " << encodeExport.frames << ", \"seconds\": " << encodeExport.elapsedSeconds
+                 << ", \"fps\": " << encodeExport.fps << ", \"cpu_seconds\": " << encodeExport.cpuSeconds
+                 << ", \"core_utilization\": " << encodeExport.coreUtilization
+                 << ",\n    \"peak_buffered_bytes\": " << encodeExport.peakBufferedBytes
+                 << ", \"serial_seconds\": " << encodeExport.serialSeconds
+                 << ", \"speedup\": " << (encodeExport.elapsedSeconds > 0.0 ? encodeExport.serialSeconds / encodeExport.elapsedSeconds : 0.0)
+                 << ", \"matches_serial\": " << (encodeExport.verified ? (encodeExport.verifyPassed ? "true" : "false") : "null") << "}";
+        }
+        if (m_options.trimSeconds > 0.0) {
+            double trimDuration = trim.outPoint - trim.inPoint;
+            json << ",\n  \"trim\": {\"path\": \"" << escape(trimPath) << "\", \"mode\": \"" << trim.mode << "\""
+                 << ", \"in\": " << trim.inPoint << ", \"out\": " << trim.outPoint
+                 << ", \"ms\": " << trim.elapsedSeconds * 1000
+                 << ", \"realtime_factor\": " << (trim.elapsedSeconds > 0.0 ? trimDuration / trim.elapsedSeconds : 0.0)
+                 << ",\n    \"gops_copied\": " << trim.gopsCopied << ", \"gops_encoded\": " << trim.gopsEncoded
+                 << ", \"copied_bytes\": " << trim.copiedBytes << ", \"encoded_frames\": " << trim.encodedFrames
+                 << ", \"encoded_seconds\": " << trim.encodedSeconds
+                 << ", \"encoded_ratio\": " << (trimDuration > 0.0 ? trim.encodedSeconds / trimDuration : 0.0)
+                 << ", \"audio_packets\": " << trim.audioPackets << ", \"output_bytes\": " << trim.outputBytes << "}";
+        }
+        json << "\n}\n";
+
+        decoder.cleanup();
+        if (!m_options.trace.empty()) {
+            Profiler::instance().setEnabled(false);
+            Profiler::instance().writeTrace(m_options.trace);
+        }
+
+        if (m_options.output.empty()) {
+            std::cout << json.str();
+        } else {
+            std::ofstream file(m_options.output);
+            if (!file) {
+                std::cerr << "无法写入报告: " << m_options.output << std::endl;
+                return 1;
+            }
+            file << json.str();
+        }
+        if (!budgetCheck.withinBudget) {
+            std::cerr << "线程预算: 分出去的核心数超过了预算或没有全部归还" << std::endl;
+            return 1;
+        }
+        if (layerParity.mismatched) {
+            std::cerr << "图层测试: 预览和导出有 " << layerParity.mismatched << " 帧画面不一致" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    // 进程的内存占用峰值（KB）
+    static uint64_t peakRssKB() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return (uint64_t)counters.PeakWorkingSetSize / 1024;
+        }
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#ifdef __APPLE__
+        return (uint64_t)usage.ru_maxrss / 1024;  // macOS上单位是字节
+#else
+        return (uint64_t)usage.ru_maxrss;
+#endif
+#endif
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr double kIndexTimeout = 30.0;  // 等待关键帧索引的最长时间（秒）
+    static constexpr double kSeekTimeout = 5.0;    // 单次seek超过该时间记为超时
+    static constexpr size_t kCompositeMinFrames = 5;      // 合成计时至少的帧数
+    static constexpr double kCompositeSeconds = 0.5;      // 每种组合至少计时的时间（秒）
+    static constexpr size_t kLayerParityFrames = 24;      // 预览与导出逐帧比较的帧数
+    static constexpr int kLayerParityImageWidth = 640;    // 图层测试用的图像尺寸，按比例放到画面上
+    static constexpr int kLayerParityImageHeight = 360;
+    static constexpr int kGradeLutSize = 33;              // 调色测试用的三维LUT尺寸，与常见的.cube文件相同
+    static constexpr double kWaveformTimeout = 120.0;     // 等待波形生成的最长时间（秒）
+    static constexpr size_t kWaveformMinQueries = 20;     // 每个缩放级别至少查询的次数
+    static constexpr double kWaveformQuerySeconds = 0.2;  // 每项计时至少的时间（秒）
+    static constexpr size_t kWaveformReduceSamples = 1 << 20;
+    static constexpr double kTailMargin = 0.5;     // 随机目标离结尾的最小距离（秒）
+    static constexpr size_t kSteadyWarmupFrames = 60;  // 顺序解码中不计入稳定阶段的前几帧（池在此期间长到稳定大小）
+    static constexpr int kProbeRuns = 5;           // 有/无探测缓存各打开的次数
+    static constexpr double kBenchSceneSeconds = 3.0;    // --scenes生成的测试视频每个镜头的长度
+    static constexpr double kSceneMatchFrames = 1.5;     // 切点离预期位置不超过这么多帧算检测到
+    static constexpr double kSceneKernelSeconds = 0.3;   // 缩略图内核每种实现至少计时的时间（秒）
+
+    static double secondsSince(Clock::time_point begin) {
+        return std::chrono::duration<double>(Clock::now() - begin).count();
+    }
+
+    // 各个池实际向系统申请内存的总次数：数据包/帧结构体、解码输出缓冲区、转换缓冲区
+    static uint64_t pooledAllocations(const VideoDecoder& decoder) {
+        MediaPoolStats pool = MediaPool::instance().stats();
+        return pool.packetAllocations + pool.frameAllocations + decoder.getPoolAllocations() +
+               decoder.getDecodeBufferAllocations();
+    }
+
+    std::string clipPath() const {
+        std::error_code ec;
+        std::filesystem::path dir = m_options.workDir.empty() ? std::filesystem::temp_directory_path(ec)
+                                                              : std::filesystem::path(m_options.workDir);
+        std::filesystem::create_directories(dir, ec);
+        const TestClipSpec& clip = m_options.clip;
+        std::ostringstream name;
+        name << "videoeditor_bench_" << clip.encoder << "_" << clip.width << "x" << clip.height << "_"
+             << clip.fps << "fps_" << (int)clip.seconds << "s_gop" << clip.gopSize << (clip.audio ? "_audio" : "");
+        if (clip.sceneSeconds > 0.0) {
+            name << "_scenes" << clip.sceneSeconds;
+        }
+        name << ".mp4";
+        return (dir / name.str()).string();
+    }
+
+    // SDL dummy视频驱动不需要显示器和GPU，软件渲染器照常创建和更新纹理
+    void createRenderer() {
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            std::cerr << "SDL初始化失败，改为无渲染器运行: " << SDL_GetError() << std::endl;
+            return;
+        }
+        m_sdlStarted = true;
+        m_window = SDL_CreateWindow("VideoEditor-bench", 0, 0, m_options.previewWidth, m_options.previewHeight,
+                                    SDL_WINDOW_HIDDEN);
+        if (m_window) {
+            m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_SOFTWARE);
+        }
+        if (!m_renderer) {
+            std::cerr << "软件渲染器创建失败，改为无渲染器运行: " << SDL_GetError() << std::endl;
+        }
+    }
+
+    struct AudioReport {
+        int sampleRate = 0;
+        int channels = 0;
+        int bufferSamples = 0;
+        double wallSeconds = 0.0;   // 音频时钟开始走动之后的真实时间
+        double audioSeconds = 0.0;  // 同一段时间内音频时钟走过的时间
+        uint64_t underruns = 0;
+        uint64_t droppedFrames = 0;
+        std::vector<double> drift;  // 每次显示新画面时画面pts与音频时钟之差的绝对值（秒）
+    };
+
+    // 以音频时钟为主时钟实时播放：SDL的dummy/disk音频驱动同样按真实时间调用回调，不需要声卡
+    bool measureAudio(const std::string& path, AudioReport& report) {
+        SDL_setenv("SDL_AUDIODRIVER", m_options.audioDriver.c_str(), 1);
+        if (m_options.audioDriver == "disk") {
+            std::filesystem::path raw = std::filesystem::path(clipPath()).parent_path() / "videoeditor_bench_audio.raw";
+            SDL_setenv("SDL_DISKAUDIOFILE", raw.string().c_str(), 1);
+        }
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+            std::cerr << "SDL音频初始化失败: " << SDL_GetError() << std::endl;
+            return false;
+        }
+        m_sdlStarted = true;
+
+        VideoDecoder decoder;
+        decoder.setThreading(m_options.threading);
+        decoder.setPreviewScaling(m_options.previewScaling);
+        decoder.setZeroCopyUpload(m_options.zeroCopy && m_renderer);
+        decoder.setOutputSize(m_options.previewWidth, m_options.previewHeight);
+        decoder.setAudioEnabled(true);
+        if (!decoder.openFile(path, m_renderer)) {
+            return false;
+        }
+        if (!decoder.hasAudio()) {
+            std::cerr << "音频测试: 文件中没有可播放的音频流: " << path << std::endl;
+            return false;
+        }
+
+        auto begin = Clock::now();
+        while (decoder.needsRefresh() && secondsSince(begin) < kSeekTimeout) {
+            if (!decoder.readFrame()) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        decoder.setAudioPlaying(true);
+        bool started = false;
+        Clock::time_point audioBegin;
+        double firstAudioTime = 0.0;
+        double audioTime = 0.0;
+        while (secondsSince(begin) < m_options.audioSeconds + kSeekTimeout) {
+            double now = 0.0;
+            if (!decoder.getAudioClock(now)) {
+                if (decoder.getAudioPlayer().finished()) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            audioTime = now;
+            if (!started) {
+                started = true;
+                audioBegin = Clock::now();
+                firstAudioTime = audioTime;
+            } else if (secondsSince(audioBegin) >= m_options.audioSeconds) {
+                break;
+            }
+
+            double delay = 0.0;
+            VideoDecoder::FrameStatus status = decoder.presentFrame(audioTime, delay);
+            if (status == VideoDecoder::FrameStatus::EndOfStream) {
+                break;
+            }
+            if (status == VideoDecoder::FrameStatus::Presented) {
+                report.drift.push_back(std::abs(decoder.getCurrentTime() - audioTime));
+            }
+            std::this_thread::sleep_for(std::chrono::duration<double>(std::min(delay, 0.005)));
+        }
+        decoder.setAudioPlaying(false);
+
+        const AudioPlayer& audio = decoder.getAudioPlayer();
+        report.sampleRate = audio.sampleRate();
+        report.channels = audio.channels();
+        report.bufferSamples = audio.deviceBufferSamples();
+        report.wallSeconds = started ? secondsSince(audioBegin) : 0.0;
+        report.audioSeconds = audioTime - firstAudioTime;
+        report.underruns = decoder.getAudioUnderruns();
+        report.droppedFrames = decoder.getDroppedFrames();
+        decoder.cleanup();
+        return true;
+    }
+
+    struct BudgetReport {
+        int leases = 0;
+        int peakGranted = 0;  // 并发登记期间每次登记后看到的已分出核心数的最大值
+        int granted = 0;      // 全部登记之后
+        int afterShrink = 0;  // 每个凭证都缩到1个线程之后
+        bool withinBudget = true;
+    };
+
+    // 比核心数多的线程同时以不同用途登记，部分限制最多领取的线程数；
+    // 已分出的核心数任何时候都不超过预算，缩减后不增加，全部归还后回到登记之前的值
+    static void measureThreadBudget(BudgetReport& report) {
+        static const DecoderRole kRoles[] = { DecoderRole::Preview, DecoderRole::Thumbnail, DecoderRole::Export };
+        ThreadBudget& budget = ThreadBudget::instance();
+        int cores = budget.totalCores();
+        int before = budget.grantedCores();
+        report.leases = cores * 2 + 3;
+        std::vector<ThreadBudget::Lease> leases(report.leases);
+        std::vector<int> observed(report.leases, 0);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < report.leases; i++) {
+            threads.emplace_back([&, i]() {
+                leases[i] = budget.acquire(kRoles[i % 3], i % 4 == 3 ? 2 : 0);
+                observed[i] = budget.grantedCores();
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        report.peakGranted = *std::max_element(observed.begin(), observed.end());
+        report.granted = budget.grantedCores();
+        for (ThreadBudget::Lease& lease : leases) {
+            lease.shrink(1);
+        }
+        report.afterShrink = budget.grantedCores();
+        leases.clear();
+        report.withinBudget = report.peakGranted <= cores && report.granted <= cores &&
+                              report.afterShrink <= report.granted && budget.grantedCores() == before;
+    }
+
+    struct CompositeReport {
+        const char* format;
+        int width;
+        int height;
+        const char* kernels;
+        int threads;
+        double frameMs;      // 每帧合成全部图层的耗时中位数
+        bool matchesScalar;  // 与标量内核的结果逐字节相同
+    };
+
+    // 1080p和4K、YUV420P和RGBA，每种可用内核合成compositeLayers个全尺寸图层
+    // 图层依次错开位置、轮换混合模式，覆盖裁剪和所有模式
+    bool measureComposite(std::vector<CompositeReport>& reports) {
+        static const int kSizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+        static const AVPixelFormat kFormats[] = { AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGBA };
+        Compositor compositor;
+        for (const auto& size : kSizes) {
+            for (AVPixelFormat format : kFormats) {
+                FramePtr base = makePattern(format, size[0], size[1], 0);
+                std::vector<FramePtr> images;
+                std::vector<CompositeLayer> layers;
+                for (int i = 0; i < m_options.compositeLayers; i++) {
+                    images.push_back(makePattern(format, size[0], size[1], i + 1));
+                    if (!images.back()) {
+                        return false;
+                    }
+                    CompositeLayer layer;
+                    layer.frame = images.back().get();
+                    layer.transform.x = i * 32;
+                    layer.transform.y = i * 16;
+                    layer.opacity = 0.75f;
+                    layer.mode = (BlendMode)(i % 4);
+                    layers.push_back(layer);
+                }
+                if (!base) {
+                    return false;
+                }
+                FramePtr canvas = makeFrame();
+                FramePtr reference = makeFrame();
+                if (!canvas || !reference || av_frame_ref(canvas.get(), base.get()) < 0 ||
+                    av_frame_ref(reference.get(), base.get()) < 0 || av_frame_make_writable(reference.get()) < 0) {
+                    return false;
+                }
+                compositor.setKernels(BlendKernels::scalar());
+                compositor.composite(reference.get(), layers);
+
+                for (const BlendKernels* kernels : BlendKernels::available()) {
+                    compositor.setKernels(*kernels);
+                    if (av_frame_make_writable(canvas.get()) < 0 || av_frame_copy(canvas.get(), base.get()) < 0) {
+                        return false;
+                    }
+                    compositor.composite(canvas.get(), layers);
+                    bool matches = framesEqual(canvas.get(), reference.get());
+
+                    // 在同一块画布上反复合成，只计时间
+                    std::vector<double> times;
+                    auto begin = Clock::now();
+                    while (times.size() < kCompositeMinFrames || secondsSince(begin) < kCompositeSeconds) {
+                        compositor.composite(canvas.get(), layers);
+                        times.push_back(compositor.lastMilliseconds());
+                    }
+                    std::sort(times.begin(), times.end());
+                    reports.push_back({ av_get_pix_fmt_name(format), size[0], size[1], kernels->name, compositor.threads(),
+                                        times[times.size() / 2], matches });
+                }
+            }
+        }
+        return true;
+    }
+
+    struct LayerParityReport {
+        size_t frames = 0;       // 比较的帧数
+        size_t mismatched = 0;   // 预览和导出不是逐字节相同的帧数（含帧数不一致时缺少的帧）
+    };
+
+    // 同一组叠加图层分别走预览解码（全尺寸、不缩放）和分段导出（rawvideo无损编码），逐帧比较两边的像素
+    bool measureLayerParity(const std::string& path, LayerParityReport& report) {
+        LayerList layers;
+        for (int i = 0; i < m_options.compositeLayers; i++) {
+            auto image = std::make_shared<LayerImage>();
+            image->name = "pattern" + std::to_string(i + 1);
+            image->frame = makePattern(AV_PIX_FMT_RGBA, kLayerParityImageWidth, kLayerParityImageHeight, i + 1);
+            if (!image->frame) {
+                return false;
+            }
+            OverlayLayer layer;
+            layer.image = image;
+            layer.x = 0.05f * i;
+            layer.y = 0.03f * i;
+            layer.width = 0.5f;
+            layer.height = 0.5f;
+            layer.opacity = 0.75f;
+            layer.mode = (BlendMode)(i % 4);
+            layers.push_back(layer);
+        }
+
+        // 多解一帧，导出的出点取最后两帧的中点
+        std::vector<FramePtr> preview;
+        std::vector<double> times;
+        if (!decodeFrames(path, layers, kLayerParityFrames + 1, preview, times)) {
+            return false;
+        }
+        if (preview.size() < 2) {
+            std::cerr << "图层测试: 视频太短" << std::endl;
+            return false;
+        }
+        double outPoint = (times[times.size() - 2] + times.back()) / 2;
+        preview.pop_back();
+
+        ChunkedExportOptions options;
+        options.encoder = "rawvideo";
+        options.layers = layers;
+        std::string exportPath = (std::filesystem::path(clipPath()).parent_path() / "videoeditor_bench_layers.nut").string();
+        ChunkedExportStats stats;
+        ChunkedExporter exporter;
+        if (!exporter.exportRange(path, 0.0, outPoint, exportPath, options, stats)) {
+            return false;
+        }
+
+        std::vector<FramePtr> exported;
+        if (!decodeFrames(exportPath, LayerList(), preview.size() + 1, exported, times)) {
+            return false;
+        }
+        report.frames = std::max(preview.size(), exported.size());
+        for (size_t i = 0; i < report.frames; i++) {
+            const AVFrame* a = i < preview.size() ? preview[i].get() : nullptr;
+            const AVFrame* b = i < exported.size() ? exported[i].get() : nullptr;
+            if (!a || !b || a->format != b->format || a->width != b->width || a->height != b->height || !framesEqual(a, b)) {
+                report.mismatched++;
+            }
+        }
+        return true;
+    }
+
+    // 用预览解码器按顺序取最多count帧（源尺寸、不缩放），各复制一份，times为各帧的显示时间
+    bool decodeFrames(const std::string& path, const LayerList& layers, size_t count, std::vector<FramePtr>& frames,
+                      std::vector<double>& times) {
+        frames.clear();
+        times.clear();
+        VideoDecoder decoder;
+        decoder.setPreviewScaling(false);
+        decoder.setZeroCopyUpload(false);
+        decoder.setLayers(layers);
+        if (!decoder.openFile(path, nullptr)) {
+            return false;
+        }
+        while (frames.size() < count && decoder.nextFrame() == VideoDecoder::FrameStatus::Presented) {
+            const AVFrame* shown = decoder.getDisplayedFrame();
+            FramePtr copy = makeFrame();
+            if (!shown || !copy) {
+                decoder.cleanup();
+                return false;
+            }
+            copy->format = shown->format;
+            copy->width = shown->width;
+            copy->height = shown->height;
+            if (av_frame_get_buffer(copy.get(), 0) < 0 || av_frame_copy(copy.get(), shown) < 0) {
+                decoder.cleanup();
+                return false;
+            }
+            frames.push_back(std::move(copy));
+            times.push_back(decoder.getCurrentTime());
+        }
+        decoder.cleanup();
+        return true;
+    }
+
+    struct ColorEffectReport {
+        const char* effect;
+        int width;
+        int height;
+        const char* kernels;
+        int threads;
+        double frameMs;         // 线程池上每帧耗时的中位数
+        double singleThreadMs;  // 单线程每帧耗时的中位数
+        bool matchesScalar;     // 与标量内核的结果逐字节相同
+    };
+
+    // 1080p和4K的YUV420P，每个效果单独、以及三个效果串起来，每种可用内核在线程池和单线程上各计时一遍
+    bool measureColorEffects(std::vector<ColorEffectReport>& reports) {
+        static const int kSizes[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+        std::shared_ptr<const CubeLut> lut = makeGradeLut();
+        const std::pair<const char*, ColorChain> kChains[] = {
+            { "adjust", { ColorEffect::adjust(0.05f, 1.15f, 1.25f) } },
+            { "gamma", { ColorEffect::gammaCurve(1.4f) } },
+            { "lut3d", { ColorEffect::lut3d(lut) } },
+            { "chain", { ColorEffect::adjust(0.05f, 1.15f, 1.25f), ColorEffect::lut3d(lut), ColorEffect::gammaCurve(1.4f) } },
+        };
+        ColorEffectStack parallel;
+        ColorEffectStack single(1);
+        for (const auto& size : kSizes) {
+            bool bt709 = ColorEffectStack::sourceIsBt709(AVCOL_SPC_UNSPECIFIED, size[1]);
+            FramePtr base = makePattern(AV_PIX_FMT_YUV420P, size[0], size[1], 0);
+            FramePtr frame = makeFrame();
+            FramePtr reference = makeFrame();
+            if (!base || !frame || !reference || av_frame_ref(frame.get(), base.get()) < 0 ||
+                av_frame_ref(reference.get(), base.get()) < 0) {
+                return false;
+            }
+            for (const auto& chain : kChains) {
+                parallel.setChain(chain.second);
+                single.setChain(chain.second);
+                single.setKernels(ColorKernels::scalar());
+                if (av_frame_make_writable(reference.get()) < 0 || av_frame_copy(reference.get(), base.get()) < 0) {
+                    return false;
+                }
+                single.apply(reference.get(), bt709);
+
+                for (const ColorKernels* kernels : ColorKernels::available()) {
+                    parallel.setKernels(*kernels);
+                    single.setKernels(*kernels);
+                    if (av_frame_make_writable(frame.get()) < 0 || av_frame_copy(frame.get(), base.get()) < 0) {
+                        return false;
+                    }
+                    parallel.apply(frame.get(), bt709);
+                    bool matches = framesEqual(frame.get(), reference.get());
+
+                    // 在同一帧上反复执行，只计时间
+                    double times[2];
+                    ColorEffectStack* stacks[2] = { &parallel, &single };
+                    for (int s = 0; s < 2; s++) {
+                        std::vector<double> samples;
+                        auto begin = Clock::now();
+                        while (samples.size() < kCompositeMinFrames || secondsSince(begin) < kCompositeSeconds) {
+                            stacks[s]->apply(frame.get(), bt709);
+                            samples.push_back(stacks[s]->lastMilliseconds());
+                        }
+                        std::sort(samples.begin(), samples.end());
+                        times[s] = samples[samples.size() / 2];
+                    }
+                    reports.push_back({ chain.first, size[0], size[1], kernels->name, parallel.threads(),
+                                        times[0], times[1], matches });
+                }
+            }
+        }
+        return true;
+    }
+
+    // 偏暖的高光、偏青的阴影、略微压低的饱和度，各通道都不是线性的，插值的每一项都会用到
+    static std::shared_ptr<const CubeLut> makeGradeLut() {
+        auto lut = std::make_shared<CubeLut>();
+        lut->title = "bench grade";
+        lut->size = kGradeLutSize;
+        for (int b = 0; b < kGradeLutSize; b++) {
+            for (int g = 0; g < kGradeLutSize; g++) {
+                for (int r = 0; r < kGradeLutSize; r++) {
+                    float rgb[3] = { r / (kGradeLutSize - 1.0f), g / (kGradeLutSize - 1.0f), b / (kGradeLutSize - 1.0f) };
+                    float luma = 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+                    float warm = luma * luma;
+                    float cool = (1.0f - luma) * (1.0f - luma);
+                    const float tint[3] = { 0.08f * warm - 0.04f * cool, 0.01f * warm + 0.02f * cool, -0.06f * warm + 0.06f * cool };
+                    for (int c = 0; c < 3; c++) {
+                        float value = luma + (rgb[c] - luma) * 0.85f + tint[c];
+                        lut->rgb.push_back(std::clamp(value * value * (3.0f - 2.0f * value) * 0.3f + value * 0.7f, 0.0f, 1.0f));
+                    }
+                }
+            }
+        }
+        return lut;
+    }
+
+    struct ProxyReport {
+        ProxyStats stats;
+        std::vector<double> exactLatencies;  // 在代理上重复同一组随机精确seek
+        int timeouts = 0;
+    };
+
+    // 生成代理后用同样设置的解码器打开它，和原文件比较精确seek的延迟
+    bool measureProxy(const std::string& path, const std::vector<double>& targets, ProxyReport& report) {
+        std::string proxyPath = (std::filesystem::path(clipPath()).parent_path() / "videoeditor_bench_proxy.mov").string();
+        ProxyGenerator generator;
+        if (!generator.generate(path, proxyPath, report.stats)) {
+            return false;
+        }
+
+        VideoDecoder decoder;
+        decoder.setThreading(m_options.threading);
+        decoder.setPreviewScaling(m_options.previewScaling);
+        decoder.setZeroCopyUpload(m_options.zeroCopy && m_renderer);
+        decoder.setFrameCacheSize(m_options.frameCacheBytes);
+        decoder.setOutputSize(m_options.previewWidth, m_options.previewHeight);
+        if (!decoder.openFile(proxyPath, m_renderer)) {
+            return false;
+        }
+        auto indexBegin = Clock::now();
+        while (!decoder.isIndexReady() && secondsSince(indexBegin) < kIndexTimeout) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        report.exactLatencies = measureSeeks(decoder, targets, VideoDecoder::SeekMode::Exact, report.timeouts);
+        decoder.cleanup();
+        return true;
+    }
+
+    struct ProbeReport {
+        std::vector<double> uncached;  // 从开始打开到第一帧显示的时间（秒）
+        std::vector<double> cached;
+        bool hit = false;              // 有缓存的打开确实跳过了探测
+        uint64_t cacheBytes = 0;
+        double duration = 0.0;         // 缓存里的精确时长
+        size_t frames = 0;
+    };
+
+    // 探测缓存：删除缓存后打开kProbeRuns次；打开一次并等关键帧索引建好（此时写入缓存）；再打开kProbeRuns次
+    bool measureProbeCache(const std::string& path, ProbeReport& report) {
+        probe::remove(path);
+        for (int i = 0; i < kProbeRuns; i++) {
+            VideoDecoder decoder;
+            double seconds = 0.0;
+            if (!timeFirstFrame(path, false, decoder, seconds)) {
+                return false;
+            }
+            report.uncached.push_back(seconds);
+        }
+
+        {
+            VideoDecoder decoder;
+            double seconds = 0.0;
+            if (!timeFirstFrame(path, true, decoder, seconds)) {
+                return false;
+            }
+            auto indexBegin = Clock::now();
+            while (!decoder.isIndexReady() && secondsSince(indexBegin) < kIndexTimeout) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        sidecar::MediaKey key;
+        std::error_code ec;
+        if (sidecar::mediaKey(path, key)) {
+            report.cacheBytes = (uint64_t)std::filesystem::file_size(probe::pathFor(key), ec);
+        }
+
+        report.hit = true;
+        for (int i = 0; i < kProbeRuns; i++) {
+            VideoDecoder decoder;
+            double seconds = 0.0;
+            if (!timeFirstFrame(path, true, decoder, seconds)) {
+                return false;
+            }
+            report.cached.push_back(seconds);
+            report.hit = report.hit && decoder.isProbeCached() && decoder.isIndexReady();
+            report.duration = decoder.getDuration();
+            report.frames = decoder.getKeyframeIndex().frameCount();
+        }
+        return true;
+    }
+
+    // 与主测试同样设置的解码器从开始打开到第一帧交付的时间
+    bool timeFirstFrame(const std::string& path, bool probeCache, VideoDecoder& decoder, double& seconds) {
+        decoder.setThreading(m_options.threading);
+        decoder.setPreviewScaling(m_options.previewScaling);
+        decoder.setZeroCopyUpload(m_options.zeroCopy && m_renderer);
+        decoder.setOutputSize(m_options.previewWidth, m_options.previewHeight);
+        decoder.setIOMode(m_options.ioMode);
+        decoder.setProbeCache(probeCache);
+        auto begin = Clock::now();
+        if (!decoder.openFile(path, m_renderer) || decoder.nextFrame() != VideoDecoder::FrameStatus::Presented) {
+            return false;
+        }
+        seconds = secondsSince(begin);
+        return true;
+    }
+
+    static double median(std::vector<double> values) {
+        if (values.empty()) {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        return values[values.size() / 2];
+    }
+
+    struct WaveformQuery {
+        double windowSeconds;
+        int level;
+        int columns;
+        double microseconds;  // 一次columns()查询的耗时中位数
+    };
+
+    struct WaveformReport {
+        int64_t peaks = 0;
+        int levels = 0;
+        double coldSeconds = 0.0;  // 删除旁路缓存后从头生成
+        double warmSeconds = 0.0;  // 再次打开，直接映射缓存
+        const char* kernel = "scalar";
+        double scalarRate = 0.0;   // 最小/最大值归约的吞吐（百万样本/秒）
+        double simdRate = 0.0;
+        std::vector<WaveformQuery> queries;
+    };
+
+    // 波形：冷生成（删除旁路缓存）、热打开、从整段到十分之一秒的各缩放级别按预览宽度查询
+    bool measureWaveform(const std::string& path, WaveformReport& report) {
+        sidecar::MediaKey key;
+        if (sidecar::mediaKey(path, key)) {
+            std::error_code ec;
+            std::filesystem::remove(sidecar::cachePath(key, ".peaks"), ec);
+        }
+
+        WaveformTrack track;
+        auto begin = Clock::now();
+        track.open(path);
+        while (!track.finished() && secondsSince(begin) < kWaveformTimeout) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        report.coldSeconds = secondsSince(begin);
+        if (!track.complete()) {
+            std::cerr << "基准测试: 波形生成失败（文件没有音轨？）" << std::endl;
+            return false;
+        }
+        track.close();
+
+        begin = Clock::now();
+        track.open(path);
+        report.warmSeconds = secondsSince(begin);
+        report.peaks = track.peakCount();
+        report.levels = track.levelCount();
+
+        double rate = track.sampleRate();
+        double duration = rate > 0.0 ? (double)report.peaks * WaveformTrack::kSamplesPerPeak / rate : 0.0;
+        std::vector<WaveformPeak> columns;
+        for (double window : { duration, 10.0, 1.0, 0.1 }) {
+            window = std::min(window, duration);
+            std::vector<double> times;
+            auto queryBegin = Clock::now();
+            while (times.size() < kWaveformMinQueries || secondsSince(queryBegin) < kWaveformQuerySeconds) {
+                auto start = Clock::now();
+                track.columns(0.0, window, m_options.previewWidth, columns);
+                times.push_back(secondsSince(start) * 1e6);
+            }
+            std::sort(times.begin(), times.end());
+            int level = track.levelFor(window * rate / m_options.previewWidth);
+            report.queries.push_back({ window, level, m_options.previewWidth, times[times.size() / 2] });
+        }
+
+        // 归约内核的吞吐，同一份随机样本分别用标量和SIMD实现
+        std::vector<int16_t> samples(kWaveformReduceSamples);
+        std::mt19937 random(m_options.seed);
+        for (int16_t& sample : samples) {
+            sample = (int16_t)random();
+        }
+        peaks::MinMaxFunction best = peaks::bestMinMax(&report.kernel);
+        report.scalarRate = reduceRate(&peaks::minMaxScalar, samples);
+        report.simdRate = reduceRate(best, samples);
+        return true;
+    }
+
+    struct SceneRun {
+        int workers;
+        size_t segments;
+        double seconds;
+        double fps;
+    };
+
+    struct SceneReport {
+        int64_t frames = 0;
+        size_t markers = 0;
+        int expectedCuts = -1;  // 只有生成的测试视频知道切点在哪里
+        int matchedCuts = 0;
+        const char* kernel = "scalar";
+        double scalarRate = 0.0;  // 1080p亮度缩略图（含直方图）每秒帧数
+        double simdRate = 0.0;
+        std::vector<SceneRun> runs;
+    };
+
+    // 镜头切换分析：工作线程数从1翻倍到核心预算，各跑一遍（不读写缓存）；用最后一遍的切点与测试视频的镜头边界对照
+    bool measureScenes(const std::string& path, SceneReport& report) {
+        int cores = ThreadBudget::instance().totalCores();
+        std::vector<int> counts;
+        for (int workers = 1; workers < cores; workers *= 2) {
+            counts.push_back(workers);
+        }
+        counts.push_back(std::max(1, cores));
+
+        SceneDetector detector;
+        for (int workers : counts) {
+            SceneOptions options;
+            options.workers = workers;
+            detector.setOptions(options);
+            SceneStats stats;
+            if (!detector.analyze(path, stats)) {
+                std::cerr << "基准测试: 镜头切换分析失败" << std::endl;
+                return false;
+            }
+            report.runs.push_back({ stats.workers, stats.segments, stats.seconds,
+                                    stats.seconds > 0.0 ? stats.frames / stats.seconds : 0.0 });
+            report.frames = stats.frames;
+            report.markers = stats.markers;
+        }
+
+        const TestClipSpec& clip = m_options.clip;
+        if (m_options.input.empty() && clip.sceneSeconds > 0.0) {
+            const std::vector<double>& markers = detector.markers();
+            report.expectedCuts = 0;
+            for (double cut = clip.sceneSeconds; cut < clip.seconds - 0.5 / clip.fps; cut += clip.sceneSeconds) {
+                report.expectedCuts++;
+                bool found = std::any_of(markers.begin(), markers.end(), [&](double marker) {
+                    return std::abs(marker - cut) <= kSceneMatchFrames / clip.fps;
+                });
+                report.matchedCuts += found ? 1 : 0;
+            }
+        }
+
+        // 缩略图内核的吞吐，同一帧1080p亮度分别用标量和最快的实现
+        FramePtr frame = makePattern(AV_PIX_FMT_YUV420P, 1920, 1080, 1);
+        if (!frame) {
+            return false;
+        }
+        report.kernel = SceneKernels::best().name;
+        report.scalarRate = thumbnailRate(SceneKernels::scalar(), frame.get());
+        report.simdRate = thumbnailRate(SceneKernels::best(), frame.get());
+        return true;
+    }
+
+    static double thumbnailRate(const SceneKernels& kernels, const AVFrame* frame) {
+        scene::Thumbnail thumbnail;
+        std::vector<uint16_t> sums;
+        int frames = 0;
+        auto begin = Clock::now();
+        while (frames < 10 || secondsSince(begin) < kSceneKernelSeconds) {
+            scene::makeThumbnail(kernels, frame->data[0], frame->linesize[0], frame->width, frame->height, thumbnail, sums);
+            frames++;
+        }
+        double seconds = secondsSince(begin);
+        return seconds > 0.0 && !thumbnail.pixels.empty() ? frames / seconds : 0.0;
+    }
+
+    // 按生成时的粒度（每项kSamplesPerPeak个立体声样本）归约，返回百万样本/秒
+    static double reduceRate(peaks::MinMaxFunction minMax, const std::vector<int16_t>& samples) {
+        const size_t chunk = WaveformTrack::kSamplesPerPeak * 2;
+        size_t processed = 0;
+        int16_t low = INT16_MAX;
+        int16_t high = INT16_MIN;
+        auto begin = Clock::now();
+        while (processed < samples.size() * 4 || secondsSince(begin) < kWaveformQuerySeconds) {
+            for (size_t i = 0; i < samples.size(); i += chunk) {
+                minMax(samples.data() + i, std::min(chunk, samples.size() - i), low, high);
+            }
+            processed += samples.size();
+        }
+        double seconds = secondsSince(begin);
+        // 使用结果，避免整个循环被优化掉
+        return seconds > 0.0 && low <= high ? processed / seconds / 1e6 : 0.0;
+    }
+
+    // 每个种子不同的渐变图案，RGBA的alpha也是渐变
+    static FramePtr makePattern(AVPixelFormat format, int width, int height, int seed) {
+        FramePtr frame = makeFrame();
+        if (!frame) {
+            return nullptr;
+        }
+        frame->format = format;
+        frame->width = width;
+        frame->height = height;
+        if (av_frame_get_buffer(frame.get(), 0) < 0) {
+            return nullptr;
+        }
+        int planes = format == AV_PIX_FMT_RGBA ? 1 : 3;
+        for (int plane = 0; plane < planes; plane++) {
+            int planeWidth = format == AV_PIX_FMT_RGBA ? width * 4 : (plane ? (width + 1) / 2 : width);
+            int planeHeight = plane ? (height + 1) / 2 : height;
+            for (int y = 0; y < planeHeight; y++) {
+                uint8_t* row = frame->data[plane] + (size_t)y * frame->linesize[plane];
+                for (int x = 0; x < planeWidth; x++) {
+                    row[x] = (uint8_t)(x * (seed + 1) + y * (plane + 2) + seed * 37);
+                }
+            }
+        }
+        return frame;
+    }
+
+    static bool framesEqual(const AVFrame* a, const AVFrame* b) {
+        int planes = a->format == AV_PIX_FMT_RGBA ? 1 : 3;
+        for (int plane = 0; plane < planes; plane++) {
+            int bytes = a->format == AV_PIX_FMT_RGBA ? a->width * 4 : (plane ? (a->width + 1) / 2 : a->width);
+            int rows = plane ? (a->height + 1) / 2 : a->height;
+            for (int y = 0; y < rows; y++) {
+                if (std::memcmp(a->data[plane] + (size_t)y * a->linesize[plane],
+                                b->data[plane] + (size_t)y * b->linesize[plane], bytes) != 0) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // 逐个发出seek，测量从请求到画面刷新完成的时间
+    std::vector<double> measureSeeks(VideoDecoder& decoder, const std::vector<double>& targets,
+                                     VideoDecoder::SeekMode mode, int& timeouts) {
+        std::vector<double> latencies;
+        for (double target : targets) {
+            auto begin = Clock::now();
+            if (!decoder.seekToTime(target, mode)) {
+                continue;
+            }
+            while (decoder.needsRefresh() && secondsSince(begin) < kSeekTimeout) {
+                if (!decoder.readFrame()) {
+                    break;
+                }
+                if (decoder.needsRefresh()) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            }
+            if (decoder.needsRefresh()) {
+                timeouts++;
+                continue;
+            }
+            latencies.push_back(secondsSince(begin));
+        }
+        return latencies;
+    }
+
+    // {"count", "mean", "p50", "p90", "p99", "max"}，单位毫秒
+    static std::string percentiles(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        auto at = [&values](double fraction) {
+            if (values.empty()) {
+                return 0.0;
+            }
+            size_t index = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+            return values[index] * 1000;
+        };
+        double mean = 0.0;
+        for (double value : values) {
+            mean += value;
+        }
+        mean = values.empty() ? 0.0 : mean / values.size() * 1000;
+
+        std::ostringstream out;
+        out << "{\"count\": " << values.size() << ", \"mean\": " << mean << ", \"p50\": " << at(0.5)
+            << ", \"p90\": " << at(0.9) << ", \"p99\": " << at(0.99)
+            << ", \"max\": " << (values.empty() ? 0.0 : values.back() * 1000) << "}";
+        return out.str();
+    }
+
+    static const char* policyName(ThreadTypePolicy policy) {
+        switch (policy) {
+            case ThreadTypePolicy::Frame:
+                return "frame";
+            case ThreadTypePolicy::Slice:
+                return "slice";
+            case ThreadTypePolicy::Auto:
+            default:
+                return "auto";
+        }
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string out;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    BenchmarkOptions m_options;
+    SDL_Window* m_window;
+    SDL_Renderer* m_renderer;
+    bool m_sdlStarted;
+};
+
+// 解析参数并运行基准测试，返回进程退出码
+inline int runBenchmark(int argc, char* argv[], int first) {
+    BenchmarkOptions options;
+    if (!Benchmark::parseArgs(argc, argv, first, options)) {
+        return 2;
+    }
+    Benchmark benchmark(options);
+    return benchmark.run();
+}
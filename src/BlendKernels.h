@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BLEND_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define BLEND_TARGET_SSE2
+#define BLEND_TARGET_AVX2
+#else
+#define BLEND_TARGET_SSE2 __attribute__((target("sse2")))
+#define BLEND_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+enum class BlendMode {
+    Normal,
+    Add,
+    Multiply,
+    Screen
+};
+
+inline const char* blendModeName(BlendMode mode) {
+    switch (mode) {
+        case BlendMode::Normal: return "normal";
+        case BlendMode::Add: return "add";
+        case BlendMode::Multiply: return "multiply";
+        case BlendMode::Screen: return "screen";
+    }
+    return "normal";
+}
+
+// 8位通道的混合内核，原地写入dst
+// 全部用整数运算，标量和SIMD版本逐字节结果相同，预览和导出无论在哪台机器上跑出的画面都一致
+// - 不透明度opacity取0..256（256为完全不透明）
+// - 先按模式算出目标值t，再按 (d * (256 - a) + t * a + 128) >> 8 与原值混合，16位无符号运算不会溢出
+// - 乘法的 x / 255 用 (x + 128 + ((x + 128) >> 8)) >> 8，在0..255*255范围内与四舍五入相同
+namespace blend {
+
+inline int mul255(int a, int b) {
+    int x = a * b + 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+inline int target(BlendMode mode, int d, int s) {
+    switch (mode) {
+        case BlendMode::Normal: return s;
+        case BlendMode::Add: return std::min(255, d + s);
+        case BlendMode::Multiply: return mul255(d, s);
+        case BlendMode::Screen: return 255 - mul255(255 - d, 255 - s);
+    }
+    return s;
+}
+
+inline uint8_t mix(int d, int t, int a) {
+    return (uint8_t)((d * (256 - a) + t * a + 128) >> 8);
+}
+
+// 每像素alpha乘以图层不透明度，再从0..255映射到0..256
+inline int pixelAlpha(int alpha, int opacity) {
+    int a = (alpha * opacity + 128) >> 8;
+    return a + (a >> 7);
+}
+
+// 按字节混合（YUV平面或不带alpha的数据）
+inline void rowScalar(BlendMode mode, uint8_t* dst, const uint8_t* src, int count, int opacity) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = mix(dst[i], target(mode, dst[i], src[i]), opacity);
+    }
+}
+
+// RGBA：颜色按模式混合，alpha按"over"合成
+inline void rowRgbaScalar(BlendMode mode, uint8_t* dst, const uint8_t* src, int pixels, int opacity) {
+    for (int i = 0; i < pixels; i++, dst += 4, src += 4) {
+        int a = pixelAlpha(src[3], opacity);
+        for (int c = 0; c < 3; c++) {
+            dst[c] = mix(dst[c], target(mode, dst[c], src[c]), a);
+        }
+        dst[3] = mix(dst[3], 255, a);
+    }
+}
+
+#ifdef BLEND_X86
+
+BLEND_TARGET_SSE2 inline __m128i mul255Sse2(__m128i a, __m128i b) {
+    __m128i x = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// 16位通道上的目标值
+BLEND_TARGET_SSE2 inline __m128i targetSse2(BlendMode mode, __m128i d, __m128i s) {
+    const __m128i max = _mm_set1_epi16(255);
+    switch (mode) {
+        case BlendMode::Normal: return s;
+        case BlendMode::Add: return _mm_min_epi16(_mm_add_epi16(d, s), max);
+        case BlendMode::Multiply: return mul255Sse2(d, s);
+        case BlendMode::Screen: return _mm_sub_epi16(max, mul255Sse2(_mm_sub_epi16(max, d), _mm_sub_epi16(max, s)));
+    }
+    return s;
+}
+
+BLEND_TARGET_SSE2 inline __m128i mixSse2(__m128i d, __m128i t, __m128i a) {
+    __m128i inv = _mm_sub_epi16(_mm_set1_epi16(256), a);
+    __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(d, inv), _mm_mullo_epi16(t, a)), _mm_set1_epi16(128));
+    return _mm_srli_epi16(sum, 8);
+}
+
+BLEND_TARGET_SSE2 inline void rowSse2(BlendMode mode, uint8_t* dst, const uint8_t* src, int count, int opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a = _mm_set1_epi16((short)opacity);
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i dLo = _mm_unpacklo_epi8(d, zero);
+        __m128i dHi = _mm_unpackhi_epi8(d, zero);
+        __m128i lo = mixSse2(dLo, targetSse2(mode, dLo, _mm_unpacklo_epi8(s, zero)), a);
+        __m128i hi = mixSse2(dHi, targetSse2(mode, dHi, _mm_unpackhi_epi8(s, zero)), a);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    rowScalar(mode, dst + i, src + i, count - i, opacity);
+}
+
+// 两个像素（8个16位通道）：alpha广播到四个通道，alpha通道的目标值固定为255
+BLEND_TARGET_SSE2 inline __m128i rgbaHalfSse2(BlendMode mode, __m128i d, __m128i s, __m128i opacity) {
+    const __m128i alphaLanes = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i a = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(alpha, opacity), _mm_set1_epi16(128)), 8);
+    a = _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+    __m128i t = _mm_or_si128(targetSse2(mode, d, s), alphaLanes);
+    return mixSse2(d, t, a);
+}
+
+BLEND_TARGET_SSE2 inline void rowRgbaSse2(BlendMode mode, uint8_t* dst, const uint8_t* src, int pixels, int opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i o = _mm_set1_epi16((short)opacity);
+    int i = 0;
+    for (; i + 4 <= pixels; i += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i * 4));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        __m128i lo = rgbaHalfSse2(mode, _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), o);
+        __m128i hi = rgbaHalfSse2(mode, _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), o);
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_packus_epi16(lo, hi));
+    }
+    rowRgbaScalar(mode, dst + i * 4, src + i * 4, pixels - i, opacity);
+}
+
+// AVX2版本与SSE2相同，unpack/pack都在128位通道内进行，顺序自然还原
+BLEND_TARGET_AVX2 inline __m256i mul255Avx2(__m256i a, __m256i b) {
+    __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+BLEND_TARGET_AVX2 inline __m256i targetAvx2(BlendMode mode, __m256i d, __m256i s) {
+    const __m256i max = _mm256_set1_epi16(255);
+    switch (mode) {
+        case BlendMode::Normal: return s;
+        case BlendMode::Add: return _mm256_min_epi16(_mm256_add_epi16(d, s), max);
+        case BlendMode::Multiply: return mul255Avx2(d, s);
+        case BlendMode::Screen:
+            return _mm256_sub_epi16(max, mul255Avx2(_mm256_sub_epi16(max, d), _mm256_sub_epi16(max, s)));
+    }
+    return s;
+}
+
+BLEND_TARGET_AVX2 inline __m256i mixAvx2(__m256i d, __m256i t, __m256i a) {
+    __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(256), a);
+    __m256i sum = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(d, inv), _mm256_mullo_epi16(t, a)),
+                                   _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(sum, 8);
+}
+
+BLEND_TARGET_AVX2 inline void rowAvx2(BlendMode mode, uint8_t* dst, const uint8_t* src, int count, int opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i a = _mm256_set1_epi16((short)opacity);
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i dLo = _mm256_unpacklo_epi8(d, zero);
+        __m256i dHi = _mm256_unpackhi_epi8(d, zero);
+        __m256i lo = mixAvx2(dLo, targetAvx2(mode, dLo, _mm256_unpacklo_epi8(s, zero)), a);
+        __m256i hi = mixAvx2(dHi, targetAvx2(mode, dHi, _mm256_unpackhi_epi8(s, zero)), a);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    rowSse2(mode, dst + i, src + i, count - i, opacity);
+}
+
+BLEND_TARGET_AVX2 inline __m256i rgbaHalfAvx2(BlendMode mode, __m256i d, __m256i s, __m256i opacity) {
+    const __m256i alphaLanes = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m256i a = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(alpha, opacity), _mm256_set1_epi16(128)), 8);
+    a = _mm256_add_epi16(a, _mm256_srli_epi16(a, 7));
+    __m256i t = _mm256_or_si256(targetAvx2(mode, d, s), alphaLanes);
+    return mixAvx2(d, t, a);
+}
+
+BLEND_TARGET_AVX2 inline void rowRgbaAvx2(BlendMode mode, uint8_t* dst, const uint8_t* src, int pixels, int opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i o = _mm256_set1_epi16((short)opacity);
+    int i = 0;
+    for (; i + 8 <= pixels; i += 8) {
+        __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i * 4));
+        __m256i s = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+        __m256i lo = rgbaHalfAvx2(mode, _mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), o);
+        __m256i hi = rgbaHalfAvx2(mode, _mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), o);
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_packus_epi16(lo, hi));
+    }
+    rowRgbaSse2(mode, dst + i * 4, src + i * 4, pixels - i, opacity);
+}
+
+#endif  // BLEND_X86
+
+}  // namespace blend
+
+// 一组混合内核，运行时按CPU支持的指令集选择
+struct BlendKernels {
+    using RowFunction = void (*)(BlendMode mode, uint8_t* dst, const uint8_t* src, int count, int opacity);
+
+    const char* name;
+    RowFunction row;      // 按字节，count为字节数
+    RowFunction rowRgba;  // RGBA，count为像素数
+
+    static const BlendKernels& scalar() {
+        static const BlendKernels kernels = { "scalar", &blend::rowScalar, &blend::rowRgbaScalar };
+        return kernels;
+    }
+
+    // 当前CPU可用的最快实现
+    static const BlendKernels& best() {
+        static const BlendKernels& kernels = *available().back();
+        return kernels;
+    }
+
+    // 当前CPU可用的全部实现，从慢到快
+    static std::vector<const BlendKernels*> available() {
+        std::vector<const BlendKernels*> result = { &scalar() };
+#ifdef BLEND_X86
+        static const BlendKernels sse2 = { "sse2", &blend::rowSse2, &blend::rowRgbaSse2 };
+        static const BlendKernels avx2 = { "avx2", &blend::rowAvx2, &blend::rowRgbaAvx2 };
+        if (cpuHasSse2()) {
+            result.push_back(&sse2);
+            if (cpuHasAvx2()) {
+                result.push_back(&avx2);
+            }
+        }
+#endif
+        return result;
+    }
+
+    // 按名字查找（scalar/sse2/avx2），当前CPU不支持时返回nullptr
+    static const BlendKernels* find(const std::string& name) {
+        for (const BlendKernels* kernels : available()) {
+            if (name == kernels->name) {
+                return kernels;
+            }
+        }
+        return nullptr;
+    }
+
+#ifdef BLEND_X86
+    // 运行时检测指令集，其他SIMD内核（例如波形的峰值归约）也用它选择实现
+    static bool cpuHasSse2() {
+#if defined(__x86_64__) || defined(_M_X64)
+        return true;
+#elif defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[3] & (1 << 26)) != 0;
+#else
+        return __builtin_cpu_supports("sse2");
+#endif
+    }
+
+    static bool cpuHasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+};
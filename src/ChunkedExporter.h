@@ -0,0 +1,902 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include "ColorEffects.h"
+#include "Compositor.h"
+#include "DecoderThreading.h"
+#include "KeyframeIndex.h"
+#include "MediaQueue.h"
+#include "Profiler.h"
+#include "ScalerCache.h"
+
+struct ChunkedExportOptions {
+    int workers = 0;                  // 并行的分段数，0为按核心预算；1为串行（整段一个编码器）
+    int width = 0;                    // 输出尺寸，0为源尺寸
+    int height = 0;
+    std::string encoder = "mpeg4";    // 编码器名，找不到时用MPEG-4
+    int64_t bitRate = 0;              // 0为按输出像素数估算
+    int gopSize = 250;
+    size_t workerMemoryBytes = 64 * 1024 * 1024;  // 每个工作线程已编码、还没轮到写出的数据上限
+    bool verify = false;              // 导出后再串行编码一遍，比较帧数和时间戳
+    ColorChain colorEffects;          // 缩放到输出尺寸后执行的调色效果链，与预览共用实现
+    LayerList layers;                 // 调色之后混合的叠加图层，与预览共用实现
+    bool printProgress = false;
+
+    // 解析导出参数，从argv[first]开始
+    static bool parseArgs(int argc, char* argv[], int first, ChunkedExportOptions& options) {
+        bool ok = true;
+        for (int i = first; i < argc; i++) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--workers" && hasValue) {
+                options.workers = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--scale" && hasValue) {
+                std::string size = argv[++i];
+                size_t x = size.find('x');
+                if (x == std::string::npos) {
+                    std::cerr << "输出尺寸应为 宽x高: " << size << std::endl;
+                    return false;
+                }
+                options.width = std::max(0, std::atoi(size.substr(0, x).c_str()));
+                options.height = std::max(0, std::atoi(size.substr(x + 1).c_str()));
+            } else if (arg == "--encoder" && hasValue) {
+                options.encoder = argv[++i];
+            } else if (arg == "--bitrate-kbps" && hasValue) {
+                options.bitRate = std::max(0L, std::atol(argv[++i])) * 1000;
+            } else if (arg == "--gop" && hasValue) {
+                options.gopSize = std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--worker-memory-mb" && hasValue) {
+                options.workerMemoryBytes = (size_t)std::max(1L, std::atol(argv[++i])) * 1024 * 1024;
+            } else if (arg == "--verify") {
+                options.verify = true;
+            } else if (hasValue && (parseColorEffectArg(arg, argv[i + 1], options.colorEffects, ok) ||
+                                    parseLayerArg(arg, argv[i + 1], options.layers, ok))) {
+                if (!ok) {
+                    return false;
+                }
+                i++;
+            } else {
+                std::cerr << "未知的导出参数: " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+struct ChunkedExportStats {
+    double inPoint = 0.0;
+    double outPoint = 0.0;
+    int workers = 0;
+    int segments = 0;
+    uint64_t frames = 0;
+    double elapsedSeconds = 0.0;
+    double fps = 0.0;
+    double cpuSeconds = 0.0;        // 进程CPU时间
+    double coreUtilization = 0.0;   // CPU时间 / (耗时 * 核心数)
+    size_t peakBufferedBytes = 0;   // 单个工作线程等待写出的最大字节数
+    uint64_t audioPackets = 0;
+    uint64_t outputBytes = 0;
+    bool verified = false;
+    bool verifyPassed = false;
+    double serialSeconds = 0.0;
+    uint64_t serialFrames = 0;
+};
+
+// 并行分段导出：需要完整重编码（缩放、换格式）时把区间按关键帧切成若干段，
+// 每个工作线程用自己的解复用/解码/缩放/编码上下文处理一段，调用线程按顺序把各段的数据包直接拼接写出
+// - 每段从关键帧开始解码、编码器从关键帧开始编码，段与段之间没有参考关系，拼接不需要重新编码
+// - 编码器不使用B帧，输出时间戳由源帧pts换算，与串行编码完全一致
+// - 每个工作线程已编码、还没写出的数据（跨它编码完的所有段）超过workerMemoryBytes时，
+//   除正在写出的段外不再产生数据、也不领取新段，内存占用不超过 工作线程数 x 预算
+class ChunkedExporter {
+public:
+    ChunkedExporter() : m_cancel(false), m_running(false), m_framesDone(0), m_framesTotal(0) {}
+
+    ~ChunkedExporter() {
+        cancel();
+        wait();
+    }
+
+    ChunkedExporter(const ChunkedExporter&) = delete;
+    ChunkedExporter& operator=(const ChunkedExporter&) = delete;
+
+    // 同步导出[inPoint, outPoint)（秒），outPoint不大于inPoint时导出到结尾
+    bool exportRange(const std::string& input, double inPoint, double outPoint, const std::string& output,
+                     const ChunkedExportOptions& options, ChunkedExportStats& stats) {
+        auto begin = std::chrono::steady_clock::now();
+        double cpuBegin = processCpuSeconds();
+        stats = ChunkedExportStats();
+        m_framesDone = 0;
+        m_framesTotal = 0;
+
+        Job job(options);
+        bool ok = probe(job, input, inPoint, outPoint) && run(job, output, stats);
+        if (job.videoPar) {
+            avcodec_parameters_free(&job.videoPar);
+        }
+
+        stats.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        stats.cpuSeconds = processCpuSeconds() - cpuBegin;
+        stats.frames = m_framesDone;
+        stats.fps = stats.elapsedSeconds > 0.0 ? stats.frames / stats.elapsedSeconds : 0.0;
+        int cores = std::max(1, (int)std::thread::hardware_concurrency());
+        stats.coreUtilization = stats.elapsedSeconds > 0.0 ? stats.cpuSeconds / (stats.elapsedSeconds * cores) : 0.0;
+        std::error_code ec;
+        if (!ok) {
+            std::filesystem::remove(output, ec);
+            return false;
+        }
+        stats.outputBytes = (uint64_t)std::filesystem::file_size(output, ec);
+
+        if (options.verify && options.workers != 1) {
+            verify(input, inPoint, outPoint, output, options, stats);
+        }
+        return true;
+    }
+
+    // 在后台线程导出，完成后在控制台打印统计；已有导出在进行时返回false
+    bool start(const std::string& input, double inPoint, double outPoint, const std::string& output,
+               const ChunkedExportOptions& options) {
+        if (m_running) {
+            return false;
+        }
+        wait();
+        m_cancel = false;
+        m_running = true;
+        m_framesDone = 0;
+        m_framesTotal = 0;
+        m_thread = std::thread([this, input, inPoint, outPoint, output, options]() {
+            Profiler::setThreadName("export_writer");
+            ChunkedExportStats stats;
+            if (exportRange(input, inPoint, outPoint, output, options, stats)) {
+                printStats(output, stats);
+            } else if (!m_cancel) {
+                std::cerr << "导出失败: " << output << std::endl;
+            }
+            m_running = false;
+        });
+        return true;
+    }
+
+    bool isRunning() const {
+        return m_running;
+    }
+
+    // 已编码的帧数占总帧数的比例
+    double progress() const {
+        uint64_t total = m_framesTotal;
+        return total ? std::min(1.0, (double)m_framesDone / total) : 0.0;
+    }
+
+    void cancel() {
+        m_cancel = true;
+    }
+
+    void wait() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    static void printStats(const std::string& output, const ChunkedExportStats& stats) {
+        std::cout << "导出完成: " << output << " 区间 " << stats.inPoint << "s - " << stats.outPoint << "s"
+                  << "，" << stats.segments << " 段 / " << stats.workers << " 个工作线程"
+                  << "，" << stats.frames << " 帧，耗时 " << stats.elapsedSeconds << "s（" << stats.fps << " fps）"
+                  << "\n  CPU " << stats.cpuSeconds << "s，核心利用率 " << (int)(stats.coreUtilization * 100) << "%"
+                  << "，单线程最大缓冲 " << stats.peakBufferedBytes / 1024 << "KB"
+                  << "，音频 " << stats.audioPackets << " 个数据包，输出 " << stats.outputBytes / 1024 << "KB" << std::endl;
+        if (stats.verified) {
+            std::cout << "  串行对照: " << (stats.verifyPassed ? "一致" : "不一致") << "，" << stats.serialFrames << " 帧，耗时 "
+                      << stats.serialSeconds << "s（加速 " << (stats.elapsedSeconds > 0.0 ? stats.serialSeconds / stats.elapsedSeconds : 0.0)
+                      << "x）" << std::endl;
+        }
+    }
+
+private:
+    // 一段源时间戳[start, end)，由一个工作线程编码
+    struct Segment {
+        int64_t start = 0;
+        int64_t end = 0;
+        std::deque<PacketPtr> packets;  // 已编码、等待写出，编码器时间基
+        size_t bytes = 0;
+        int worker = 0;  // 编码这一段的工作线程
+        bool done = false;
+    };
+
+    struct Job {
+        explicit Job(const ChunkedExportOptions& exportOptions) : options(exportOptions) {}
+
+        ChunkedExportOptions options;
+        std::string input;
+        AVCodecParameters* videoPar = nullptr;
+        int videoIndex = -1;
+        int audioIndex = -1;
+        AVRational sourceTimeBase = { 1, 1 };
+        AVRational encoderTimeBase = { 1, 25 };
+        AVRational frameRate = { 25, 1 };
+        int width = 0;
+        int height = 0;
+        int64_t bitRate = 0;
+        bool globalHeader = false;
+        int64_t startTs = 0;  // 源视频流时间基
+        int64_t inTs = 0;
+        int64_t outTs = 0;
+        int workers = 1;
+        std::deque<Segment> segments;  // 扩容时不移动元素
+        std::vector<uint8_t> extradata;  // 所有分段编码器的全局头必须一致
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        size_t head = 0;               // 正在写出的段
+        std::vector<size_t> workerBytes;  // 每个工作线程已编码、还没写出的字节数
+        size_t peakBuffered = 0;
+        size_t nextSegment = 0;
+        std::atomic<bool> failed{ false };
+    };
+
+    // 音频直接复制，写出线程用单独的解复用上下文读取
+    struct AudioCopy {
+        AVFormatContext* input = nullptr;
+        AVStream* source = nullptr;
+        AVStream* output = nullptr;
+        int64_t start = 0;   // 音频流时间基
+        int64_t end = 0;
+        PacketPtr pending;
+        bool eof = false;
+    };
+
+    static constexpr double kMinSegmentSeconds = 2.0;   // 分段太短时关键帧处的额外解码占比过高
+    static constexpr int kSegmentsPerWorker = 4;        // 分段多于工作线程，快慢不均时后面的段可以补上
+    static constexpr double kBitsPerPixel = 0.1;        // 未指定码率时每像素的比特数
+    static constexpr int kWaitMs = 50;
+    static constexpr int kProgressIntervalMs = 1000;
+
+    static int interruptCallback(void* opaque) {
+        return ((ChunkedExporter*)opaque)->m_cancel.load() ? 1 : 0;
+    }
+
+    static int64_t packetTime(const AVPacket* packet) {
+        return packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    }
+
+    static double processCpuSeconds() {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+            auto seconds = [](const FILETIME& time) {
+                return (((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime) / 1e7;
+            };
+            return seconds(kernel) + seconds(user);
+        }
+        return 0.0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0.0;
+        }
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+    }
+
+    AVFormatContext* openInput(const std::string& path) {
+        AVFormatContext* context = avformat_alloc_context();
+        if (!context) {
+            return nullptr;
+        }
+        context->interrupt_callback.callback = &ChunkedExporter::interruptCallback;
+        context->interrupt_callback.opaque = this;
+        if (avformat_open_input(&context, path.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "导出: 无法打开视频文件: " << path << std::endl;
+            return nullptr;
+        }
+        if (avformat_find_stream_info(context, nullptr) < 0) {
+            std::cerr << "导出: 无法获取流信息" << std::endl;
+            avformat_close_input(&context);
+            return nullptr;
+        }
+        return context;
+    }
+
+    // 只保留一个流的数据包
+    static void keepOnly(AVFormatContext* context, int streamIndex) {
+        for (unsigned int i = 0; i < context->nb_streams; i++) {
+            context->streams[i]->discard = (int)i == streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+    }
+
+    // 读取流参数，扫描关键帧并切分段
+    bool probe(Job& job, const std::string& input, double inPoint, double outPoint) {
+        job.input = input;
+        AVFormatContext* context = openInput(input);
+        if (!context) {
+            return false;
+        }
+        job.videoIndex = av_find_best_stream(context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (job.videoIndex < 0) {
+            std::cerr << "导出: 未找到视频流" << std::endl;
+            avformat_close_input(&context);
+            return false;
+        }
+        job.audioIndex = av_find_best_stream(context, AVMEDIA_TYPE_AUDIO, -1, job.videoIndex, nullptr, 0);
+        AVStream* stream = context->streams[job.videoIndex];
+        job.videoPar = avcodec_parameters_alloc();
+        if (!job.videoPar || avcodec_parameters_copy(job.videoPar, stream->codecpar) < 0) {
+            avformat_close_input(&context);
+            return false;
+        }
+
+        job.sourceTimeBase = stream->time_base;
+        AVRational rate = av_guess_frame_rate(context, stream, nullptr);
+        if (rate.num > 0 && rate.den > 0) {
+            job.frameRate = rate;
+        }
+        // MPEG-4等编码器要求时间基分母不超过16位，超出时按帧率
+        job.encoderTimeBase = job.sourceTimeBase.den <= 65535 ? job.sourceTimeBase : av_inv_q(job.frameRate);
+
+        job.width = (job.options.width > 0 ? job.options.width : job.videoPar->width) & ~1;
+        job.height = (job.options.height > 0 ? job.options.height : job.videoPar->height) & ~1;
+        job.bitRate = job.options.bitRate > 0 ? job.options.bitRate
+                                              : (int64_t)(job.width * job.height * av_q2d(job.frameRate) * kBitsPerPixel);
+
+        double duration = context->duration > 0 ? context->duration / (double)AV_TIME_BASE : 0.0;
+        if (outPoint <= inPoint || (duration > 0.0 && outPoint > duration)) {
+            outPoint = duration > 0.0 ? duration : std::numeric_limits<double>::max() / 2;
+        }
+        job.startTs = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        job.inTs = job.startTs + (int64_t)std::llround(std::max(0.0, inPoint) / av_q2d(job.sourceTimeBase));
+        job.outTs = outPoint < std::numeric_limits<double>::max() / 2
+                        ? job.startTs + (int64_t)std::llround(outPoint / av_q2d(job.sourceTimeBase))
+                        : std::numeric_limits<int64_t>::max();
+        avformat_close_input(&context);
+
+        KeyframeIndex index;
+        if (!index.buildSync(input, job.videoIndex) || index.keyframes().empty()) {
+            if (!m_cancel) {
+                std::cerr << "导出: 无法建立关键帧索引" << std::endl;
+            }
+            return false;
+        }
+        if (job.outTs == std::numeric_limits<int64_t>::max()) {
+            job.outTs = index.framePts().back() + 1;
+        }
+        m_framesTotal = index.framesBetween(job.inTs - 1, job.outTs - 1);
+        if (m_framesTotal == 0) {
+            std::cerr << "导出: 区间内没有视频帧" << std::endl;
+            return false;
+        }
+
+        planSegments(job, index);
+        return true;
+    }
+
+    // 在关键帧处切段，每段不短于kMinSegmentSeconds
+    void planSegments(Job& job, const KeyframeIndex& index) {
+        int workers = job.options.workers > 0 ? job.options.workers : ThreadBudget::instance().totalCores();
+        double range = (job.outTs - job.inTs) * av_q2d(job.sourceTimeBase);
+        double target = std::max(kMinSegmentSeconds, range / (std::max(1, workers) * kSegmentsPerWorker));
+
+        int64_t start = job.inTs;
+        if (workers > 1) {
+            for (const KeyframeEntry& keyframe : index.keyframes()) {
+                if (keyframe.pts <= start || keyframe.pts >= job.outTs) {
+                    continue;
+                }
+                if ((keyframe.pts - start) * av_q2d(job.sourceTimeBase) >= target) {
+                    Segment segment;
+                    segment.start = start;
+                    segment.end = keyframe.pts;
+                    job.segments.push_back(std::move(segment));
+                    start = keyframe.pts;
+                }
+            }
+        }
+        Segment last;
+        last.start = start;
+        last.end = job.outTs;
+        job.segments.push_back(std::move(last));
+        job.workers = std::max(1, std::min(workers, (int)job.segments.size()));
+    }
+
+    AVCodecContext* openEncoder(const Job& job) {
+        const AVCodec* codec = avcodec_find_encoder_by_name(job.options.encoder.c_str());
+        if (!codec) {
+            codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+        }
+        AVCodecContext* encoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+        if (!encoder) {
+            std::cerr << "导出: 找不到编码器 " << job.options.encoder << std::endl;
+            return nullptr;
+        }
+        encoder->width = job.width;
+        encoder->height = job.height;
+        encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+        encoder->sample_aspect_ratio = job.videoPar->sample_aspect_ratio;
+        encoder->time_base = job.encoderTimeBase;
+        encoder->framerate = job.frameRate;
+        encoder->gop_size = job.options.gopSize;
+        encoder->max_b_frames = 0;  // dts等于pts，各段拼接后时间戳自然递增
+        encoder->bit_rate = job.bitRate;
+        encoder->thread_count = 1;  // 并行来自分段，每段一个线程
+        encoder->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+        if (job.globalHeader) {
+            encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if (avcodec_open2(encoder, codec, nullptr) < 0) {
+            std::cerr << "导出: 无法打开编码器 " << codec->name << std::endl;
+            avcodec_free_context(&encoder);
+            return nullptr;
+        }
+        return encoder;
+    }
+
+    bool run(Job& job, const std::string& path, ChunkedExportStats& stats) {
+        AVFormatContext* output = nullptr;
+        if (avformat_alloc_output_context2(&output, nullptr, nullptr, path.c_str()) < 0 || !output) {
+            std::cerr << "导出: 无法识别输出格式: " << path << std::endl;
+            return false;
+        }
+        job.globalHeader = (output->oformat->flags & AVFMT_GLOBALHEADER) != 0;
+
+        AudioCopy audio;
+        std::vector<std::thread> workers;
+        bool ok = false;
+        do {
+            // 输出流参数来自一个同样配置的编码器，各段编码器的全局头与它比较
+            AVCodecContext* encoder = openEncoder(job);
+            if (!encoder) {
+                break;
+            }
+            AVStream* video = avformat_new_stream(output, nullptr);
+            bool created = video && avcodec_parameters_from_context(video->codecpar, encoder) >= 0;
+            if (created) {
+                video->time_base = job.encoderTimeBase;
+                video->avg_frame_rate = job.frameRate;
+                job.extradata.assign(encoder->extradata, encoder->extradata + encoder->extradata_size);
+            }
+            avcodec_free_context(&encoder);
+            if (!created || !openAudio(job, output, audio)) {
+                break;
+            }
+
+            if (!(output->oformat->flags & AVFMT_NOFILE) && avio_open(&output->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+                std::cerr << "导出: 无法写入文件: " << path << std::endl;
+                break;
+            }
+            if (avformat_write_header(output, nullptr) < 0) {
+                std::cerr << "导出: 无法写入文件头" << std::endl;
+                break;
+            }
+
+            job.workerBytes.assign(job.workers, 0);
+            for (int i = 0; i < job.workers; i++) {
+                workers.emplace_back([this, &job, i]() { runWorker(job, i); });
+            }
+            ok = writeSegments(job, output, video, audio, stats) && writeAudio(output, audio, nullptr, {}, stats);
+            if (ok) {
+                ok = av_write_trailer(output) >= 0;
+            }
+        } while (false);
+
+        if (!ok) {
+            job.failed = true;
+        }
+        job.changed.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        if (audio.input) {
+            avformat_close_input(&audio.input);
+        }
+        if (!(output->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&output->pb);
+        }
+        avformat_free_context(output);
+
+        stats.inPoint = (job.inTs - job.startTs) * av_q2d(job.sourceTimeBase);
+        stats.outPoint = (job.outTs - job.startTs) * av_q2d(job.sourceTimeBase);
+        stats.workers = job.workers;
+        stats.segments = (int)job.segments.size();
+        stats.peakBufferedBytes = job.peakBuffered;
+        return ok && !job.failed;
+    }
+
+    bool openAudio(Job& job, AVFormatContext* output, AudioCopy& audio) {
+        if (job.audioIndex < 0) {
+            return true;
+        }
+        audio.input = openInput(job.input);
+        if (!audio.input) {
+            return false;
+        }
+        keepOnly(audio.input, job.audioIndex);
+        audio.source = audio.input->streams[job.audioIndex];
+        audio.output = avformat_new_stream(output, nullptr);
+        if (!audio.output || avcodec_parameters_copy(audio.output->codecpar, audio.source->codecpar) < 0) {
+            return false;
+        }
+        audio.output->codecpar->codec_tag = 0;
+        audio.output->time_base = audio.source->time_base;
+        audio.start = av_rescale_q(job.inTs, job.sourceTimeBase, audio.source->time_base);
+        audio.end = job.outTs == std::numeric_limits<int64_t>::max()
+                        ? std::numeric_limits<int64_t>::max()
+                        : av_rescale_q(job.outTs, job.sourceTimeBase, audio.source->time_base);
+        av_seek_frame(audio.input, job.audioIndex, audio.start, AVSEEK_FLAG_BACKWARD);
+        audio.pending = makePacket();
+        return audio.pending != nullptr;
+    }
+
+    // 写出dts不晚于video（编码器时间基）的音频数据包；video为空时写出剩余全部
+    bool writeAudio(AVFormatContext* output, AudioCopy& audio, const AVPacket* video, AVRational videoTimeBase,
+                    ChunkedExportStats& stats) {
+        if (!audio.input) {
+            return true;
+        }
+        while (!audio.eof) {
+            if (!audio.pending->data) {
+                if (av_read_frame(audio.input, audio.pending.get()) < 0) {
+                    audio.eof = true;
+                    break;
+                }
+                int64_t pts = packetTime(audio.pending.get());
+                if (pts == AV_NOPTS_VALUE || pts < audio.start) {
+                    av_packet_unref(audio.pending.get());
+                    continue;
+                }
+                if (pts >= audio.end) {
+                    av_packet_unref(audio.pending.get());
+                    audio.eof = true;
+                    break;
+                }
+                if (audio.pending->pts != AV_NOPTS_VALUE) {
+                    audio.pending->pts -= audio.start;
+                }
+                if (audio.pending->dts != AV_NOPTS_VALUE) {
+                    audio.pending->dts -= audio.start;
+                }
+            }
+            if (video && av_compare_ts(audio.pending->dts, audio.source->time_base, video->dts, videoTimeBase) > 0) {
+                break;
+            }
+            audio.pending->stream_index = audio.output->index;
+            audio.pending->pos = -1;
+            av_packet_rescale_ts(audio.pending.get(), audio.source->time_base, audio.output->time_base);
+            if (av_interleaved_write_frame(output, audio.pending.get()) < 0) {
+                std::cerr << "导出: 写入音频数据包失败" << std::endl;
+                return false;
+            }
+            stats.audioPackets++;
+        }
+        return true;
+    }
+
+    // 按段的顺序写出；当前段的数据包一产生就写出，后面的段先缓冲在内存里
+    bool writeSegments(Job& job, AVFormatContext* output, AVStream* video, AudioCopy& audio, ChunkedExportStats& stats) {
+        auto lastReport = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < job.segments.size(); i++) {
+            Segment& segment = job.segments[i];
+            while (true) {
+                PacketPtr packet;
+                {
+                    std::unique_lock<std::mutex> lock(job.mutex);
+                    while (segment.packets.empty() && !segment.done && !job.failed && !m_cancel) {
+                        job.changed.wait_for(lock, std::chrono::milliseconds(kWaitMs));
+                    }
+                    if (job.failed || m_cancel) {
+                        return false;
+                    }
+                    if (segment.packets.empty()) {
+                        job.head = i + 1;
+                        job.changed.notify_all();
+                        break;
+                    }
+                    packet = std::move(segment.packets.front());
+                    segment.packets.pop_front();
+                    segment.bytes -= packet->size;
+                    job.workerBytes[segment.worker] -= packet->size;
+                }
+                job.changed.notify_all();
+
+                ProfileScope scope("export_mux");
+                if (!writeAudio(output, audio, packet.get(), job.encoderTimeBase, stats)) {
+                    return false;
+                }
+                packet->stream_index = video->index;
+                av_packet_rescale_ts(packet.get(), job.encoderTimeBase, video->time_base);
+                if (av_interleaved_write_frame(output, packet.get()) < 0) {
+                    std::cerr << "导出: 写入视频数据包失败" << std::endl;
+                    return false;
+                }
+
+                if (job.options.printProgress &&
+                    std::chrono::steady_clock::now() - lastReport >= std::chrono::milliseconds(kProgressIntervalMs)) {
+                    lastReport = std::chrono::steady_clock::now();
+                    std::cout << "导出进度: " << (int)(progress() * 100) << "%（" << m_framesDone << " / " << m_framesTotal
+                              << " 帧，第 " << i + 1 << " / " << job.segments.size() << " 段）" << std::endl;
+                }
+            }
+        }
+        return true;
+    }
+
+    // 工作线程：自己的解复用、解码、缩放上下文，依次领取还没编码的段
+    void runWorker(Job& job, int worker) {
+        Profiler::setThreadName("export");
+        // 分段并行时各工作线程平分核心，而不是每个都按整个导出的权重领取
+        int maxThreads = job.workers > 1 ? std::max(1, ThreadBudget::instance().totalCores() / job.workers) : 0;
+        ThreadBudget::Lease lease = ThreadBudget::instance().acquire(DecoderRole::Export, maxThreads);
+        AVFormatContext* input = openInput(job.input);
+        const AVCodec* codec = avcodec_find_decoder(job.videoPar->codec_id);
+        AVCodecContext* decoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+        bool ok = input && decoder && avcodec_parameters_to_context(decoder, job.videoPar) >= 0;
+        if (ok) {
+            keepOnly(input, job.videoIndex);
+            decoder->pkt_timebase = job.sourceTimeBase;
+            decoder->thread_count = lease.threads();
+            ok = avcodec_open2(decoder, codec, nullptr) >= 0;
+        }
+        if (!ok) {
+            std::cerr << "导出: 工作线程无法打开解码器" << std::endl;
+            job.failed = true;
+        }
+
+        ScalerCache scaler(1);
+        // 分段并行时每个工作线程已经占满一个核心，调色和图层混合在本线程上做；串行导出时用满全部核心
+        ColorEffectStack effects(job.workers > 1 ? 1 : 0);
+        effects.setChain(job.options.colorEffects);
+        LayerStack overlays(job.workers > 1 ? 1 : 0);
+        overlays.setLayers(job.options.layers);
+        while (ok && !job.failed && !m_cancel) {
+            size_t index = 0;
+            {
+                // 之前编码的段还没写出的部分已经占满预算时先不领新段
+                std::unique_lock<std::mutex> lock(job.mutex);
+                while (job.workerBytes[worker] >= job.options.workerMemoryBytes && !job.failed && !m_cancel) {
+                    job.changed.wait_for(lock, std::chrono::milliseconds(kWaitMs));
+                }
+                index = job.nextSegment++;
+                if (index < job.segments.size()) {
+                    job.segments[index].worker = worker;
+                }
+            }
+            if (index >= job.segments.size()) {
+                break;
+            }
+            if (!encodeSegment(job, input, decoder, scaler, effects, overlays, index)) {
+                job.failed = true;
+            }
+        }
+        job.changed.notify_all();
+
+        avcodec_free_context(&decoder);
+        if (input) {
+            avformat_close_input(&input);
+        }
+    }
+
+    bool encodeSegment(Job& job, AVFormatContext* input, AVCodecContext* decoder, ScalerCache& scaler,
+                       ColorEffectStack& effects, LayerStack& overlays, size_t index) {
+        ProfileScope scope("export_segment");
+        Segment& segment = job.segments[index];
+        AVCodecContext* encoder = openEncoder(job);
+        if (!encoder) {
+            return false;
+        }
+        if (job.extradata.size() != (size_t)encoder->extradata_size ||
+            (encoder->extradata_size > 0 && std::memcmp(job.extradata.data(), encoder->extradata, encoder->extradata_size) != 0)) {
+            std::cerr << "导出: 分段编码器的全局头不一致，无法直接拼接" << std::endl;
+            avcodec_free_context(&encoder);
+            return false;
+        }
+
+        bool bt709 = ColorEffectStack::sourceIsBt709(job.videoPar->color_space, job.videoPar->height);
+        FramePtr decoded = makeFrame();
+        FramePtr scaled = makeFrame();
+        PacketPtr packet = makePacket();
+        bool ok = decoded && scaled && packet;
+        if (ok) {
+            scaled->format = AV_PIX_FMT_YUV420P;
+            scaled->width = job.width;
+            scaled->height = job.height;
+            ok = av_frame_get_buffer(scaled.get(), 0) >= 0;
+        }
+
+        auto receivePackets = [&]() {
+            while (avcodec_receive_packet(encoder, packet.get()) == 0) {
+                PacketPtr out = makePacket();
+                if (!out) {
+                    return false;
+                }
+                av_packet_move_ref(out.get(), packet.get());
+                pushPacket(job, index, std::move(out));
+            }
+            return true;
+        };
+        auto receiveFrames = [&]() {
+            while (avcodec_receive_frame(decoder, decoded.get()) == 0) {
+                int64_t pts = decoded->best_effort_timestamp;
+                bool keep = pts != AV_NOPTS_VALUE && pts >= segment.start && pts < segment.end;
+                if (keep) {
+                    SwsContext* context = scaler.get(decoded->width, decoded->height, (AVPixelFormat)decoded->format,
+                                                     job.width, job.height, AV_PIX_FMT_YUV420P);
+                    if (!context || av_frame_make_writable(scaled.get()) < 0) {
+                        av_frame_unref(decoded.get());
+                        return false;
+                    }
+                    {
+                        ProfileScope scaleScope("sws_scale");
+                        sws_scale(context, decoded->data, decoded->linesize, 0, decoded->height, scaled->data, scaled->linesize);
+                    }
+                    // 转换后是有限范围的YUV420P，矩阵不变；调色矩阵按源视频流选，与预览一致，不看缩放后的输出尺寸
+                    scaled->colorspace = decoded->colorspace;
+                    scaled->color_range = AVCOL_RANGE_MPEG;
+                    effects.apply(scaled.get(), bt709);
+                    overlays.apply(scaled.get());
+                    scaled->pts = av_rescale_q(pts - job.inTs, job.sourceTimeBase, job.encoderTimeBase);
+                    if (avcodec_send_frame(encoder, scaled.get()) < 0 || !receivePackets()) {
+                        av_frame_unref(decoded.get());
+                        return false;
+                    }
+                    m_framesDone++;
+                }
+                av_frame_unref(decoded.get());
+            }
+            return true;
+        };
+
+        // 从段起点之前的关键帧开始解码；读到段终点的关键帧之后，
+        // 只继续送入pts早于终点的数据包（开放GOP中参考它的前导帧），随后的第一个其他数据包就停止
+        avcodec_flush_buffers(decoder);
+        if (ok && av_seek_frame(input, job.videoIndex, segment.start, AVSEEK_FLAG_BACKWARD) < 0) {
+            std::cerr << "导出: 跳转到分段起点失败" << std::endl;
+            ok = false;
+        }
+        bool pastEnd = false;
+        while (ok && !job.failed && !m_cancel) {
+            if (av_read_frame(input, packet.get()) < 0) {
+                break;
+            }
+            if (packet->stream_index != job.videoIndex) {
+                av_packet_unref(packet.get());
+                continue;
+            }
+            int64_t pts = packetTime(packet.get());
+            if (pastEnd && pts != AV_NOPTS_VALUE && pts >= segment.end) {
+                av_packet_unref(packet.get());
+                break;
+            }
+            if ((packet->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE && pts >= segment.end) {
+                pastEnd = true;
+            }
+            int sent = avcodec_send_packet(decoder, packet.get());
+            av_packet_unref(packet.get());
+            if (sent >= 0) {
+                ok = receiveFrames();
+            }
+        }
+        if (ok && !job.failed && !m_cancel) {
+            avcodec_send_packet(decoder, nullptr);
+            ok = receiveFrames();
+            avcodec_send_frame(encoder, nullptr);
+            ok = ok && receivePackets();
+        }
+        avcodec_free_context(&encoder);
+        if (!ok || job.failed || m_cancel) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(job.mutex);
+        segment.done = true;
+        job.changed.notify_all();
+        return true;
+    }
+
+    // 不是正在写出的段时，本线程所有段合计的缓冲超过预算就等写出线程追上来；
+    // 正在写出的段一产生就被取走，不等待，写出线程总能前进
+    void pushPacket(Job& job, size_t index, PacketPtr packet) {
+        std::unique_lock<std::mutex> lock(job.mutex);
+        Segment& segment = job.segments[index];
+        size_t& buffered = job.workerBytes[segment.worker];
+        while (job.head != index && buffered >= job.options.workerMemoryBytes && !job.failed && !m_cancel) {
+            job.changed.wait_for(lock, std::chrono::milliseconds(kWaitMs));
+        }
+        segment.bytes += packet->size;
+        buffered += packet->size;
+        segment.packets.push_back(std::move(packet));
+        job.peakBuffered = std::max(job.peakBuffered, buffered);
+        job.changed.notify_all();
+    }
+
+    // 再用一个编码器串行导出同一区间，比较视频的帧数和每帧时间戳
+    void verify(const std::string& input, double inPoint, double outPoint, const std::string& output,
+                const ChunkedExportOptions& options, ChunkedExportStats& stats) {
+        std::filesystem::path serialPath(output);
+        serialPath.replace_filename(serialPath.stem().string() + "_serial" + serialPath.extension().string());
+        ChunkedExportOptions serialOptions = options;
+        serialOptions.workers = 1;
+        serialOptions.verify = false;
+        serialOptions.printProgress = false;
+
+        uint64_t frames = m_framesDone;
+        ChunkedExportStats serial;
+        stats.verified = true;
+        if (!exportRange(input, inPoint, outPoint, serialPath.string(), serialOptions, serial)) {
+            stats.verifyPassed = false;
+            return;
+        }
+        m_framesDone = frames;
+        stats.serialSeconds = serial.elapsedSeconds;
+        stats.serialFrames = serial.frames;
+
+        std::vector<std::pair<int64_t, int64_t>> parallelTimes;
+        std::vector<std::pair<int64_t, int64_t>> serialTimes;
+        stats.verifyPassed = readVideoTimestamps(output, parallelTimes) && readVideoTimestamps(serialPath.string(), serialTimes) &&
+                             parallelTimes == serialTimes;
+        if (!stats.verifyPassed) {
+            size_t first = 0;
+            while (first < parallelTimes.size() && first < serialTimes.size() && parallelTimes[first] == serialTimes[first]) {
+                first++;
+            }
+            std::cerr << "导出校验: 并行 " << parallelTimes.size() << " 帧，串行 " << serialTimes.size()
+                      << " 帧，第 " << first << " 个数据包开始不一致" << std::endl;
+        }
+        std::error_code ec;
+        std::filesystem::remove(serialPath, ec);
+    }
+
+    // 输出文件中视频数据包的(pts, dts)，按解码顺序
+    bool readVideoTimestamps(const std::string& path, std::vector<std::pair<int64_t, int64_t>>& times) {
+        AVFormatContext* context = openInput(path);
+        if (!context) {
+            return false;
+        }
+        int videoIndex = av_find_best_stream(context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        PacketPtr packet = makePacket();
+        while (packet && videoIndex >= 0 && av_read_frame(context, packet.get()) >= 0) {
+            if (packet->stream_index == videoIndex) {
+                times.emplace_back(packet->pts, packet->dts);
+            }
+            av_packet_unref(packet.get());
+        }
+        avformat_close_input(&context);
+        return videoIndex >= 0;
+    }
+
+    std::atomic<bool> m_cancel;
+    std::atomic<bool> m_running;
+    std::atomic<uint64_t> m_framesDone;
+    std::atomic<uint64_t> m_framesTotal;
+    std::thread m_thread;
+};
@@ -0,0 +1,394 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DecoderThreading.h"
+#include "FrameCache.h"
+#include "MediaIO.h"
+#include "Profiler.h"
+#include "VideoDecoder.h"
+
+// 新打开的预览解码器使用的设置；改动只对之后打开的片段生效
+struct DecoderSettings {
+    size_t packetQueueSize = 64;
+    size_t frameQueueSize = 4;
+    bool zeroCopy = false;
+    bool previewScaling = true;
+    int lowres = 0;
+    DecoderThreadingConfig threading;
+    size_t frameCacheBytes = 256 * 1024 * 1024;
+    bool audio = true;
+    IOMode ioMode = IOMode::Auto;
+    bool probeCache = true;
+    ColorChain colorEffects;  // 新打开的片段默认的效果链
+    LayerList layers;         // 新打开的片段默认的叠加图层
+
+    void apply(VideoDecoder& decoder) const {
+        decoder.setQueueDepths(packetQueueSize, frameQueueSize);
+        decoder.setZeroCopyUpload(zeroCopy);
+        decoder.setPreviewScaling(previewScaling);
+        decoder.setLowres(lowres);
+        decoder.setThreading(threading);
+        decoder.setFrameCacheSize(frameCacheBytes);
+        decoder.setAudioEnabled(audio);
+        decoder.setIOMode(ioMode);
+        decoder.setProbeCache(probeCache);
+        decoder.setColorEffects(colorEffects);
+        decoder.setLayers(layers);
+    }
+};
+
+// 片段池：同时持有多个打开着的预览解码器，切回最近用过的片段不用重新打开
+// - 保温的解码器按最近使用排序，总数和估计的画面内存超过上限时关闭最久未用的；当前片段不淘汰
+// - 没打开过的片段在后台线程上完成avformat_open_input/find_stream_info和解码器的打开（冷打开），
+//   UI线程在poll()里接上纹理和音频设备后才切换过去，等待期间调用方显示占位画面
+// - 当前片段改用预览代理时同样在后台打开代理，就绪后才换下原来的解码器，UI线程不等待文件打开
+// - 除后台线程的openInput之外，所有方法都只在UI线程上调用
+class ClipPool {
+public:
+    enum class Event { None, Ready, Failed, Replaced };
+
+    ClipPool() : m_renderer(nullptr), m_hasActive(false), m_replacing(0), m_memoryLimit(kDefaultMemoryLimit), m_maxClips(kDefaultMaxClips),
+                 m_quit(false), m_warmHits(0), m_coldOpens(0), m_evictions(0) {}
+
+    ~ClipPool() {
+        close();
+    }
+
+    ClipPool(const ClipPool&) = delete;
+    ClipPool& operator=(const ClipPool&) = delete;
+
+    DecoderSettings& settings() {
+        return m_settings;
+    }
+
+    void setRenderer(SDL_Renderer* renderer) {
+        m_renderer = renderer;
+    }
+
+    // 所有保温解码器（含当前片段）估计的画面内存上限（字节）
+    void setMemoryLimit(size_t bytes) {
+        m_memoryLimit = bytes;
+    }
+
+    void setMaxClips(size_t clips) {
+        m_maxClips = std::max<size_t>(1, clips);
+    }
+
+    // 切换到path。已经保温的片段立即成为当前片段并返回true；
+    // 否则交给后台线程打开，返回false，之后由poll()报告结果。当前片段在等待期间被挂起
+    bool request(const std::string& path) {
+        m_loadingPath.clear();
+        if (m_hasActive && m_clips.front().path == path) {
+            return true;
+        }
+        for (auto it = m_clips.begin(); it != m_clips.end(); ++it) {
+            if (it->path == path) {
+                suspendActive();
+                m_clips.splice(m_clips.begin(), m_clips, it);
+                activateFront();
+                m_warmHits++;
+                std::cout << "片段: 切换到保温的 " << path << std::endl;
+                return true;
+            }
+        }
+
+        suspendActive();
+        m_loadingPath = path;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (isOpening(path)) {
+            return false;
+        }
+        Clip clip;
+        clip.path = path;
+        clip.decoder.reset(new VideoDecoder());
+        m_settings.apply(*clip.decoder);
+        enqueue(std::move(clip));
+        m_coldOpens++;
+        return false;
+    }
+
+    // 当前片段改为解码file（预览代理）：在后台打开，就绪后poll()换下当前的解码器并报告Replaced，
+    // 片段仍按原路径登记，效果链和图层沿用当前的。file打不开时继续使用原来的解码器
+    bool replaceActive(const std::string& file) {
+        if (!m_hasActive) {
+            return false;
+        }
+        const Clip& current = m_clips.front();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (isOpening(current.path)) {
+            return false;
+        }
+        Clip clip;
+        clip.path = current.path;
+        clip.file = file;
+        clip.decoder.reset(new VideoDecoder());
+        m_settings.apply(*clip.decoder);
+        clip.decoder->setColorEffects(current.decoder->getColorEffects());
+        clip.decoder->setLayers(current.decoder->getLayers());
+        enqueue(std::move(clip));
+        m_replacing++;
+        return true;
+    }
+
+    // 每次主循环调用：给后台打开完成的解码器接上纹理和音频设备并放进池里
+    // 最近一次request的片段就绪时成为当前片段（Ready）；打开失败时恢复之前的片段（Failed）
+    // 当前片段的替代解码器就绪时换下原来的解码器（Replaced），调用方需要重新取active()并seek回当前位置
+    Event poll() {
+        std::vector<Opened> finished;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            finished.swap(m_finished);
+        }
+        Event event = Event::None;
+        for (Opened& opened : finished) {
+            if (!opened.clip.file.empty()) {
+                m_replacing--;
+                auto it = std::find_if(m_clips.begin(), m_clips.end(), [&](const Clip& clip) { return clip.path == opened.clip.path; });
+                if (it != m_clips.end()) {
+                    if (replace(*it, opened)) {
+                        event = Event::Replaced;
+                    }
+                    continue;
+                }
+                // 原来的片段已经被淘汰：打开的代理当作这个片段的冷打开结果
+            }
+            bool requested = opened.clip.path == m_loadingPath;
+            if (!opened.ok || !opened.clip.decoder->attachOutput(m_renderer)) {
+                std::cerr << "片段: 无法打开 " << opened.clip.path << std::endl;
+                if (requested) {
+                    m_loadingPath.clear();
+                    resumeActive();
+                    event = Event::Failed;
+                }
+                continue;
+            }
+            if (requested) {
+                m_loadingPath.clear();
+                m_clips.push_front(std::move(opened.clip));
+                activateFront();
+                event = Event::Ready;
+            } else {
+                // 被后来的请求取代的片段：打开的成果留着，下次切过去时直接可用
+                // 排在第一个（当前或挂起中的片段）之后
+                opened.clip.decoder->suspend();
+                auto position = m_clips.empty() ? m_clips.begin() : std::next(m_clips.begin());
+                m_clips.insert(position, std::move(opened.clip));
+            }
+        }
+        evict();
+        return event;
+    }
+
+    bool isLoading() const {
+        return !m_loadingPath.empty();
+    }
+
+    // replaceActive()请求的替代文件还有没打开完的
+    bool isReplacing() const {
+        return m_replacing > 0;
+    }
+
+    const std::string& loadingPath() const {
+        return m_loadingPath;
+    }
+
+    bool hasActive() const {
+        return m_hasActive;
+    }
+
+    // 当前片段的解码器；还没有片段时返回一个未打开的解码器，调用方不用判空
+    VideoDecoder& active() {
+        return m_hasActive ? *m_clips.front().decoder : m_empty;
+    }
+
+    const std::string& activePath() const {
+        static const std::string kNone;
+        return m_hasActive ? m_clips.front().path : kNone;
+    }
+
+    size_t clipCount() const {
+        return m_clips.size();
+    }
+
+    size_t memoryBytes() const {
+        size_t total = 0;
+        for (const Clip& clip : m_clips) {
+            total += clip.decoder->getMemoryBytes();
+        }
+        return total;
+    }
+
+    // 停止后台打开并关闭所有解码器；必须在渲染器销毁之前调用
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_cond.notify_all();
+        if (m_worker.joinable()) {
+            m_worker.join();
+        }
+        m_pending.clear();
+        m_finished.clear();
+        m_clips.clear();
+        m_hasActive = false;
+        m_replacing = 0;
+        m_loadingPath.clear();
+    }
+
+    void printStats() const {
+        std::cout << "片段: 保温命中 " << m_warmHits << " 次，冷打开 " << m_coldOpens << " 次，淘汰 " << m_evictions
+                  << " 个，池中 " << m_clips.size() << " 个片段，约 " << memoryBytes() / (1024 * 1024) << "MB" << std::endl;
+    }
+
+    static constexpr size_t kDefaultMemoryLimit = 1024ULL * 1024 * 1024;
+    static constexpr size_t kDefaultMaxClips = 8;
+
+private:
+    struct Clip {
+        std::string path;
+        std::string file;  // 解码器打开的文件，为空时就是path；改用预览代理时是代理文件
+        std::unique_ptr<VideoDecoder> decoder;
+    };
+
+    struct Opened {
+        Clip clip;
+        bool ok;
+    };
+
+    // 调用方持有m_mutex
+    bool isOpening(const std::string& path) const {
+        if (m_opening == path) {
+            return true;
+        }
+        for (const Clip& clip : m_pending) {
+            if (clip.path == path) {
+                return true;
+            }
+        }
+        for (const Opened& opened : m_finished) {
+            if (opened.clip.path == path) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 调用方持有m_mutex
+    void enqueue(Clip clip) {
+        m_pending.push_back(std::move(clip));
+        if (!m_worker.joinable()) {
+            m_quit = false;
+            m_worker = std::thread(&ClipPool::workerLoop, this);
+        }
+        m_cond.notify_one();
+    }
+
+    // 用后台打开的替代解码器换下clip原来的解码器；clip是当前片段时返回true
+    bool replace(Clip& clip, Opened& opened) {
+        bool current = m_hasActive && &clip == &m_clips.front();
+        if (!opened.ok || !opened.clip.decoder->attachOutput(m_renderer)) {
+            std::cerr << "片段: 无法打开 " << opened.clip.file << "，继续使用 " << clip.path << std::endl;
+            return false;
+        }
+        clip.decoder = std::move(opened.clip.decoder);
+        clip.file = opened.clip.file;
+        if (current) {
+            clip.decoder->resume();
+        } else {
+            clip.decoder->suspend();
+        }
+        return current;
+    }
+
+    void suspendActive() {
+        if (m_hasActive) {
+            m_clips.front().decoder->suspend();
+            m_hasActive = false;
+        }
+    }
+
+    // 冷打开失败时回到挂起之前的片段
+    void resumeActive() {
+        if (!m_hasActive && !m_clips.empty()) {
+            activateFront();
+        }
+    }
+
+    void activateFront() {
+        m_clips.front().decoder->resume();
+        m_hasActive = true;
+    }
+
+    // 从最久未用的一端关闭，直到个数和内存都不超过上限；第一个（当前或冷打开期间挂起的片段）不淘汰
+    void evict() {
+        size_t total = memoryBytes();
+        while (m_clips.size() > 1 && (m_clips.size() > m_maxClips || total > m_memoryLimit)) {
+            Clip& victim = m_clips.back();
+            size_t bytes = victim.decoder->getMemoryBytes();
+            std::cout << "片段: 淘汰 " << victim.path << "（约 " << bytes / (1024 * 1024) << "MB）" << std::endl;
+            m_clips.pop_back();
+            total -= std::min(total, bytes);
+            m_evictions++;
+        }
+    }
+
+    void workerLoop() {
+        Profiler::setThreadName("clip_open");
+        while (true) {
+            Clip clip;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() { return m_quit || !m_pending.empty(); });
+                if (m_quit) {
+                    return;
+                }
+                clip = std::move(m_pending.front());
+                m_pending.pop_front();
+                m_opening = clip.path;
+            }
+            bool ok;
+            {
+                ProfileScope scope("clip_open");
+                ok = clip.decoder->openInput(clip.file.empty() ? clip.path : clip.file);
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_opening.clear();
+            m_finished.push_back({ std::move(clip), ok });
+        }
+    }
+
+    DecoderSettings m_settings;
+    SDL_Renderer* m_renderer;
+    std::list<Clip> m_clips;     // 打开着的片段，最近使用的在前；m_hasActive时第一个是当前片段
+    bool m_hasActive;
+    size_t m_replacing;          // 正在后台打开的替代文件个数
+    std::string m_loadingPath;   // 正在等待冷打开完成、完成后要切换过去的片段
+    VideoDecoder m_empty;
+    size_t m_memoryLimit;
+    size_t m_maxClips;
+
+    std::mutex m_mutex;          // 保护以下与后台线程共享的成员
+    std::condition_variable m_cond;
+    std::deque<Clip> m_pending;
+    std::string m_opening;
+    std::vector<Opened> m_finished;
+    bool m_quit;
+    std::thread m_worker;
+
+    uint64_t m_warmHits;
+    uint64_t m_coldOpens;
+    uint64_t m_evictions;
+};
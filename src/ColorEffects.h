@@ -0,0 +1,714 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include "BlendKernels.h"
+#include "DecoderThreading.h"
+#include "Profiler.h"
+#include "WorkerPool.h"
+
+// .cube格式的RGB三维查找表（Adobe/Resolve导出的调色LUT），值域0..1
+struct CubeLut {
+    std::string title;
+    int size = 0;
+    std::vector<float> rgb;  // size^3个RGB，红色变化最快
+
+    // 只支持LUT_3D_SIZE，DOMAIN_MIN/MAX必须是默认的0..1
+    static bool load(const std::string& path, CubeLut& lut) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "调色: 无法打开LUT文件 " << path << std::endl;
+            return false;
+        }
+        lut = CubeLut();
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream fields(line);
+            std::string key;
+            if (!(fields >> key) || key[0] == '#') {
+                continue;
+            }
+            if (key == "TITLE") {
+                size_t quote = line.find('"');
+                lut.title = quote == std::string::npos ? "" : line.substr(quote + 1, line.find_last_of('"') - quote - 1);
+            } else if (key == "LUT_3D_SIZE") {
+                fields >> lut.size;
+                if (lut.size < 2 || lut.size > 256) {
+                    std::cerr << "调色: 不支持的LUT尺寸 " << lut.size << std::endl;
+                    return false;
+                }
+                lut.rgb.reserve((size_t)lut.size * lut.size * lut.size * 3);
+            } else if (key == "DOMAIN_MIN" || key == "DOMAIN_MAX") {
+                float a = 0.0f, b = 0.0f, c = 0.0f;
+                fields >> a >> b >> c;
+                float expected = key == "DOMAIN_MIN" ? 0.0f : 1.0f;
+                if (a != expected || b != expected || c != expected) {
+                    std::cerr << "调色: 不支持自定义的LUT定义域 " << path << std::endl;
+                    return false;
+                }
+            } else if (key == "LUT_1D_SIZE") {
+                std::cerr << "调色: 不支持一维LUT " << path << std::endl;
+                return false;
+            } else {
+                float g = 0.0f, b = 0.0f;
+                if (!(fields >> g >> b)) {
+                    std::cerr << "调色: 无法解析LUT中的行: " << line << std::endl;
+                    return false;
+                }
+                lut.rgb.push_back(std::strtof(key.c_str(), nullptr));
+                lut.rgb.push_back(g);
+                lut.rgb.push_back(b);
+            }
+        }
+        if (lut.size == 0 || lut.rgb.size() != (size_t)lut.size * lut.size * lut.size * 3) {
+            std::cerr << "调色: LUT数据不完整 " << path << std::endl;
+            return false;
+        }
+        if (lut.title.empty()) {
+            lut.title = path;
+        }
+        return true;
+    }
+
+    // 三线性插值，输入先截断到0..1
+    void sample(const float in[3], float out[3]) const {
+        int index[3];
+        float frac[3];
+        for (int c = 0; c < 3; c++) {
+            float position = std::clamp(in[c], 0.0f, 1.0f) * (size - 1);
+            index[c] = std::min((int)position, size - 2);
+            frac[c] = position - index[c];
+        }
+        for (int c = 0; c < 3; c++) {
+            auto at = [&](int r, int g, int b) {
+                return rgb[(((size_t)(index[2] + b) * size + index[1] + g) * size + index[0] + r) * 3 + c];
+            };
+            float c00 = at(0, 0, 0) + (at(1, 0, 0) - at(0, 0, 0)) * frac[0];
+            float c10 = at(0, 1, 0) + (at(1, 1, 0) - at(0, 1, 0)) * frac[0];
+            float c01 = at(0, 0, 1) + (at(1, 0, 1) - at(0, 0, 1)) * frac[0];
+            float c11 = at(0, 1, 1) + (at(1, 1, 1) - at(0, 1, 1)) * frac[0];
+            float c0 = c00 + (c10 - c00) * frac[1];
+            float c1 = c01 + (c11 - c01) * frac[1];
+            out[c] = c0 + (c1 - c0) * frac[2];
+        }
+    }
+};
+
+enum class ColorEffectType {
+    Adjust,  // 亮度/对比度/饱和度
+    Gamma,   // 亮度的gamma曲线
+    Lut3D    // RGB三维查找表
+};
+
+inline const char* colorEffectName(ColorEffectType type) {
+    switch (type) {
+        case ColorEffectType::Adjust: return "adjust";
+        case ColorEffectType::Gamma: return "gamma";
+        case ColorEffectType::Lut3D: return "lut3d";
+    }
+    return "adjust";
+}
+
+// 效果链中的一个效果；亮度按有效范围归一化到0..1，色度归一化到-0.5..0.5后计算
+struct ColorEffect {
+    ColorEffectType type = ColorEffectType::Adjust;
+    bool enabled = true;
+    float brightness = 0.0f;  // 亮度偏移，-1..1
+    float contrast = 1.0f;    // 围绕中灰缩放亮度
+    float saturation = 1.0f;  // 缩放色度
+    float gamma = 1.0f;       // 亮度 n -> n^(1/gamma)，大于1提亮暗部
+    std::shared_ptr<const CubeLut> lut;
+
+    static ColorEffect adjust(float brightness, float contrast, float saturation) {
+        ColorEffect effect;
+        effect.brightness = brightness;
+        effect.contrast = contrast;
+        effect.saturation = saturation;
+        return effect;
+    }
+
+    static ColorEffect gammaCurve(float gamma) {
+        ColorEffect effect;
+        effect.type = ColorEffectType::Gamma;
+        effect.gamma = gamma;
+        return effect;
+    }
+
+    static ColorEffect lut3d(std::shared_ptr<const CubeLut> lut) {
+        ColorEffect effect;
+        effect.type = ColorEffectType::Lut3D;
+        effect.lut = std::move(lut);
+        return effect;
+    }
+};
+
+// 片段的效果链，按顺序作用
+using ColorChain = std::vector<ColorEffect>;
+
+// 解析一个效果参数，arg不是效果参数时返回false且不消耗value
+// --brightness F / --contrast F / --saturation F / --gamma F / --lut FILE.cube，按命令行顺序加入效果链
+inline bool parseColorEffectArg(const std::string& arg, const char* value, ColorChain& chain, bool& ok) {
+    ok = true;
+    if (arg == "--brightness" || arg == "--contrast" || arg == "--saturation") {
+        float amount = (float)std::atof(value);
+        chain.push_back(ColorEffect::adjust(arg == "--brightness" ? amount : 0.0f, arg == "--contrast" ? amount : 1.0f,
+                                            arg == "--saturation" ? amount : 1.0f));
+    } else if (arg == "--gamma") {
+        float gamma = (float)std::atof(value);
+        ok = gamma > 0.0f;
+        if (!ok) {
+            std::cerr << "调色: gamma必须大于0: " << value << std::endl;
+            return true;
+        }
+        chain.push_back(ColorEffect::gammaCurve(gamma));
+    } else if (arg == "--lut") {
+        auto lut = std::make_shared<CubeLut>();
+        ok = CubeLut::load(value, *lut);
+        if (ok) {
+            chain.push_back(ColorEffect::lut3d(std::move(lut)));
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// 链中有没有会改变画面的效果
+inline bool colorChainActive(const ColorChain& chain) {
+    for (const ColorEffect& effect : chain) {
+        if (effect.enabled) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// YUV平面上的调色内核，原地写入
+// - 一维效果（亮度/对比度/饱和度/gamma）预先合成每个平面一张256项的查找表，每个字节查一次
+// - 三维LUT预先换算成YUV空间中17x17x17的格点（每个格点打包Y/U/V三个字节），按像素的Y/U/V做三线性插值
+//   格点间距16，插值权重就是每个分量的低4位：先沿Y、再沿U、最后沿V插值，(x + 2048) >> 12 取整
+// - 全部用整数运算，标量和SIMD版本逐字节结果相同
+namespace color {
+
+constexpr int kCubeSize = 17;
+constexpr int kCubePlane = kCubeSize * kCubeSize;
+
+inline void lutScalar(uint8_t* row, int count, const uint8_t* table) {
+    for (int i = 0; i < count; i++) {
+        row[i] = table[row[i]];
+    }
+}
+
+inline int lerp16(int a, int b, int f) {
+    return (a << 4) + (b - a) * f;
+}
+
+// 8个角的打包值中取出一个通道做三线性插值
+inline int cubeChannel(const uint32_t* corner, int shift, int fy, int fu, int fv) {
+    auto at = [&](int offset) { return (int)((corner[offset] >> shift) & 0xFF); };
+    int c00 = lerp16(at(0), at(1), fy);
+    int c10 = lerp16(at(kCubeSize), at(kCubeSize + 1), fy);
+    int c01 = lerp16(at(kCubePlane), at(kCubePlane + 1), fy);
+    int c11 = lerp16(at(kCubePlane + kCubeSize), at(kCubePlane + kCubeSize + 1), fy);
+    return (lerp16(lerp16(c00, c10, fu), lerp16(c01, c11, fu), fv) + 2048) >> 12;
+}
+
+inline const uint32_t* cubeCell(const uint32_t* lattice, int y, int u, int v) {
+    return lattice + ((v >> 4) * kCubeSize + (u >> 4)) * kCubeSize + (y >> 4);
+}
+
+// 亮度行：第x个像素使用色度的第x/2个样本（4:2:0），只写回Y
+inline void cubeLumaScalar(const uint32_t* lattice, uint8_t* y, const uint8_t* u, const uint8_t* v, int count) {
+    for (int i = 0; i < count; i++) {
+        int uu = u[i >> 1], vv = v[i >> 1];
+        y[i] = (uint8_t)cubeChannel(cubeCell(lattice, y[i], uu, vv), 0, y[i] & 15, uu & 15, vv & 15);
+    }
+}
+
+// 色度行：第i个样本使用同位亮度y[2i]，写回U和V
+inline void cubeChromaScalar(const uint32_t* lattice, const uint8_t* y, uint8_t* u, uint8_t* v, int count) {
+    for (int i = 0; i < count; i++) {
+        int yy = y[i * 2], uu = u[i], vv = v[i];
+        const uint32_t* corner = cubeCell(lattice, yy, uu, vv);
+        u[i] = (uint8_t)cubeChannel(corner, 8, yy & 15, uu & 15, vv & 15);
+        v[i] = (uint8_t)cubeChannel(corner, 16, yy & 15, uu & 15, vv & 15);
+    }
+}
+
+#ifdef BLEND_X86
+
+// 256项查找表：按高4位分成16张16项的小表，每张用pshufb按低4位查
+// 第t张表时把值减去16t再饱和加0x70：只有落在这张表里的字节最高位为0，其余字节pshufb查出0，按位或起来就是结果
+BLEND_TARGET_AVX2 inline void lutAvx2(uint8_t* row, int count, const uint8_t* table) {
+    const __m256i bias = _mm256_set1_epi8(0x70);
+    const __m256i step = _mm256_set1_epi8(0x10);
+    int i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(row + i));
+        __m256i result = _mm256_setzero_si256();
+        for (int t = 0; t < 16; t++) {
+            __m256i part = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(table + t * 16)));
+            result = _mm256_or_si256(result, _mm256_shuffle_epi8(part, _mm256_adds_epu8(x, bias)));
+            x = _mm256_sub_epi8(x, step);
+        }
+        _mm256_storeu_si256((__m256i*)(row + i), result);
+    }
+    lutScalar(row + i, count - i, table);
+}
+
+BLEND_TARGET_AVX2 inline __m256i lerp16Avx2(__m256i a, __m256i b, __m256i f) {
+    return _mm256_add_epi32(_mm256_slli_epi32(a, 4), _mm256_mullo_epi32(_mm256_sub_epi32(b, a), f));
+}
+
+// 8个像素的格点：gather出8个角的打包值，权重为各分量的低4位
+struct CubeGather {
+    __m256i corner[8];
+    __m256i fy, fu, fv;
+};
+
+BLEND_TARGET_AVX2 inline void cubeGatherAvx2(const uint32_t* lattice, __m256i y, __m256i u, __m256i v, CubeGather& g) {
+    static const int kOffsets[8] = { 0, 1, kCubeSize, kCubeSize + 1,
+                                     kCubePlane, kCubePlane + 1, kCubePlane + kCubeSize, kCubePlane + kCubeSize + 1 };
+    const __m256i low = _mm256_set1_epi32(15);
+    const __m256i size = _mm256_set1_epi32(kCubeSize);
+    g.fy = _mm256_and_si256(y, low);
+    g.fu = _mm256_and_si256(u, low);
+    g.fv = _mm256_and_si256(v, low);
+    __m256i index = _mm256_add_epi32(
+        _mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(v, 4), size), _mm256_srli_epi32(u, 4)), size),
+        _mm256_srli_epi32(y, 4));
+    for (int k = 0; k < 8; k++) {
+        g.corner[k] = _mm256_i32gather_epi32((const int*)lattice, _mm256_add_epi32(index, _mm256_set1_epi32(kOffsets[k])), 4);
+    }
+}
+
+BLEND_TARGET_AVX2 inline __m256i cubeChannelAvx2(const CubeGather& g, int shift) {
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    __m256i c[8];
+    for (int k = 0; k < 8; k++) {
+        c[k] = _mm256_and_si256(_mm256_srl_epi32(g.corner[k], count), mask);
+    }
+    __m256i c00 = lerp16Avx2(c[0], c[1], g.fy);
+    __m256i c10 = lerp16Avx2(c[2], c[3], g.fy);
+    __m256i c01 = lerp16Avx2(c[4], c[5], g.fy);
+    __m256i c11 = lerp16Avx2(c[6], c[7], g.fy);
+    __m256i r = lerp16Avx2(lerp16Avx2(c00, c10, g.fu), lerp16Avx2(c01, c11, g.fu), g.fv);
+    return _mm256_srli_epi32(_mm256_add_epi32(r, _mm256_set1_epi32(2048)), 12);
+}
+
+// 8个0..255的32位值写成8个字节
+BLEND_TARGET_AVX2 inline void storeBytesAvx2(uint8_t* dst, __m256i values) {
+    __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(values, values), _mm256_setzero_si256());
+    packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+    _mm_storel_epi64((__m128i*)dst, _mm256_castsi256_si128(packed));
+}
+
+// 4个色度样本各复制一次，对应8个亮度像素
+BLEND_TARGET_AVX2 inline __m256i loadChromaPairsAvx2(const uint8_t* src) {
+    int32_t bytes;
+    std::memcpy(&bytes, src, sizeof(bytes));
+    __m128i c = _mm_cvtsi32_si128(bytes);
+    return _mm256_cvtepu8_epi32(_mm_unpacklo_epi8(c, c));
+}
+
+BLEND_TARGET_AVX2 inline void cubeLumaAvx2(const uint32_t* lattice, uint8_t* y, const uint8_t* u, const uint8_t* v, int count) {
+    CubeGather g;
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i yy = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(y + i)));
+        cubeGatherAvx2(lattice, yy, loadChromaPairsAvx2(u + i / 2), loadChromaPairsAvx2(v + i / 2), g);
+        storeBytesAvx2(y + i, cubeChannelAvx2(g, 0));
+    }
+    cubeLumaScalar(lattice, y + i, u + i / 2, v + i / 2, count - i);
+}
+
+BLEND_TARGET_AVX2 inline void cubeChromaAvx2(const uint32_t* lattice, const uint8_t* y, uint8_t* u, uint8_t* v, int count) {
+    CubeGather g;
+    int i = 0;
+    // 每次读16个亮度字节取偶数位；多留一个样本给标量收尾，奇数宽度时不会读出亮度行之外
+    for (; i + 9 <= count; i += 8) {
+        __m128i even = _mm_and_si128(_mm_loadu_si128((const __m128i*)(y + i * 2)), _mm_set1_epi16(0x00FF));
+        __m256i uu = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(u + i)));
+        __m256i vv = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(v + i)));
+        cubeGatherAvx2(lattice, _mm256_cvtepu16_epi32(even), uu, vv, g);
+        storeBytesAvx2(u + i, cubeChannelAvx2(g, 8));
+        storeBytesAvx2(v + i, cubeChannelAvx2(g, 16));
+    }
+    cubeChromaScalar(lattice, y + i * 2, u + i, v + i, count - i);
+}
+
+#endif  // BLEND_X86
+
+}  // namespace color
+
+// 一组调色内核，运行时按CPU支持的指令集选择
+// SSE2没有字节查表（pshufb）和gather，只提供标量和AVX2两种实现
+struct ColorKernels {
+    using LutFunction = void (*)(uint8_t* row, int count, const uint8_t* table);
+    using CubeLumaFunction = void (*)(const uint32_t* lattice, uint8_t* y, const uint8_t* u, const uint8_t* v, int count);
+    using CubeChromaFunction = void (*)(const uint32_t* lattice, const uint8_t* y, uint8_t* u, uint8_t* v, int count);
+
+    const char* name;
+    LutFunction lut;
+    CubeLumaFunction cubeLuma;
+    CubeChromaFunction cubeChroma;
+
+    static const ColorKernels& scalar() {
+        static const ColorKernels kernels = { "scalar", &color::lutScalar, &color::cubeLumaScalar, &color::cubeChromaScalar };
+        return kernels;
+    }
+
+    static const ColorKernels& best() {
+        static const ColorKernels& kernels = *available().back();
+        return kernels;
+    }
+
+    // 当前CPU可用的全部实现，从慢到快
+    static std::vector<const ColorKernels*> available() {
+        std::vector<const ColorKernels*> result = { &scalar() };
+#ifdef BLEND_X86
+        static const ColorKernels avx2 = { "avx2", &color::lutAvx2, &color::cubeLumaAvx2, &color::cubeChromaAvx2 };
+        if (BlendKernels::cpuHasAvx2()) {
+            result.push_back(&avx2);
+        }
+#endif
+        return result;
+    }
+
+    static const ColorKernels* find(const std::string& name) {
+        for (const ColorKernels* kernels : available()) {
+            if (name == kernels->name) {
+                return kernels;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// 片段的调色效果栈：在解码出的YUV平面上原地执行效果链，预览（解码线程）和导出（工作线程）共用
+// - 支持YUV420P/YUVJ420P/NV12；效果链在第一次用到或颜色参数（范围、矩阵）变化时编译成若干级：
+//   相邻的一维效果合成一级（每个平面一张查找表），相邻的三维LUT合成一级（一组YUV格点）
+// - 画面按行切成条带在线程池上并行，每个条带依次执行所有级；条带高度是偶数，色度行不跨条带
+// - setChain可以在其他线程调用，下一次apply时生效
+class ColorEffectStack {
+public:
+    explicit ColorEffectStack(int threads = 0)
+        : m_threads(threads > 0 ? threads : ThreadBudget::instance().totalCores()), m_kernels(&ColorKernels::best()),
+          m_changed(false), m_active(false), m_compiledFull(false), m_compiledBt709(false), m_compiled(false),
+          m_lastMs(0.0) {}
+
+    ColorEffectStack(const ColorEffectStack&) = delete;
+    ColorEffectStack& operator=(const ColorEffectStack&) = delete;
+
+    static bool supportsFormat(int format) {
+        return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P || format == AV_PIX_FMT_NV12;
+    }
+
+    // 按源视频流的色彩空间选择矩阵，没有标注时按源的编码高度推断（720及以上按BT.709）；
+    // 预览缩小后的帧高度不能用来推断，否则预览和导出的调色结果不一致
+    static bool sourceIsBt709(AVColorSpace colorspace, int sourceHeight) {
+        return colorspace == AVCOL_SPC_BT709 ||
+               (colorspace != AVCOL_SPC_BT470BG && colorspace != AVCOL_SPC_SMPTE170M && sourceHeight >= 720);
+    }
+
+    void setChain(const ColorChain& chain) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = chain;
+        m_changed = true;
+    }
+
+    ColorChain chain() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_changed ? m_pending : m_chain;
+    }
+
+    // 效果链中有启用的效果
+    bool active() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return colorChainActive(m_changed ? m_pending : m_chain);
+    }
+
+    void setKernels(const ColorKernels& kernels) {
+        m_kernels = &kernels;
+    }
+
+    const ColorKernels& kernels() const {
+        return *m_kernels;
+    }
+
+    int threads() const {
+        return m_threads;
+    }
+
+    // 上一次apply()的耗时（毫秒）
+    double lastMilliseconds() const {
+        return m_lastMs;
+    }
+
+    // 在frame上原地执行效果链；frame必须可写，bt709由sourceIsBt709按源视频流得出。不支持的像素格式返回false，画面不变
+    bool apply(AVFrame* frame, bool bt709) {
+        ProfileScope scope("color_effects");
+        auto begin = std::chrono::steady_clock::now();
+        if (!frame || !supportsFormat(frame->format)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_changed) {
+                m_chain.swap(m_pending);
+                m_changed = false;
+                m_compiled = false;
+                m_active = colorChainActive(m_chain);
+            }
+        }
+        if (!m_active) {
+            return true;
+        }
+
+        bool full = frame->color_range == AVCOL_RANGE_JPEG || frame->format == AV_PIX_FMT_YUVJ420P;
+        if (!m_compiled || full != m_compiledFull || bt709 != m_compiledBt709) {
+            compile(full, bt709);
+        }
+        if (m_stages.empty()) {
+            return true;
+        }
+
+        if (!m_pool) {
+            m_pool.reset(new WorkerPool(m_threads, "color"));
+        }
+        int slices = (frame->height + kSliceRows - 1) / kSliceRows;
+        m_scratch.resize((size_t)slices * 4 * ((frame->width + 1) / 2));
+        m_pool->parallelFor(slices, [&](int slice) { processSlice(frame, slice); });
+        m_lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return true;
+    }
+
+private:
+    // 编译后的一级：一维查找表或三维格点
+    struct Stage {
+        bool cube = false;
+        bool lumaActive = false;
+        bool chromaActive = false;
+        std::array<uint8_t, 256> luma;
+        std::array<uint8_t, 256> chroma;
+        std::vector<uint32_t> lattice;  // kCubeSize^3个格点，Y变化最快；每个格点 Y | U << 8 | V << 16
+    };
+
+    static constexpr int kSliceRows = 32;  // 条带高度，必须是偶数，保证色度行不跨条带
+
+    // 按范围把字节值归一化：亮度0..1，色度-0.5..0.5
+    struct Range {
+        float lumaBlack, lumaScale, chromaScale;
+
+        explicit Range(bool full)
+            : lumaBlack(full ? 0.0f : 16.0f), lumaScale(full ? 255.0f : 219.0f), chromaScale(full ? 255.0f : 224.0f) {}
+
+        float luma(float code) const { return (code - lumaBlack) / lumaScale; }
+        float chroma(float code) const { return (code - 128.0f) / chromaScale; }
+        int lumaCode(float n) const { return std::clamp((int)std::lround(n * lumaScale + lumaBlack), 0, 255); }
+        int chromaCode(float c) const { return std::clamp((int)std::lround(c * chromaScale + 128.0f), 0, 255); }
+    };
+
+    static float applyLuma(const ColorEffect& effect, float n) {
+        if (effect.type == ColorEffectType::Adjust) {
+            return (n - 0.5f) * effect.contrast + 0.5f + effect.brightness;
+        }
+        return std::pow(std::max(0.0f, n), 1.0f / effect.gamma);
+    }
+
+    static float applyChroma(const ColorEffect& effect, float c) {
+        return effect.type == ColorEffectType::Adjust ? c * effect.saturation : c;
+    }
+
+    // 相邻的一维效果从浮点值一路算下来，最后才取整，合成后只有一次舍入
+    static void compileLut(const ColorChain& chain, size_t first, size_t last, const Range& range, Stage& stage) {
+        for (int code = 0; code < 256; code++) {
+            float n = range.luma((float)code);
+            float c = range.chroma((float)code);
+            for (size_t i = first; i < last; i++) {
+                if (chain[i].enabled) {
+                    n = applyLuma(chain[i], n);
+                    c = applyChroma(chain[i], c);
+                }
+            }
+            stage.luma[code] = (uint8_t)range.lumaCode(n);
+            stage.chroma[code] = (uint8_t)range.chromaCode(c);
+            stage.lumaActive |= stage.luma[code] != code;
+            stage.chromaActive |= stage.chroma[code] != code;
+        }
+    }
+
+    // 每个YUV格点换成RGB，依次经过相邻的LUT，再换回YUV；最后一个格点落在256，是插值用的外延点
+    static void compileCube(const ColorChain& chain, size_t first, size_t last, const Range& range, bool bt709, Stage& stage) {
+        const float kr = bt709 ? 0.2126f : 0.299f;
+        const float kb = bt709 ? 0.0722f : 0.114f;
+        const float kg = 1.0f - kr - kb;
+        stage.cube = true;
+        stage.lattice.resize((size_t)color::kCubePlane * color::kCubeSize);
+        for (int v = 0; v < color::kCubeSize; v++) {
+            for (int u = 0; u < color::kCubeSize; u++) {
+                for (int y = 0; y < color::kCubeSize; y++) {
+                    float yn = range.luma(y * 16.0f);
+                    float cb = range.chroma(u * 16.0f);
+                    float cr = range.chroma(v * 16.0f);
+                    float rgb[3];
+                    rgb[0] = yn + 2.0f * (1.0f - kr) * cr;
+                    rgb[2] = yn + 2.0f * (1.0f - kb) * cb;
+                    rgb[1] = (yn - kr * rgb[0] - kb * rgb[2]) / kg;
+                    for (size_t i = first; i < last; i++) {
+                        if (chain[i].enabled && chain[i].lut) {
+                            float mapped[3];
+                            chain[i].lut->sample(rgb, mapped);
+                            std::copy(mapped, mapped + 3, rgb);
+                        }
+                    }
+                    float outY = kr * rgb[0] + kg * rgb[1] + kb * rgb[2];
+                    uint32_t packed = (uint32_t)range.lumaCode(outY) |
+                                      (uint32_t)range.chromaCode((rgb[2] - outY) / (2.0f * (1.0f - kb))) << 8 |
+                                      (uint32_t)range.chromaCode((rgb[0] - outY) / (2.0f * (1.0f - kr))) << 16;
+                    stage.lattice[((size_t)v * color::kCubeSize + u) * color::kCubeSize + y] = packed;
+                }
+            }
+        }
+    }
+
+    void compile(bool full, bool bt709) {
+        Range range(full);
+        m_stages.clear();
+        size_t i = 0;
+        while (i < m_chain.size()) {
+            bool cube = m_chain[i].type == ColorEffectType::Lut3D;
+            size_t end = i;
+            while (end < m_chain.size() && (m_chain[end].type == ColorEffectType::Lut3D) == cube) {
+                end++;
+            }
+            Stage stage;
+            if (cube) {
+                bool any = false;
+                for (size_t k = i; k < end; k++) {
+                    any |= m_chain[k].enabled && m_chain[k].lut;
+                }
+                if (any) {
+                    compileCube(m_chain, i, end, range, bt709, stage);
+                    m_stages.push_back(std::move(stage));
+                }
+            } else {
+                compileLut(m_chain, i, end, range, stage);
+                if (stage.lumaActive || stage.chromaActive) {
+                    m_stages.push_back(std::move(stage));
+                }
+            }
+            i = end;
+        }
+        m_compiled = true;
+        m_compiledFull = full;
+        m_compiledBt709 = bt709;
+    }
+
+    void processSlice(AVFrame* frame, int slice) {
+        ProfileScope scope("color_slice");
+        const ColorKernels& kernels = *m_kernels;
+        bool nv12 = frame->format == AV_PIX_FMT_NV12;
+        int width = frame->width;
+        int chromaWidth = (width + 1) / 2;
+        int rowBegin = slice * kSliceRows;
+        int rowEnd = std::min(frame->height, rowBegin + kSliceRows);
+        int chromaBegin = rowBegin / 2;
+        int chromaEnd = (rowEnd + 1) / 2;
+        uint8_t* scratch = m_scratch.data() + (size_t)slice * 4 * chromaWidth;
+
+        for (const Stage& stage : m_stages) {
+            if (!stage.cube) {
+                if (stage.lumaActive) {
+                    for (int y = rowBegin; y < rowEnd; y++) {
+                        kernels.lut(frame->data[0] + (size_t)y * frame->linesize[0], width, stage.luma.data());
+                    }
+                }
+                if (stage.chromaActive) {
+                    for (int y = chromaBegin; y < chromaEnd; y++) {
+                        if (nv12) {
+                            kernels.lut(frame->data[1] + (size_t)y * frame->linesize[1], chromaWidth * 2, stage.chroma.data());
+                        } else {
+                            kernels.lut(frame->data[1] + (size_t)y * frame->linesize[1], chromaWidth, stage.chroma.data());
+                            kernels.lut(frame->data[2] + (size_t)y * frame->linesize[2], chromaWidth, stage.chroma.data());
+                        }
+                    }
+                }
+                continue;
+            }
+
+            // 色度用原始的同位亮度、亮度用原始的色度：先留一份原始色度，再写色度，最后写这一对亮度行
+            const uint32_t* lattice = stage.lattice.data();
+            uint8_t* originalU = scratch;
+            uint8_t* originalV = scratch + chromaWidth;
+            for (int y = chromaBegin; y < chromaEnd; y++) {
+                uint8_t* luma0 = frame->data[0] + (size_t)(y * 2) * frame->linesize[0];
+                uint8_t* luma1 = y * 2 + 1 < frame->height ? luma0 + frame->linesize[0] : nullptr;
+                uint8_t* u;
+                uint8_t* v;
+                uint8_t* interleaved = nullptr;
+                if (nv12) {
+                    interleaved = frame->data[1] + (size_t)y * frame->linesize[1];
+                    u = scratch + chromaWidth * 2;
+                    v = scratch + chromaWidth * 3;
+                    for (int x = 0; x < chromaWidth; x++) {
+                        u[x] = originalU[x] = interleaved[x * 2];
+                        v[x] = originalV[x] = interleaved[x * 2 + 1];
+                    }
+                } else {
+                    u = frame->data[1] + (size_t)y * frame->linesize[1];
+                    v = frame->data[2] + (size_t)y * frame->linesize[2];
+                    std::memcpy(originalU, u, chromaWidth);
+                    std::memcpy(originalV, v, chromaWidth);
+                }
+                kernels.cubeChroma(lattice, luma0, u, v, chromaWidth);
+                if (interleaved) {
+                    for (int x = 0; x < chromaWidth; x++) {
+                        interleaved[x * 2] = u[x];
+                        interleaved[x * 2 + 1] = v[x];
+                    }
+                }
+                kernels.cubeLuma(lattice, luma0, originalU, originalV, width);
+                if (luma1) {
+                    kernels.cubeLuma(lattice, luma1, originalU, originalV, width);
+                }
+            }
+        }
+    }
+
+    int m_threads;
+    std::unique_ptr<WorkerPool> m_pool;  // 第一次有效果要执行时才创建，没有调色的片段不占线程
+    const ColorKernels* m_kernels;
+
+    mutable std::mutex m_mutex;          // 保护m_pending和m_changed
+    ColorChain m_pending;
+    bool m_changed;
+
+    // 以下只在apply的线程上访问
+    ColorChain m_chain;
+    bool m_active;
+    bool m_compiledFull;
+    bool m_compiledBt709;
+    bool m_compiled;
+    std::vector<Stage> m_stages;
+    std::vector<uint8_t> m_scratch;      // 每个条带4行色度宽度的临时缓冲区
+    double m_lastMs;
+};
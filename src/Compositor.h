@@ -0,0 +1,490 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include "BlendKernels.h"
+#include "DecoderThreading.h"
+#include "MediaQueue.h"
+#include "Profiler.h"
+#include "ScalerCache.h"
+#include "WorkerPool.h"
+
+// 图层在画布上的位置和尺寸（像素），尺寸为0时使用图层图像的尺寸
+struct LayerTransform {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+struct CompositeLayer {
+    const AVFrame* frame = nullptr;  // 与画布相同的像素格式
+    LayerTransform transform;
+    float opacity = 1.0f;
+    BlendMode mode = BlendMode::Normal;
+    bool visible = true;
+};
+
+// CPU多图层合成：图层按顺序从下往上原地混合到画布上
+// - 画布和图层为YUV420P或RGBA；YUV上add/multiply/screen作用于亮度，色度按normal以同样的不透明度混合
+// - 尺寸与变换不同的图层先各自缩放（多个图层并行），再把画布按行切成条带，每个条带依次混合所有图层
+// - 内核在运行时按CPU选择（scalar/sse2/avx2），结果逐字节相同，预览和导出不依赖GPU
+class Compositor {
+public:
+    explicit Compositor(int threads = 0)
+        : m_pool(threads > 0 ? threads : ThreadBudget::instance().totalCores(), "composite"),
+          m_kernels(&BlendKernels::best()), m_lastMs(0.0) {}
+
+    Compositor(const Compositor&) = delete;
+    Compositor& operator=(const Compositor&) = delete;
+
+    static bool supportsFormat(int format) {
+        return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P || format == AV_PIX_FMT_RGBA;
+    }
+
+    void setKernels(const BlendKernels& kernels) {
+        m_kernels = &kernels;
+    }
+
+    const BlendKernels& kernels() const {
+        return *m_kernels;
+    }
+
+    int threads() const {
+        return m_pool.threads();
+    }
+
+    // 上一次composite()的耗时（毫秒）
+    double lastMilliseconds() const {
+        return m_lastMs;
+    }
+
+    // 把layers依次混合到canvas上；canvas必须可写
+    bool composite(AVFrame* canvas, const std::vector<CompositeLayer>& layers) {
+        ProfileScope scope("composite");
+        auto begin = std::chrono::steady_clock::now();
+        if (!canvas || !supportsFormat(canvas->format)) {
+            return false;
+        }
+        if (!prepare(canvas, layers)) {
+            return false;
+        }
+
+        int tiles = (canvas->height + kTileRows - 1) / kTileRows;
+        m_pool.parallelFor(tiles, [&](int tile) { blendTile(canvas, tile); });
+        m_lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return true;
+    }
+
+private:
+    // 缩放后落在画布坐标系中的图层
+    struct Placed {
+        const AVFrame* frame;
+        int x, y, width, height;
+        int opacity;  // 0..256
+        BlendMode mode;
+    };
+
+    static constexpr int kTileRows = 32;  // 条带高度，必须是偶数，保证色度行不跨条带
+
+    static bool isYuv(int format) {
+        return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P;
+    }
+
+    bool prepare(const AVFrame* canvas, const std::vector<CompositeLayer>& layers) {
+        bool yuv = isYuv(canvas->format);
+        m_placed.clear();
+        std::vector<size_t> needsScaling;
+        for (const CompositeLayer& layer : layers) {
+            if (!layer.visible || !layer.frame || layer.opacity <= 0.0f) {
+                continue;
+            }
+            if (isYuv(layer.frame->format) != yuv || (!yuv && layer.frame->format != canvas->format)) {
+                return false;
+            }
+            Placed placed;
+            placed.frame = layer.frame;
+            placed.x = layer.transform.x;
+            placed.y = layer.transform.y;
+            placed.width = layer.transform.width > 0 ? layer.transform.width : layer.frame->width;
+            placed.height = layer.transform.height > 0 ? layer.transform.height : layer.frame->height;
+            if (yuv) {
+                // 4:2:0的色度按2x2对齐
+                placed.x &= ~1;
+                placed.y &= ~1;
+                placed.width &= ~1;
+                placed.height &= ~1;
+            }
+            placed.opacity = std::clamp((int)std::lround(layer.opacity * 256.0f), 0, 256);
+            placed.mode = layer.mode;
+            if (placed.width <= 0 || placed.height <= 0) {
+                continue;
+            }
+            // YUV图层奇数的最后一行/列直接舍去，不为此缩放
+            int sourceWidth = yuv ? layer.frame->width & ~1 : layer.frame->width;
+            int sourceHeight = yuv ? layer.frame->height & ~1 : layer.frame->height;
+            if (placed.width != sourceWidth || placed.height != sourceHeight) {
+                needsScaling.push_back(m_placed.size());
+            }
+            m_placed.push_back(placed);
+        }
+
+        // 每个需要缩放的图层有自己的缩放缓存和目标帧，尺寸不变时跨帧复用
+        while (m_scaled.size() < needsScaling.size()) {
+            m_scaled.push_back(makeFrame());
+            m_scalers.emplace_back(new ScalerCache(1));
+        }
+        std::vector<char> failed(needsScaling.size(), 0);
+        m_pool.parallelFor((int)needsScaling.size(), [&](int i) {
+            Placed& placed = m_placed[needsScaling[i]];
+            if (!scaleLayer(placed, *m_scalers[i], m_scaled[i].get())) {
+                failed[i] = 1;
+            }
+        });
+        return std::find(failed.begin(), failed.end(), 1) == failed.end();
+    }
+
+    static bool scaleLayer(Placed& placed, ScalerCache& scaler, AVFrame* scaled) {
+        ProfileScope scope("composite_scale");
+        if (!scaled) {
+            return false;
+        }
+        const AVFrame* source = placed.frame;
+        if (scaled->width != placed.width || scaled->height != placed.height || scaled->format != source->format) {
+            av_frame_unref(scaled);
+            scaled->format = source->format;
+            scaled->width = placed.width;
+            scaled->height = placed.height;
+            if (av_frame_get_buffer(scaled, 0) < 0) {
+                return false;
+            }
+        }
+        SwsContext* context = scaler.get(source->width, source->height, (AVPixelFormat)source->format,
+                                         placed.width, placed.height, (AVPixelFormat)source->format);
+        if (!context) {
+            return false;
+        }
+        sws_scale(context, source->data, source->linesize, 0, source->height, scaled->data, scaled->linesize);
+        placed.frame = scaled;
+        return true;
+    }
+
+    void blendTile(AVFrame* canvas, int tile) {
+        ProfileScope scope("composite_tile");
+        const BlendKernels& kernels = *m_kernels;
+        bool yuv = isYuv(canvas->format);
+        int rowBegin = tile * kTileRows;
+        int rowEnd = std::min(canvas->height, rowBegin + kTileRows);
+
+        for (const Placed& layer : m_placed) {
+            int x0 = std::max(0, layer.x);
+            int x1 = std::min(canvas->width, layer.x + layer.width);
+            int y0 = std::max(rowBegin, layer.y);
+            int y1 = std::min(rowEnd, layer.y + layer.height);
+            if (x0 >= x1 || y0 >= y1) {
+                continue;
+            }
+            const AVFrame* src = layer.frame;
+
+            if (!yuv) {
+                for (int y = y0; y < y1; y++) {
+                    kernels.rowRgba(layer.mode, canvas->data[0] + (size_t)y * canvas->linesize[0] + x0 * 4,
+                                    src->data[0] + (size_t)(y - layer.y) * src->linesize[0] + (x0 - layer.x) * 4,
+                                    x1 - x0, layer.opacity);
+                }
+                continue;
+            }
+
+            for (int y = y0; y < y1; y++) {
+                kernels.row(layer.mode, canvas->data[0] + (size_t)y * canvas->linesize[0] + x0,
+                            src->data[0] + (size_t)(y - layer.y) * src->linesize[0] + (x0 - layer.x),
+                            x1 - x0, layer.opacity);
+            }
+            int cx0 = x0 / 2;
+            int cx1 = (x1 + 1) / 2;
+            for (int plane = 1; plane <= 2; plane++) {
+                for (int y = y0 / 2; y < (y1 + 1) / 2; y++) {
+                    kernels.row(BlendMode::Normal, canvas->data[plane] + (size_t)y * canvas->linesize[plane] + cx0,
+                                src->data[plane] + (size_t)(y - layer.y / 2) * src->linesize[plane] + (cx0 - layer.x / 2),
+                                cx1 - cx0, layer.opacity);
+                }
+            }
+        }
+    }
+
+    WorkerPool m_pool;
+    const BlendKernels* m_kernels;
+    std::vector<Placed> m_placed;
+    std::vector<FramePtr> m_scaled;                     // 缩放后的图层，按需要缩放的顺序
+    std::vector<std::unique_ptr<ScalerCache>> m_scalers;
+    double m_lastMs;
+};
+
+// 叠加图层的图像：图片文件（PNG/JPEG等，视频文件取第一帧）解码后的一帧，保持原始像素格式和尺寸
+// 没有alpha通道的概念，整个图层按不透明度混合
+struct LayerImage {
+    std::string name;
+    FramePtr frame;
+
+    static bool load(const std::string& path, LayerImage& image) {
+        AVFormatContext* input = nullptr;
+        if (avformat_open_input(&input, path.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "图层: 无法打开图像 " << path << std::endl;
+            return false;
+        }
+        AVCodecContext* decoder = nullptr;
+        FramePtr frame = makeFrame();
+        PacketPtr packet = makePacket();
+        bool ok = false;
+        int index = -1;
+        if (frame && packet && avformat_find_stream_info(input, nullptr) >= 0) {
+            index = av_find_best_stream(input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        }
+        if (index >= 0) {
+            const AVCodecParameters* par = input->streams[index]->codecpar;
+            const AVCodec* codec = avcodec_find_decoder(par->codec_id);
+            decoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+            if (decoder && avcodec_parameters_to_context(decoder, par) >= 0 && avcodec_open2(decoder, codec, nullptr) >= 0) {
+                while (!ok && av_read_frame(input, packet.get()) >= 0) {
+                    if (packet->stream_index == index && avcodec_send_packet(decoder, packet.get()) >= 0) {
+                        ok = avcodec_receive_frame(decoder, frame.get()) == 0;
+                    }
+                    av_packet_unref(packet.get());
+                }
+                if (!ok && avcodec_send_packet(decoder, nullptr) >= 0) {
+                    ok = avcodec_receive_frame(decoder, frame.get()) == 0;
+                }
+            }
+        }
+        avcodec_free_context(&decoder);
+        avformat_close_input(&input);
+        if (!ok) {
+            std::cerr << "图层: 无法解码图像 " << path << std::endl;
+            return false;
+        }
+        image.name = path;
+        image.frame = std::move(frame);
+        return true;
+    }
+};
+
+// 片段上的一个叠加图层；位置和尺寸是画布宽高的比例，缩小的预览和全尺寸的导出布局一致
+struct OverlayLayer {
+    std::shared_ptr<const LayerImage> image;
+    float x = 0.0f;
+    float y = 0.0f;
+    float width = 1.0f;
+    float height = 1.0f;
+    float opacity = 1.0f;
+    BlendMode mode = BlendMode::Normal;
+    bool visible = true;
+};
+
+// 图层从下往上的顺序
+using LayerList = std::vector<OverlayLayer>;
+
+inline bool parseBlendMode(const std::string& name, BlendMode& mode) {
+    for (BlendMode candidate : { BlendMode::Normal, BlendMode::Add, BlendMode::Multiply, BlendMode::Screen }) {
+        if (name == blendModeName(candidate)) {
+            mode = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 解析一个图层参数：--layer FILE 在最上面添加一个铺满画面的图层，
+// --layer-rect X,Y,W,H（画面比例）/ --layer-opacity F / --layer-blend normal|add|multiply|screen 修改最近添加的图层
+// 不是图层参数时返回false；参数值有误时ok为false
+inline bool parseLayerArg(const std::string& arg, const char* value, LayerList& layers, bool& ok) {
+    ok = true;
+    if (arg == "--layer") {
+        auto image = std::make_shared<LayerImage>();
+        ok = LayerImage::load(value, *image);
+        if (ok) {
+            OverlayLayer layer;
+            layer.image = std::move(image);
+            layers.push_back(layer);
+        }
+        return true;
+    }
+    if (arg != "--layer-rect" && arg != "--layer-opacity" && arg != "--layer-blend") {
+        return false;
+    }
+    if (layers.empty()) {
+        std::cerr << "图层: " << arg << " 之前需要先用 --layer 添加图层" << std::endl;
+        ok = false;
+        return true;
+    }
+    OverlayLayer& layer = layers.back();
+    if (arg == "--layer-rect") {
+        float x = 0.0f, y = 0.0f, width = 0.0f, height = 0.0f;
+        ok = std::sscanf(value, "%f,%f,%f,%f", &x, &y, &width, &height) == 4 && width > 0.0f && height > 0.0f;
+        if (ok) {
+            layer.x = x;
+            layer.y = y;
+            layer.width = width;
+            layer.height = height;
+        } else {
+            std::cerr << "图层: 位置应为 X,Y,W,H（画面宽高的比例）: " << value << std::endl;
+        }
+    } else if (arg == "--layer-opacity") {
+        float opacity = (float)std::atof(value);
+        ok = opacity >= 0.0f && opacity <= 1.0f;
+        if (ok) {
+            layer.opacity = opacity;
+        } else {
+            std::cerr << "图层: 不透明度应在0..1之间: " << value << std::endl;
+        }
+    } else {
+        ok = parseBlendMode(value, layer.mode);
+        if (!ok) {
+            std::cerr << "图层: 未知的混合模式: " << value << std::endl;
+        }
+    }
+    return true;
+}
+
+// 列表中有没有会改变画面的图层
+inline bool layerListActive(const LayerList& layers) {
+    for (const OverlayLayer& layer : layers) {
+        if (layer.visible && layer.image && layer.opacity > 0.0f) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 片段的叠加图层栈：把图层按比例放到画布上，用Compositor从下往上混合；预览（解码线程）和导出（工作线程）共用
+// - 画布是YUV420P/YUVJ420P；图层图像第一次用到时转换成画布的像素格式（原始尺寸），之后复用
+// - 画布尺寸相同时预览和导出的结果逐字节相同（混合内核与线程数、CPU无关）
+// - setLayers可以在其他线程调用，下一次apply时生效
+class LayerStack {
+public:
+    explicit LayerStack(int threads = 0) : m_threads(threads), m_changed(false), m_converter(1) {}
+
+    LayerStack(const LayerStack&) = delete;
+    LayerStack& operator=(const LayerStack&) = delete;
+
+    static bool supportsFormat(int format) {
+        return format == AV_PIX_FMT_YUV420P || format == AV_PIX_FMT_YUVJ420P;
+    }
+
+    void setLayers(const LayerList& layers) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = layers;
+        m_changed = true;
+    }
+
+    LayerList layers() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_changed ? m_pending : m_layers;
+    }
+
+    bool active() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return layerListActive(m_changed ? m_pending : m_layers);
+    }
+
+    // 把图层混合到canvas上；canvas必须可写。不支持的像素格式返回false，画面不变
+    bool apply(AVFrame* canvas) {
+        ProfileScope scope("layers");
+        if (!canvas || !supportsFormat(canvas->format)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_changed) {
+                m_layers.swap(m_pending);
+                m_changed = false;
+                m_converted.clear();
+            }
+        }
+        m_converted.resize(m_layers.size());
+
+        m_placed.clear();
+        for (size_t i = 0; i < m_layers.size(); i++) {
+            const OverlayLayer& layer = m_layers[i];
+            if (!layer.visible || !layer.image || layer.opacity <= 0.0f) {
+                continue;
+            }
+            const AVFrame* image = convertedImage(i, canvas->format);
+            if (!image) {
+                return false;
+            }
+            CompositeLayer placed;
+            placed.frame = image;
+            placed.transform.x = (int)std::lround(layer.x * canvas->width);
+            placed.transform.y = (int)std::lround(layer.y * canvas->height);
+            placed.transform.width = std::max(1, (int)std::lround(layer.width * canvas->width));
+            placed.transform.height = std::max(1, (int)std::lround(layer.height * canvas->height));
+            placed.opacity = layer.opacity;
+            placed.mode = layer.mode;
+            m_placed.push_back(placed);
+        }
+        if (m_placed.empty()) {
+            return true;
+        }
+        if (!m_compositor) {
+            m_compositor.reset(new Compositor(m_threads));
+        }
+        return m_compositor->composite(canvas, m_placed);
+    }
+
+private:
+    // 图层图像换成画布的像素格式，结果按图层缓存
+    const AVFrame* convertedImage(size_t index, int format) {
+        const AVFrame* source = m_layers[index].image->frame.get();
+        if (source->format == format) {
+            return source;
+        }
+        FramePtr& converted = m_converted[index];
+        if (converted && converted->format == format) {
+            return converted.get();
+        }
+        converted = makeFrame();
+        if (!converted) {
+            return nullptr;
+        }
+        converted->format = format;
+        converted->width = source->width;
+        converted->height = source->height;
+        SwsContext* context = m_converter.get(source->width, source->height, (AVPixelFormat)source->format,
+                                              source->width, source->height, (AVPixelFormat)format);
+        if (!context || av_frame_get_buffer(converted.get(), 0) < 0) {
+            converted.reset();
+            return nullptr;
+        }
+        sws_scale(context, source->data, source->linesize, 0, source->height, converted->data, converted->linesize);
+        return converted.get();
+    }
+
+    int m_threads;
+    mutable std::mutex m_mutex;
+    LayerList m_pending;
+    bool m_changed;
+
+    // 只在apply的线程上使用
+    LayerList m_layers;
+    std::vector<FramePtr> m_converted;  // 与m_layers一一对应，图像已经是画布格式时为空
+    std::vector<CompositeLayer> m_placed;
+    ScalerCache m_converter;
+    std::unique_ptr<Compositor> m_compositor;  // 第一次有可见图层时才创建线程池
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// 解码器多线程策略
+enum class ThreadTypePolicy {
+    Auto,   // 按解码器能力选择：支持帧级并行用帧级，否则用片级
+    Frame,  // 帧级并行：吞吐最高，但会带来(线程数-1)帧的输出延迟
+    Slice   // 片级并行：没有额外延迟，效果取决于码流的切片数
+};
+
+// 解码器在程序中的用途，决定在全局核心预算中的权重
+enum class DecoderRole {
+    Preview,    // 主预览，需要实时播放
+    Thumbnail,  // 缩略图等后台任务
+    Export      // 导出
+};
+
+struct DecoderThreadingConfig {
+    ThreadTypePolicy type = ThreadTypePolicy::Auto;
+    int threadCount = 0;    // 0表示使用核心预算分配到的份额
+    bool autoTune = false;  // 打开文件时实测不同线程数的解码速度后选择
+};
+
+// 全局核心预算：解码器打开时从还没分出去的核心里领取线程数，关闭时归还，所有登记的份额之和不超过核心数
+// 领取的份额按权重计算（只看已经登记的解码器），再受剩余核心数限制；核心已经分完时退回单线程解码，不计入预算
+// 解码器的线程数只能在avcodec_open2之前设置，因此份额在登记时确定，之后登记的解码器不影响已打开的
+class ThreadBudget {
+public:
+    static ThreadBudget& instance() {
+        static ThreadBudget budget;
+        return budget;
+    }
+
+    // 登记凭证，析构时自动归还份额
+    class Lease {
+    public:
+        Lease() : m_id(0) {}
+        explicit Lease(int id) : m_id(id) {}
+        ~Lease() {
+            release();
+        }
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        Lease(Lease&& other) noexcept : m_id(other.m_id) {
+            other.m_id = 0;
+        }
+
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                release();
+                m_id = other.m_id;
+                other.m_id = 0;
+            }
+            return *this;
+        }
+
+        // 分到的线程数，至少为1
+        int threads() const {
+            return m_id ? std::max(1, ThreadBudget::instance().grantOf(m_id)) : 1;
+        }
+
+        // 实际只用了threads个线程（自动调优选了更少的线程、显式指定了线程数等），多出来的还给预算
+        void shrink(int threads) {
+            if (m_id) {
+                ThreadBudget::instance().shrinkGrant(m_id, threads);
+            }
+        }
+
+        void release() {
+            if (m_id) {
+                ThreadBudget::instance().unregisterDecoder(m_id);
+                m_id = 0;
+            }
+        }
+
+    private:
+        int m_id;
+    };
+
+    // 登记并领取份额；maxThreads大于0时最多领取这么多（调用方自己已经并行，或者线程数已经确定）
+    Lease acquire(DecoderRole role, int maxThreads = 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int id = ++m_nextId;
+        Entry& entry = m_entries[id];
+        entry.weight = weightOf(role);
+        int totalWeight = 0;
+        int granted = 0;
+        for (const auto& other : m_entries) {
+            totalWeight += other.second.weight;
+            granted += other.second.granted;
+        }
+        int share = std::max(1, m_totalCores * entry.weight / std::max(1, totalWeight));
+        if (maxThreads > 0) {
+            share = std::min(share, maxThreads);
+        }
+        entry.granted = std::max(0, std::min(share, m_totalCores - granted));
+        return Lease(id);
+    }
+
+    // 已经分出去的核心数，不超过totalCores()（减少核心总数之前分出去的份额除外）
+    int grantedCores() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        int granted = 0;
+        for (const auto& entry : m_entries) {
+            granted += entry.second.granted;
+        }
+        return granted;
+    }
+
+    // 设置可用核心总数，0表示使用硬件线程数
+    void setTotalCores(int cores) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_totalCores = cores > 0 ? cores : hardwareCores();
+    }
+
+    int totalCores() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_totalCores;
+    }
+
+    static const char* typeName(int threadType) {
+        if (threadType & FF_THREAD_FRAME) {
+            return "frame";
+        }
+        if (threadType & FF_THREAD_SLICE) {
+            return "slice";
+        }
+        return "none";
+    }
+
+    // 按策略和解码器能力设置thread_type，返回实际可用的类型
+    static int chooseThreadType(const AVCodec* codec, ThreadTypePolicy policy) {
+        bool frameCapable = (codec->capabilities & AV_CODEC_CAP_FRAME_THREADS) != 0;
+        bool sliceCapable = (codec->capabilities & AV_CODEC_CAP_SLICE_THREADS) != 0;
+
+        switch (policy) {
+            case ThreadTypePolicy::Frame:
+                return frameCapable ? FF_THREAD_FRAME : (sliceCapable ? FF_THREAD_SLICE : 0);
+            case ThreadTypePolicy::Slice:
+                return sliceCapable ? FF_THREAD_SLICE : (frameCapable ? FF_THREAD_FRAME : 0);
+            case ThreadTypePolicy::Auto:
+            default:
+                // 帧级并行对H.264/HEVC等长GOP格式提升最大；片级作为补充
+                if (frameCapable) {
+                    return FF_THREAD_FRAME | (sliceCapable ? FF_THREAD_SLICE : 0);
+                }
+                return sliceCapable ? FF_THREAD_SLICE : 0;
+        }
+    }
+
+    // 降低调用线程的调度优先级，用于缩略图等不能和预览抢CPU的后台任务
+    static void lowerCurrentThreadPriority() {
+#ifdef _WIN32
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+        // Linux上nice值是按线程生效的
+        setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+#endif
+    }
+
+    static bool parseThreadType(const std::string& text, ThreadTypePolicy& policy) {
+        if (text == "auto") {
+            policy = ThreadTypePolicy::Auto;
+        } else if (text == "frame") {
+            policy = ThreadTypePolicy::Frame;
+        } else if (text == "slice") {
+            policy = ThreadTypePolicy::Slice;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+private:
+    ThreadBudget() : m_totalCores(hardwareCores()), m_nextId(0) {}
+
+    static int hardwareCores() {
+        unsigned int cores = std::thread::hardware_concurrency();
+        return cores ? (int)cores : 1;
+    }
+
+    static int weightOf(DecoderRole role) {
+        switch (role) {
+            case DecoderRole::Preview:
+                return 4;
+            case DecoderRole::Export:
+                return 4;
+            case DecoderRole::Thumbnail:
+            default:
+                return 1;
+        }
+    }
+
+    int grantOf(int id) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(id);
+        return it != m_entries.end() ? it->second.granted : 0;
+    }
+
+    void shrinkGrant(int id, int threads) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(id);
+        if (it != m_entries.end()) {
+            it->second.granted = std::min(it->second.granted, std::max(0, threads));
+        }
+    }
+
+    void unregisterDecoder(int id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.erase(id);
+    }
+
+    struct Entry {
+        int weight = 1;
+        int granted = 0;  // 分到的核心数；0表示核心已经分完，只在调用线程上解码
+    };
+
+    mutable std::mutex m_mutex;
+    int m_totalCores;
+    int m_nextId;
+    std::map<int, Entry> m_entries;  // 登记id -> 权重和份额
+};
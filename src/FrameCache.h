@@ -0,0 +1,410 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "MediaQueue.h"
+
+// 转换后帧的缓冲区池：按(格式, 宽, 高)复用同样大小的缓冲区
+// 帧释放时缓冲区回到池中，下一帧转换直接取用，稳定播放时不再有malloc/free
+// 解码线程取用、UI线程释放，AVBufferPool本身是线程安全的
+class FramePool {
+public:
+    FramePool() : m_pool(nullptr), m_format(AV_PIX_FMT_NONE), m_width(0), m_height(0),
+                  m_poolBuffers(0), m_peak(0), m_allocations(0), m_requests(0) {}
+
+    ~FramePool() {
+        reset();
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // 为frame分配池中的缓冲区并填好data/linesize
+    bool allocate(AVFrame* frame, AVPixelFormat format, int width, int height) {
+        if (!m_pool || format != m_format || width != m_width || height != m_height) {
+            // 尺寸变化（例如窗口缩放）：旧池在其缓冲区全部归还后自动释放
+            reset();
+            int size = av_image_get_buffer_size(format, width, height, kAlign);
+            if (size <= 0) {
+                return false;
+            }
+            m_pool = av_buffer_pool_init2((size_t)size, this, &FramePool::allocBuffer, nullptr);
+            if (!m_pool) {
+                return false;
+            }
+            m_format = format;
+            m_width = width;
+            m_height = height;
+        }
+
+        uint64_t allocated = m_allocations;
+        AVBufferRef* buffer = av_buffer_pool_get(m_pool);
+        if (!buffer) {
+            return false;
+        }
+        m_requests++;
+        if (m_allocations != allocated) {
+            m_peak = std::max<uint64_t>(m_peak, ++m_poolBuffers);
+        }
+
+        frame->format = format;
+        frame->width = width;
+        frame->height = height;
+        frame->buf[0] = buffer;
+        if (av_image_fill_arrays(frame->data, frame->linesize, buffer->data, format, width, height, kAlign) < 0) {
+            av_frame_unref(frame);
+            return false;
+        }
+        return true;
+    }
+
+    void reset() {
+        if (m_pool) {
+            av_buffer_pool_uninit(&m_pool);
+        }
+        m_format = AV_PIX_FMT_NONE;
+        m_width = m_height = 0;
+        m_poolBuffers = 0;
+    }
+
+    // 实际向系统申请缓冲区的次数 / 取用缓冲区的总次数
+    uint64_t allocations() const {
+        return m_allocations;
+    }
+
+    uint64_t requests() const {
+        return m_requests;
+    }
+
+    // 同一尺寸下池中缓冲区数量的峰值，即同时在外（队列、帧缓存、屏幕上）的转换帧最多有多少
+    uint64_t peak() const {
+        return m_peak;
+    }
+
+private:
+    static constexpr int kAlign = 32;
+
+    static AVBufferRef* allocBuffer(void* opaque, size_t size) {
+        ((FramePool*)opaque)->m_allocations++;
+        return av_buffer_alloc(size);
+    }
+
+    AVBufferPool* m_pool;
+    AVPixelFormat m_format;
+    int m_width;
+    int m_height;
+    uint64_t m_poolBuffers;  // 当前池已申请的缓冲区数，只在解码线程访问
+    std::atomic<uint64_t> m_peak;
+    std::atomic<uint64_t> m_allocations;
+    std::atomic<uint64_t> m_requests;
+};
+
+// 解码器输出帧的缓冲区池，通过get_buffer2接管libavcodec的帧分配
+// 每个平面一个AVBufferPool，按(格式, 对齐后的宽高)重建；解码帧可以直接放进帧队列和帧缓存，
+// 显示或淘汰后缓冲区回到这里。帧线程解码时get_buffer2会被多个线程同时调用
+// 硬件帧、不支持DR1的解码器和池分配失败时交还给avcodec_default_get_buffer2
+class DecodeBufferPool {
+public:
+    DecodeBufferPool() : m_format(AV_PIX_FMT_NONE), m_width(0), m_height(0), m_poolBuffers(0), m_setBytes(0),
+                         m_bytes(0), m_peak(0), m_allocations(0), m_requests(0) {
+        std::fill(std::begin(m_pools), std::end(m_pools), nullptr);
+    }
+
+    ~DecodeBufferPool() {
+        reset();
+    }
+
+    DecodeBufferPool(const DecodeBufferPool&) = delete;
+    DecodeBufferPool& operator=(const DecodeBufferPool&) = delete;
+
+    // 在avcodec_open2之前调用；池的生命周期必须覆盖解码器上下文
+    void attach(AVCodecContext* context) {
+        context->opaque = this;
+        context->get_buffer2 = &DecodeBufferPool::getBuffer;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        releasePools();
+    }
+
+    // 实际申请的平面缓冲区数 / 取用的帧数
+    uint64_t allocations() const {
+        return m_allocations;
+    }
+
+    uint64_t requests() const {
+        return m_requests;
+    }
+
+    // 同一组尺寸下池里缓冲区组数的峰值，即同时在外的解码帧最多有多少
+    uint64_t peak() const {
+        return m_peak;
+    }
+
+    // 当前池里的缓冲区（含在外未还的）占用的字节数
+    size_t bytes() const {
+        return m_bytes;
+    }
+
+private:
+    static constexpr int kAlign = 64;    // 行宽对齐，覆盖各平台SIMD的要求
+    static constexpr int kPadding = 16;  // 与libavcodec默认分配一致的尾部余量
+
+    static int getBuffer(AVCodecContext* context, AVFrame* frame, int flags) {
+        DecodeBufferPool* self = (DecodeBufferPool*)context->opaque;
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+        if (!self || context->codec_type != AVMEDIA_TYPE_VIDEO || !desc || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL) ||
+            !(context->codec->capabilities & AV_CODEC_CAP_DR1) || !self->fill(context, frame)) {
+            return avcodec_default_get_buffer2(context, frame, flags);
+        }
+        return 0;
+    }
+
+    bool fill(AVCodecContext* context, AVFrame* frame) {
+        AVPixelFormat format = (AVPixelFormat)frame->format;
+        int width = frame->width;
+        int height = frame->height;
+        int linesizeAlign[AV_NUM_DATA_POINTERS];
+        avcodec_align_dimensions2(context, &width, &height, linesizeAlign);
+
+        // 加宽直到每个平面的行宽都满足对齐（与libavcodec的默认实现相同的做法）
+        int linesizes[4] = {0};
+        for (int w = width;; w += w & ~(w - 1)) {
+            if (av_image_fill_linesizes(linesizes, format, w) < 0) {
+                return false;
+            }
+            bool aligned = true;
+            for (int i = 0; i < 4; i++) {
+                aligned = aligned && linesizes[i] % kAlign == 0;
+            }
+            if (aligned) {
+                break;
+            }
+        }
+        ptrdiff_t strides[4];
+        std::copy(linesizes, linesizes + 4, strides);
+        size_t sizes[4] = {0};
+        if (av_image_fill_plane_sizes(sizes, format, height, strides) < 0) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (format != m_format || width != m_width || height != m_height) {
+            releasePools();
+            for (int i = 0; i < 4 && sizes[i]; i++) {
+                m_pools[i] = av_buffer_pool_init2(sizes[i] + kPadding + kAlign - 1, this, &DecodeBufferPool::allocBuffer, nullptr);
+                if (!m_pools[i]) {
+                    releasePools();
+                    return false;
+                }
+                m_setBytes += sizes[i] + kPadding + kAlign - 1;
+            }
+            m_format = format;
+            m_width = width;
+            m_height = height;
+        }
+
+        uint64_t allocated = m_allocations;
+        for (int i = 0; i < 4 && m_pools[i]; i++) {
+            frame->buf[i] = av_buffer_pool_get(m_pools[i]);
+            if (!frame->buf[i]) {
+                av_frame_unref(frame);
+                return false;
+            }
+            frame->data[i] = frame->buf[i]->data;
+            frame->linesize[i] = linesizes[i];
+        }
+        frame->extended_data = frame->data;
+        m_requests++;
+        // 池里没有空闲缓冲区、新申请了一组：池的大小加一
+        if (m_allocations != allocated) {
+            m_peak = std::max<uint64_t>(m_peak, ++m_poolBuffers);
+            m_bytes = m_poolBuffers * m_setBytes;
+        }
+        return true;
+    }
+
+    // 旧池在其缓冲区全部归还后由FFmpeg释放
+    void releasePools() {
+        for (AVBufferPool*& pool : m_pools) {
+            if (pool) {
+                av_buffer_pool_uninit(&pool);
+            }
+        }
+        m_format = AV_PIX_FMT_NONE;
+        m_width = m_height = 0;
+        m_poolBuffers = 0;
+        m_setBytes = 0;
+        m_bytes = 0;
+    }
+
+    static AVBufferRef* allocBuffer(void* opaque, size_t size) {
+        ((DecodeBufferPool*)opaque)->m_allocations++;
+        return av_buffer_alloc(size);
+    }
+
+    std::mutex m_mutex;
+    AVBufferPool* m_pools[4];
+    AVPixelFormat m_format;
+    int m_width;
+    int m_height;
+    uint64_t m_poolBuffers;
+    size_t m_setBytes;              // 一组（一帧的全部平面）缓冲区的字节数
+    std::atomic<size_t> m_bytes;
+    std::atomic<uint64_t> m_peak;
+    std::atomic<uint64_t> m_allocations;
+    std::atomic<uint64_t> m_requests;
+};
+
+struct CachedFrame {
+    FramePtr frame;
+    double pts;
+    double duration;
+    size_t bytes;  // 帧持有的缓冲区大小
+};
+
+// 最近解码过的帧，按pts排序，总内存不超过上限
+// 逐帧后退、倒放、回放刚播过的片段时直接从这里取帧，不需要seek再从关键帧解码
+// 超出上限时淘汰离当前位置最远的帧；只由UI线程访问
+class FrameCache {
+public:
+    FrameCache() : m_capacity(kDefaultCapacity), m_bytes(0), m_hits(0), m_misses(0) {}
+
+    // 内存上限（字节），0表示关闭缓存
+    void setCapacity(size_t bytes) {
+        m_capacity = bytes;
+        evict(0.0, 0);
+    }
+
+    size_t capacity() const {
+        return m_capacity;
+    }
+
+    // 保存一帧，focus为当前关注的位置，淘汰时优先保留它附近的帧
+    void insert(FramePtr frame, double pts, double duration, double focus) {
+        if (!frame || m_capacity == 0) {
+            return;
+        }
+
+        size_t bytes = 0;
+        for (AVBufferRef* buffer : frame->buf) {
+            if (buffer) {
+                bytes += buffer->size;
+            }
+        }
+
+        auto existing = m_frames.find(pts);
+        if (existing != m_frames.end()) {
+            m_bytes -= existing->second.bytes;
+            m_frames.erase(existing);
+        }
+
+        evict(focus, bytes);
+        if (m_bytes + bytes > m_capacity) {
+            return;
+        }
+        m_frames.emplace(pts, CachedFrame{ std::move(frame), pts, duration, bytes });
+        m_bytes += bytes;
+    }
+
+    // 显示区间包含time的帧
+    const CachedFrame* find(double time) const {
+        auto it = m_frames.upper_bound(time);
+        if (it == m_frames.begin()) {
+            return nullptr;
+        }
+        --it;
+        double duration = it->second.duration > 0.0 ? it->second.duration : kDefaultFrameDuration;
+        return time < it->first + duration ? &it->second : nullptr;
+    }
+
+    // pts之后的第一帧
+    const CachedFrame* next(double pts) const {
+        auto it = m_frames.upper_bound(pts + kEpsilon);
+        return it != m_frames.end() ? &it->second : nullptr;
+    }
+
+    // pts之前的最后一帧
+    const CachedFrame* previous(double pts) const {
+        auto it = m_frames.lower_bound(pts - kEpsilon);
+        if (it == m_frames.begin()) {
+            return nullptr;
+        }
+        return &std::prev(it)->second;
+    }
+
+    void clear() {
+        m_frames.clear();
+        m_bytes = 0;
+    }
+
+    void resetStats() {
+        m_hits = 0;
+        m_misses = 0;
+    }
+
+    void recordHit() {
+        m_hits++;
+    }
+
+    void recordMiss() {
+        m_misses++;
+    }
+
+    uint64_t hits() const {
+        return m_hits;
+    }
+
+    uint64_t misses() const {
+        return m_misses;
+    }
+
+    double hitRate() const {
+        uint64_t total = m_hits + m_misses;
+        return total ? (double)m_hits / total : 0.0;
+    }
+
+    size_t size() const {
+        return m_frames.size();
+    }
+
+    size_t bytes() const {
+        return m_bytes;
+    }
+
+private:
+    static constexpr size_t kDefaultCapacity = 256 * 1024 * 1024;
+    static constexpr double kDefaultFrameDuration = 0.04;
+    static constexpr double kEpsilon = 1e-4;
+
+    // 腾出incoming字节的空间：从两端中离focus较远的一端开始淘汰
+    void evict(double focus, size_t incoming) {
+        while (!m_frames.empty() && m_bytes + incoming > m_capacity) {
+            auto first = m_frames.begin();
+            auto last = std::prev(m_frames.end());
+            auto victim = (focus - first->first) > (last->first - focus) ? first : last;
+            m_bytes -= victim->second.bytes;
+            m_frames.erase(victim);
+        }
+    }
+
+    std::map<double, CachedFrame> m_frames;  // pts -> 帧
+    size_t m_capacity;
+    size_t m_bytes;
+    uint64_t m_hits;
+    uint64_t m_misses;
+};
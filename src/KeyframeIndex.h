@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "MediaQueue.h"
+#include "Profiler.h"
+
+struct KeyframeEntry {
+    int64_t pts;  // 流时间基
+    int64_t dts;
+    int64_t pos;  // 文件字节偏移，未知时为-1
+};
+
+// 视频流的关键帧/数据包索引
+// 用独立的AVFormatContext在后台线程扫描一遍数据包（只解复用不解码），
+// 之后seek可以直接定位到目标之前最近的关键帧，并估算从任意位置解码到目标需要多少帧
+// 构建完成（ready()为true）之后数据不再修改，可以从任意线程无锁读取
+class KeyframeIndex {
+public:
+    KeyframeIndex() : m_ready(false), m_cancel(false) {}
+
+    ~KeyframeIndex() {
+        cancel();
+    }
+
+    KeyframeIndex(const KeyframeIndex&) = delete;
+    KeyframeIndex& operator=(const KeyframeIndex&) = delete;
+
+    // onReady在构建成功之后于后台线程上调用（例如把索引写入探测缓存），取消时不调用
+    void buildAsync(const std::string& filename, int streamIndex,
+                    std::function<void(const KeyframeIndex&)> onReady = nullptr) {
+        cancel();
+        m_keyframes.clear();
+        m_packetPts.clear();
+        m_ready = false;
+        m_cancel = false;
+        m_thread = std::thread([this, filename, streamIndex, onReady]() {
+            Profiler::setThreadName("index");
+            build(filename, streamIndex);
+            if (onReady && ready()) {
+                onReady(*this);
+            }
+        });
+    }
+
+    // 直接使用已有的索引（来自探测缓存），立即就绪；两个数组都必须按pts排序
+    void install(std::vector<KeyframeEntry> keyframes, std::vector<int64_t> framePts) {
+        cancel();
+        m_keyframes = std::move(keyframes);
+        m_packetPts = std::move(framePts);
+        m_ready.store(true, std::memory_order_release);
+    }
+
+    // 在当前线程构建，返回是否成功；导出等本来就在后台线程里的任务使用
+    bool buildSync(const std::string& filename, int streamIndex) {
+        cancel();
+        m_keyframes.clear();
+        m_packetPts.clear();
+        m_cancel = false;
+        build(filename, streamIndex);
+        return ready();
+    }
+
+    // 停止构建并等待线程退出，索引回到未就绪状态
+    void cancel() {
+        m_cancel = true;
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_ready = false;
+    }
+
+    bool ready() const {
+        return m_ready.load(std::memory_order_acquire);
+    }
+
+    // pts不晚于给定时间戳的最后一个关键帧；没有时返回第一个关键帧，索引为空返回nullptr
+    const KeyframeEntry* keyframeAtOrBefore(int64_t pts) const {
+        if (!ready() || m_keyframes.empty()) {
+            return nullptr;
+        }
+        auto it = std::upper_bound(m_keyframes.begin(), m_keyframes.end(), pts,
+                                   [](int64_t value, const KeyframeEntry& entry) { return value < entry.pts; });
+        if (it == m_keyframes.begin()) {
+            return &m_keyframes.front();
+        }
+        return &*(it - 1);
+    }
+
+    // 距离给定时间戳最近的关键帧（前后都可以），用于拖动时间线时的快速预览
+    const KeyframeEntry* nearestKeyframe(int64_t pts) const {
+        const KeyframeEntry* before = keyframeAtOrBefore(pts);
+        if (!before) {
+            return nullptr;
+        }
+        size_t next = (size_t)(before - m_keyframes.data()) + 1;
+        if (next < m_keyframes.size() && m_keyframes[next].pts - pts < pts - before->pts) {
+            return &m_keyframes[next];
+        }
+        return before;
+    }
+
+    // pts落在(fromPts, toPts]之间的帧数，即从fromPts解码到toPts需要解码的帧数
+    size_t framesBetween(int64_t fromPts, int64_t toPts) const {
+        if (!ready() || toPts <= fromPts) {
+            return 0;
+        }
+        auto first = std::upper_bound(m_packetPts.begin(), m_packetPts.end(), fromPts);
+        auto last = std::upper_bound(m_packetPts.begin(), m_packetPts.end(), toPts);
+        return (size_t)(last - first);
+    }
+
+    size_t frameCount() const {
+        return ready() ? m_packetPts.size() : 0;
+    }
+
+    const std::vector<KeyframeEntry>& keyframes() const {
+        return m_keyframes;
+    }
+
+    // 按显示顺序排列的全部帧pts
+    const std::vector<int64_t>& framePts() const {
+        return m_packetPts;
+    }
+
+private:
+    static int interruptCallback(void* opaque) {
+        return ((KeyframeIndex*)opaque)->m_cancel.load() ? 1 : 0;
+    }
+
+    void build(const std::string& filename, int streamIndex) {
+        ProfileScope scope("keyframe_index");
+        AVFormatContext* context = avformat_alloc_context();
+        if (!context) {
+            return;
+        }
+        context->interrupt_callback.callback = &KeyframeIndex::interruptCallback;
+        context->interrupt_callback.opaque = this;
+
+        if (avformat_open_input(&context, filename.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "索引: 无法打开视频文件: " << filename << std::endl;
+            return;
+        }
+
+        if (streamIndex < 0 || streamIndex >= (int)context->nb_streams) {
+            avformat_close_input(&context);
+            return;
+        }
+
+        // 其他流的数据包不需要
+        for (unsigned int i = 0; i < context->nb_streams; i++) {
+            if ((int)i != streamIndex) {
+                context->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+
+        std::vector<KeyframeEntry> keyframes;
+        std::vector<int64_t> packetPts;
+        PacketPtr packet = makePacket();
+        while (packet && !m_cancel && av_read_frame(context, packet.get()) >= 0) {
+            if (packet->stream_index == streamIndex) {
+                int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+                if (pts != AV_NOPTS_VALUE) {
+                    packetPts.push_back(pts);
+                    if (packet->flags & AV_PKT_FLAG_KEY) {
+                        keyframes.push_back({ pts, packet->dts, packet->pos });
+                    }
+                }
+            }
+            av_packet_unref(packet.get());
+        }
+        avformat_close_input(&context);
+
+        if (m_cancel) {
+            return;
+        }
+
+        std::sort(packetPts.begin(), packetPts.end());
+        std::sort(keyframes.begin(), keyframes.end(),
+                  [](const KeyframeEntry& a, const KeyframeEntry& b) { return a.pts < b.pts; });
+        m_keyframes = std::move(keyframes);
+        m_packetPts = std::move(packetPts);
+        m_ready.store(true, std::memory_order_release);
+    }
+
+    std::vector<KeyframeEntry> m_keyframes;  // 按pts排序
+    std::vector<int64_t> m_packetPts;         // 按pts排序
+    std::atomic<bool> m_ready;
+    std::atomic<bool> m_cancel;
+    std::thread m_thread;
+};
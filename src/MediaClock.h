@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+
+// 播放主时钟：记录"某个真实时刻对应的媒体时间"，之后按真实时间线性推进
+// 暂停时时钟停在当前位置；seek或同步时用set()重新对齐
+// 速率可以大于1（快进）或为负（倒放）
+class MediaClock {
+public:
+    MediaClock() : m_paused(true), m_pts(0.0), m_updated(now()), m_rate(1.0) {}
+
+    // 当前媒体时间（秒）
+    double get() const {
+        if (m_paused) {
+            return m_pts;
+        }
+        return m_pts + (now() - m_updated) * m_rate;
+    }
+
+    void set(double pts) {
+        m_pts = pts;
+        m_updated = now();
+    }
+
+    void setPaused(bool paused) {
+        if (paused == m_paused) {
+            return;
+        }
+        m_pts = get();
+        m_updated = now();
+        m_paused = paused;
+    }
+
+    bool isPaused() const {
+        return m_paused;
+    }
+
+    void setRate(double rate) {
+        m_pts = get();
+        m_updated = now();
+        m_rate = rate;
+    }
+
+    double rate() const {
+        return m_rate;
+    }
+
+private:
+    static double now() {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool m_paused;
+    double m_pts;      // m_updated时刻对应的媒体时间
+    double m_updated;  // 单调时钟，秒
+    double m_rate;     // 媒体时间相对真实时间的速率
+};
@@ -0,0 +1,548 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#elif defined(__APPLE__)
+#include <sys/mount.h>
+#include <sys/param.h>
+#endif
+#endif
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavformat/avio.h>
+#include <libavutil/mem.h>
+}
+
+#include "Profiler.h"
+
+// 输入的读取方式
+// Auto: 本地文件用内存映射，网络挂载（NFS/SMB等）用后台预读；URL仍交给FFmpeg自己的协议
+// FFmpeg: FFmpeg默认的同步小块读取
+// Prefetch: 独立线程按大块顺序预读到环形缓冲区，读取方大多直接命中内存
+// Mapped: 整个文件映射到内存，读取即拷贝，缺页由系统按需读入
+enum class IOMode { Auto, FFmpeg, Prefetch, Mapped };
+
+// 读取统计：交给解复用器的字节数、实际从存储读入的字节数、读取方等待数据的累计时间、
+// 读请求数及其中不用等待直接命中缓冲区的次数、seek次数
+struct MediaIOStats {
+    uint64_t bytesRead = 0;
+    uint64_t bytesFetched = 0;
+    double stallSeconds = 0.0;
+    uint64_t reads = 0;
+    uint64_t hits = 0;
+    uint64_t seeks = 0;
+
+    double hitRate() const {
+        return reads ? (double)hits / reads : 0.0;
+    }
+};
+
+// 可替换的输入层：用自定义AVIOContext接管解复用器的读取和seek
+// 读取回调只在调用av_read_frame/avformat_*的那个线程上执行（同一时刻只有一个），预读线程是唯一的生产者
+class MediaIO {
+public:
+    MediaIO() : m_mode(IOMode::FFmpeg), m_avio(nullptr), m_size(0), m_position(0), m_mapped(nullptr),
+                m_start(0), m_filled(0), m_generation(0), m_eof(false), m_error(false), m_prefetchQuit(false),
+                m_bytesRead(0), m_bytesFetched(0), m_stallNanoseconds(0), m_reads(0), m_hits(0), m_seeks(0) {
+#ifdef _WIN32
+        m_file = INVALID_HANDLE_VALUE;
+        m_mapping = nullptr;
+#else
+        m_fd = -1;
+#endif
+    }
+
+    ~MediaIO() {
+        close();
+    }
+
+    MediaIO(const MediaIO&) = delete;
+    MediaIO& operator=(const MediaIO&) = delete;
+
+    static bool parseMode(const std::string& name, IOMode& mode) {
+        if (name == "auto") {
+            mode = IOMode::Auto;
+        } else if (name == "ffmpeg") {
+            mode = IOMode::FFmpeg;
+        } else if (name == "prefetch") {
+            mode = IOMode::Prefetch;
+        } else if (name == "mmap") {
+            mode = IOMode::Mapped;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    static const char* modeName(IOMode mode) {
+        switch (mode) {
+            case IOMode::Auto: return "auto";
+            case IOMode::Prefetch: return "prefetch";
+            case IOMode::Mapped: return "mmap";
+            default: return "ffmpeg";
+        }
+    }
+
+    // 文件是否在网络文件系统上（这类存储上内存映射的缺页同样会卡住读取方，改用预读）
+    static bool isRemotePath(const std::string& path) {
+#ifdef _WIN32
+        if (path.rfind("\\\\", 0) == 0 || path.rfind("//", 0) == 0) {
+            return true;
+        }
+        std::error_code ec;
+        std::string root = std::filesystem::absolute(path, ec).root_path().string();
+        return !ec && !root.empty() && GetDriveTypeA(root.c_str()) == DRIVE_REMOTE;
+#elif defined(__linux__)
+        struct statfs info;
+        if (statfs(path.c_str(), &info) != 0) {
+            return false;
+        }
+        switch ((uint32_t)info.f_type) {
+            case 0x6969:      // NFS
+            case 0x517B:      // SMB
+            case 0xFF534D42:  // CIFS
+            case 0xFE534D42:  // SMB2
+            case 0x65735546:  // FUSE（sshfs、rclone等）
+            case 0x73757245:  // Coda
+            case 0x5346414F:  // AFS
+            case 0x01021997:  // 9p
+                return true;
+            default:
+                return false;
+        }
+#elif defined(__APPLE__)
+        struct statfs info;
+        if (statfs(path.c_str(), &info) != 0) {
+            return false;
+        }
+        return !(info.f_flags & MNT_LOCAL);
+#else
+        (void)path;
+        return false;
+#endif
+    }
+
+    // 按mode打开文件并创建AVIOContext；URL或FFmpeg模式下不接管，返回true并由FFmpeg自己打开
+    bool open(const std::string& path, IOMode mode) {
+        close();
+        resetStats();
+        if (path.find("://") != std::string::npos) {
+            mode = IOMode::FFmpeg;
+        } else if (mode == IOMode::Auto) {
+            mode = isRemotePath(path) ? IOMode::Prefetch : IOMode::Mapped;
+        }
+        m_mode = mode;
+        if (mode == IOMode::FFmpeg) {
+            return true;
+        }
+
+        if (!openFile(path)) {
+            std::cerr << "输入: 无法打开 " << path << std::endl;
+            m_mode = IOMode::FFmpeg;
+            return false;
+        }
+        if (mode == IOMode::Mapped && !mapFile()) {
+            // 映射失败（例如32位地址空间放不下）时退回预读
+            std::cerr << "输入: 内存映射失败，改为后台预读" << std::endl;
+            m_mode = mode = IOMode::Prefetch;
+        }
+        if (mode == IOMode::Prefetch) {
+            m_buffer.assign(kPrefetchBytes, 0);
+            m_chunk.assign(kChunkBytes, 0);
+            resetPrefetch(0);
+            m_prefetchQuit = false;
+            m_prefetchThread = std::thread(&MediaIO::prefetchLoop, this);
+        }
+
+        uint8_t* buffer = (uint8_t*)av_malloc(kIOBufferBytes);
+        if (!buffer) {
+            close();
+            return false;
+        }
+        m_avio = avio_alloc_context(buffer, kIOBufferBytes, 0, this, &MediaIO::readPacket, nullptr, &MediaIO::seekPacket);
+        if (!m_avio) {
+            av_free(buffer);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // 在avformat_open_input之前把自定义IO接到context上；FFmpeg模式下什么也不做
+    void attach(AVFormatContext* context) {
+        if (m_avio && context) {
+            context->pb = m_avio;
+            context->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+    }
+
+    // 在avformat_close_input之后调用（自定义IO不归AVFormatContext释放）
+    void close() {
+        if (m_prefetchThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_prefetchQuit = true;
+            }
+            m_dataReady.notify_all();
+            m_spaceReady.notify_all();
+            m_prefetchThread.join();
+        }
+        if (m_avio) {
+            av_freep(&m_avio->buffer);
+            avio_context_free(&m_avio);
+        }
+        unmapFile();
+        closeFile();
+        m_buffer.clear();
+        m_buffer.shrink_to_fit();
+        m_chunk.clear();
+        m_chunk.shrink_to_fit();
+        m_size = 0;
+        m_position = 0;
+        m_mode = IOMode::FFmpeg;
+    }
+
+    // 实际使用的方式（Auto已经解析为具体方式）
+    IOMode mode() const {
+        return m_mode;
+    }
+
+    MediaIOStats stats() const {
+        MediaIOStats stats;
+        stats.bytesRead = m_bytesRead.load();
+        stats.bytesFetched = m_mode == IOMode::Mapped ? m_bytesRead.load() : m_bytesFetched.load();
+        stats.stallSeconds = m_stallNanoseconds.load() / 1e9;
+        stats.reads = m_reads.load();
+        stats.hits = m_hits.load();
+        stats.seeks = m_seeks.load();
+        return stats;
+    }
+
+    void resetStats() {
+        m_bytesRead = 0;
+        m_bytesFetched = 0;
+        m_stallNanoseconds = 0;
+        m_reads = 0;
+        m_hits = 0;
+        m_seeks = 0;
+    }
+
+private:
+    static constexpr int kIOBufferBytes = 256 * 1024;             // 解复用器每次向回调要的最大字节数
+    static constexpr size_t kPrefetchBytes = 32 * 1024 * 1024;    // 预读环形缓冲区
+    static constexpr size_t kChunkBytes = 1024 * 1024;            // 预读线程每次从存储读取的大小
+    static constexpr int64_t kKeepBehind = 4 * 1024 * 1024;       // 读取位置之前保留的数据，小幅向后seek直接命中
+
+    // ---- AVIOContext回调 ----
+
+    static int readPacket(void* opaque, uint8_t* buffer, int size) {
+        MediaIO* self = (MediaIO*)opaque;
+        ProfileScope scope("io_read");
+        int result = self->m_mode == IOMode::Mapped ? self->readMapped(buffer, size) : self->readPrefetched(buffer, size);
+        if (result > 0) {
+            self->m_bytesRead += (uint64_t)result;
+        }
+        return result;
+    }
+
+    static int64_t seekPacket(void* opaque, int64_t offset, int whence) {
+        MediaIO* self = (MediaIO*)opaque;
+        whence &= ~AVSEEK_FORCE;
+        if (whence == AVSEEK_SIZE) {
+            return self->m_size;
+        }
+        int64_t target;
+        if (whence == SEEK_SET) {
+            target = offset;
+        } else if (whence == SEEK_CUR) {
+            target = self->m_position + offset;
+        } else if (whence == SEEK_END) {
+            target = self->m_size + offset;
+        } else {
+            return AVERROR(EINVAL);
+        }
+        if (target < 0) {
+            return AVERROR(EINVAL);
+        }
+        self->m_seeks++;
+        if (self->m_mode == IOMode::Prefetch) {
+            self->seekPrefetched(target);
+        } else {
+            self->m_position = target;
+        }
+        return target;
+    }
+
+    // ---- 内存映射 ----
+
+    int readMapped(uint8_t* buffer, int size) {
+        if (m_position >= m_size) {
+            return AVERROR_EOF;
+        }
+        int count = (int)std::min<int64_t>(size, m_size - m_position);
+        std::memcpy(buffer, m_mapped + m_position, (size_t)count);
+        m_position += count;
+        m_reads++;
+        m_hits++;
+        return count;
+    }
+
+    // ---- 后台预读 ----
+    // 环形缓冲区中保存文件的[m_start, m_start + m_filled)，位置p在m_buffer[p % kPrefetchBytes]
+    // seek落在窗口内时只移动读取位置；落在窗口外时换代，预读线程丢弃手上的数据从新位置重新读
+
+    int readPrefetched(uint8_t* buffer, int size) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_reads++;
+        auto available = [this] { return m_start + m_filled - m_position; };
+        if (available() <= 0 && !m_eof && !m_error) {
+            auto begin = std::chrono::steady_clock::now();
+            ProfileScope scope("io_stall");
+            m_dataReady.wait(lock, [&] { return available() > 0 || m_eof || m_error || m_prefetchQuit; });
+            m_stallNanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin).count();
+        } else {
+            m_hits++;
+        }
+        if (available() <= 0) {
+            return m_error ? AVERROR(EIO) : AVERROR_EOF;
+        }
+
+        int count = (int)std::min<int64_t>(size, available());
+        size_t offset = (size_t)(m_position % (int64_t)kPrefetchBytes);
+        size_t first = std::min((size_t)count, kPrefetchBytes - offset);
+        std::memcpy(buffer, m_buffer.data() + offset, first);
+        std::memcpy(buffer + first, m_buffer.data(), (size_t)count - first);
+        m_position += count;
+        m_spaceReady.notify_one();
+        return count;
+    }
+
+    void seekPrefetched(int64_t target) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_position = target;
+        if (target < m_start || target > m_start + m_filled) {
+            resetPrefetch(target);
+        }
+        m_spaceReady.notify_one();
+    }
+
+    // 调用方持有m_mutex，或预读线程尚未启动
+    void resetPrefetch(int64_t position) {
+        m_generation++;
+        m_start = position;
+        m_filled = 0;
+        m_eof = false;
+        m_error = false;
+    }
+
+    void prefetchLoop() {
+        Profiler::setThreadName("io_prefetch");
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_prefetchQuit) {
+            // 缓冲区满时回收读取位置之前、超出保留量的部分
+            int64_t behind = m_position - m_start - kKeepBehind;
+            if (m_filled + (int64_t)kChunkBytes > (int64_t)kPrefetchBytes && behind > 0) {
+                int64_t reclaim = std::min<int64_t>(behind, m_filled);
+                m_start += reclaim;
+                m_filled -= reclaim;
+            }
+            int64_t next = m_start + m_filled;
+            bool full = m_filled + (int64_t)kChunkBytes > (int64_t)kPrefetchBytes;
+            if (full || m_eof || m_error || next >= m_size) {
+                if (next >= m_size && !m_eof) {
+                    m_eof = true;
+                    m_dataReady.notify_all();
+                }
+                m_spaceReady.wait(lock);
+                continue;
+            }
+
+            // 读存储时不持锁；期间发生了窗口外的seek（换代）时丢弃这次读到的数据
+            uint64_t generation = m_generation;
+            size_t length = (size_t)std::min<int64_t>((int64_t)kChunkBytes, m_size - next);
+            lock.unlock();
+            int64_t count = readAt(next, m_chunk.data(), length);
+            lock.lock();
+            if (generation != m_generation) {
+                continue;
+            }
+            if (count <= 0) {
+                m_error = count < 0;
+                m_eof = count == 0;
+                m_dataReady.notify_all();
+                continue;
+            }
+            m_bytesFetched += (uint64_t)count;
+            size_t offset = (size_t)(next % (int64_t)kPrefetchBytes);
+            size_t first = std::min((size_t)count, kPrefetchBytes - offset);
+            std::memcpy(m_buffer.data() + offset, m_chunk.data(), first);
+            std::memcpy(m_buffer.data(), m_chunk.data() + first, (size_t)count - first);
+            m_filled += count;
+            m_dataReady.notify_all();
+        }
+    }
+
+    // ---- 平台相关的文件访问 ----
+
+    bool openFile(const std::string& path) {
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size)) {
+            closeFile();
+            return false;
+        }
+        m_size = size.QuadPart;
+#else
+        m_fd = ::open(path.c_str(), O_RDONLY);
+        if (m_fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(m_fd, &info) != 0) {
+            closeFile();
+            return false;
+        }
+        m_size = info.st_size;
+#endif
+        return true;
+    }
+
+    void closeFile() {
+#ifdef _WIN32
+        if (m_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+#endif
+    }
+
+    // 从offset读最多length字节；返回读到的字节数，文件结束为0，出错为-1
+    int64_t readAt(int64_t offset, uint8_t* buffer, size_t length) {
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD count = 0;
+        if (!ReadFile(m_file, buffer, (DWORD)length, &count, &overlapped)) {
+            return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+        }
+        return count;
+#else
+        ssize_t count;
+        do {
+            count = pread(m_fd, buffer, length, (off_t)offset);
+        } while (count < 0 && errno == EINTR);
+        return count;
+#endif
+    }
+
+    bool mapFile() {
+        if (m_size <= 0 || (uint64_t)m_size > (uint64_t)SIZE_MAX) {
+            return false;
+        }
+#ifdef _WIN32
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) {
+            return false;
+        }
+        m_mapped = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!m_mapped) {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+            return false;
+        }
+#else
+        void* mapped = mmap(nullptr, (size_t)m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        // 解复用基本是顺序读，提示系统加大预读
+        madvise(mapped, (size_t)m_size, MADV_SEQUENTIAL);
+        m_mapped = (const uint8_t*)mapped;
+#endif
+        return true;
+    }
+
+    void unmapFile() {
+        if (!m_mapped) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(m_mapped);
+        CloseHandle(m_mapping);
+        m_mapping = nullptr;
+#else
+        munmap((void*)m_mapped, (size_t)m_size);
+#endif
+        m_mapped = nullptr;
+    }
+
+    IOMode m_mode;
+    AVIOContext* m_avio;
+    int64_t m_size;
+    int64_t m_position;  // 解复用器看到的读取位置，只在读取线程访问（预读模式下在锁内读写）
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_fd;
+#endif
+    const uint8_t* m_mapped;
+
+    std::mutex m_mutex;
+    std::condition_variable m_dataReady;   // 预读线程 -> 读取方
+    std::condition_variable m_spaceReady;  // 读取方/seek -> 预读线程
+    std::thread m_prefetchThread;
+    std::vector<uint8_t> m_buffer;
+    std::vector<uint8_t> m_chunk;          // 预读线程不持锁读存储时用的临时块
+    int64_t m_start;
+    int64_t m_filled;
+    uint64_t m_generation;
+    bool m_eof;
+    bool m_error;
+    bool m_prefetchQuit;
+
+    std::atomic<uint64_t> m_bytesRead;
+    std::atomic<uint64_t> m_bytesFetched;
+    std::atomic<uint64_t> m_stallNanoseconds;
+    std::atomic<uint64_t> m_reads;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_seeks;
+};
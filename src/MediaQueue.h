@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+// 回收池的统计：向系统申请的次数、取用的次数、同时在外的数量和它的峰值
+struct MediaPoolStats {
+    uint64_t packetAllocations = 0;
+    uint64_t packetRequests = 0;
+    int64_t packetsInUse = 0;
+    int64_t packetsPeak = 0;
+    uint64_t frameAllocations = 0;
+    uint64_t frameRequests = 0;
+    int64_t framesInUse = 0;
+    int64_t framesPeak = 0;
+};
+
+// AVPacket / AVFrame 结构体本身的回收池（数据缓冲区由AVBufferRef引用计数，在别处池化）
+// 释放时先unref再放回空闲列表，下次取用不再av_packet_alloc/av_frame_alloc，
+// 稳定播放时每个数据包、每一帧都不产生堆分配；任何线程都可以取用和归还
+class MediaPool {
+public:
+    // 有意不析构：静态对象中的PacketPtr/FramePtr可能在它之后才释放
+    static MediaPool& instance() {
+        static MediaPool* pool = new MediaPool();
+        return *pool;
+    }
+
+    AVPacket* packet() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.packetRequests++;
+            m_stats.packetsPeak = std::max(m_stats.packetsPeak, ++m_stats.packetsInUse);
+            if (!m_packets.empty()) {
+                AVPacket* packet = m_packets.back();
+                m_packets.pop_back();
+                return packet;
+            }
+            m_stats.packetAllocations++;
+        }
+        return av_packet_alloc();
+    }
+
+    AVFrame* frame() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.frameRequests++;
+            m_stats.framesPeak = std::max(m_stats.framesPeak, ++m_stats.framesInUse);
+            if (!m_frames.empty()) {
+                AVFrame* frame = m_frames.back();
+                m_frames.pop_back();
+                return frame;
+            }
+            m_stats.frameAllocations++;
+        }
+        return av_frame_alloc();
+    }
+
+    void recycle(AVPacket* packet) {
+        if (!packet) {
+            return;
+        }
+        av_packet_unref(packet);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.packetsInUse--;
+            if (m_packets.size() < kMaxPooled) {
+                m_packets.push_back(packet);
+                return;
+            }
+        }
+        av_packet_free(&packet);
+    }
+
+    void recycle(AVFrame* frame) {
+        if (!frame) {
+            return;
+        }
+        av_frame_unref(frame);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.framesInUse--;
+            if (m_frames.size() < kMaxPooled) {
+                m_frames.push_back(frame);
+                return;
+            }
+        }
+        av_frame_free(&frame);
+    }
+
+    MediaPoolStats stats() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    // 空闲列表上限：超过时直接释放，避免一次性的大批量（例如导出时整段缓存的数据包）常驻内存
+    static constexpr size_t kMaxPooled = 256;
+
+    MediaPool() {
+        m_packets.reserve(kMaxPooled);
+        m_frames.reserve(kMaxPooled);
+    }
+
+    mutable std::mutex m_mutex;
+    std::vector<AVPacket*> m_packets;
+    std::vector<AVFrame*> m_frames;
+    MediaPoolStats m_stats;
+};
+
+// AVPacket / AVFrame 的RAII包装，便于放入队列时自动释放
+// 只能移动不能复制，跨线程传递时所有权随之转移；释放时结构体回到MediaPool
+struct PacketDeleter {
+    void operator()(AVPacket* packet) const {
+        MediaPool::instance().recycle(packet);
+    }
+};
+
+struct FrameDeleter {
+    void operator()(AVFrame* frame) const {
+        MediaPool::instance().recycle(frame);
+    }
+};
+
+using PacketPtr = std::unique_ptr<AVPacket, PacketDeleter>;
+using FramePtr = std::unique_ptr<AVFrame, FrameDeleter>;
+
+// 从MediaPool取一个空的数据包/帧，分配失败时为空
+inline PacketPtr makePacket() {
+    return PacketPtr(MediaPool::instance().packet());
+}
+
+inline FramePtr makeFrame() {
+    return FramePtr(MediaPool::instance().frame());
+}
+
+// 有界阻塞队列：队列满时push阻塞（背压），队列空时pop阻塞
+// abort()唤醒所有等待者并使后续操作立即返回，用于关闭线程
+// 元素存放在按容量预先分配的环形数组里，入队出队不分配内存（std::deque会反复申请和释放节点块）
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity = 16)
+        : m_slots(capacity ? capacity : 1), m_head(0), m_count(0),
+          m_capacity(capacity ? capacity : 1), m_aborted(false) {}
+
+    // 只在没有消费者持有front()指针时调用（线程启动前）；扩容时按顺序搬移已有元素
+    void setCapacity(size_t capacity) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = capacity ? capacity : 1;
+        if (m_capacity > m_slots.size()) {
+            std::vector<T> slots(m_capacity);
+            for (size_t i = 0; i < m_count; i++) {
+                slots[i] = std::move(m_slots[(m_head + i) % m_slots.size()]);
+            }
+            m_slots.swap(slots);
+            m_head = 0;
+        }
+        m_notFull.notify_all();
+    }
+
+    size_t capacity() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_capacity;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_count;
+    }
+
+    // 阻塞直到有空位；队列被中止时返回false，item被丢弃
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_aborted || m_count < m_capacity; });
+        if (m_aborted) {
+            return false;
+        }
+        m_slots[(m_head + m_count) % m_slots.size()] = std::move(item);
+        m_count++;
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    enum class PushResult { Pushed, GaveUp, Aborted };
+
+    // 与push相同，但在等待期间giveUp()变为true时放弃入队；改变giveUp条件的一方调用wakeProducers()
+    template <typename Predicate>
+    PushResult pushUnless(T item, Predicate giveUp) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [&] { return m_aborted || m_count < m_capacity || giveUp(); });
+        if (m_aborted) {
+            return PushResult::Aborted;
+        }
+        if (m_count >= m_capacity) {
+            return PushResult::GaveUp;
+        }
+        m_slots[(m_head + m_count) % m_slots.size()] = std::move(item);
+        m_count++;
+        m_notEmpty.notify_one();
+        return PushResult::Pushed;
+    }
+
+    void wakeProducers() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_notFull.notify_all();
+    }
+
+    // 阻塞直到有数据；队列被中止时返回false
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_aborted || m_count > 0; });
+        if (m_aborted) {
+            return false;
+        }
+        takeFront(item);
+        m_notFull.notify_one();
+        return true;
+    }
+
+    bool tryPop(T& item) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_aborted || m_count == 0) {
+            return false;
+        }
+        takeFront(item);
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // 返回队首元素的指针（不出队）。只有唯一的消费者线程可以调用，
+    // 且在该线程下一次pop/flush之前指针有效（push只写入空槽，不会移动已有元素）
+    T* front() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_aborted || m_count == 0) {
+            return nullptr;
+        }
+        return &m_slots[m_head];
+    }
+
+    // 清空队列并唤醒被背压阻塞的生产者
+    void flush() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        clearSlots();
+        m_notFull.notify_all();
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_aborted = true;
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+    // 重新启用队列（abort之后再次打开文件时使用）
+    void start() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        clearSlots();
+        m_aborted = false;
+    }
+
+private:
+    void takeFront(T& item) {
+        item = std::move(m_slots[m_head]);
+        m_slots[m_head] = T();
+        m_head = (m_head + 1) % m_slots.size();
+        m_count--;
+    }
+
+    // 释放队列中元素持有的数据包/帧，槽位本身保留
+    void clearSlots() {
+        for (size_t i = 0; i < m_count; i++) {
+            m_slots[(m_head + i) % m_slots.size()] = T();
+        }
+        m_head = 0;
+        m_count = 0;
+    }
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::vector<T> m_slots;
+    size_t m_head;
+    size_t m_count;
+    size_t m_capacity;
+    bool m_aborted;
+};
+
+// 解复用线程 -> 解码线程
+// serial用于seek后丢弃过期数据：每次seek序号加一，旧序号的数据包直接丢弃
+// packet为空表示文件结束，解码器需要进入drain模式
+struct QueuedPacket {
+    PacketPtr packet;
+    int serial = 0;
+};
+
+// 解码线程 -> UI线程，frame通常已经是纹理可以直接上传的格式
+// （零拷贝上传模式下可能是原始解码帧，由UI线程直接转换到纹理内存）
+// frame为空表示文件结束
+struct QueuedFrame {
+    FramePtr frame;
+    double pts = 0.0;       // 秒
+    double duration = 0.0;  // 秒
+    int serial = 0;
+    size_t bytesCopied = 0; // 解码线程中已经发生的像素拷贝字节数
+};
+
+using PacketQueue = BoundedQueue<QueuedPacket>;
+using FrameQueue = BoundedQueue<QueuedFrame>;
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/mem.h>
+}
+
+#include "KeyframeIndex.h"
+#include "SidecarCache.h"
+
+// 探测结果的旁路缓存：avformat_find_stream_info得到的各流参数、视频流的精确时长和帧数、关键帧表
+// 再次打开同一文件（路径+大小+修改时间不变）时直接把参数填回解复用器，跳过探测解码，关键帧索引也不用重新扫描
+// 文件格式带版本号和libavformat的版本，任何一项不符都当作没有缓存
+namespace probe {
+
+// 一个流在探测之后的参数，定长字段按原样写入文件，后面跟extradata
+struct StreamInfo {
+    int32_t codecType;
+    int32_t codecId;
+    uint32_t codecTag;
+    int32_t format;
+    int64_t bitRate;
+    int32_t bitsPerCodedSample;
+    int32_t bitsPerRawSample;
+    int32_t profile;
+    int32_t level;
+    int32_t width;
+    int32_t height;
+    int32_t sarNum;
+    int32_t sarDen;
+    int32_t fieldOrder;
+    int32_t colorRange;
+    int32_t colorPrimaries;
+    int32_t colorTrc;
+    int32_t colorSpace;
+    int32_t chromaLocation;
+    int32_t videoDelay;
+    int32_t sampleRate;
+    int32_t channels;
+    int32_t channelOrder;
+    int32_t frameSize;
+    uint64_t channelMask;
+    int32_t blockAlign;
+    int32_t initialPadding;
+    int32_t trailingPadding;
+    int32_t seekPreroll;
+    int32_t timeBaseNum;
+    int32_t timeBaseDen;
+    int32_t avgRateNum;
+    int32_t avgRateDen;
+    int32_t realRateNum;
+    int32_t realRateDen;
+    int64_t startTime;
+    int64_t duration;
+    int64_t frames;
+    uint32_t extradataSize;
+    uint32_t reserved;
+};
+
+struct Record {
+    int videoStream = -1;
+    int64_t formatStartTime = AV_NOPTS_VALUE;
+    int64_t formatDuration = AV_NOPTS_VALUE;
+    double duration = 0.0;  // 视频流从第一帧开始到最后一帧结束的时长（秒），来自完整的数据包扫描
+    std::vector<StreamInfo> streams;
+    std::vector<std::vector<uint8_t>> extradata;
+    std::vector<KeyframeEntry> keyframes;
+    std::vector<int64_t> framePts;
+};
+
+constexpr uint32_t kVersion = 1;
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t library;  // avformat_version()，解复用器升级后参数的含义可能不同
+    int32_t videoStream;
+    uint64_t mediaSize;
+    int64_t mediaTime;
+    int64_t formatStartTime;
+    int64_t formatDuration;
+    double duration;
+    uint32_t streamCount;
+    uint32_t reserved;
+    uint64_t keyframeCount;
+    uint64_t frameCount;
+};
+
+inline std::string pathFor(const sidecar::MediaKey& key) {
+    return sidecar::cachePath(key, ".probe");
+}
+
+// 在avformat_find_stream_info之后记录各流的参数；关键帧表由setIndex在索引建好后补上
+inline void capture(const AVFormatContext* context, int videoStream, Record& record) {
+    record = Record();
+    record.videoStream = videoStream;
+    record.formatStartTime = context->start_time;
+    record.formatDuration = context->duration;
+    for (unsigned int i = 0; i < context->nb_streams; i++) {
+        const AVStream* stream = context->streams[i];
+        const AVCodecParameters* par = stream->codecpar;
+        StreamInfo info = {};
+        info.codecType = par->codec_type;
+        info.codecId = par->codec_id;
+        info.codecTag = par->codec_tag;
+        info.format = par->format;
+        info.bitRate = par->bit_rate;
+        info.bitsPerCodedSample = par->bits_per_coded_sample;
+        info.bitsPerRawSample = par->bits_per_raw_sample;
+        info.profile = par->profile;
+        info.level = par->level;
+        info.width = par->width;
+        info.height = par->height;
+        info.sarNum = par->sample_aspect_ratio.num;
+        info.sarDen = par->sample_aspect_ratio.den;
+        info.fieldOrder = par->field_order;
+        info.colorRange = par->color_range;
+        info.colorPrimaries = par->color_primaries;
+        info.colorTrc = par->color_trc;
+        info.colorSpace = par->color_space;
+        info.chromaLocation = par->chroma_location;
+        info.videoDelay = par->video_delay;
+        info.sampleRate = par->sample_rate;
+        info.channels = par->ch_layout.nb_channels;
+        info.channelOrder = par->ch_layout.order;
+        info.channelMask = par->ch_layout.order == AV_CHANNEL_ORDER_NATIVE ? par->ch_layout.u.mask : 0;
+        info.frameSize = par->frame_size;
+        info.blockAlign = par->block_align;
+        info.initialPadding = par->initial_padding;
+        info.trailingPadding = par->trailing_padding;
+        info.seekPreroll = par->seek_preroll;
+        info.timeBaseNum = stream->time_base.num;
+        info.timeBaseDen = stream->time_base.den;
+        info.avgRateNum = stream->avg_frame_rate.num;
+        info.avgRateDen = stream->avg_frame_rate.den;
+        info.realRateNum = stream->r_frame_rate.num;
+        info.realRateDen = stream->r_frame_rate.den;
+        info.startTime = stream->start_time;
+        info.duration = stream->duration;
+        info.frames = stream->nb_frames;
+        info.extradataSize = par->extradata && par->extradata_size > 0 ? (uint32_t)par->extradata_size : 0;
+        record.streams.push_back(info);
+        record.extradata.emplace_back(par->extradata, par->extradata + info.extradataSize);
+    }
+}
+
+// 从建好的关键帧索引补上帧表和精确时长；最后一帧的时长取与前一帧的间隔
+inline void setIndex(Record& record, const KeyframeIndex& index) {
+    record.keyframes = index.keyframes();
+    record.framePts = index.framePts();
+    record.duration = 0.0;
+    if (record.videoStream < 0 || record.videoStream >= (int)record.streams.size() || record.framePts.empty()) {
+        return;
+    }
+    const StreamInfo& video = record.streams[record.videoStream];
+    if (video.timeBaseNum <= 0 || video.timeBaseDen <= 0) {
+        return;
+    }
+    const std::vector<int64_t>& pts = record.framePts;
+    int64_t last = pts.back() - pts.front();
+    if (pts.size() >= 2) {
+        last += pts.back() - pts[pts.size() - 2];
+    } else if (video.avgRateNum > 0 && video.avgRateDen > 0) {
+        last += av_rescale_q(1, AVRational{ video.avgRateDen, video.avgRateNum }, AVRational{ video.timeBaseNum, video.timeBaseDen });
+    }
+    record.duration = last * av_q2d(AVRational{ video.timeBaseNum, video.timeBaseDen });
+}
+
+// 把缓存的参数填回刚打开的解复用器。流的个数、类型、编码和时间基必须与文件头解析出的一致，否则返回false，
+// 调用方照常探测
+inline bool apply(const Record& record, AVFormatContext* context) {
+    if (record.streams.size() != context->nb_streams) {
+        return false;
+    }
+    for (unsigned int i = 0; i < context->nb_streams; i++) {
+        const StreamInfo& info = record.streams[i];
+        const AVStream* stream = context->streams[i];
+        if (info.codecType != stream->codecpar->codec_type || info.codecId != stream->codecpar->codec_id ||
+            info.timeBaseNum != stream->time_base.num || info.timeBaseDen != stream->time_base.den) {
+            return false;
+        }
+    }
+
+    for (unsigned int i = 0; i < context->nb_streams; i++) {
+        const StreamInfo& info = record.streams[i];
+        const std::vector<uint8_t>& extradata = record.extradata[i];
+        AVStream* stream = context->streams[i];
+        AVCodecParameters* par = stream->codecpar;
+        par->codec_tag = info.codecTag;
+        par->format = info.format;
+        par->bit_rate = info.bitRate;
+        par->bits_per_coded_sample = info.bitsPerCodedSample;
+        par->bits_per_raw_sample = info.bitsPerRawSample;
+        par->profile = info.profile;
+        par->level = info.level;
+        par->width = info.width;
+        par->height = info.height;
+        par->sample_aspect_ratio = AVRational{ info.sarNum, info.sarDen };
+        par->field_order = (AVFieldOrder)info.fieldOrder;
+        par->color_range = (AVColorRange)info.colorRange;
+        par->color_primaries = (AVColorPrimaries)info.colorPrimaries;
+        par->color_trc = (AVColorTransferCharacteristic)info.colorTrc;
+        par->color_space = (AVColorSpace)info.colorSpace;
+        par->chroma_location = (AVChromaLocation)info.chromaLocation;
+        par->video_delay = info.videoDelay;
+        par->sample_rate = info.sampleRate;
+        av_channel_layout_uninit(&par->ch_layout);
+        if (info.channelOrder == AV_CHANNEL_ORDER_NATIVE && info.channelMask) {
+            av_channel_layout_from_mask(&par->ch_layout, info.channelMask);
+        } else if (info.channels > 0) {
+            par->ch_layout.order = AV_CHANNEL_ORDER_UNSPEC;
+            par->ch_layout.nb_channels = info.channels;
+        }
+        par->frame_size = info.frameSize;
+        par->block_align = info.blockAlign;
+        par->initial_padding = info.initialPadding;
+        par->trailing_padding = info.trailingPadding;
+        par->seek_preroll = info.seekPreroll;
+
+        av_freep(&par->extradata);
+        par->extradata_size = 0;
+        if (!extradata.empty()) {
+            par->extradata = (uint8_t*)av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (!par->extradata) {
+                return false;
+            }
+            std::memcpy(par->extradata, extradata.data(), extradata.size());
+            par->extradata_size = (int)extradata.size();
+        }
+
+        stream->avg_frame_rate = AVRational{ info.avgRateNum, info.avgRateDen };
+        stream->r_frame_rate = AVRational{ info.realRateNum, info.realRateDen };
+        stream->start_time = info.startTime;
+        stream->duration = info.duration;
+        stream->nb_frames = info.frames;
+    }
+    context->start_time = record.formatStartTime;
+    context->duration = record.formatDuration;
+    return true;
+}
+
+// 读取filename的缓存；不存在、版本不符或媒体已被修改时返回false
+inline bool load(const std::string& filename, Record& record) {
+    sidecar::MediaKey key;
+    if (!sidecar::mediaKey(filename, key)) {
+        return false;
+    }
+    std::ifstream in(pathFor(key), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t offset = 0;
+    auto read = [&data, &offset](void* out, size_t size) {
+        if (size > data.size() - offset) {
+            return false;
+        }
+        if (size == 0) {
+            return true;
+        }
+        std::memcpy(out, data.data() + offset, size);
+        offset += size;
+        return true;
+    };
+
+    FileHeader header;
+    if (!read(&header, sizeof(header)) || std::memcmp(header.magic, "VEPR", 4) != 0 || header.version != kVersion ||
+        header.library != avformat_version() || header.mediaSize != key.size || header.mediaTime != key.mtime ||
+        header.videoStream < 0 || header.videoStream >= (int)header.streamCount) {
+        return false;
+    }
+    // 长度字段先和文件大小比较，损坏的文件不会导致超大的分配
+    size_t remaining = data.size() - offset;
+    if (header.streamCount > remaining / sizeof(StreamInfo) ||
+        header.keyframeCount > remaining / sizeof(KeyframeEntry) || header.frameCount > remaining / sizeof(int64_t)) {
+        return false;
+    }
+
+    Record loaded;
+    loaded.videoStream = header.videoStream;
+    loaded.formatStartTime = header.formatStartTime;
+    loaded.formatDuration = header.formatDuration;
+    loaded.duration = header.duration;
+    loaded.streams.resize(header.streamCount);
+    loaded.extradata.resize(header.streamCount);
+    for (uint32_t i = 0; i < header.streamCount; i++) {
+        StreamInfo& info = loaded.streams[i];
+        if (!read(&info, sizeof(info)) || info.extradataSize > data.size() - offset) {
+            return false;
+        }
+        loaded.extradata[i].resize(info.extradataSize);
+        if (!read(loaded.extradata[i].data(), info.extradataSize)) {
+            return false;
+        }
+    }
+    loaded.keyframes.resize((size_t)header.keyframeCount);
+    loaded.framePts.resize((size_t)header.frameCount);
+    if (!read(loaded.keyframes.data(), loaded.keyframes.size() * sizeof(KeyframeEntry)) ||
+        !read(loaded.framePts.data(), loaded.framePts.size() * sizeof(int64_t)) || offset != data.size()) {
+        return false;
+    }
+    record = std::move(loaded);
+    return true;
+}
+
+// 写入filename的缓存：先写临时文件再改名，读取方不会看到写了一半的文件
+inline bool save(const std::string& filename, const Record& record) {
+    sidecar::MediaKey key;
+    if (!sidecar::mediaKey(filename, key) || record.videoStream < 0) {
+        return false;
+    }
+    FileHeader header = {};
+    std::memcpy(header.magic, "VEPR", 4);
+    header.version = kVersion;
+    header.library = avformat_version();
+    header.videoStream = record.videoStream;
+    header.mediaSize = key.size;
+    header.mediaTime = key.mtime;
+    header.formatStartTime = record.formatStartTime;
+    header.formatDuration = record.formatDuration;
+    header.duration = record.duration;
+    header.streamCount = (uint32_t)record.streams.size();
+    header.keyframeCount = record.keyframes.size();
+    header.frameCount = record.framePts.size();
+
+    std::string path = pathFor(key);
+    std::string partial = path + ".partial";
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write((const char*)&header, sizeof(header));
+        for (size_t i = 0; i < record.streams.size(); i++) {
+            out.write((const char*)&record.streams[i], sizeof(StreamInfo));
+            out.write((const char*)record.extradata[i].data(), (std::streamsize)record.extradata[i].size());
+        }
+        out.write((const char*)record.keyframes.data(), (std::streamsize)(record.keyframes.size() * sizeof(KeyframeEntry)));
+        out.write((const char*)record.framePts.data(), (std::streamsize)(record.framePts.size() * sizeof(int64_t)));
+        if (!out) {
+            std::cerr << "探测缓存: 无法写入 " << partial << std::endl;
+            std::error_code ec;
+            std::filesystem::remove(partial, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    std::filesystem::rename(partial, path, ec);
+    if (ec) {
+        std::filesystem::remove(partial, ec);
+        return false;
+    }
+    return true;
+}
+
+// 删除filename的缓存，基准测试用来测量没有缓存时的打开
+inline void remove(const std::string& filename) {
+    sidecar::MediaKey key;
+    if (sidecar::mediaKey(filename, key)) {
+        std::error_code ec;
+        std::filesystem::remove(pathFor(key), ec);
+    }
+}
+
+}  // namespace probe
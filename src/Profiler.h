@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProfileEvent {
+    const char* name;   // 必须是字符串字面量等静态存储的字符串
+    uint64_t start;     // 纳秒，相对Profiler创建时刻
+    uint64_t duration;  // 纳秒
+};
+
+// 单个线程的事件环形缓冲区：只有所属线程写入，其他线程可以随时读取快照
+// 写入不加锁；每个槽位带序号（序号锁），读取时前后两次读序号，复制期间被覆盖或正在写的槽位直接丢弃
+class ProfileRing {
+public:
+    static constexpr size_t kCapacity = 1 << 14;
+
+    ProfileRing() : m_active(true), m_slots(kCapacity), m_head(0) {}
+
+    ProfileRing(const ProfileRing&) = delete;
+    ProfileRing& operator=(const ProfileRing&) = delete;
+
+    void push(const char* name, uint64_t start, uint64_t duration) {
+        uint64_t index = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[index & (kCapacity - 1)];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start.store(start, std::memory_order_relaxed);
+        slot.duration.store(duration, std::memory_order_relaxed);
+        slot.sequence.store(index + 1, std::memory_order_release);
+        m_head.store(index + 1, std::memory_order_release);
+    }
+
+    // 追加开始时间不早于since的事件
+    void snapshot(std::vector<ProfileEvent>& out, uint64_t since) const {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        uint64_t begin = head > kCapacity ? head - kCapacity : 0;
+        for (uint64_t i = begin; i < head; i++) {
+            const Slot& slot = m_slots[i & (kCapacity - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != i + 1) {
+                continue;
+            }
+            ProfileEvent event = { slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                                   slot.duration.load(std::memory_order_relaxed) };
+            // 读字段期间写入线程绕回来覆盖了这个槽位
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != i + 1) {
+                continue;
+            }
+            if (event.start >= since) {
+                out.push_back(event);
+            }
+        }
+    }
+
+    // 被新线程复用时丢弃上一个线程的事件，只能在没有读者时调用（Profiler的锁内）
+    void reset() {
+        for (Slot& slot : m_slots) {
+            slot.sequence.store(0, std::memory_order_relaxed);
+        }
+        m_head.store(0, std::memory_order_release);
+    }
+
+    std::atomic<bool> m_active;  // 所属线程是否还在运行，退出后可以被新线程复用
+    std::string m_name;          // 线程名，在Profiler的锁内读写
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence;  // 写完的事件序号 + 1，正在写入时为0
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> start;
+        std::atomic<uint64_t> duration;
+    };
+
+    std::vector<Slot> m_slots;
+    std::atomic<uint64_t> m_head;  // 累计写入的事件数
+};
+
+// 热路径分段计时
+// - 用ProfileScope包住要测量的代码段，关闭时只有一次relaxed原子读，几乎没有开销
+// - 打开后每个线程写自己的环形缓冲区，互不加锁
+// - writeTrace()导出Chrome/Perfetto可以直接打开的trace JSON；summarize()供界面叠加层显示
+class Profiler {
+public:
+    struct StageStats {
+        const char* name = nullptr;
+        uint64_t count = 0;
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+    };
+
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    static bool enabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    void setEnabled(bool enabled) {
+        s_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    // 当前线程在trace中显示的名字；关闭时只记下名字，不分配环形缓冲区
+    static void setThreadName(const char* name) {
+        ThreadSlot& slot = threadSlot();
+        slot.name = name;
+        if (slot.ring) {
+            std::lock_guard<std::mutex> lock(instance().m_mutex);
+            slot.ring->m_name = name;
+        }
+    }
+
+    uint64_t now() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_epoch).count();
+    }
+
+    void record(const char* name, uint64_t start, uint64_t duration) {
+        if (ProfileRing* ring = threadRing()) {
+            ring->push(name, start, duration);
+        }
+    }
+
+    // 最近windowSeconds秒内各阶段的次数、总耗时和最大耗时，按总耗时降序
+    std::vector<StageStats> summarize(double windowSeconds) {
+        uint64_t current = now();
+        uint64_t window = (uint64_t)(windowSeconds * 1e9);
+        uint64_t since = current > window ? current - window : 0;
+
+        std::map<const char*, StageStats> stages;
+        std::vector<ProfileEvent> events;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& ring : m_rings) {
+                ring->snapshot(events, since);
+            }
+        }
+        for (const ProfileEvent& event : events) {
+            StageStats& stage = stages[event.name];
+            stage.name = event.name;
+            stage.count++;
+            double ms = event.duration / 1e6;
+            stage.totalMs += ms;
+            stage.maxMs = std::max(stage.maxMs, ms);
+        }
+
+        std::vector<StageStats> result;
+        for (const auto& entry : stages) {
+            result.push_back(entry.second);
+        }
+        std::sort(result.begin(), result.end(),
+                  [](const StageStats& a, const StageStats& b) { return a.totalMs > b.totalMs; });
+        return result;
+    }
+
+    // 导出Chrome trace格式（chrome://tracing 或 ui.perfetto.dev 打开）
+    bool writeTrace(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "无法写入trace文件: " << path << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        size_t count = 0;
+        for (size_t i = 0; i < m_rings.size(); i++) {
+            int tid = (int)i + 1;
+            const std::string& name = m_rings[i]->m_name;
+            file << (first ? "" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+                 << ", \"args\": {\"name\": \"" << (name.empty() ? "thread" : name) << "\"}}";
+            first = false;
+
+            std::vector<ProfileEvent> events;
+            m_rings[i]->snapshot(events, 0);
+            for (const ProfileEvent& event : events) {
+                file << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+                     << ", \"ts\": " << event.start / 1000.0 << ", \"dur\": " << event.duration / 1000.0 << "}";
+            }
+            count += events.size();
+        }
+        file << "\n]}\n";
+        std::cout << "已导出trace: " << path << "（" << count << " 个事件）" << std::endl;
+        return true;
+    }
+
+private:
+    static constexpr size_t kMaxThreads = 64;
+
+    Profiler() : m_epoch(std::chrono::steady_clock::now()) {}
+
+    // 线程退出时把环形缓冲区标记为空闲，事件保留到被新线程复用为止
+    struct ThreadSlot {
+        ProfileRing* ring = nullptr;
+        const char* name = nullptr;
+        ~ThreadSlot() {
+            if (ring) {
+                ring->m_active.store(false);
+            }
+        }
+    };
+
+    static ThreadSlot& threadSlot() {
+        thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    ProfileRing* threadRing() {
+        ThreadSlot& slot = threadSlot();
+        if (slot.ring) {
+            return slot.ring;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& ring : m_rings) {
+            bool expected = false;
+            if (ring->m_active.compare_exchange_strong(expected, true)) {
+                ring->reset();
+                slot.ring = ring.get();
+                break;
+            }
+        }
+        if (!slot.ring) {
+            if (m_rings.size() >= kMaxThreads) {
+                return nullptr;
+            }
+            m_rings.push_back(std::make_unique<ProfileRing>());
+            slot.ring = m_rings.back().get();
+        }
+        slot.ring->m_name = slot.name ? slot.name : "";
+        return slot.ring;
+    }
+
+    static inline std::atomic<bool> s_enabled{ false };
+
+    std::chrono::steady_clock::time_point m_epoch;
+    std::mutex m_mutex;  // 保护m_rings的增减和线程名
+    std::vector<std::unique_ptr<ProfileRing>> m_rings;
+};
+
+// 作用域计时：构造时记下开始时间，析构时写入当前线程的环形缓冲区
+// 例: { ProfileScope scope("sws_scale"); sws_scale(...); }
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : m_name(name), m_start(0), m_active(Profiler::enabled()) {
+        if (m_active) {
+            m_start = Profiler::instance().now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (m_active) {
+            Profiler& profiler = Profiler::instance();
+            profiler.record(m_name, m_start, profiler.now() - m_start);
+        }
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* m_name;
+    uint64_t m_start;
+    bool m_active;
+};
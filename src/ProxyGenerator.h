@@ -0,0 +1,494 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include "DecoderThreading.h"
+#include "MediaQueue.h"
+#include "Profiler.h"
+#include "ScalerCache.h"
+#include "SidecarCache.h"
+
+// 代理文件的缓存目录：<缓存根目录>/proxies，文件名由媒体的身份计算
+// 按总大小上限淘汰最久未使用的代理，使用时间记在文件的修改时间上
+namespace proxy {
+
+inline std::filesystem::path directory() {
+    std::filesystem::path dir = sidecar::cacheDirectory() / "proxies";
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+inline std::string pathFor(const sidecar::MediaKey& key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mov", (unsigned long long)sidecar::hashKey(key));
+    return (directory() / name).string();
+}
+
+// 生成过程中写入的临时文件，完成后改名为正式路径，半途退出的不会被当作可用的代理
+inline std::string partialPathFor(const std::string& path) {
+    std::filesystem::path partial(path);
+    partial.replace_extension(".partial.mov");
+    return partial.string();
+}
+
+// 标记为最近使用
+inline void touch(const std::string& path) {
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+}
+
+// 删除最久未使用的代理直到总大小不超过limitBytes；keep（正在使用的代理）和正在生成的临时文件不删
+inline void evict(uint64_t limitBytes, const std::string& keep) {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const auto& item : std::filesystem::directory_iterator(directory(), ec)) {
+        std::string name = item.path().filename().string();
+        if (!item.is_regular_file(ec) || item.path().extension() != ".mov" ||
+            name.find(".partial.") != std::string::npos) {
+            continue;
+        }
+        Entry entry = { item.path(), item.last_write_time(ec), (uint64_t)item.file_size(ec) };
+        total += entry.size;
+        entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    for (const Entry& entry : entries) {
+        if (total <= limitBytes) {
+            break;
+        }
+        if (entry.path.string() == keep) {
+            continue;
+        }
+        if (std::filesystem::remove(entry.path, ec)) {
+            total -= entry.size;
+            std::cout << "代理: 淘汰 " << entry.path.filename().string() << "（" << entry.size / (1024 * 1024) << "MB）" << std::endl;
+        }
+    }
+}
+
+}  // namespace proxy
+
+struct ProxyStats {
+    int width = 0;
+    int height = 0;
+    int64_t frames = 0;
+    int64_t audioPackets = 0;
+    double elapsedSeconds = 0.0;
+    uint64_t outputBytes = 0;
+};
+
+// 后台生成预览用的代理文件：低分辨率、每一帧都是关键帧（MPEG-4 intra），音频原样复制
+// - 时间戳保持源的秒数，预览在原文件和代理之间切换时播放位置、入点/出点、时长都不变
+// - 工作线程优先级低于预览，解码线程数来自核心预算（与缩略图同一档）
+// - 代理只用于预览和拖动时间线，导出仍然读取原文件
+class ProxyGenerator {
+public:
+    ProxyGenerator() : m_cancel(false), m_running(false), m_ready(false), m_progress(0.0), m_cacheLimit(kDefaultCacheLimit) {}
+
+    ~ProxyGenerator() {
+        cancel();
+        wait();
+    }
+
+    ProxyGenerator(const ProxyGenerator&) = delete;
+    ProxyGenerator& operator=(const ProxyGenerator&) = delete;
+
+    // 代理缓存目录的总大小上限（字节）
+    void setCacheLimit(uint64_t bytes) {
+        m_cacheLimit = bytes;
+    }
+
+    // 为source准备代理：缓存中已有时立即就绪，否则在后台生成；返回false表示无法使用代理
+    bool start(const std::string& source) {
+        cancel();
+        wait();
+        m_cancel = false;
+        m_ready = false;
+        m_progress = 0.0;
+
+        sidecar::MediaKey key;
+        if (m_cacheLimit == 0 || !sidecar::mediaKey(source, key)) {
+            return false;
+        }
+        m_path = proxy::pathFor(key);
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(m_path, ec)) {
+            proxy::touch(m_path);
+            m_progress = 1.0;
+            m_ready = true;
+            std::cout << "代理: 使用缓存 " << m_path << std::endl;
+            return true;
+        }
+
+        m_running = true;
+        m_thread = std::thread([this, source]() {
+            ThreadBudget::lowerCurrentThreadPriority();
+            Profiler::setThreadName("proxy");
+            std::string partial = proxy::partialPathFor(m_path);
+            ProxyStats stats;
+            if (generate(source, partial, stats)) {
+                std::error_code ec;
+                std::filesystem::rename(partial, m_path, ec);
+                if (!ec) {
+                    printStats(m_path, stats);
+                    proxy::evict(m_cacheLimit, m_path);
+                    m_ready = true;
+                }
+            } else if (!m_cancel) {
+                std::cerr << "代理: 生成失败: " << source << std::endl;
+            }
+            m_running = false;
+        });
+        return true;
+    }
+
+    bool isRunning() const {
+        return m_running;
+    }
+
+    // 代理文件已经可用
+    bool ready() const {
+        return m_ready.load();
+    }
+
+    double progress() const {
+        return m_progress.load();
+    }
+
+    // ready()之后有效
+    const std::string& path() const {
+        return m_path;
+    }
+
+    void cancel() {
+        m_cancel = true;
+    }
+
+    // 停止生成并忘掉当前的代理，打开另一个文件之前调用
+    void close() {
+        cancel();
+        wait();
+        m_ready = false;
+        m_progress = 0.0;
+    }
+
+    void wait() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    // 在当前线程把source转成代理写到output，失败或取消时删除output
+    bool generate(const std::string& source, const std::string& output, ProxyStats& stats) {
+        ProfileScope scope("proxy");
+        auto begin = std::chrono::steady_clock::now();
+        stats = ProxyStats();
+        Job job;
+        bool ok = openInput(job, source) && openOutput(job, output, stats) && transcode(job, stats);
+        closeJob(job);
+
+        stats.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::error_code ec;
+        if (!ok || m_cancel) {
+            std::filesystem::remove(output, ec);
+            return false;
+        }
+        stats.outputBytes = (uint64_t)std::filesystem::file_size(output, ec);
+        return true;
+    }
+
+    static void printStats(const std::string& output, const ProxyStats& stats) {
+        std::cout << "代理: 生成完成 " << output << " " << stats.width << "x" << stats.height
+                  << "，" << stats.frames << " 帧，音频 " << stats.audioPackets << " 个数据包"
+                  << "，耗时 " << stats.elapsedSeconds * 1000 << "ms，" << stats.outputBytes / 1024 << "KB" << std::endl;
+    }
+
+    static constexpr int kProxyHeight = 540;
+    static constexpr uint64_t kDefaultCacheLimit = 4ULL * 1024 * 1024 * 1024;
+
+private:
+    static constexpr int kQuantizer = 4;  // MPEG-4固定量化参数，帧内编码下画质足够预览
+
+    struct Job {
+        AVFormatContext* input = nullptr;
+        AVFormatContext* output = nullptr;
+        AVCodecContext* decoder = nullptr;
+        AVCodecContext* encoder = nullptr;
+        AVStream* videoOut = nullptr;
+        AVStream* audioOut = nullptr;
+        int videoIndex = -1;
+        int audioIndex = -1;
+        AVRational sourceTimeBase = { 1, 25 };
+        AVRational encoderTimeBase = { 1, 25 };
+        double startSeconds = 0.0;
+        double duration = 0.0;
+        int64_t lastPts = AV_NOPTS_VALUE;
+        ThreadBudget::Lease lease;
+    };
+
+    static int interruptCallback(void* opaque) {
+        return ((ProxyGenerator*)opaque)->m_cancel.load() ? 1 : 0;
+    }
+
+    bool openInput(Job& job, const std::string& source) {
+        job.input = avformat_alloc_context();
+        if (!job.input) {
+            return false;
+        }
+        job.input->interrupt_callback.callback = &ProxyGenerator::interruptCallback;
+        job.input->interrupt_callback.opaque = this;
+        if (avformat_open_input(&job.input, source.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "代理: 无法打开文件: " << source << std::endl;
+            return false;
+        }
+        if (avformat_find_stream_info(job.input, nullptr) < 0) {
+            return false;
+        }
+        job.videoIndex = av_find_best_stream(job.input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (job.videoIndex < 0) {
+            std::cerr << "代理: 未找到视频流" << std::endl;
+            return false;
+        }
+        job.audioIndex = av_find_best_stream(job.input, AVMEDIA_TYPE_AUDIO, -1, job.videoIndex, nullptr, 0);
+        for (unsigned int i = 0; i < job.input->nb_streams; i++) {
+            if ((int)i != job.videoIndex && (int)i != job.audioIndex) {
+                job.input->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+
+        AVStream* stream = job.input->streams[job.videoIndex];
+        job.sourceTimeBase = stream->time_base;
+        job.startSeconds = stream->start_time != AV_NOPTS_VALUE ? stream->start_time * av_q2d(stream->time_base) : 0.0;
+        job.duration = stream->duration != AV_NOPTS_VALUE ? stream->duration * av_q2d(stream->time_base)
+                       : job.input->duration > 0 ? job.input->duration / (double)AV_TIME_BASE : 0.0;
+
+        const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+        job.decoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+        if (!job.decoder || avcodec_parameters_to_context(job.decoder, stream->codecpar) < 0) {
+            std::cerr << "代理: 无法创建解码器" << std::endl;
+            return false;
+        }
+        job.lease = ThreadBudget::instance().acquire(DecoderRole::Thumbnail);
+        job.decoder->thread_count = std::max(1, job.lease.threads());
+        if (avcodec_open2(job.decoder, codec, nullptr) < 0) {
+            std::cerr << "代理: 无法打开解码器" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool openOutput(Job& job, const std::string& path, ProxyStats& stats) {
+        // 扩展名是.partial.mov，格式显式指定
+        if (avformat_alloc_output_context2(&job.output, nullptr, "mov", path.c_str()) < 0 || !job.output) {
+            return false;
+        }
+
+        AVStream* source = job.input->streams[job.videoIndex];
+        AVRational sar = source->codecpar->sample_aspect_ratio;
+        double aspect = (double)job.decoder->width / std::max(1, job.decoder->height) * (sar.num > 0 && sar.den > 0 ? av_q2d(sar) : 1.0);
+        stats.height = std::min(kProxyHeight, job.decoder->height) & ~1;
+        stats.width = std::max(2, (int)std::lround(stats.height * aspect) & ~1);
+
+        AVRational rate = av_guess_frame_rate(job.input, source, nullptr);
+        if (rate.num <= 0 || rate.den <= 0) {
+            rate = { 25, 1 };
+        }
+        // MPEG-4等编码器要求时间基分母不超过16位，超出时按帧率
+        job.encoderTimeBase = job.sourceTimeBase.den <= 65535 ? job.sourceTimeBase : av_inv_q(rate);
+
+        const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+        job.encoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+        if (!job.encoder) {
+            std::cerr << "代理: 找不到MPEG-4编码器" << std::endl;
+            return false;
+        }
+        job.encoder->width = stats.width;
+        job.encoder->height = stats.height;
+        job.encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+        job.encoder->sample_aspect_ratio = { 1, 1 };
+        job.encoder->time_base = job.encoderTimeBase;
+        job.encoder->framerate = rate;
+        job.encoder->gop_size = 1;  // 每一帧都是关键帧，任意位置seek只解码一帧
+        job.encoder->max_b_frames = 0;
+        job.encoder->flags |= AV_CODEC_FLAG_QSCALE;
+        job.encoder->global_quality = FF_QP2LAMBDA * kQuantizer;
+        job.encoder->thread_count = 1;
+        if (job.output->oformat->flags & AVFMT_GLOBALHEADER) {
+            job.encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+        if (avcodec_open2(job.encoder, codec, nullptr) < 0) {
+            std::cerr << "代理: 无法打开编码器" << std::endl;
+            return false;
+        }
+
+        job.videoOut = avformat_new_stream(job.output, nullptr);
+        if (!job.videoOut || avcodec_parameters_from_context(job.videoOut->codecpar, job.encoder) < 0) {
+            return false;
+        }
+        job.videoOut->time_base = job.encoderTimeBase;
+        job.videoOut->avg_frame_rate = rate;
+
+        // 音频原样复制；容器放不下时不生成代理，否则切换到代理后会没有声音
+        if (job.audioIndex >= 0) {
+            AVStream* audio = job.input->streams[job.audioIndex];
+            if (avformat_query_codec(job.output->oformat, audio->codecpar->codec_id, FF_COMPLIANCE_NORMAL) != 1) {
+                std::cerr << "代理: 容器不支持复制音频 " << avcodec_get_name(audio->codecpar->codec_id) << std::endl;
+                return false;
+            }
+            job.audioOut = avformat_new_stream(job.output, nullptr);
+            if (!job.audioOut || avcodec_parameters_copy(job.audioOut->codecpar, audio->codecpar) < 0) {
+                return false;
+            }
+            job.audioOut->codecpar->codec_tag = 0;
+            job.audioOut->time_base = audio->time_base;
+        }
+
+        if (avio_open(&job.output->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+            std::cerr << "代理: 无法写入文件: " << path << std::endl;
+            return false;
+        }
+        if (avformat_write_header(job.output, nullptr) < 0) {
+            std::cerr << "代理: 无法写入文件头" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool transcode(Job& job, ProxyStats& stats) {
+        AVStream* audioIn = job.audioIndex >= 0 ? job.input->streams[job.audioIndex] : nullptr;
+        ScalerCache scalers(1);
+        PacketPtr packet = makePacket();
+        FramePtr decoded = makeFrame();
+        FramePtr scaled = makeFrame();
+        if (!packet || !decoded || !scaled) {
+            return false;
+        }
+        scaled->format = AV_PIX_FMT_YUV420P;
+        scaled->width = stats.width;
+        scaled->height = stats.height;
+        if (av_frame_get_buffer(scaled.get(), 0) < 0) {
+            return false;
+        }
+
+        // 解码器送出的帧缩小后编码，编码器送出的数据包写入文件
+        auto encodeFrame = [&](AVFrame* frame) {
+            if (avcodec_send_frame(job.encoder, frame) < 0) {
+                return false;
+            }
+            while (avcodec_receive_packet(job.encoder, packet.get()) == 0) {
+                av_packet_rescale_ts(packet.get(), job.encoderTimeBase, job.videoOut->time_base);
+                packet->stream_index = job.videoOut->index;
+                if (av_interleaved_write_frame(job.output, packet.get()) < 0) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        auto receiveFrames = [&]() {
+            while (avcodec_receive_frame(job.decoder, decoded.get()) == 0) {
+                int64_t pts = decoded->best_effort_timestamp;
+                if (pts == AV_NOPTS_VALUE || m_cancel) {
+                    av_frame_unref(decoded.get());
+                    continue;
+                }
+                SwsContext* scaler = scalers.get(decoded->width, decoded->height, (AVPixelFormat)decoded->format,
+                                                 stats.width, stats.height, AV_PIX_FMT_YUV420P, SWS_AREA);
+                if (!scaler || av_frame_make_writable(scaled.get()) < 0) {
+                    return false;
+                }
+                sws_scale(scaler, decoded->data, decoded->linesize, 0, decoded->height, scaled->data, scaled->linesize);
+                // 保持源的时间戳；换算到编码器时间基后重复的往后挪一格，编码器要求严格递增
+                scaled->pts = av_rescale_q(pts, job.sourceTimeBase, job.encoderTimeBase);
+                if (job.lastPts != AV_NOPTS_VALUE && scaled->pts <= job.lastPts) {
+                    scaled->pts = job.lastPts + 1;
+                }
+                job.lastPts = scaled->pts;
+                double seconds = pts * av_q2d(job.sourceTimeBase) - job.startSeconds;
+                av_frame_unref(decoded.get());
+                if (!encodeFrame(scaled.get())) {
+                    return false;
+                }
+                stats.frames++;
+                if (job.duration > 0.0) {
+                    m_progress = std::min(1.0, std::max(0.0, seconds / job.duration));
+                }
+            }
+            return true;
+        };
+
+        while (!m_cancel && av_read_frame(job.input, packet.get()) >= 0) {
+            bool ok = true;
+            if (packet->stream_index == job.videoIndex) {
+                avcodec_send_packet(job.decoder, packet.get());  // 损坏的数据包只跳过
+                av_packet_unref(packet.get());
+                ok = receiveFrames();
+            } else if (audioIn && packet->stream_index == job.audioIndex) {
+                av_packet_rescale_ts(packet.get(), audioIn->time_base, job.audioOut->time_base);
+                packet->stream_index = job.audioOut->index;
+                packet->pos = -1;
+                ok = av_interleaved_write_frame(job.output, packet.get()) >= 0;
+                stats.audioPackets++;
+            } else {
+                av_packet_unref(packet.get());
+            }
+            if (!ok) {
+                return false;
+            }
+        }
+        if (m_cancel) {
+            return false;
+        }
+
+        avcodec_send_packet(job.decoder, nullptr);
+        if (!receiveFrames() || !encodeFrame(nullptr)) {
+            return false;
+        }
+        m_progress = 1.0;
+        return av_write_trailer(job.output) >= 0;
+    }
+
+    static void closeJob(Job& job) {
+        avcodec_free_context(&job.decoder);
+        avcodec_free_context(&job.encoder);
+        if (job.output) {
+            avio_closep(&job.output->pb);
+            avformat_free_context(job.output);
+            job.output = nullptr;
+        }
+        if (job.input) {
+            avformat_close_input(&job.input);
+        }
+        job.lease.release();
+    }
+
+    std::atomic<bool> m_cancel;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_ready;
+    std::atomic<double> m_progress;
+    uint64_t m_cacheLimit;
+    std::string m_path;  // 代理的正式路径
+    std::thread m_thread;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+// 按(源尺寸, 源格式, 目标尺寸, 目标格式, 算法)缓存SwsContext
+// 预览尺寸不变时直接复用，只有窗口缩放等导致参数变化时才重建；
+// 容量很小，满了之后通过sws_getCachedContext改造最久未使用的那个
+// 非线程安全，每个线程使用自己的实例（rebuilds()除外，可以从其他线程读取）
+class ScalerCache {
+public:
+    explicit ScalerCache(size_t capacity = 4) : m_capacity(capacity ? capacity : 1), m_tick(0), m_rebuilds(0) {}
+
+    ~ScalerCache() {
+        clear();
+    }
+
+    ScalerCache(const ScalerCache&) = delete;
+    ScalerCache& operator=(const ScalerCache&) = delete;
+
+    SwsContext* get(int srcWidth, int srcHeight, AVPixelFormat srcFormat,
+                    int dstWidth, int dstHeight, AVPixelFormat dstFormat,
+                    int flags = SWS_BILINEAR) {
+        Key key = { srcWidth, srcHeight, srcFormat, dstWidth, dstHeight, dstFormat, flags };
+        m_tick++;
+
+        for (Entry& entry : m_entries) {
+            if (entry.key == key) {
+                entry.lastUsed = m_tick;
+                return entry.context;
+            }
+        }
+
+        Entry* slot = nullptr;
+        if (m_entries.size() < m_capacity) {
+            m_entries.push_back(Entry());
+            slot = &m_entries.back();
+        } else {
+            slot = &m_entries.front();
+            for (Entry& entry : m_entries) {
+                if (entry.lastUsed < slot->lastUsed) {
+                    slot = &entry;
+                }
+            }
+        }
+
+        slot->context = sws_getCachedContext(
+            slot->context,
+            srcWidth, srcHeight, srcFormat,
+            dstWidth, dstHeight, dstFormat,
+            flags, nullptr, nullptr, nullptr
+        );
+        slot->key = key;
+        slot->lastUsed = m_tick;
+        m_rebuilds++;
+
+        if (!slot->context) {
+            // 创建失败时旧的context已被sws_getCachedContext释放，条目不保留
+            m_entries.erase(m_entries.begin() + (slot - m_entries.data()));
+            return nullptr;
+        }
+        return slot->context;
+    }
+
+    void clear() {
+        for (Entry& entry : m_entries) {
+            sws_freeContext(entry.context);
+        }
+        m_entries.clear();
+    }
+
+    // 累计创建/重建SwsContext的次数，正常播放时应当只在尺寸变化时增加
+    uint64_t rebuilds() const {
+        return m_rebuilds;
+    }
+
+private:
+    struct Key {
+        int srcWidth, srcHeight;
+        AVPixelFormat srcFormat;
+        int dstWidth, dstHeight;
+        AVPixelFormat dstFormat;
+        int flags;
+
+        bool operator==(const Key& other) const {
+            return srcWidth == other.srcWidth && srcHeight == other.srcHeight && srcFormat == other.srcFormat &&
+                   dstWidth == other.dstWidth && dstHeight == other.dstHeight && dstFormat == other.dstFormat &&
+                   flags == other.flags;
+        }
+    };
+
+    struct Entry {
+        Key key = {};
+        SwsContext* context = nullptr;
+        uint64_t lastUsed = 0;
+    };
+
+    std::vector<Entry> m_entries;
+    size_t m_capacity;
+    uint64_t m_tick;
+    std::atomic<uint64_t> m_rebuilds;
+};
@@ -0,0 +1,852 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include "BlendKernels.h"
+#include "DecoderThreading.h"
+#include "KeyframeIndex.h"
+#include "MediaQueue.h"
+#include "ProbeCache.h"
+#include "Profiler.h"
+#include "ScalerCache.h"
+#include "SidecarCache.h"
+
+// 镜头切换检测用到的亮度统计
+// 每帧的亮度平面按8x8块求平均得到一张小缩略图（1080p为240x135），相邻两帧比较缩略图的平均绝对差和64级直方图
+namespace scene {
+
+constexpr int kBlockSize = 8;
+constexpr int kHistogramBins = 64;
+
+// 把一行中每8个像素的和累加到sums[group]；一个块8行的和最大16320，不会溢出uint16_t
+inline void groupSumsScalar(const uint8_t* row, int groups, uint16_t* sums) {
+    for (int group = 0; group < groups; group++) {
+        const uint8_t* pixels = row + group * kBlockSize;
+        int sum = 0;
+        for (int i = 0; i < kBlockSize; i++) {
+            sum += pixels[i];
+        }
+        sums[group] = (uint16_t)(sums[group] + sum);
+    }
+}
+
+// a、b两段字节的绝对差之和
+inline uint64_t sadScalar(const uint8_t* a, const uint8_t* b, size_t count) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += (uint64_t)std::abs((int)a[i] - (int)b[i]);
+    }
+    return sum;
+}
+
+#ifdef BLEND_X86
+
+// psadbw对零求差就是每8个字节求和，结果在每个64位的低16位；两次packs把它们按顺序收拢成8个uint16
+BLEND_TARGET_SSE2 inline void groupSumsSse2(const uint8_t* row, int groups, uint16_t* sums) {
+    const __m128i zero = _mm_setzero_si128();
+    int group = 0;
+    for (; group + 8 <= groups; group += 8) {
+        const uint8_t* pixels = row + group * kBlockSize;
+        __m128i a = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)pixels), zero);
+        __m128i b = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pixels + 16)), zero);
+        __m128i c = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pixels + 32)), zero);
+        __m128i d = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(pixels + 48)), zero);
+        __m128i packed = _mm_packs_epi32(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+        __m128i total = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sums + group)), packed);
+        _mm_storeu_si128((__m128i*)(sums + group), total);
+    }
+    groupSumsScalar(row + group * kBlockSize, groups - group, sums + group);
+}
+
+BLEND_TARGET_SSE2 inline uint64_t sadSse2(const uint8_t* a, const uint8_t* b, size_t count) {
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(x, y));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, total);
+    return lanes[0] + lanes[1] + sadScalar(a + i, b + i, count - i);
+}
+
+// packs只在128位通道内进行，最后按32位（两个组）重排回原来的顺序
+BLEND_TARGET_AVX2 inline void groupSumsAvx2(const uint8_t* row, int groups, uint16_t* sums) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int group = 0;
+    for (; group + 16 <= groups; group += 16) {
+        const uint8_t* pixels = row + group * kBlockSize;
+        __m256i a = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)pixels), zero);
+        __m256i b = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(pixels + 32)), zero);
+        __m256i c = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(pixels + 64)), zero);
+        __m256i d = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(pixels + 96)), zero);
+        __m256i packed = _mm256_packs_epi32(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+        packed = _mm256_permutevar8x32_epi32(packed, order);
+        __m256i total = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*)(sums + group)), packed);
+        _mm256_storeu_si256((__m256i*)(sums + group), total);
+    }
+    groupSumsScalar(row + group * kBlockSize, groups - group, sums + group);
+}
+
+BLEND_TARGET_AVX2 inline uint64_t sadAvx2(const uint8_t* a, const uint8_t* b, size_t count) {
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(x, y));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sadScalar(a + i, b + i, count - i);
+}
+
+#endif  // BLEND_X86
+
+}  // namespace scene
+
+// 一套亮度统计的实现
+struct SceneKernels {
+    using GroupSumsFunction = void (*)(const uint8_t* row, int groups, uint16_t* sums);
+    using SadFunction = uint64_t (*)(const uint8_t* a, const uint8_t* b, size_t count);
+
+    const char* name;
+    GroupSumsFunction groupSums;
+    SadFunction sad;
+
+    static const SceneKernels& scalar() {
+        static const SceneKernels kernels = { "scalar", &scene::groupSumsScalar, &scene::sadScalar };
+        return kernels;
+    }
+
+    static const SceneKernels& best() {
+        static const SceneKernels& kernels = *available().back();
+        return kernels;
+    }
+
+    // 当前CPU可用的全部实现，从慢到快
+    static std::vector<const SceneKernels*> available() {
+        std::vector<const SceneKernels*> result = { &scalar() };
+#ifdef BLEND_X86
+        static const SceneKernels sse2 = { "sse2", &scene::groupSumsSse2, &scene::sadSse2 };
+        static const SceneKernels avx2 = { "avx2", &scene::groupSumsAvx2, &scene::sadAvx2 };
+        if (BlendKernels::cpuHasSse2()) {
+            result.push_back(&sse2);
+            if (BlendKernels::cpuHasAvx2()) {
+                result.push_back(&avx2);
+            }
+        }
+#endif
+        return result;
+    }
+
+    static const SceneKernels* find(const std::string& name) {
+        for (const SceneKernels* kernels : available()) {
+            if (name == kernels->name) {
+                return kernels;
+            }
+        }
+        return nullptr;
+    }
+};
+
+namespace scene {
+
+// 一帧的亮度缩略图和它的直方图
+struct Thumbnail {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+    uint32_t histogram[kHistogramBins] = {};
+};
+
+// 亮度平面按块求平均；不足一块的右边缘和下边缘忽略，sums是调用方复用的临时数组
+inline void makeThumbnail(const SceneKernels& kernels, const uint8_t* luma, int linesize, int width, int height,
+                          Thumbnail& out, std::vector<uint16_t>& sums) {
+    out.width = width / kBlockSize;
+    out.height = height / kBlockSize;
+    out.pixels.resize((size_t)out.width * out.height);
+    std::fill(std::begin(out.histogram), std::end(out.histogram), 0u);
+    sums.resize(out.width);
+    for (int blockRow = 0; blockRow < out.height; blockRow++) {
+        std::fill(sums.begin(), sums.end(), (uint16_t)0);
+        for (int i = 0; i < kBlockSize; i++) {
+            kernels.groupSums(luma + (ptrdiff_t)(blockRow * kBlockSize + i) * linesize, out.width, sums.data());
+        }
+        uint8_t* row = out.pixels.data() + (size_t)blockRow * out.width;
+        for (int x = 0; x < out.width; x++) {
+            int value = (sums[x] + kBlockSize * kBlockSize / 2) / (kBlockSize * kBlockSize);
+            row[x] = (uint8_t)value;
+            out.histogram[value * kHistogramBins / 256]++;
+        }
+    }
+}
+
+// 两张缩略图的平均绝对差（0..255）；尺寸变了（流中途改分辨率）当作完全不同
+inline float difference(const SceneKernels& kernels, const Thumbnail& a, const Thumbnail& b) {
+    if (a.width != b.width || a.height != b.height) {
+        return 255.0f;
+    }
+    if (a.pixels.empty()) {
+        return 0.0f;
+    }
+    return (float)((double)kernels.sad(a.pixels.data(), b.pixels.data(), a.pixels.size()) / a.pixels.size());
+}
+
+// 两个直方图不重叠的比例（0..1）
+inline float histogramDistance(const Thumbnail& a, const Thumbnail& b) {
+    if (a.pixels.empty() || a.pixels.size() != b.pixels.size()) {
+        return a.pixels.size() == b.pixels.size() ? 0.0f : 1.0f;
+    }
+    uint64_t sum = 0;
+    for (int i = 0; i < kHistogramBins; i++) {
+        sum += (uint64_t)std::abs((int64_t)a.histogram[i] - (int64_t)b.histogram[i]);
+    }
+    return (float)((double)sum / (2.0 * a.pixels.size()));
+}
+
+}  // namespace scene
+
+// 一帧与前一帧的差异；文件的第一帧两项都是-1
+struct SceneSample {
+    int64_t pts;       // 视频流时间基
+    float difference;  // 亮度缩略图的平均绝对差，0..255
+    float histogram;   // 直方图的差异比例，0..1
+};
+
+// 判定切点的阈值；改动阈值只需要重新判定，不需要重新分析（缓存里保存的是逐帧的差异）
+struct SceneOptions {
+    int workers = 0;               // 并行分析的段数上限，0表示使用全部核心
+    float minDifference = 20.0f;   // 平均绝对差至少这么大才可能是切点
+    float adaptiveRatio = 3.0f;    // 并且是之前kWindow帧平均差的这么多倍（画面本身在剧烈运动时不误判）
+    float histogramCut = 0.5f;     // 或者直方图的差异超过这个比例
+    double minSceneSeconds = 0.5;  // 两个切点之间的最短间隔
+};
+
+struct SceneStats {
+    int workers = 0;
+    size_t segments = 0;
+    int64_t frames = 0;
+    size_t markers = 0;
+    double seconds = 0.0;
+    const char* kernels = "";
+};
+
+// 镜头切换检测，结果作为时间线上的标记
+// - 在关键帧处把视频流切成若干段，每个工作线程用自己的解复用器和单线程解码器依次领取分段，
+//   段与段之间没有依赖，吞吐量随核心数近似线性增长
+// - 每帧只做亮度缩略图（SIMD）和直方图，与前一帧比较；段首帧和段尾帧的缩略图留下来，全部完成后接上段间的差异
+// - 逐帧的差异写入旁路缓存，再次打开同一文件时直接按当前阈值判定切点
+// - 后台分析完成之前markers()为空；关闭文件时取消并等待所有线程退出
+class SceneDetector {
+public:
+    SceneDetector()
+        : m_kernels(&SceneKernels::best()), m_timeBase{ 1, 1 }, m_complete(false), m_cancel(false), m_running(false),
+          m_framesDone(0), m_framesTotal(0) {}
+
+    ~SceneDetector() {
+        close();
+    }
+
+    SceneDetector(const SceneDetector&) = delete;
+    SceneDetector& operator=(const SceneDetector&) = delete;
+
+    // 对之后的open/analyze生效
+    void setOptions(const SceneOptions& options) {
+        m_options = options;
+    }
+
+    const SceneOptions& options() const {
+        return m_options;
+    }
+
+    void setKernels(const SceneKernels& kernels) {
+        m_kernels = &kernels;
+    }
+
+    // 文件打开之后调用：有缓存时直接判定切点，否则在后台分析
+    bool open(const std::string& filename) {
+        close();
+        m_filename = filename;
+        m_cancel = false;
+        if (loadCache()) {
+            m_markers = detectCuts();
+            m_complete.store(true, std::memory_order_release);
+            std::cout << "场景: 从缓存载入 " << m_samples.size() << " 帧，" << m_markers.size() << " 个切点" << std::endl;
+            return true;
+        }
+        m_running = true;
+        m_thread = std::thread([this]() {
+            ThreadBudget::lowerCurrentThreadPriority();
+            Profiler::setThreadName("scenes");
+            SceneStats stats;
+            if (run(true, stats)) {
+                saveCache();
+                std::cout << "场景: 分析完成 " << stats.frames << " 帧，" << stats.markers << " 个切点，" << stats.workers
+                          << " 个线程，" << (int)(stats.seconds * 1000) << "ms" << std::endl;
+            }
+            m_running = false;
+        });
+        return true;
+    }
+
+    // 在当前线程分析filename，不读写缓存；基准测试用
+    bool analyze(const std::string& filename, SceneStats& stats) {
+        close();
+        m_filename = filename;
+        m_cancel = false;
+        return run(false, stats);
+    }
+
+    // 取消后台分析并清空结果
+    void close() {
+        m_cancel = true;
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_complete = false;
+        m_samples.clear();
+        m_markers.clear();
+        m_framesDone = 0;
+        m_framesTotal = 0;
+    }
+
+    // 后台分析是否结束（包括失败和取消）
+    bool finished() const {
+        return !m_running.load();
+    }
+
+    bool complete() const {
+        return m_complete.load(std::memory_order_acquire);
+    }
+
+    // 已经分析的帧数比例，0..1
+    double progress() const {
+        if (complete()) {
+            return 1.0;
+        }
+        int64_t total = m_framesTotal.load();
+        return total > 0 ? std::min(1.0, (double)m_framesDone.load() / total) : 0.0;
+    }
+
+    // 切点的时间（秒，与时间线相同的流时间），升序；分析完成之前为空
+    const std::vector<double>& markers() const {
+        static const std::vector<double> kNone;
+        return complete() ? m_markers : kNone;
+    }
+
+    size_t markerCount() const {
+        return markers().size();
+    }
+
+    // time之后（之前）最近的切点；正好停在切点上时跳到下一个（上一个）
+    bool nextMarker(double time, double& marker) const {
+        const std::vector<double>& list = markers();
+        auto it = std::upper_bound(list.begin(), list.end(), time + kMarkerEpsilon);
+        if (it == list.end()) {
+            return false;
+        }
+        marker = *it;
+        return true;
+    }
+
+    bool previousMarker(double time, double& marker) const {
+        const std::vector<double>& list = markers();
+        auto it = std::lower_bound(list.begin(), list.end(), time - kMarkerEpsilon);
+        if (it == list.begin()) {
+            return false;
+        }
+        marker = *std::prev(it);
+        return true;
+    }
+
+private:
+    static constexpr double kMinSegmentSeconds = 1.0;  // 分段太短时开放GOP的前导帧重复解码占比过高
+    static constexpr int kSegmentsPerWorker = 4;       // 分段多于工作线程，快慢不均时后面的段可以补上
+    static constexpr size_t kWindow = 12;              // 自适应阈值参考的之前帧数
+    static constexpr double kMarkerEpsilon = 1e-3;
+    static constexpr uint32_t kCacheVersion = 1;
+
+    struct Segment {
+        int64_t start = 0;  // 视频流时间基，[start, end)
+        int64_t end = 0;
+        std::vector<SceneSample> samples;
+        scene::Thumbnail first;  // 段内第一帧和最后一帧，合并时算出段间的差异
+        scene::Thumbnail last;
+    };
+
+    struct Plan {
+        int videoIndex = -1;
+        AVCodecParameters* videoPar = nullptr;
+        AVRational timeBase = { 1, 1 };
+        int64_t frames = 0;
+        int workers = 1;
+        const SceneKernels* kernels = nullptr;
+        std::vector<Segment> segments;  // 开始分析之后不再增减
+        std::atomic<size_t> nextSegment{ 0 };
+        std::atomic<bool> failed{ false };
+
+        ~Plan() {
+            avcodec_parameters_free(&videoPar);
+        }
+    };
+
+    // 每个工作线程复用的缓冲
+    struct Scratch {
+        ScalerCache scaler{ 1 };
+        std::vector<uint8_t> gray;
+        std::vector<uint16_t> sums;
+        scene::Thumbnail previous;
+        scene::Thumbnail current;
+    };
+
+    // 旁路缓存文件布局：文件头 | SceneSample * sampleCount
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t mediaSize;
+        int64_t mediaTime;
+        int32_t timeBaseNum;
+        int32_t timeBaseDen;
+        uint64_t sampleCount;
+    };
+
+    static int interruptCallback(void* opaque) {
+        return ((SceneDetector*)opaque)->m_cancel.load() ? 1 : 0;
+    }
+
+    AVFormatContext* openInput() {
+        AVFormatContext* context = avformat_alloc_context();
+        if (!context) {
+            return nullptr;
+        }
+        context->interrupt_callback.callback = &SceneDetector::interruptCallback;
+        context->interrupt_callback.opaque = this;
+        if (avformat_open_input(&context, m_filename.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "场景: 无法打开文件: " << m_filename << std::endl;
+            return nullptr;
+        }
+        if (avformat_find_stream_info(context, nullptr) < 0) {
+            std::cerr << "场景: 无法获取流信息" << std::endl;
+            avformat_close_input(&context);
+            return nullptr;
+        }
+        return context;
+    }
+
+    static void keepOnly(AVFormatContext* context, int streamIndex) {
+        for (unsigned int i = 0; i < context->nb_streams; i++) {
+            context->streams[i]->discard = (int)i == streamIndex ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+    }
+
+    bool run(bool lowPriority, SceneStats& stats) {
+        auto begin = std::chrono::steady_clock::now();
+        Plan plan;
+        plan.kernels = m_kernels;
+        if (!prepare(plan)) {
+            return false;
+        }
+        m_framesTotal = plan.frames;
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < plan.workers; i++) {
+            workers.emplace_back([this, &plan, lowPriority]() { runWorker(plan, lowPriority); });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        if (m_cancel || plan.failed) {
+            return false;
+        }
+
+        merge(plan);
+        m_markers = detectCuts();
+        stats.workers = plan.workers;
+        stats.segments = plan.segments.size();
+        stats.frames = (int64_t)m_samples.size();
+        stats.markers = m_markers.size();
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        stats.kernels = plan.kernels->name;
+        m_complete.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // 读取视频流参数和关键帧表（优先用探测缓存里的），在关键帧处切段
+    bool prepare(Plan& plan) {
+        AVFormatContext* context = openInput();
+        if (!context) {
+            return false;
+        }
+        plan.videoIndex = av_find_best_stream(context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (plan.videoIndex < 0) {
+            std::cerr << "场景: 未找到视频流" << std::endl;
+            avformat_close_input(&context);
+            return false;
+        }
+        AVStream* stream = context->streams[plan.videoIndex];
+        plan.videoPar = avcodec_parameters_alloc();
+        if (!plan.videoPar || avcodec_parameters_copy(plan.videoPar, stream->codecpar) < 0) {
+            avformat_close_input(&context);
+            return false;
+        }
+        plan.timeBase = stream->time_base;
+        int64_t startTs = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+        avformat_close_input(&context);
+
+        std::vector<KeyframeEntry> keyframes;
+        std::vector<int64_t> framePts;
+        probe::Record record;
+        if (probe::load(m_filename, record) && record.videoStream == plan.videoIndex && !record.keyframes.empty()) {
+            keyframes = std::move(record.keyframes);
+            framePts = std::move(record.framePts);
+        } else {
+            KeyframeIndex index;
+            if (!index.buildSync(m_filename, plan.videoIndex) || index.keyframes().empty()) {
+                if (!m_cancel) {
+                    std::cerr << "场景: 无法建立关键帧索引" << std::endl;
+                }
+                return false;
+            }
+            keyframes = index.keyframes();
+            framePts = index.framePts();
+        }
+        if (framePts.empty()) {
+            return false;
+        }
+        plan.frames = (int64_t)framePts.size();
+        startTs = std::min(startTs, framePts.front());
+        planSegments(plan, keyframes, startTs, framePts.back() + 1);
+        return true;
+    }
+
+    // 每段不短于kMinSegmentSeconds
+    void planSegments(Plan& plan, const std::vector<KeyframeEntry>& keyframes, int64_t startTs, int64_t endTs) {
+        int workers = m_options.workers > 0 ? m_options.workers : ThreadBudget::instance().totalCores();
+        double range = (endTs - startTs) * av_q2d(plan.timeBase);
+        double target = std::max(kMinSegmentSeconds, range / (std::max(1, workers) * kSegmentsPerWorker));
+
+        int64_t start = startTs;
+        if (workers > 1) {
+            for (const KeyframeEntry& keyframe : keyframes) {
+                if (keyframe.pts <= start || keyframe.pts >= endTs) {
+                    continue;
+                }
+                if ((keyframe.pts - start) * av_q2d(plan.timeBase) >= target) {
+                    Segment segment;
+                    segment.start = start;
+                    segment.end = keyframe.pts;
+                    plan.segments.push_back(std::move(segment));
+                    start = keyframe.pts;
+                }
+            }
+        }
+        Segment last;
+        last.start = start;
+        last.end = endTs;
+        plan.segments.push_back(std::move(last));
+        plan.workers = std::max(1, std::min(workers, (int)plan.segments.size()));
+    }
+
+    // 工作线程：自己的解复用和解码上下文，依次领取还没分析的段
+    void runWorker(Plan& plan, bool lowPriority) {
+        if (lowPriority) {
+            ThreadBudget::lowerCurrentThreadPriority();
+        }
+        Profiler::setThreadName("scenes");
+        AVFormatContext* input = openInput();
+        const AVCodec* codec = avcodec_find_decoder(plan.videoPar->codec_id);
+        AVCodecContext* decoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+        bool ok = input && decoder && avcodec_parameters_to_context(decoder, plan.videoPar) >= 0;
+        if (ok) {
+            keepOnly(input, plan.videoIndex);
+            decoder->pkt_timebase = plan.timeBase;
+            decoder->thread_count = 1;  // 并行来自分段，每段一个线程
+            decoder->skip_loop_filter = AVDISCARD_ALL;  // 只看块平均的亮度，去块滤波不影响结果
+            ok = avcodec_open2(decoder, codec, nullptr) >= 0;
+        }
+        if (!ok) {
+            if (!m_cancel) {
+                std::cerr << "场景: 工作线程无法打开解码器" << std::endl;
+            }
+            plan.failed = true;
+        }
+
+        Scratch scratch;
+        while (ok && !plan.failed && !m_cancel) {
+            size_t index = plan.nextSegment++;
+            if (index >= plan.segments.size()) {
+                break;
+            }
+            if (!analyzeSegment(plan, input, decoder, scratch, index)) {
+                plan.failed = true;
+            }
+        }
+
+        avcodec_free_context(&decoder);
+        if (input) {
+            avformat_close_input(&input);
+        }
+    }
+
+    // 8位YUV和灰度格式直接用第0个平面，其余格式先转成GRAY8
+    bool thumbnail(const Plan& plan, const AVFrame* frame, Scratch& scratch) {
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+        bool direct = desc && !(desc->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) &&
+                      desc->comp[0].plane == 0 && desc->comp[0].step == 1 && desc->comp[0].offset == 0 &&
+                      desc->comp[0].shift == 0 && desc->comp[0].depth == 8;
+        const uint8_t* luma = frame->data[0];
+        int linesize = frame->linesize[0];
+        if (!direct) {
+            SwsContext* context = scratch.scaler.get(frame->width, frame->height, (AVPixelFormat)frame->format,
+                                                     frame->width, frame->height, AV_PIX_FMT_GRAY8);
+            if (!context) {
+                return false;
+            }
+            linesize = (frame->width + 31) & ~31;
+            scratch.gray.resize((size_t)linesize * frame->height);
+            uint8_t* planes[4] = { scratch.gray.data(), nullptr, nullptr, nullptr };
+            int linesizes[4] = { linesize, 0, 0, 0 };
+            sws_scale(context, frame->data, frame->linesize, 0, frame->height, planes, linesizes);
+            luma = scratch.gray.data();
+        }
+        scene::makeThumbnail(*plan.kernels, luma, linesize, frame->width, frame->height, scratch.current, scratch.sums);
+        return true;
+    }
+
+    bool analyzeSegment(Plan& plan, AVFormatContext* input, AVCodecContext* decoder, Scratch& scratch, size_t index) {
+        ProfileScope scope("scene_segment");
+        Segment& segment = plan.segments[index];
+        FramePtr frame = makeFrame();
+        PacketPtr packet = makePacket();
+        if (!frame || !packet) {
+            return false;
+        }
+
+        auto receiveFrames = [&]() {
+            while (avcodec_receive_frame(decoder, frame.get()) == 0) {
+                int64_t pts = frame->best_effort_timestamp;
+                if (pts != AV_NOPTS_VALUE && pts >= segment.start && pts < segment.end) {
+                    if (!thumbnail(plan, frame.get(), scratch)) {
+                        av_frame_unref(frame.get());
+                        return false;
+                    }
+                    SceneSample sample = { pts, -1.0f, -1.0f };
+                    if (segment.samples.empty()) {
+                        segment.first = scratch.current;
+                    } else {
+                        sample.difference = scene::difference(*plan.kernels, scratch.previous, scratch.current);
+                        sample.histogram = scene::histogramDistance(scratch.previous, scratch.current);
+                    }
+                    segment.samples.push_back(sample);
+                    std::swap(scratch.previous, scratch.current);
+                    m_framesDone++;
+                }
+                av_frame_unref(frame.get());
+            }
+            return true;
+        };
+
+        // 与分段导出相同：从段起点的关键帧开始解码，读到段终点的关键帧之后
+        // 只继续送入pts早于终点的数据包（开放GOP的前导帧），随后的第一个其他数据包就停止
+        avcodec_flush_buffers(decoder);
+        bool ok = av_seek_frame(input, plan.videoIndex, segment.start, AVSEEK_FLAG_BACKWARD) >= 0;
+        if (!ok && !m_cancel) {
+            std::cerr << "场景: 跳转到分段起点失败" << std::endl;
+        }
+        bool pastEnd = false;
+        while (ok && !plan.failed && !m_cancel) {
+            if (av_read_frame(input, packet.get()) < 0) {
+                break;
+            }
+            if (packet->stream_index != plan.videoIndex) {
+                av_packet_unref(packet.get());
+                continue;
+            }
+            int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (pastEnd && pts != AV_NOPTS_VALUE && pts >= segment.end) {
+                av_packet_unref(packet.get());
+                break;
+            }
+            if ((packet->flags & AV_PKT_FLAG_KEY) && pts != AV_NOPTS_VALUE && pts >= segment.end) {
+                pastEnd = true;
+            }
+            int sent = avcodec_send_packet(decoder, packet.get());
+            av_packet_unref(packet.get());
+            if (sent >= 0) {
+                ok = receiveFrames();
+            }
+        }
+        if (ok && !plan.failed && !m_cancel) {
+            avcodec_send_packet(decoder, nullptr);
+            ok = receiveFrames();
+        }
+        if (!ok || plan.failed || m_cancel) {
+            return false;
+        }
+        if (!segment.samples.empty()) {
+            segment.last = scratch.previous;
+        }
+        return true;
+    }
+
+    // 按段的顺序拼接，每段第一帧与前一段最后一帧比较
+    void merge(Plan& plan) {
+        m_samples.clear();
+        m_samples.reserve((size_t)plan.frames);
+        const scene::Thumbnail* previous = nullptr;
+        for (Segment& segment : plan.segments) {
+            if (segment.samples.empty()) {
+                continue;
+            }
+            if (previous) {
+                segment.samples[0].difference = scene::difference(*plan.kernels, *previous, segment.first);
+                segment.samples[0].histogram = scene::histogramDistance(*previous, segment.first);
+            }
+            m_samples.insert(m_samples.end(), segment.samples.begin(), segment.samples.end());
+            previous = &segment.last;
+        }
+        m_timeBase = plan.timeBase;
+    }
+
+    // 差异足够大，并且远大于之前一段的平均差或者直方图明显不同，距上一个切点（或文件开头）不太近
+    std::vector<double> detectCuts() const {
+        std::vector<double> cuts;
+        if (m_samples.empty()) {
+            return cuts;
+        }
+        double timeBase = av_q2d(m_timeBase);
+        double lastCut = m_samples.front().pts * timeBase;
+        std::deque<float> window;
+        double windowSum = 0.0;
+        for (const SceneSample& sample : m_samples) {
+            if (sample.difference < 0.0f) {
+                continue;
+            }
+            double time = sample.pts * timeBase;
+            double average = window.empty() ? 0.0 : windowSum / window.size();
+            bool cut = sample.difference >= m_options.minDifference &&
+                       (sample.difference >= m_options.adaptiveRatio * std::max(average, 1.0) ||
+                        sample.histogram >= m_options.histogramCut) &&
+                       time - lastCut >= m_options.minSceneSeconds;
+            if (cut) {
+                cuts.push_back(time);
+                lastCut = time;
+                continue;  // 切点本身不计入平均，下一个镜头仍以正常的运动量为参考
+            }
+            window.push_back(sample.difference);
+            windowSum += sample.difference;
+            if (window.size() > kWindow) {
+                windowSum -= window.front();
+                window.pop_front();
+            }
+        }
+        return cuts;
+    }
+
+    bool loadCache() {
+        sidecar::MediaKey key;
+        if (!sidecar::mediaKey(m_filename, key)) {
+            return false;
+        }
+        std::ifstream in(sidecar::cachePath(key, ".scenes"), std::ios::binary);
+        if (!in) {
+            return false;
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        CacheHeader header;
+        if (data.size() < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        size_t remaining = data.size() - sizeof(header);
+        if (std::memcmp(header.magic, "VESC", 4) != 0 || header.version != kCacheVersion ||
+            header.mediaSize != key.size || header.mediaTime != key.mtime || header.timeBaseNum <= 0 ||
+            header.timeBaseDen <= 0 || header.sampleCount == 0 || header.sampleCount != remaining / sizeof(SceneSample) ||
+            remaining % sizeof(SceneSample) != 0) {
+            return false;
+        }
+        m_samples.resize((size_t)header.sampleCount);
+        std::memcpy(m_samples.data(), data.data() + sizeof(header), remaining);
+        m_timeBase = AVRational{ header.timeBaseNum, header.timeBaseDen };
+        return true;
+    }
+
+    // 先写临时文件再改名，读取方不会看到写了一半的文件
+    bool saveCache() const {
+        sidecar::MediaKey key;
+        if (!sidecar::mediaKey(m_filename, key) || m_samples.empty()) {
+            return false;
+        }
+        CacheHeader header = {};
+        std::memcpy(header.magic, "VESC", 4);
+        header.version = kCacheVersion;
+        header.mediaSize = key.size;
+        header.mediaTime = key.mtime;
+        header.timeBaseNum = m_timeBase.num;
+        header.timeBaseDen = m_timeBase.den;
+        header.sampleCount = m_samples.size();
+
+        std::string path = sidecar::cachePath(key, ".scenes");
+        std::string partial = path + ".partial";
+        {
+            std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)m_samples.data(), (std::streamsize)(m_samples.size() * sizeof(SceneSample)));
+            if (!out) {
+                std::cerr << "场景: 无法写入 " << partial << std::endl;
+                std::error_code ec;
+                std::filesystem::remove(partial, ec);
+                return false;
+            }
+        }
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        std::filesystem::rename(partial, path, ec);
+        if (ec) {
+            std::filesystem::remove(partial, ec);
+            return false;
+        }
+        return true;
+    }
+
+    SceneOptions m_options;
+    const SceneKernels* m_kernels;
+    std::string m_filename;
+
+    // 以下在分析线程上写入，m_complete发布之后UI线程只读
+    std::vector<SceneSample> m_samples;
+    AVRational m_timeBase;
+    std::vector<double> m_markers;
+
+    std::atomic<bool> m_complete;
+    std::atomic<bool> m_cancel;
+    std::atomic<bool> m_running;
+    std::atomic<int64_t> m_framesDone;
+    std::atomic<int64_t> m_framesTotal;
+    std::thread m_thread;
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// 拖动时间线的调度器：鼠标事件只记录最新目标，每帧最多发出一次seek
+// - 拖动过程中发出关键帧seek（只解码最近的关键帧），画面立即跟上鼠标
+// - 同一时间只有一个seek在执行；新请求到来时，执行时间超过kStaleAfter的旧seek被取消并以最新目标重发
+// - 鼠标停下超过kSettleAfter或松开时，对最终位置发出精确seek
+// - 统计从鼠标事件到画面更新的延迟
+class ScrubController {
+public:
+    enum class Action {
+        None,
+        Keyframe,  // 快速定位到最近的关键帧
+        Exact      // 精确定位到目标帧
+    };
+
+    ScrubController() { reset(); }
+
+    void reset() {
+        m_dragging = false;
+        m_hasPending = false;
+        m_needExact = false;
+        m_inFlight = false;
+        m_target = 0.0;
+        m_firstPendingTime = 0.0;
+        m_lastRequestTime = 0.0;
+        m_inFlightAction = Action::None;
+        m_inFlightIssued = 0.0;
+        m_inFlightRequested = 0.0;
+        m_requests = 0;
+        m_seeksIssued = 0;
+        m_seeksCancelled = 0;
+        m_latencies.clear();
+        m_exactLatency = 0.0;
+    }
+
+    // 鼠标按下
+    void begin() {
+        m_dragging = true;
+        m_requests = 0;
+        m_seeksIssued = 0;
+        m_seeksCancelled = 0;
+        m_latencies.clear();
+        m_exactLatency = 0.0;
+    }
+
+    // 每个鼠标移动事件调用，只保留最新的目标
+    void request(double time) {
+        if (!m_hasPending) {
+            m_firstPendingTime = now();
+        }
+        m_target = time;
+        m_hasPending = true;
+        m_needExact = true;
+        m_lastRequestTime = now();
+        m_requests++;
+    }
+
+    // 鼠标松开：下一次poll立即发出精确seek
+    void end() {
+        m_dragging = false;
+    }
+
+    bool isDragging() const {
+        return m_dragging;
+    }
+
+    // 每帧调用一次，返回需要发出的seek及其目标
+    Action poll(double& target) {
+        double current = now();
+
+        if (m_hasPending) {
+            // 有seek正在执行：还不算太旧就等它完成，否则取消并重发最新目标
+            if (m_inFlight && current - m_inFlightIssued < kStaleAfter) {
+                return Action::None;
+            }
+            if (m_inFlight) {
+                m_seeksCancelled++;
+            }
+
+            target = m_target;
+            m_hasPending = false;
+            Action action = m_dragging ? Action::Keyframe : Action::Exact;
+            if (action == Action::Exact) {
+                m_needExact = false;
+            }
+            issue(current, action);
+            return action;
+        }
+
+        // 鼠标停住或已经松开：对最终位置做一次精确seek
+        bool settled = !m_dragging || current - m_lastRequestTime >= kSettleAfter;
+        bool idle = !m_inFlight || current - m_inFlightIssued >= kStaleAfter;
+        if (m_needExact && settled && idle) {
+            if (m_inFlight) {
+                m_seeksCancelled++;
+            }
+            m_needExact = false;
+            m_firstPendingTime = m_lastRequestTime;
+            target = m_target;
+            issue(current, Action::Exact);
+            return Action::Exact;
+        }
+
+        return Action::None;
+    }
+
+    // 发出的seek对应的画面已经显示
+    void onFrameDisplayed() {
+        if (!m_inFlight) {
+            return;
+        }
+        m_inFlight = false;
+
+        double latency = now() - m_inFlightRequested;
+        if (m_inFlightAction == Action::Exact) {
+            m_exactLatency = latency;
+            if (!m_dragging && !m_needExact && !m_hasPending) {
+                report();
+            }
+        } else {
+            m_latencies.push_back(latency);
+        }
+    }
+
+    // 最近一次拖动的统计
+    void report() const {
+        std::vector<double> sorted = m_latencies;
+        std::sort(sorted.begin(), sorted.end());
+        double average = 0.0;
+        for (double value : sorted) {
+            average += value;
+        }
+        if (!sorted.empty()) {
+            average /= sorted.size();
+        }
+        double p95 = sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, sorted.size() * 95 / 100)];
+        double worst = sorted.empty() ? 0.0 : sorted.back();
+
+        std::cout << "拖动统计: 鼠标事件 " << m_requests
+                  << "，发出seek " << m_seeksIssued
+                  << "，取消 " << m_seeksCancelled
+                  << "，画面延迟 平均 " << (int)(average * 1000)
+                  << "ms / p95 " << (int)(p95 * 1000)
+                  << "ms / 最大 " << (int)(worst * 1000)
+                  << "ms，精确帧 " << (int)(m_exactLatency * 1000) << "ms" << std::endl;
+    }
+
+private:
+    static constexpr double kStaleAfter = 0.1;    // 正在执行的seek超过该时间且有新目标时取消重发
+    static constexpr double kSettleAfter = 0.12;  // 鼠标静止该时间后做精确seek
+
+    static double now() {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    void issue(double current, Action action) {
+        m_inFlight = true;
+        m_inFlightAction = action;
+        m_inFlightIssued = current;
+        m_inFlightRequested = m_firstPendingTime;
+        m_seeksIssued++;
+    }
+
+    bool m_dragging;
+    bool m_hasPending;        // 有尚未发出的新目标
+    bool m_needExact;         // 最终位置还没有精确seek过
+    double m_target;
+    double m_firstPendingTime;  // 尚未发出的请求中最早的那个的时间
+    double m_lastRequestTime;
+
+    bool m_inFlight;
+    Action m_inFlightAction;
+    double m_inFlightIssued;
+    double m_inFlightRequested;
+
+    uint64_t m_requests;
+    uint64_t m_seeksIssued;
+    uint64_t m_seeksCancelled;
+    std::vector<double> m_latencies;  // 关键帧seek的延迟（秒）
+    double m_exactLatency;
+};
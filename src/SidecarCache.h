@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 媒体文件的旁路缓存（缩略图、索引等）
+// 缓存文件放在用户缓存目录下，文件名由媒体的路径+大小+修改时间计算，媒体被修改后自动失效
+namespace sidecar {
+
+// 媒体文件的身份：路径、大小、修改时间，写入缓存文件头用于校验
+struct MediaKey {
+    std::string path;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
+inline bool mediaKey(const std::string& filename, MediaKey& key) {
+    std::error_code ec;
+    std::filesystem::path path = std::filesystem::absolute(filename, ec);
+    if (ec) {
+        path = filename;
+    }
+    key.path = path.lexically_normal().string();
+    key.size = (uint64_t)std::filesystem::file_size(path, ec);
+    if (ec) {
+        return false;
+    }
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return false;
+    }
+    key.mtime = (int64_t)time.time_since_epoch().count();
+    return true;
+}
+
+// FNV-1a 64位哈希
+inline uint64_t hashKey(const MediaKey& key) {
+    uint64_t hash = 1469598103934665603ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+    mix(key.path.data(), key.path.size());
+    mix(&key.size, sizeof(key.size));
+    mix(&key.mtime, sizeof(key.mtime));
+    return hash;
+}
+
+// 缓存根目录：VIDEOEDITOR_CACHE_DIR，否则为系统的用户缓存目录下的VideoEditor
+inline std::filesystem::path cacheDirectory() {
+    std::filesystem::path dir;
+    if (const char* custom = std::getenv("VIDEOEDITOR_CACHE_DIR")) {
+        dir = custom;
+    } else {
+#ifdef _WIN32
+        const char* base = std::getenv("LOCALAPPDATA");
+        dir = base ? std::filesystem::path(base) / "VideoEditor" : std::filesystem::path("cache");
+#else
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+            dir = std::filesystem::path(xdg) / "VideoEditor";
+        } else if (const char* home = std::getenv("HOME")) {
+            dir = std::filesystem::path(home) / ".cache" / "VideoEditor";
+        } else {
+            dir = "cache";
+        }
+#endif
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    return dir;
+}
+
+// 某个媒体文件的某类缓存的路径，例如 cachePath(key, ".thumbs")
+inline std::string cachePath(const MediaKey& key, const char* extension) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)hashKey(key));
+    return (cacheDirectory() / (std::string(name) + extension)).string();
+}
+
+// 读写方式映射到内存的文件，大小固定
+class MappedFile {
+public:
+    MappedFile() : m_data(nullptr), m_size(0), m_created(false) {
+#ifdef _WIN32
+        m_file = INVALID_HANDLE_VALUE;
+        m_mapping = nullptr;
+#else
+        m_fd = -1;
+#endif
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // 打开或创建文件并映射size字节；文件原来的大小不同时会被调整，created()返回true
+    bool open(const std::string& path, size_t size) {
+        close();
+        if (size == 0) {
+            return false;
+        }
+
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                             OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER current;
+        if (!GetFileSizeEx(m_file, &current)) {
+            close();
+            return false;
+        }
+        m_created = (size_t)current.QuadPart != size;
+        if (m_created) {
+            LARGE_INTEGER target;
+            target.QuadPart = (LONGLONG)size;
+            if (!SetFilePointerEx(m_file, target, nullptr, FILE_BEGIN) || !SetEndOfFile(m_file)) {
+                close();
+                return false;
+            }
+        }
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+        if (!m_mapping) {
+            close();
+            return false;
+        }
+        m_data = (uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (!m_data) {
+            close();
+            return false;
+        }
+#else
+        m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (m_fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(m_fd, &info) != 0) {
+            close();
+            return false;
+        }
+        m_created = (size_t)info.st_size != size;
+        if (m_created && ftruncate(m_fd, (off_t)size) != 0) {
+            close();
+            return false;
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (mapped == MAP_FAILED) {
+            close();
+            return false;
+        }
+        m_data = (uint8_t*)mapped;
+#endif
+        m_size = size;
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (m_data) {
+            FlushViewOfFile(m_data, 0);
+            UnmapViewOfFile(m_data);
+        }
+        if (m_mapping) {
+            CloseHandle(m_mapping);
+            m_mapping = nullptr;
+        }
+        if (m_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (m_data) {
+            munmap(m_data, m_size);
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    bool isOpen() const {
+        return m_data != nullptr;
+    }
+
+    uint8_t* data() const {
+        return m_data;
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    // 文件是新建的或大小被调整过，内容不可信
+    bool created() const {
+        return m_created;
+    }
+
+private:
+    uint8_t* m_data;
+    size_t m_size;
+    bool m_created;
+#ifdef _WIN32
+    HANDLE m_file;
+    HANDLE m_mapping;
+#else
+    int m_fd;
+#endif
+};
+
+}  // namespace sidecar
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+}
+
+#include "MediaQueue.h"
+
+// 基准测试用的合成视频参数
+struct TestClipSpec {
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    double seconds = 10.0;
+    int gopSize = 30;     // 关键帧间隔（帧）
+    int bFrames = 2;      // 带B帧，解码输出顺序与解码顺序不同
+    int64_t bitRate = 4000000;
+    std::string encoder = "mpeg4";  // FFmpeg自带的编码器，不依赖x264等外部库
+    bool audio = false;             // 附带一条正弦波音轨
+    int sampleRate = 48000;
+    std::string audioEncoder = "aac";  // FFmpeg自带的AAC编码器，找不到时退回MP2
+    double sceneSeconds = 0.0;      // 每隔这么久换一个镜头（背景图案和色调突变），0表示整段一个镜头
+};
+
+// 测试音轨：440Hz正弦波，每秒开头有一段高音，便于听出音画是否同步
+inline void fillTestTone(AVFrame* frame, int64_t firstSample, int sampleRate) {
+    AVSampleFormat format = (AVSampleFormat)frame->format;
+    int channels = frame->ch_layout.nb_channels;
+    bool planar = av_sample_fmt_is_planar(format);
+    const double kPi = 3.14159265358979323846;
+    for (int i = 0; i < frame->nb_samples; i++) {
+        int64_t n = firstSample + i;
+        double t = (double)n / sampleRate;
+        double frequency = (n % sampleRate) < sampleRate / 20 ? 1760.0 : 440.0;
+        double value = 0.3 * std::sin(2.0 * kPi * frequency * t);
+        for (int c = 0; c < channels; c++) {
+            int index = planar ? i : i * channels + c;
+            uint8_t* data = frame->data[planar ? c : 0];
+            if (format == AV_SAMPLE_FMT_FLTP || format == AV_SAMPLE_FMT_FLT) {
+                ((float*)data)[index] = (float)value;
+            } else {
+                ((int16_t*)data)[index] = (int16_t)(value * 32767);
+            }
+        }
+    }
+}
+
+// 用libavcodec在本地生成测试视频，画面是移动的渐变加一个移动的方块
+// 不需要网络、GPU或预先准备的素材，CI上也能直接运行
+inline bool generateTestClip(const std::string& path, const TestClipSpec& spec) {
+    const AVCodec* codec = avcodec_find_encoder_by_name(spec.encoder.c_str());
+    if (!codec) {
+        codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    }
+    if (!codec) {
+        std::cerr << "测试视频: 找不到编码器 " << spec.encoder << std::endl;
+        return false;
+    }
+
+    const AVCodec* audioCodec = nullptr;
+    if (spec.audio) {
+        audioCodec = avcodec_find_encoder_by_name(spec.audioEncoder.c_str());
+        if (!audioCodec) {
+            audioCodec = avcodec_find_encoder(AV_CODEC_ID_MP2);
+        }
+        if (!audioCodec) {
+            std::cerr << "测试视频: 找不到音频编码器 " << spec.audioEncoder << std::endl;
+            return false;
+        }
+    }
+
+    AVFormatContext* output = nullptr;
+    if (avformat_alloc_output_context2(&output, nullptr, nullptr, path.c_str()) < 0 || !output) {
+        std::cerr << "测试视频: 无法创建输出: " << path << std::endl;
+        return false;
+    }
+
+    AVCodecContext* encoder = avcodec_alloc_context3(codec);
+    AVCodecContext* audioEncoder = audioCodec ? avcodec_alloc_context3(audioCodec) : nullptr;
+    if (!encoder || (audioCodec && !audioEncoder)) {
+        avcodec_free_context(&encoder);
+        avcodec_free_context(&audioEncoder);
+        avformat_free_context(output);
+        return false;
+    }
+    encoder->width = spec.width;
+    encoder->height = spec.height;
+    encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+    encoder->time_base = { 1, spec.fps };
+    encoder->framerate = { spec.fps, 1 };
+    encoder->gop_size = spec.gopSize;
+    encoder->max_b_frames = spec.bFrames;
+    encoder->flags |= AV_CODEC_FLAG_CLOSED_GOP; // GOP之间没有参考关系，裁剪导出时完整的GOP可以直接复制
+    encoder->bit_rate = spec.bitRate;
+    if (output->oformat->flags & AVFMT_GLOBALHEADER) {
+        encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if (audioEncoder) {
+        // FFmpeg自带的AAC编码器只接受FLTP，MP2接受S16
+        audioEncoder->sample_fmt = audioCodec->id == AV_CODEC_ID_AAC ? AV_SAMPLE_FMT_FLTP : AV_SAMPLE_FMT_S16;
+        audioEncoder->sample_rate = spec.sampleRate;
+        audioEncoder->time_base = { 1, spec.sampleRate };
+        audioEncoder->bit_rate = 128000;
+        av_channel_layout_default(&audioEncoder->ch_layout, 2);
+        if (output->oformat->flags & AVFMT_GLOBALHEADER) {
+            audioEncoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
+    }
+
+    bool ok = false;
+    AVStream* stream = nullptr;
+    AVStream* audioStream = nullptr;
+    FramePtr frame = makeFrame();
+    FramePtr audioFrame = makeFrame();
+    PacketPtr packet = makePacket();
+
+    // 把编码器当前输出的数据包全部写入文件
+    auto drain = [&](AVCodecContext* context, AVStream* target) {
+        while (avcodec_receive_packet(context, packet.get()) == 0) {
+            av_packet_rescale_ts(packet.get(), context->time_base, target->time_base);
+            packet->stream_index = target->index;
+            if (av_interleaved_write_frame(output, packet.get()) < 0) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    do {
+        if (!frame || !audioFrame || !packet || avcodec_open2(encoder, codec, nullptr) < 0) {
+            std::cerr << "测试视频: 无法打开编码器" << std::endl;
+            break;
+        }
+        stream = avformat_new_stream(output, nullptr);
+        if (!stream || avcodec_parameters_from_context(stream->codecpar, encoder) < 0) {
+            break;
+        }
+        stream->time_base = encoder->time_base;
+
+        if (audioEncoder) {
+            if (avcodec_open2(audioEncoder, audioCodec, nullptr) < 0) {
+                std::cerr << "测试视频: 无法打开音频编码器" << std::endl;
+                break;
+            }
+            audioStream = avformat_new_stream(output, nullptr);
+            if (!audioStream || avcodec_parameters_from_context(audioStream->codecpar, audioEncoder) < 0) {
+                break;
+            }
+            audioStream->time_base = audioEncoder->time_base;
+
+            audioFrame->format = audioEncoder->sample_fmt;
+            audioFrame->nb_samples = audioEncoder->frame_size > 0 ? audioEncoder->frame_size : 1024;
+            audioFrame->sample_rate = audioEncoder->sample_rate;
+            if (av_channel_layout_copy(&audioFrame->ch_layout, &audioEncoder->ch_layout) < 0 ||
+                av_frame_get_buffer(audioFrame.get(), 0) < 0) {
+                break;
+            }
+        }
+
+        if (!(output->oformat->flags & AVFMT_NOFILE) && avio_open(&output->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+            std::cerr << "测试视频: 无法写入文件: " << path << std::endl;
+            break;
+        }
+        if (avformat_write_header(output, nullptr) < 0) {
+            break;
+        }
+
+        frame->format = encoder->pix_fmt;
+        frame->width = encoder->width;
+        frame->height = encoder->height;
+        if (av_frame_get_buffer(frame.get(), 0) < 0) {
+            break;
+        }
+
+        int frameCount = (int)(spec.seconds * spec.fps);
+        int box = spec.height / 6;
+        int64_t audioSamples = 0;
+        bool failed = false;
+        for (int i = 0; i < frameCount && !failed; i++) {
+            if (av_frame_make_writable(frame.get()) < 0) {
+                failed = true;
+                break;
+            }
+
+            int boxX = (i * 8) % std::max(1, spec.width - box);
+            int boxY = spec.height / 2 - box / 2;
+            // 镜头编号决定背景条纹的宽度和整体偏移，换镜头时缩略图和直方图都突变
+            int scene = spec.sceneSeconds > 0.0 ? (int)(i / (spec.sceneSeconds * spec.fps)) : 0;
+            int stripe = scene % 2;
+            for (int y = 0; y < spec.height; y++) {
+                uint8_t* row = frame->data[0] + y * frame->linesize[0];
+                for (int x = 0; x < spec.width; x++) {
+                    bool inBox = x >= boxX && x < boxX + box && y >= boxY && y < boxY + box;
+                    row[x] = inBox ? 235 : (uint8_t)((x >> stripe) + y + i * 3 + scene * 97);
+                }
+            }
+            for (int y = 0; y < spec.height / 2; y++) {
+                uint8_t* u = frame->data[1] + y * frame->linesize[1];
+                uint8_t* v = frame->data[2] + y * frame->linesize[2];
+                for (int x = 0; x < spec.width / 2; x++) {
+                    u[x] = (uint8_t)(128 + y + i * 2 + scene * 61);
+                    v[x] = (uint8_t)(64 + x + i * 5 + scene * 37);
+                }
+            }
+
+            frame->pts = i;
+            if (avcodec_send_frame(encoder, frame.get()) < 0 || !drain(encoder, stream)) {
+                failed = true;
+            }
+
+            // 音频编码到这一帧画面结束的时刻
+            int64_t audioEnd = (int64_t)(i + 1) * spec.sampleRate / spec.fps;
+            while (audioEncoder && !failed && audioSamples < audioEnd) {
+                if (av_frame_make_writable(audioFrame.get()) < 0) {
+                    failed = true;
+                    break;
+                }
+                fillTestTone(audioFrame.get(), audioSamples, spec.sampleRate);
+                audioFrame->pts = audioSamples;
+                audioSamples += audioFrame->nb_samples;
+                if (avcodec_send_frame(audioEncoder, audioFrame.get()) < 0 || !drain(audioEncoder, audioStream)) {
+                    failed = true;
+                }
+            }
+        }
+        if (failed) {
+            std::cerr << "测试视频: 编码失败" << std::endl;
+            break;
+        }
+
+        // 冲出编码器中剩余的帧
+        avcodec_send_frame(encoder, nullptr);
+        if (!drain(encoder, stream)) {
+            break;
+        }
+        if (audioEncoder) {
+            avcodec_send_frame(audioEncoder, nullptr);
+            if (!drain(audioEncoder, audioStream)) {
+                break;
+            }
+        }
+        ok = av_write_trailer(output) >= 0;
+    } while (false);
+
+    avcodec_free_context(&encoder);
+    avcodec_free_context(&audioEncoder);
+    if (!(output->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&output->pb);
+    }
+    avformat_free_context(output);
+    return ok;
+}
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+#include "DecoderThreading.h"
+#include "MediaQueue.h"
+#include "Profiler.h"
+#include "ScalerCache.h"
+#include "SidecarCache.h"
+
+// 时间线上的缩略图胶片条
+// - 整个时长平均分成若干槽位，每个槽位一张缩略图，取槽位中点之前最近的关键帧
+// - 后台工作线程使用独立的解复用器/解码器，只解码关键帧(AVDISCARD_NONKEY)并缩小，线程优先级低于预览
+// - 生成顺序由粗到细，胶片条先整体出现再逐步变密；还没生成的槽位显示最近的已有缩略图
+// - 像素直接写入内存映射的旁路缓存文件，再次打开同一文件时已生成的缩略图立即可用
+// - 绘制用的小纹理放在按内存上限淘汰的LRU中，纹理只在UI线程创建和销毁
+class ThumbnailStrip {
+public:
+    ThumbnailStrip()
+        : m_streamIndex(-1), m_duration(0.0), m_interval(0.0), m_slotCount(0),
+          m_thumbWidth(0), m_thumbHeight(0), m_slotFlags(nullptr), m_slotPixels(nullptr),
+          m_nextOrder(0), m_readyCount(0), m_activeWorkers(0), m_cancel(false),
+          m_textureBytes(0), m_memoryLimit(kDefaultMemoryLimit) {}
+
+    ~ThumbnailStrip() {
+        close();
+    }
+
+    ThumbnailStrip(const ThumbnailStrip&) = delete;
+    ThumbnailStrip& operator=(const ThumbnailStrip&) = delete;
+
+    // 纹理LRU的内存上限（字节）
+    void setMemoryLimit(size_t bytes) {
+        m_memoryLimit = std::max<size_t>(bytes, 1);
+    }
+
+    // 视频打开之后调用：映射旁路缓存，在后台生成缺少的缩略图
+    bool open(const std::string& filename, int streamIndex, double duration, int videoWidth, int videoHeight) {
+        close();
+        if (streamIndex < 0 || duration <= 0.0 || videoWidth <= 0 || videoHeight <= 0) {
+            return false;
+        }
+
+        m_filename = filename;
+        m_streamIndex = streamIndex;
+        m_duration = duration;
+        m_interval = std::max(kMinInterval, duration / kMaxSlots);
+        m_slotCount = std::max(1, (int)std::ceil(duration / m_interval));
+        m_thumbHeight = kThumbHeight;
+        m_thumbWidth = std::max(16, std::min(kThumbHeight * 4, (int)(kThumbHeight * (double)videoWidth / videoHeight) & ~1));
+
+        if (!mapCache()) {
+            close();
+            return false;
+        }
+
+        for (int i = 0; i < m_slotCount; i++) {
+            if (m_slotFlags[i]) {
+                m_ready[i].store(1, std::memory_order_relaxed);
+                m_readyCount++;
+            }
+        }
+        if (m_readyCount > 0) {
+            std::cout << "缩略图: 从缓存载入 " << m_readyCount << "/" << m_slotCount << std::endl;
+        }
+        if (m_readyCount == m_slotCount) {
+            return true;
+        }
+
+        buildOrder();
+        m_cancel = false;
+        m_lease = ThreadBudget::instance().acquire(DecoderRole::Thumbnail);
+        int workers = std::max(1, std::min(kMaxWorkers, m_lease.threads()));
+        m_lease.shrink(workers);
+        m_activeWorkers = workers;
+        for (int i = 0; i < workers; i++) {
+            m_workers.emplace_back(&ThumbnailStrip::workerLoop, this);
+        }
+        return true;
+    }
+
+    // 停止后台生成并释放纹理，必须在渲染器销毁之前调用
+    void close() {
+        m_cancel = true;
+        for (std::thread& worker : m_workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        m_workers.clear();
+        m_lease.release();
+
+        clearTextures();
+        m_file.close();
+        m_memoryFallback.clear();
+        m_slotFlags = nullptr;
+        m_slotPixels = nullptr;
+        m_ready.reset();
+        m_order.clear();
+        m_nextOrder = 0;
+        m_readyCount = 0;
+        m_slotCount = 0;
+        m_streamIndex = -1;
+    }
+
+    bool isOpen() const {
+        return m_slotCount > 0 && m_slotPixels != nullptr;
+    }
+
+    int readyCount() const {
+        return m_readyCount.load();
+    }
+
+    int slotCount() const {
+        return m_slotCount;
+    }
+
+    // 后台是否还有线程在生成缩略图
+    bool isGenerating() const {
+        return m_activeWorkers.load() > 0;
+    }
+
+    // 在时间线条内平铺缩略图，rect为时间线条的区域，返回发出的纹理拷贝次数
+    int draw(SDL_Renderer* renderer, const SDL_Rect& rect) {
+        if (!isOpen() || rect.w <= 0 || rect.h <= 0) {
+            return 0;
+        }
+        int copies = 0;
+
+        int tileWidth = std::max(8, rect.h * m_thumbWidth / m_thumbHeight);
+        for (int x = rect.x; x < rect.x + rect.w; x += tileWidth) {
+            int width = std::min(tileWidth, rect.x + rect.w - x);
+            double time = ((x - rect.x) + width * 0.5) / rect.w * m_duration;
+            int slot = nearestReadySlot(std::min(m_slotCount - 1, (int)(time / m_interval)));
+            if (slot < 0) {
+                return copies;
+            }
+
+            SDL_Texture* thumbnail = texture(renderer, slot);
+            if (!thumbnail) {
+                continue;
+            }
+            // 最后一块只显示缩略图的左边一部分
+            SDL_Rect src = { 0, 0, m_thumbWidth * width / tileWidth, m_thumbHeight };
+            SDL_Rect dst = { x, rect.y, width, rect.h };
+            SDL_RenderCopy(renderer, thumbnail, &src, &dst);
+            copies++;
+        }
+        return copies;
+    }
+
+private:
+    static constexpr int kMaxSlots = 240;          // 槽位数上限，长视频按时长均分
+    static constexpr double kMinInterval = 1.0;    // 相邻槽位的最小间隔（秒）
+    static constexpr int kThumbHeight = 60;        // 缩略图高度，时间线条高度的两倍
+    static constexpr int kMaxWorkers = 2;
+    static constexpr int kMaxPacketsPerThumb = 512; // 找不到关键帧时放弃该槽位
+    static constexpr size_t kDefaultMemoryLimit = 8 * 1024 * 1024;
+    static constexpr uint32_t kCacheVersion = 1;
+
+    // 旁路缓存文件布局：文件头 | 每槽位一个字节的完成标记 | 每槽位一张RGB24缩略图
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t mediaSize;
+        int64_t mediaTime;
+        double interval;
+        int32_t slotCount;
+        int32_t thumbWidth;
+        int32_t thumbHeight;
+        int32_t reserved;
+    };
+
+    size_t thumbBytes() const {
+        return (size_t)m_thumbWidth * m_thumbHeight * 3;
+    }
+
+    size_t flagsOffset() const {
+        return sizeof(CacheHeader);
+    }
+
+    size_t pixelsOffset() const {
+        // 像素区按64字节对齐
+        return (flagsOffset() + (size_t)m_slotCount + 63) & ~(size_t)63;
+    }
+
+    bool mapCache() {
+        size_t fileSize = pixelsOffset() + thumbBytes() * m_slotCount;
+        m_ready.reset(new std::atomic<uint8_t>[m_slotCount]);
+        for (int i = 0; i < m_slotCount; i++) {
+            m_ready[i].store(0, std::memory_order_relaxed);
+        }
+
+        sidecar::MediaKey key;
+        bool mapped = sidecar::mediaKey(m_filename, key) && m_file.open(sidecar::cachePath(key, ".thumbs"), fileSize);
+        if (!mapped) {
+            // 缓存不可用时退回到进程内存，只是不能跨会话保留
+            std::cerr << "缩略图: 无法映射缓存文件，本次不保存" << std::endl;
+            m_memoryFallback.assign(fileSize, 0);
+            m_slotFlags = m_memoryFallback.data() + flagsOffset();
+            m_slotPixels = m_memoryFallback.data() + pixelsOffset();
+            return true;
+        }
+
+        CacheHeader expected = {};
+        std::memcpy(expected.magic, "VETH", 4);
+        expected.version = kCacheVersion;
+        expected.mediaSize = key.size;
+        expected.mediaTime = key.mtime;
+        expected.interval = m_interval;
+        expected.slotCount = m_slotCount;
+        expected.thumbWidth = m_thumbWidth;
+        expected.thumbHeight = m_thumbHeight;
+
+        uint8_t* data = m_file.data();
+        if (m_file.created() || std::memcmp(data, &expected, sizeof(expected)) != 0) {
+            std::memset(data, 0, fileSize);
+            std::memcpy(data, &expected, sizeof(expected));
+        }
+        m_slotFlags = data + flagsOffset();
+        m_slotPixels = data + pixelsOffset();
+        return true;
+    }
+
+    // 由粗到细的生成顺序：0, n/2, n/4, 3n/4, ...，任何时刻已生成的槽位都大致均匀分布
+    void buildOrder() {
+        m_order.clear();
+        std::vector<bool> added(m_slotCount, false);
+        int step = 1;
+        while (step < m_slotCount) {
+            step *= 2;
+        }
+        for (; step >= 1; step /= 2) {
+            for (int slot = 0; slot < m_slotCount; slot += step) {
+                if (!added[slot]) {
+                    added[slot] = true;
+                    if (!m_ready[slot].load(std::memory_order_relaxed)) {
+                        m_order.push_back(slot);
+                    }
+                }
+            }
+        }
+        m_nextOrder = 0;
+    }
+
+    static int interruptCallback(void* opaque) {
+        return ((ThumbnailStrip*)opaque)->m_cancel.load() ? 1 : 0;
+    }
+
+    void workerLoop() {
+        ThreadBudget::lowerCurrentThreadPriority();
+        Profiler::setThreadName("thumbnail");
+
+        AVFormatContext* formatContext = avformat_alloc_context();
+        if (!formatContext) {
+            m_activeWorkers--;
+            return;
+        }
+        formatContext->interrupt_callback.callback = &ThumbnailStrip::interruptCallback;
+        formatContext->interrupt_callback.opaque = this;
+        if (avformat_open_input(&formatContext, m_filename.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "缩略图: 无法打开视频文件: " << m_filename << std::endl;
+            m_activeWorkers--;
+            return;
+        }
+
+        AVCodecContext* codecContext = nullptr;
+        if (avformat_find_stream_info(formatContext, nullptr) >= 0 &&
+            m_streamIndex < (int)formatContext->nb_streams) {
+            for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
+                if ((int)i != m_streamIndex) {
+                    formatContext->streams[i]->discard = AVDISCARD_ALL;
+                }
+            }
+            codecContext = openDecoder(formatContext->streams[m_streamIndex]);
+        }
+
+        if (codecContext) {
+            AVStream* stream = formatContext->streams[m_streamIndex];
+            ScalerCache scalers(1);
+            PacketPtr packet = makePacket();
+            FramePtr frame = makeFrame();
+            while (packet && frame && !m_cancel) {
+                size_t index = m_nextOrder.fetch_add(1);
+                if (index >= m_order.size()) {
+                    break;
+                }
+                int slot = m_order[index];
+                ProfileScope scope("thumbnail");
+                if (decodeSlot(formatContext, codecContext, stream, scalers, packet.get(), frame.get(), slot)) {
+                    m_slotFlags[slot] = 1;
+                    m_ready[slot].store(1, std::memory_order_release);
+                    m_readyCount++;
+                }
+            }
+            avcodec_free_context(&codecContext);
+        }
+        avformat_close_input(&formatContext);
+
+        // 最后一个退出的工作线程报告结果
+        if (m_activeWorkers.fetch_sub(1) == 1 && !m_cancel) {
+            std::cout << "缩略图: 生成完成 " << m_readyCount << "/" << m_slotCount << std::endl;
+        }
+    }
+
+    AVCodecContext* openDecoder(AVStream* stream) {
+        const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+        if (!codec) {
+            return nullptr;
+        }
+        AVCodecContext* codecContext = avcodec_alloc_context3(codec);
+        if (!codecContext) {
+            return nullptr;
+        }
+        if (avcodec_parameters_to_context(codecContext, stream->codecpar) < 0) {
+            avcodec_free_context(&codecContext);
+            return nullptr;
+        }
+        // 只解码关键帧，不做环路滤波；每个工作线程单线程解码，并行度由工作线程数决定
+        codecContext->skip_frame = AVDISCARD_NONKEY;
+        codecContext->skip_loop_filter = AVDISCARD_ALL;
+        codecContext->thread_count = 1;
+        if (avcodec_open2(codecContext, codec, nullptr) < 0) {
+            avcodec_free_context(&codecContext);
+            return nullptr;
+        }
+        return codecContext;
+    }
+
+    // 解码槽位中点之前最近的关键帧，缩小后写入槽位的像素区
+    bool decodeSlot(AVFormatContext* formatContext, AVCodecContext* codecContext, AVStream* stream,
+                    ScalerCache& scalers, AVPacket* packet, AVFrame* frame, int slot) {
+        double time = (slot + 0.5) * m_interval;
+        int64_t targetTs = (int64_t)std::llround(std::min(time, m_duration) / av_q2d(stream->time_base));
+        if (av_seek_frame(formatContext, m_streamIndex, targetTs, AVSEEK_FLAG_BACKWARD) < 0) {
+            return false;
+        }
+        avcodec_flush_buffers(codecContext);
+
+        bool draining = false;
+        for (int packets = 0; packets < kMaxPacketsPerThumb && !m_cancel; packets++) {
+            if (!draining) {
+                int ret = av_read_frame(formatContext, packet);
+                if (ret < 0) {
+                    draining = true;
+                    avcodec_send_packet(codecContext, nullptr);
+                } else if (packet->stream_index != m_streamIndex) {
+                    av_packet_unref(packet);
+                    continue;
+                } else {
+                    ret = avcodec_send_packet(codecContext, packet);
+                    av_packet_unref(packet);
+                    if (ret < 0 && ret != AVERROR(EAGAIN)) {
+                        continue;
+                    }
+                }
+            }
+
+            int ret = avcodec_receive_frame(codecContext, frame);
+            if (ret == 0) {
+                bool stored = storeThumbnail(scalers, frame, slot);
+                av_frame_unref(frame);
+                return stored;
+            }
+            if (ret == AVERROR_EOF || (draining && ret != AVERROR(EAGAIN))) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool storeThumbnail(ScalerCache& scalers, AVFrame* frame, int slot) {
+        SwsContext* scaler = scalers.get(frame->width, frame->height, (AVPixelFormat)frame->format,
+                                         m_thumbWidth, m_thumbHeight, AV_PIX_FMT_RGB24, SWS_AREA);
+        if (!scaler) {
+            return false;
+        }
+        uint8_t* dst[4] = { m_slotPixels + thumbBytes() * slot, nullptr, nullptr, nullptr };
+        int dstLinesize[4] = { m_thumbWidth * 3, 0, 0, 0 };
+        sws_scale(scaler, frame->data, frame->linesize, 0, frame->height, dst, dstLinesize);
+        return true;
+    }
+
+    // 离给定槽位最近的已生成槽位，没有时返回-1
+    int nearestReadySlot(int slot) const {
+        for (int distance = 0; distance < m_slotCount; distance++) {
+            if (slot - distance >= 0 && m_ready[slot - distance].load(std::memory_order_acquire)) {
+                return slot - distance;
+            }
+            if (slot + distance < m_slotCount && m_ready[slot + distance].load(std::memory_order_acquire)) {
+                return slot + distance;
+            }
+        }
+        return -1;
+    }
+
+    // 取槽位的纹理，不在LRU中时从缓存像素创建，超出内存上限时淘汰最久未使用的
+    SDL_Texture* texture(SDL_Renderer* renderer, int slot) {
+        auto it = m_textures.find(slot);
+        if (it != m_textures.end()) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.position);
+            return it->second.texture;
+        }
+
+        size_t bytes = (size_t)m_thumbWidth * m_thumbHeight * 4;
+        while (!m_lru.empty() && m_textureBytes + bytes > m_memoryLimit) {
+            evictOldest();
+        }
+
+        SDL_Texture* created = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB24, SDL_TEXTUREACCESS_STATIC,
+                                                 m_thumbWidth, m_thumbHeight);
+        if (!created) {
+            return nullptr;
+        }
+        SDL_UpdateTexture(created, nullptr, m_slotPixels + thumbBytes() * slot, m_thumbWidth * 3);
+
+        m_lru.push_front(slot);
+        m_textures[slot] = { created, m_lru.begin() };
+        m_textureBytes += bytes;
+        return created;
+    }
+
+    void evictOldest() {
+        int slot = m_lru.back();
+        m_lru.pop_back();
+        auto it = m_textures.find(slot);
+        if (it != m_textures.end()) {
+            SDL_DestroyTexture(it->second.texture);
+            m_textures.erase(it);
+            m_textureBytes -= (size_t)m_thumbWidth * m_thumbHeight * 4;
+        }
+    }
+
+    void clearTextures() {
+        for (auto& entry : m_textures) {
+            SDL_DestroyTexture(entry.second.texture);
+        }
+        m_textures.clear();
+        m_lru.clear();
+        m_textureBytes = 0;
+    }
+
+    struct CachedTexture {
+        SDL_Texture* texture;
+        std::list<int>::iterator position;
+    };
+
+    std::string m_filename;
+    int m_streamIndex;
+    double m_duration;
+    double m_interval;  // 每个槽位覆盖的时长（秒）
+    int m_slotCount;
+    int m_thumbWidth;
+    int m_thumbHeight;
+
+    sidecar::MappedFile m_file;
+    std::vector<uint8_t> m_memoryFallback;  // 缓存文件不可用时代替映射
+    uint8_t* m_slotFlags;   // 缓存中的完成标记
+    uint8_t* m_slotPixels;  // 缓存中的像素区
+    std::unique_ptr<std::atomic<uint8_t>[]> m_ready;  // 供UI线程读取的完成标记
+
+    std::vector<int> m_order;  // 待生成槽位的顺序
+    std::atomic<size_t> m_nextOrder;
+    std::atomic<int> m_readyCount;
+    std::atomic<int> m_activeWorkers;
+    std::atomic<bool> m_cancel;
+    std::vector<std::thread> m_workers;
+    ThreadBudget::Lease m_lease;
+
+    std::unordered_map<int, CachedTexture> m_textures;
+    std::list<int> m_lru;  // 最近使用的在前
+    size_t m_textureBytes;
+    size_t m_memoryLimit;
+};
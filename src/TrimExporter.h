@@ -0,0 +1,810 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "DecoderThreading.h"
+#include "MediaQueue.h"
+#include "Profiler.h"
+
+struct TrimExportStats {
+    std::string mode;             // copy: 全部流复制；smart: 只重编码两端；keyframe: 无法重编码，入出点对齐到关键帧
+    double inPoint = 0.0;         // 实际使用的入点/出点（秒）
+    double outPoint = 0.0;
+    double elapsedSeconds = 0.0;
+    int gopsCopied = 0;
+    int gopsEncoded = 0;
+    uint64_t copiedPackets = 0;
+    uint64_t copiedBytes = 0;
+    uint64_t encodedFrames = 0;
+    uint64_t encodedBytes = 0;
+    double encodedSeconds = 0.0;  // 重编码的画面时长
+    uint64_t audioPackets = 0;
+    uint64_t outputBytes = 0;
+};
+
+// 智能裁剪导出：入点和出点之间完整的GOP直接复制数据包（不解码不编码），
+// 只有被入点/出点切开的GOP按源的参数重新编码，最后写成MP4/MKV
+// 只读取入点之前最近的关键帧到出点附近（dts越过出点为止）的数据包，导出耗时与文件总长无关
+// 重编码段的参数集（SPS/PPS、VOL等）写在码流内；其后第一个复制的关键帧前补上源的参数集，解码器随之切换回来
+// H.264写MP4/MOV时有重编码段就标为avc3，参数集在码流内切换是合规的
+// 不支持的编码格式或没有对应编码器时退回关键帧对齐的纯复制
+class TrimExporter {
+public:
+    TrimExporter() : m_cancel(false), m_running(false) {}
+
+    ~TrimExporter() {
+        cancel();
+        wait();
+    }
+
+    TrimExporter(const TrimExporter&) = delete;
+    TrimExporter& operator=(const TrimExporter&) = delete;
+
+    // 同步导出[inPoint, outPoint)（秒），输出格式由扩展名决定
+    bool exportRange(const std::string& input, double inPoint, double outPoint,
+                     const std::string& output, TrimExportStats& stats) {
+        auto begin = std::chrono::steady_clock::now();
+        stats = TrimExportStats();
+        if (outPoint <= inPoint) {
+            std::cerr << "导出: 出点必须在入点之后" << std::endl;
+            return false;
+        }
+
+        Job job;
+        bool ok = openInput(job, input) && readRange(job, inPoint, outPoint) && plan(job, stats) &&
+                  buildVideo(job, stats) && writeOutput(job, output, stats);
+        closeInput(job);
+
+        stats.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        if (!ok) {
+            std::error_code ec;
+            std::filesystem::remove(output, ec);
+            return false;
+        }
+        std::error_code ec;
+        stats.outputBytes = (uint64_t)std::filesystem::file_size(output, ec);
+        return true;
+    }
+
+    // 在后台线程导出，完成后在控制台打印统计；已有导出在进行时返回false
+    bool start(const std::string& input, double inPoint, double outPoint, const std::string& output) {
+        if (m_running) {
+            return false;
+        }
+        wait();
+        m_cancel = false;
+        m_running = true;
+        m_thread = std::thread([this, input, inPoint, outPoint, output]() {
+            Profiler::setThreadName("export");
+            TrimExportStats stats;
+            if (exportRange(input, inPoint, outPoint, output, stats)) {
+                printStats(output, stats);
+            } else if (!m_cancel) {
+                std::cerr << "导出失败: " << output << std::endl;
+            }
+            m_running = false;
+        });
+        return true;
+    }
+
+    bool isRunning() const {
+        return m_running;
+    }
+
+    void cancel() {
+        m_cancel = true;
+    }
+
+    void wait() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    static void printStats(const std::string& output, const TrimExportStats& stats) {
+        double duration = stats.outPoint - stats.inPoint;
+        std::cout << "导出完成: " << output << "（" << stats.mode << "）"
+                  << " 区间 " << stats.inPoint << "s - " << stats.outPoint << "s"
+                  << "，耗时 " << stats.elapsedSeconds * 1000 << "ms"
+                  << "（" << (stats.elapsedSeconds > 0.0 ? duration / stats.elapsedSeconds : 0.0) << "x实时）"
+                  << "\n  复制 " << stats.gopsCopied << " 个GOP / " << stats.copiedPackets << " 个数据包 / "
+                  << stats.copiedBytes / 1024 << "KB"
+                  << "，重编码 " << stats.gopsEncoded << " 个GOP / " << stats.encodedFrames << " 帧 / "
+                  << stats.encodedSeconds << "s（占 " << (duration > 0.0 ? stats.encodedSeconds / duration * 100 : 0.0) << "%）"
+                  << "，音频 " << stats.audioPackets << " 个数据包，输出 " << stats.outputBytes / 1024 << "KB" << std::endl;
+    }
+
+private:
+    enum class GopAction { Skip, Copy, Encode };
+
+    // 按解码顺序的一个GOP：从关键帧开始到下一个关键帧之前
+    struct Gop {
+        size_t first = 0;  // 在videoPackets中的范围[first, last)
+        size_t last = 0;
+        int64_t keyPts = 0;
+        int64_t minPts = std::numeric_limits<int64_t>::max();
+        int64_t endPts = std::numeric_limits<int64_t>::min();  // 最后一帧显示结束的时间
+        size_t bytes = 0;
+        GopAction action = GopAction::Skip;
+    };
+
+    struct OutputPacket {
+        PacketPtr packet;
+        bool encoded;
+    };
+
+    struct Job {
+        AVFormatContext* input = nullptr;
+        AVStream* video = nullptr;
+        AVStream* audio = nullptr;
+        int64_t inTs = 0;   // 视频流时间基
+        int64_t outTs = 0;
+        int64_t offsetTs = 0;       // 输出时间戳减去的量（视频流时间基）
+        int64_t frameDuration = 1;
+        int64_t reorderDelay = 0;   // 源中pts - dts的最大值
+        std::vector<PacketPtr> videoPackets;  // 解码顺序
+        std::vector<PacketPtr> audioPackets;
+        std::vector<Gop> gops;
+        std::vector<OutputPacket> output;     // 输出的视频数据包，解码顺序
+        std::vector<uint8_t> parameterSets;   // 复制的关键帧之前补上的源参数集
+        int nalLengthSize = 0;                // H.264 AVCC的NAL长度字段字节数，0表示起始码格式
+    };
+
+    static constexpr int kEncodeGopSize = 250;  // 重编码段内的关键帧间隔
+    static constexpr unsigned int kAvc3Tag = MKTAG('a', 'v', 'c', '3');
+
+    static int interruptCallback(void* opaque) {
+        return ((TrimExporter*)opaque)->m_cancel.load() ? 1 : 0;
+    }
+
+    static int64_t packetTime(const AVPacket* packet) {
+        return packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    }
+
+    // 音频包结束的时间（音频流时间基）；包没有时长时按每帧的采样数估算
+    static int64_t audioPacketEnd(const Job& job, const AVPacket* packet) {
+        int64_t duration = packet->duration;
+        const AVCodecParameters* par = job.audio->codecpar;
+        if (duration <= 0 && par->frame_size > 0 && par->sample_rate > 0) {
+            duration = av_rescale_q(par->frame_size, { 1, par->sample_rate }, job.audio->time_base);
+        }
+        return packet->pts + std::max<int64_t>(1, duration);
+    }
+
+    bool openInput(Job& job, const std::string& input) {
+        job.input = avformat_alloc_context();
+        if (!job.input) {
+            return false;
+        }
+        job.input->interrupt_callback.callback = &TrimExporter::interruptCallback;
+        job.input->interrupt_callback.opaque = this;
+        if (avformat_open_input(&job.input, input.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "导出: 无法打开视频文件: " << input << std::endl;
+            return false;
+        }
+        if (avformat_find_stream_info(job.input, nullptr) < 0) {
+            std::cerr << "导出: 无法获取流信息" << std::endl;
+            return false;
+        }
+
+        int videoIndex = av_find_best_stream(job.input, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (videoIndex < 0) {
+            std::cerr << "导出: 未找到视频流" << std::endl;
+            return false;
+        }
+        job.video = job.input->streams[videoIndex];
+        int audioIndex = av_find_best_stream(job.input, AVMEDIA_TYPE_AUDIO, -1, videoIndex, nullptr, 0);
+        job.audio = audioIndex >= 0 ? job.input->streams[audioIndex] : nullptr;
+
+        // 其余的流不读取
+        for (unsigned int i = 0; i < job.input->nb_streams; i++) {
+            if ((int)i != videoIndex && (int)i != audioIndex) {
+                job.input->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+
+        AVRational rate = job.video->avg_frame_rate;
+        job.frameDuration = rate.num > 0 && rate.den > 0 ? std::max<int64_t>(1, av_rescale_q(1, av_inv_q(rate), job.video->time_base)) : 1;
+
+        // H.264 AVCC：参数集从avcC中取出，转成与数据包相同的长度前缀格式
+        const AVCodecParameters* par = job.video->codecpar;
+        if (par->codec_id == AV_CODEC_ID_H264 && par->extradata_size >= 7 && par->extradata[0] == 1) {
+            job.nalLengthSize = (par->extradata[4] & 3) + 1;
+            job.parameterSets = avccParameterSets(par->extradata, par->extradata_size, job.nalLengthSize);
+        } else if (par->extradata_size > 0) {
+            job.parameterSets.assign(par->extradata, par->extradata + par->extradata_size);
+        }
+        return true;
+    }
+
+    void closeInput(Job& job) {
+        job.videoPackets.clear();
+        job.audioPackets.clear();
+        job.output.clear();
+        if (job.input) {
+            avformat_close_input(&job.input);
+        }
+    }
+
+    // 从入点之前最近的关键帧读到dts越过出点为止：之后的包显示时间都在出点之后；
+    // 出点之后的关键帧也读进来，它所在GOP的前导帧（开放GOP，pts早于关键帧）可能还在出点之前，由plan()决定重编码
+    // 音频读到视频读过的最晚显示时间，等plan()定下最终的视频区间之后再截取；没有时间戳的音频包接在上一个包之后
+    bool readRange(Job& job, double inPoint, double outPoint) {
+        ProfileScope scope("export_read");
+        AVRational tb = job.video->time_base;
+        job.inTs = (int64_t)std::llround(inPoint / av_q2d(tb));
+        job.outTs = (int64_t)std::llround(outPoint / av_q2d(tb));
+        if (av_seek_frame(job.input, job.video->index, job.inTs, AVSEEK_FLAG_BACKWARD) < 0) {
+            std::cerr << "导出: 跳转到入点失败，从头读取" << std::endl;
+        }
+
+        int64_t audioOut = std::numeric_limits<int64_t>::max();  // 视频读完之后才确定
+        int64_t videoEnd = job.outTs;  // 读到的视频帧最晚的显示结束时间
+        bool videoDone = false;
+        bool audioDone = job.audio == nullptr;
+        PacketPtr packet = makePacket();
+        while (packet && (!videoDone || !audioDone)) {
+            if (m_cancel) {
+                return false;
+            }
+            if (av_read_frame(job.input, packet.get()) < 0) {
+                break;
+            }
+
+            int64_t pts = packetTime(packet.get());
+            if (packet->stream_index == job.video->index && !videoDone && pts != AV_NOPTS_VALUE) {
+                bool key = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+                if (job.videoPackets.empty() && !key) {
+                    av_packet_unref(packet.get());
+                    continue;
+                }
+                int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : pts;
+                if (!job.videoPackets.empty() && dts >= job.outTs) {
+                    videoDone = true;
+                    if (job.audio) {
+                        audioOut = av_rescale_q(std::max(videoEnd, pts), tb, job.audio->time_base);
+                    }
+                } else {
+                    videoEnd = std::max(videoEnd, pts + (packet->duration > 0 ? packet->duration : job.frameDuration));
+                    job.videoPackets.push_back(makePacket());
+                    av_packet_move_ref(job.videoPackets.back().get(), packet.get());
+                }
+            } else if (job.audio && packet->stream_index == job.audio->index && !audioDone) {
+                if (pts == AV_NOPTS_VALUE && !job.audioPackets.empty()) {
+                    pts = audioPacketEnd(job, job.audioPackets.back().get());
+                }
+                if (pts != AV_NOPTS_VALUE && pts >= audioOut) {
+                    audioDone = true;
+                } else if (pts != AV_NOPTS_VALUE) {
+                    packet->pts = pts;
+                    if (packet->dts == AV_NOPTS_VALUE) {
+                        packet->dts = pts;
+                    }
+                    job.audioPackets.push_back(makePacket());
+                    av_packet_move_ref(job.audioPackets.back().get(), packet.get());
+                }
+            }
+            av_packet_unref(packet.get());
+        }
+
+        if (job.videoPackets.empty()) {
+            std::cerr << "导出: 入点之后没有视频数据" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 划分GOP并决定每个GOP复制还是重编码
+    bool plan(Job& job, TrimExportStats& stats) {
+        for (size_t i = 0; i < job.videoPackets.size(); i++) {
+            const AVPacket* packet = job.videoPackets[i].get();
+            int64_t pts = packetTime(packet);
+            if ((packet->flags & AV_PKT_FLAG_KEY) || job.gops.empty()) {
+                Gop gop;
+                gop.first = i;
+                gop.keyPts = pts;
+                job.gops.push_back(gop);
+            }
+            Gop& gop = job.gops.back();
+            gop.last = i + 1;
+            gop.minPts = std::min(gop.minPts, pts);
+            gop.endPts = std::max(gop.endPts, pts + (packet->duration > 0 ? packet->duration : job.frameDuration));
+            gop.bytes += packet->size;
+            if (packet->dts != AV_NOPTS_VALUE && packet->pts != AV_NOPTS_VALUE) {
+                job.reorderDelay = std::max(job.reorderDelay, packet->pts - packet->dts);
+            }
+        }
+
+        // 完整落在区间内的GOP复制；前导帧（pts早于关键帧）参考上一个GOP，只有上一个GOP也是复制的才能复制
+        bool needEncode = false;
+        for (size_t i = 0; i < job.gops.size(); i++) {
+            Gop& gop = job.gops[i];
+            bool leading = gop.minPts < gop.keyPts;
+            if (gop.endPts <= job.inTs || gop.minPts >= job.outTs) {
+                gop.action = GopAction::Skip;
+            } else if (gop.minPts >= job.inTs && gop.endPts <= job.outTs &&
+                       (!leading || (i > 0 && job.gops[i - 1].action == GopAction::Copy))) {
+                gop.action = GopAction::Copy;
+            } else {
+                gop.action = GopAction::Encode;
+                needEncode = true;
+            }
+        }
+
+        AVRational tb = job.video->time_base;
+        job.offsetTs = job.inTs;
+        stats.mode = needEncode ? "smart" : "copy";
+        if (needEncode && !canEncode(job)) {
+            // 退回关键帧对齐：与区间有交集的GOP全部复制，入点提前到第一个关键帧
+            job.offsetTs = std::numeric_limits<int64_t>::max();
+            int64_t end = job.outTs;
+            for (Gop& gop : job.gops) {
+                if (gop.action != GopAction::Skip) {
+                    gop.action = GopAction::Copy;
+                    job.offsetTs = std::min(job.offsetTs, gop.minPts);
+                    end = std::max(end, gop.endPts);
+                }
+            }
+            job.outTs = end;
+            stats.mode = "keyframe";
+            std::cerr << "导出: 无法按源参数重新编码 " << avcodec_get_name(job.video->codecpar->codec_id)
+                      << "，入点和出点对齐到关键帧" << std::endl;
+        }
+
+        stats.inPoint = std::max(job.offsetTs, job.gops.front().minPts) * av_q2d(tb);
+        stats.outPoint = std::min(job.outTs, job.gops.back().endPts) * av_q2d(tb);
+        job.offsetTs = std::min(job.offsetTs, job.inTs);
+        trimAudio(job);
+        return true;
+    }
+
+    // 音频按最终的视频区间[offsetTs, outTs)截取，关键帧对齐时跟着视频一起扩大
+    static void trimAudio(Job& job) {
+        if (!job.audio) {
+            return;
+        }
+        int64_t audioIn = av_rescale_q(job.offsetTs, job.video->time_base, job.audio->time_base);
+        int64_t audioOut = av_rescale_q(job.outTs, job.video->time_base, job.audio->time_base);
+        auto outside = [&](const PacketPtr& packet) {
+            int64_t pts = packetTime(packet.get());
+            return pts < audioIn || pts >= audioOut;
+        };
+        job.audioPackets.erase(std::remove_if(job.audioPackets.begin(), job.audioPackets.end(), outside), job.audioPackets.end());
+    }
+
+    // 只对参数集可以写在码流内、解码器遇到新参数集会切换的格式做重编码
+    bool canEncode(const Job& job) {
+        AVCodecID id = job.video->codecpar->codec_id;
+        if (id != AV_CODEC_ID_H264 && id != AV_CODEC_ID_MPEG4 && id != AV_CODEC_ID_MPEG2VIDEO) {
+            return false;
+        }
+        AVCodecContext* encoder = openEncoder(job, job.video->codecpar->bit_rate);
+        if (!encoder) {
+            return false;
+        }
+        avcodec_free_context(&encoder);
+        return true;
+    }
+
+    // 按源的尺寸、像素格式、帧率、profile和码率创建编码器；不使用全局头，参数集写在每个关键帧前
+    AVCodecContext* openEncoder(const Job& job, int64_t bitRate) {
+        const AVCodecParameters* par = job.video->codecpar;
+        const AVCodec* codec = avcodec_find_encoder(par->codec_id);
+        if (!codec) {
+            return nullptr;
+        }
+        AVCodecContext* encoder = avcodec_alloc_context3(codec);
+        if (!encoder) {
+            return nullptr;
+        }
+        AVRational rate = job.video->avg_frame_rate;
+        if (rate.num <= 0 || rate.den <= 0) {
+            rate = { 25, 1 };
+        }
+        encoder->width = par->width;
+        encoder->height = par->height;
+        encoder->pix_fmt = (AVPixelFormat)par->format;
+        encoder->sample_aspect_ratio = par->sample_aspect_ratio;
+        encoder->color_range = par->color_range;
+        encoder->color_primaries = par->color_primaries;
+        encoder->color_trc = par->color_trc;
+        encoder->colorspace = par->color_space;
+        encoder->time_base = av_inv_q(rate);
+        encoder->framerate = rate;
+        encoder->gop_size = kEncodeGopSize;
+        encoder->max_b_frames = 0;  // 输出顺序即显示顺序，时间戳直接沿用源帧的pts
+        encoder->bit_rate = bitRate > 0 ? bitRate : 0;
+        encoder->profile = par->profile;
+        encoder->level = par->level;
+        encoder->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+        if (avcodec_open2(encoder, codec, nullptr) < 0) {
+            avcodec_free_context(&encoder);
+            return nullptr;
+        }
+        return encoder;
+    }
+
+    // 按GOP顺序生成输出的视频数据包：复制段直接引用源数据包，重编码段解码后重新编码
+    bool buildVideo(Job& job, TrimExportStats& stats) {
+        bool afterEncoded = false;
+        for (size_t i = 0; i < job.gops.size();) {
+            if (m_cancel) {
+                return false;
+            }
+            const Gop& gop = job.gops[i];
+            if (gop.action == GopAction::Skip) {
+                i++;
+                continue;
+            }
+            if (gop.action == GopAction::Copy) {
+                ProfileScope scope("export_copy");
+                for (size_t p = gop.first; p < gop.last; p++) {
+                    PacketPtr packet = makePacket();
+                    if (!packet || av_packet_ref(packet.get(), job.videoPackets[p].get()) < 0) {
+                        return false;
+                    }
+                    // 重编码段之后的第一个关键帧：补上源的参数集
+                    if (afterEncoded && p == gop.first && !job.parameterSets.empty()) {
+                        packet = prependParameterSets(job, packet.get());
+                        if (!packet) {
+                            return false;
+                        }
+                    }
+                    stats.copiedPackets++;
+                    stats.copiedBytes += packet->size;
+                    job.output.push_back({ std::move(packet), false });
+                }
+                stats.gopsCopied++;
+                afterEncoded = false;
+                i++;
+                continue;
+            }
+
+            size_t end = i;
+            while (end < job.gops.size() && job.gops[end].action == GopAction::Encode) {
+                end++;
+            }
+            if (!encodeSegment(job, i, end, stats)) {
+                return false;
+            }
+            stats.gopsEncoded += (int)(end - i);
+            afterEncoded = true;
+            i = end;
+        }
+
+        fixDecodeTimestamps(job);
+        return true;
+    }
+
+    // 重编码[first, last)这几个GOP中落在区间内的帧
+    bool encodeSegment(Job& job, size_t first, size_t last, TrimExportStats& stats) {
+        ProfileScope scope("export_encode");
+        const AVCodecParameters* par = job.video->codecpar;
+
+        int64_t segmentStart = std::numeric_limits<int64_t>::max();
+        int64_t segmentEnd = std::numeric_limits<int64_t>::min();
+        size_t bytes = 0;
+        for (size_t g = first; g < last; g++) {
+            segmentStart = std::min(segmentStart, job.gops[g].minPts);
+            segmentEnd = std::max(segmentEnd, job.gops[g].endPts);
+            bytes += job.gops[g].bytes;
+        }
+        int64_t keepFrom = std::max(segmentStart, job.inTs);
+        int64_t keepUntil = std::min(segmentEnd, job.outTs);
+
+        // 码率取这几个GOP的实际码率，画质与周围复制的部分接近
+        double seconds = (segmentEnd - segmentStart) * av_q2d(job.video->time_base);
+        int64_t bitRate = seconds > 0.0 ? (int64_t)(bytes * 8 / seconds) : par->bit_rate;
+
+        const AVCodec* codec = avcodec_find_decoder(par->codec_id);
+        AVCodecContext* decoder = codec ? avcodec_alloc_context3(codec) : nullptr;
+        AVCodecContext* encoder = openEncoder(job, bitRate);
+        FramePtr frame = makeFrame();
+        PacketPtr packet = makePacket();
+        ThreadBudget::Lease lease = ThreadBudget::instance().acquire(DecoderRole::Export);
+        bool ok = decoder && encoder && frame && packet && avcodec_parameters_to_context(decoder, par) >= 0;
+        if (ok) {
+            decoder->pkt_timebase = job.video->time_base;
+            decoder->thread_count = lease.threads();
+            ok = avcodec_open2(decoder, codec, nullptr) >= 0;
+        }
+        if (!ok) {
+            std::cerr << "导出: 无法创建重编码所需的解码器/编码器" << std::endl;
+            avcodec_free_context(&decoder);
+            avcodec_free_context(&encoder);
+            return false;
+        }
+
+        // 编码器不使用B帧，输出顺序与输入相同：按顺序把源帧的pts还给编码后的数据包
+        std::deque<int64_t> pendingPts;
+        int64_t frameIndex = 0;
+        auto receivePackets = [&]() {
+            while (avcodec_receive_packet(encoder, packet.get()) == 0) {
+                PacketPtr out = makePacket();
+                if (!out || pendingPts.empty()) {
+                    av_packet_unref(packet.get());
+                    continue;
+                }
+                int flags = packet->flags;
+                if (job.nalLengthSize > 0) {
+                    if (!annexbToLengthPrefixed(packet.get(), job.nalLengthSize, out.get())) {
+                        av_packet_unref(packet.get());
+                        return false;
+                    }
+                } else {
+                    av_packet_move_ref(out.get(), packet.get());
+                }
+                out->pts = pendingPts.front();
+                out->dts = out->pts - job.reorderDelay;
+                out->duration = job.frameDuration;
+                out->flags = flags;
+                pendingPts.pop_front();
+                av_packet_unref(packet.get());
+
+                stats.encodedBytes += out->size;
+                job.output.push_back({ std::move(out), true });
+            }
+            return true;
+        };
+        auto encodeFrame = [&](AVFrame* decoded) {
+            int64_t pts = decoded->best_effort_timestamp;
+            if (pts == AV_NOPTS_VALUE || pts < keepFrom || pts >= keepUntil) {
+                return true;
+            }
+            pendingPts.push_back(pts);
+            decoded->pts = frameIndex++;
+            decoded->pict_type = AV_PICTURE_TYPE_NONE;
+            stats.encodedFrames++;
+            stats.encodedSeconds += job.frameDuration * av_q2d(job.video->time_base);
+            return avcodec_send_frame(encoder, decoded) >= 0 && receivePackets();
+        };
+        auto receiveFrames = [&]() {
+            while (avcodec_receive_frame(decoder, frame.get()) == 0) {
+                bool sent = encodeFrame(frame.get());
+                av_frame_unref(frame.get());
+                if (!sent) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        // 第一个GOP有前导帧时从上一个GOP开始解码，前导帧才有参考帧
+        size_t decodeFrom = first;
+        if (first > 0 && job.gops[first].minPts < job.gops[first].keyPts) {
+            decodeFrom = first - 1;
+        }
+        for (size_t p = job.gops[decodeFrom].first; ok && p < job.gops[last - 1].last; p++) {
+            if (m_cancel) {
+                ok = false;
+                break;
+            }
+            if (avcodec_send_packet(decoder, job.videoPackets[p].get()) < 0) {
+                continue;
+            }
+            ok = receiveFrames();
+        }
+        if (ok) {
+            avcodec_send_packet(decoder, nullptr);
+            ok = receiveFrames();
+        }
+        if (ok) {
+            avcodec_send_frame(encoder, nullptr);
+            ok = receivePackets();
+        }
+
+        avcodec_free_context(&decoder);
+        avcodec_free_context(&encoder);
+        return ok;
+    }
+
+    // 重编码的数据包沿用源的解码延迟；与相邻复制段衔接处dts不递增时顺延到上一个包之后，
+    // 顺延后有dts超过pts的包时，整条视频的dts一起提前（加大解码延迟），保证dts严格递增且不晚于pts
+    static void fixDecodeTimestamps(Job& job) {
+        std::vector<OutputPacket>& output = job.output;
+        int64_t lag = 0;
+        for (size_t i = 0; i < output.size(); i++) {
+            AVPacket* packet = output[i].packet.get();
+            if (i > 0 && packet->dts <= output[i - 1].packet->dts) {
+                packet->dts = output[i - 1].packet->dts + 1;
+            }
+            lag = std::max(lag, packet->dts - packet->pts);
+        }
+        if (lag > 0) {
+            for (OutputPacket& out : output) {
+                out.packet->dts -= lag;
+            }
+        }
+    }
+
+    bool writeOutput(Job& job, const std::string& path, TrimExportStats& stats) {
+        ProfileScope scope("export_write");
+        AVFormatContext* output = nullptr;
+        if (avformat_alloc_output_context2(&output, nullptr, nullptr, path.c_str()) < 0 || !output) {
+            std::cerr << "导出: 无法识别输出格式（应为.mp4/.mov/.mkv）: " << path << std::endl;
+            return false;
+        }
+
+        bool ok = false;
+        do {
+            AVStream* video = avformat_new_stream(output, nullptr);
+            if (!video || avcodec_parameters_copy(video->codecpar, job.video->codecpar) < 0) {
+                break;
+            }
+            video->codecpar->codec_tag = 0;
+            // 重编码段的SPS/PPS与avcC中的不同，写在码流内；MP4/MOV中用avc3标明参数集可以出现在码流内
+            if (stats.gopsEncoded > 0 && job.video->codecpar->codec_id == AV_CODEC_ID_H264 && output->oformat->codec_tag &&
+                av_codec_get_id(output->oformat->codec_tag, kAvc3Tag) == AV_CODEC_ID_H264) {
+                video->codecpar->codec_tag = kAvc3Tag;
+            }
+            video->time_base = job.video->time_base;
+            video->avg_frame_rate = job.video->avg_frame_rate;
+            video->sample_aspect_ratio = job.video->sample_aspect_ratio;
+
+            AVStream* audio = nullptr;
+            if (job.audio) {
+                audio = avformat_new_stream(output, nullptr);
+                if (!audio || avcodec_parameters_copy(audio->codecpar, job.audio->codecpar) < 0) {
+                    break;
+                }
+                audio->codecpar->codec_tag = 0;
+                audio->time_base = job.audio->time_base;
+            }
+
+            if (!(output->oformat->flags & AVFMT_NOFILE) && avio_open(&output->pb, path.c_str(), AVIO_FLAG_WRITE) < 0) {
+                std::cerr << "导出: 无法写入文件: " << path << std::endl;
+                break;
+            }
+            if (avformat_write_header(output, nullptr) < 0) {
+                std::cerr << "导出: 无法写入文件头" << std::endl;
+                break;
+            }
+
+            // 按dts交错写入视频和音频
+            int64_t audioOffset = job.audio ? av_rescale_q(job.offsetTs, job.video->time_base, job.audio->time_base) : 0;
+            size_t v = 0;
+            size_t a = 0;
+            bool failed = false;
+            while (!failed && (v < job.output.size() || a < job.audioPackets.size())) {
+                bool takeVideo = a >= job.audioPackets.size() ||
+                                 (v < job.output.size() &&
+                                  av_compare_ts(job.output[v].packet->dts - job.offsetTs, job.video->time_base,
+                                                job.audioPackets[a]->dts - audioOffset, job.audio->time_base) <= 0);
+                AVPacket* packet;
+                if (takeVideo) {
+                    packet = job.output[v++].packet.get();
+                    shiftTimestamps(packet, job.offsetTs);
+                    packet->stream_index = video->index;
+                    av_packet_rescale_ts(packet, job.video->time_base, video->time_base);
+                } else {
+                    packet = job.audioPackets[a++].get();
+                    shiftTimestamps(packet, audioOffset);
+                    packet->stream_index = audio->index;
+                    av_packet_rescale_ts(packet, job.audio->time_base, audio->time_base);
+                    stats.audioPackets++;
+                }
+                packet->pos = -1;
+                failed = av_interleaved_write_frame(output, packet) < 0;
+            }
+            if (failed) {
+                std::cerr << "导出: 写入数据包失败" << std::endl;
+                break;
+            }
+            ok = av_write_trailer(output) >= 0;
+        } while (false);
+
+        if (!(output->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&output->pb);
+        }
+        avformat_free_context(output);
+        return ok;
+    }
+
+    static void shiftTimestamps(AVPacket* packet, int64_t offset) {
+        if (packet->pts != AV_NOPTS_VALUE) {
+            packet->pts -= offset;
+        }
+        if (packet->dts != AV_NOPTS_VALUE) {
+            packet->dts -= offset;
+        }
+    }
+
+    // avcC中的SPS/PPS转成长度前缀格式，可以直接放在数据包开头
+    static std::vector<uint8_t> avccParameterSets(const uint8_t* data, int size, int lengthSize) {
+        std::vector<uint8_t> out;
+        int offset = 5;
+        for (int type = 0; type < 2 && offset < size; type++) {
+            int count = type == 0 ? (data[offset] & 0x1f) : data[offset];
+            offset++;
+            for (int i = 0; i < count && offset + 2 <= size; i++) {
+                int length = (data[offset] << 8) | data[offset + 1];
+                offset += 2;
+                if (offset + length > size) {
+                    return {};
+                }
+                appendNal(out, data + offset, length, lengthSize);
+                offset += length;
+            }
+        }
+        return out;
+    }
+
+    static void appendNal(std::vector<uint8_t>& out, const uint8_t* nal, size_t size, int lengthSize) {
+        for (int shift = (lengthSize - 1) * 8; shift >= 0; shift -= 8) {
+            out.push_back((uint8_t)(size >> shift));
+        }
+        out.insert(out.end(), nal, nal + size);
+    }
+
+    // 编码器输出的Annex B（起始码分隔）转成源使用的长度前缀格式
+    static bool annexbToLengthPrefixed(const AVPacket* in, int lengthSize, AVPacket* out) {
+        std::vector<uint8_t> converted;
+        converted.reserve(in->size + 64);
+        const uint8_t* data = in->data;
+        int size = in->size;
+        auto findStart = [&](int from) {
+            for (int i = from; i + 2 < size; i++) {
+                if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+                    return i;
+                }
+            }
+            return size;
+        };
+
+        int start = findStart(0);
+        while (start < size) {
+            int nal = start + 3;
+            int next = findStart(nal);
+            int end = next;
+            while (end > nal && data[end - 1] == 0) {
+                end--;
+            }
+            if (end > nal) {
+                appendNal(converted, data + nal, (size_t)(end - nal), lengthSize);
+            }
+            start = next;
+        }
+
+        if (av_new_packet(out, (int)converted.size()) < 0) {
+            return false;
+        }
+        std::memcpy(out->data, converted.data(), converted.size());
+        return true;
+    }
+
+    static PacketPtr prependParameterSets(const Job& job, const AVPacket* packet) {
+        PacketPtr out = makePacket();
+        int size = (int)job.parameterSets.size() + packet->size;
+        if (!out || av_new_packet(out.get(), size) < 0) {
+            return nullptr;
+        }
+        std::memcpy(out->data, job.parameterSets.data(), job.parameterSets.size());
+        std::memcpy(out->data + job.parameterSets.size(), packet->data, packet->size);
+        out->pts = packet->pts;
+        out->dts = packet->dts;
+        out->duration = packet->duration;
+        out->flags = packet->flags;
+        return out;
+    }
+
+    std::atomic<bool> m_cancel;
+    std::atomic<bool> m_running;
+    std::thread m_thread;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// 界面图元的批量提交：连续的同类同色图元攒起来，一次SDL_RenderFillRects/SDL_RenderDrawRects发出
+// 颜色或类型变化时才提交，绘制顺序不变；水平/竖直线段按1像素宽的矩形并入填充批次
+// 统计实际发出的绘制调用次数，批次之外的纹理拷贝由调用方用countCall()计入
+class DrawBatch {
+public:
+    explicit DrawBatch(SDL_Renderer* renderer = nullptr)
+        : m_renderer(renderer), m_kind(Kind::Fill), m_color{ 0, 0, 0, 0 }, m_calls(0) {}
+
+    void setRenderer(SDL_Renderer* renderer) {
+        flush();
+        m_renderer = renderer;
+    }
+
+    void fill(const SDL_Rect& rect, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255) {
+        add(Kind::Fill, rect, { r, g, b, a });
+    }
+
+    void outline(const SDL_Rect& rect, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255) {
+        add(Kind::Outline, rect, { r, g, b, a });
+    }
+
+    void line(int x1, int y1, int x2, int y2, Uint8 r, Uint8 g, Uint8 b, Uint8 a = 255) {
+        if (x1 == x2 || y1 == y2) {
+            SDL_Rect rect = { std::min(x1, x2), std::min(y1, y2), std::abs(x2 - x1) + 1, std::abs(y2 - y1) + 1 };
+            add(Kind::Fill, rect, { r, g, b, a });
+            return;
+        }
+        flush();
+        applyColor({ r, g, b, a });
+        SDL_RenderDrawLine(m_renderer, x1, y1, x2, y2);
+        restoreBlend(a);
+        m_calls++;
+    }
+
+    // 把攒下的图元提交给渲染器；在批次之外直接调用SDL绘制之前必须先调用
+    void flush() {
+        if (m_rects.empty()) {
+            return;
+        }
+        applyColor(m_color);
+        if (m_kind == Kind::Fill) {
+            SDL_RenderFillRects(m_renderer, m_rects.data(), (int)m_rects.size());
+        } else {
+            SDL_RenderDrawRects(m_renderer, m_rects.data(), (int)m_rects.size());
+        }
+        restoreBlend(m_color.a);
+        m_rects.clear();
+        m_calls++;
+    }
+
+    void countCall(int calls = 1) {
+        m_calls += calls;
+    }
+
+    uint64_t calls() const {
+        return m_calls;
+    }
+
+    void resetCalls() {
+        m_calls = 0;
+    }
+
+private:
+    enum class Kind { Fill, Outline };
+
+    static bool sameColor(const SDL_Color& a, const SDL_Color& b) {
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    }
+
+    void add(Kind kind, const SDL_Rect& rect, const SDL_Color& color) {
+        if (!m_rects.empty() && (kind != m_kind || !sameColor(color, m_color))) {
+            flush();
+        }
+        m_kind = kind;
+        m_color = color;
+        m_rects.push_back(rect);
+    }
+
+    // 半透明的图元临时打开混合，画完恢复成不混合
+    void applyColor(const SDL_Color& color) {
+        if (color.a < 255) {
+            SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_BLEND);
+        }
+        SDL_SetRenderDrawColor(m_renderer, color.r, color.g, color.b, color.a);
+    }
+
+    void restoreBlend(Uint8 alpha) {
+        if (alpha < 255) {
+            SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_NONE);
+        }
+    }
+
+    SDL_Renderer* m_renderer;
+    Kind m_kind;
+    SDL_Color m_color;
+    std::vector<SDL_Rect> m_rects;  // 跨帧复用，不再每帧分配
+    uint64_t m_calls;
+};
+
+// 保留模式的静态图层：内容画进一张目标纹理，尺寸和调用方给出的内容键都不变时每帧只拷贝一次
+// 键里放布局（窗口尺寸）和会改变这层内容的状态（时长、缩略图/波形的进度等）
+// 渲染器不支持目标纹理时退化为每帧直接画到屏幕上
+class CachedLayer {
+public:
+    CachedLayer() : m_texture(nullptr), m_renderer(nullptr), m_width(0), m_height(0), m_key(0),
+                    m_valid(false), m_drawing(false), m_redraws(0) {}
+
+    ~CachedLayer() {
+        release();
+    }
+
+    CachedLayer(const CachedLayer&) = delete;
+    CachedLayer& operator=(const CachedLayer&) = delete;
+
+    // 需要重画时把渲染目标切到图层纹理并返回true，调用方画完内容后调用end()
+    bool begin(SDL_Renderer* renderer, int width, int height, uint64_t key) {
+        if (!SDL_RenderTargetSupported(renderer)) {
+            m_redraws++;
+            return true;
+        }
+        if (m_valid && renderer == m_renderer && width == m_width && height == m_height && key == m_key) {
+            return false;
+        }
+        if (!m_texture || renderer != m_renderer || width != m_width || height != m_height) {
+            release();
+            m_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                          std::max(1, width), std::max(1, height));
+            if (!m_texture) {
+                std::cerr << "界面: 无法创建图层纹理，改为直接绘制: " << SDL_GetError() << std::endl;
+                m_redraws++;
+                return true;
+            }
+            SDL_SetTextureBlendMode(m_texture, SDL_BLENDMODE_NONE);
+            m_renderer = renderer;
+            m_width = width;
+            m_height = height;
+        }
+        SDL_SetRenderTarget(renderer, m_texture);
+        m_key = key;
+        m_valid = true;
+        m_drawing = true;
+        m_redraws++;
+        return true;
+    }
+
+    void end() {
+        if (m_drawing) {
+            SDL_SetRenderTarget(m_renderer, nullptr);
+            m_drawing = false;
+        }
+    }
+
+    // 把图层拷贝到当前渲染目标的左上角；直接绘制模式下内容已经在屏幕上
+    bool draw(SDL_Renderer* renderer) {
+        if (!m_texture || !m_valid || renderer != m_renderer) {
+            return false;
+        }
+        SDL_Rect dst = { 0, 0, m_width, m_height };
+        SDL_RenderCopy(renderer, m_texture, nullptr, &dst);
+        return true;
+    }
+
+    // 渲染目标被重置（例如Direct3D设备丢失）时内容失效，下一帧重画
+    void invalidate() {
+        m_valid = false;
+    }
+
+    void release() {
+        if (m_texture) {
+            SDL_DestroyTexture(m_texture);
+            m_texture = nullptr;
+        }
+        m_renderer = nullptr;
+        m_width = m_height = 0;
+        m_valid = false;
+    }
+
+    uint64_t redraws() const {
+        return m_redraws;
+    }
+
+    // 把一个值混进图层的内容键
+    static uint64_t mixKey(uint64_t key, uint64_t value) {
+        key ^= value + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+        return key;
+    }
+
+private:
+    SDL_Texture* m_texture;
+    SDL_Renderer* m_renderer;
+    int m_width;
+    int m_height;
+    uint64_t m_key;
+    bool m_valid;
+    bool m_drawing;
+    uint64_t m_redraws;
+};
+
+// 主循环的统计：实际渲染/跳过的次数、每帧绘制调用数，以及空闲（不播放、不拖动、无后台任务）时的CPU占用
+class UiStats {
+public:
+    UiStats() : m_rendered(0), m_skipped(0), m_drawCalls(0), m_maxDrawCalls(0), m_idleWall(0.0), m_idleCpu(0.0),
+                m_wallMark(0.0), m_cpuMark(0.0), m_idle(false) {}
+
+    void onRender(uint64_t drawCalls) {
+        m_rendered++;
+        m_drawCalls += drawCalls;
+        m_maxDrawCalls = std::max(m_maxDrawCalls, drawCalls);
+    }
+
+    void onSkip() {
+        m_skipped++;
+    }
+
+    // 每次循环调用一次；上一段间隔如果是空闲的就计入空闲的墙钟和CPU时间
+    void mark(bool idle) {
+        double wall = wallSeconds();
+        double cpu = processCpuSeconds();
+        if (m_idle && m_wallMark > 0.0) {
+            m_idleWall += wall - m_wallMark;
+            m_idleCpu += cpu - m_cpuMark;
+        }
+        m_wallMark = wall;
+        m_cpuMark = cpu;
+        m_idle = idle;
+    }
+
+    void print() const {
+        std::cout << "界面: 渲染 " << m_rendered << " 帧，跳过 " << m_skipped << " 次，每帧绘制调用 平均 "
+                  << (m_rendered ? (double)m_drawCalls / m_rendered : 0.0) << " 最多 " << m_maxDrawCalls;
+        if (m_idleWall > 0.0) {
+            std::cout << "，空闲时CPU占用 " << m_idleCpu / m_idleWall * 100.0 << "%";
+        }
+        std::cout << std::endl;
+    }
+
+    // 整个进程（所有线程）累计使用的CPU时间（秒）
+    static double processCpuSeconds() {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+            return 0.0;
+        }
+        auto seconds = [](const FILETIME& time) {
+            return (((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime) / 1e7;
+        };
+        return seconds(kernel) + seconds(user);
+#else
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0.0;
+        }
+        return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+    }
+
+private:
+    static double wallSeconds() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t m_rendered;
+    uint64_t m_skipped;
+    uint64_t m_drawCalls;
+    uint64_t m_maxDrawCalls;
+    double m_idleWall;
+    double m_idleCpu;
+    double m_wallMark;
+    double m_cpuMark;
+    bool m_idle;  // 上一段间隔是否空闲
+};
@@ -0,0 +1,1692 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// FFmpeg头文件
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+#include <libavutil/imgutils.h>
+}
+
+#include "AudioPlayer.h"
+#include "ColorEffects.h"
+#include "Compositor.h"
+#include "MediaQueue.h"
+#include "FrameCache.h"
+#include "ScalerCache.h"
+#include "DecoderThreading.h"
+#include "KeyframeIndex.h"
+#include "MediaIO.h"
+#include "ProbeCache.h"
+#include "Profiler.h"
+
+// 视频解码器类
+// 解码流水线：解复用线程 -> 数据包队列 -> 解码/转换线程 -> 帧队列 -> UI线程上传纹理
+// 两个队列都是有界的，队列满时生产者阻塞，避免解码跑得比显示快时无限占用内存
+class VideoDecoder {
+public:
+    VideoDecoder() : 
+        formatContext(nullptr), 
+        ioMode(IOMode::Auto),
+        outputAttached(false),
+        probeCacheEnabled(true),
+        probeCached(false),
+        exactDuration(0.0),
+        codecContext(nullptr), 
+        videoStream(nullptr),
+        videoStreamIndex(-1),
+        frame(nullptr),
+        textureRenderer(nullptr),
+        texture(nullptr),
+        textureWidth(0),
+        textureHeight(0),
+        textureFormat(SDL_PIXELFORMAT_UNKNOWN),
+        outputFormat(AV_PIX_FMT_NONE),
+        frameBytes(0),
+        zeroCopyUpload(false),
+        previewScaling(true),
+        lowres(0),
+        role(DecoderRole::Preview),
+        autoTunedFps(0.0),
+        outputWidth(0),
+        outputHeight(0),
+        scrubbing(false),
+        packetQueueSize(64),
+        frameQueueSize(4),
+        audioEnabled(false),
+        audioStreamIndex(-1),
+        serial(0),
+        quit(false),
+        seekRequested(false),
+        seekTarget(0.0),
+        skipNonRef(false),
+        skipTarget(std::numeric_limits<double>::lowest()),
+        keyframeOnly(false),
+        currentPts(0.0),
+        currentDuration(0.0),
+        cachePlayback(false),
+        repeatDeadline(0.0),
+        hasFrame(false),
+        endOfStream(false),
+        refreshPending(false),
+        refreshTarget(std::numeric_limits<double>::lowest()),
+        droppedFrames(0),
+        repeatedFrames(0),
+        lastFrameBytesCopied(0),
+        totalBytesCopied(0),
+        keyframeSeeks(0),
+        forwardSeeks(0) {}
+
+    ~VideoDecoder() {
+        cleanup();
+    }
+
+    // 设置队列深度，在openFile之前调用生效
+    void setQueueDepths(size_t packets, size_t frames) {
+        packetQueueSize = packets ? packets : 1;
+        frameQueueSize = frames ? frames : 1;
+    }
+
+    // 零拷贝上传：需要格式转换时不再分配中间缓冲区，
+    // 由UI线程锁定纹理后让swscale直接写入纹理内存，在openFile之前调用生效
+    void setZeroCopyUpload(bool enabled) {
+        zeroCopyUpload = enabled;
+    }
+
+    // 按预览区域的实际尺寸转换，而不是解码分辨率，默认开启
+    void setPreviewScaling(bool enabled) {
+        previewScaling = enabled;
+    }
+
+    // 解码器lowres级别（0为关闭，1为1/2分辨率...），在openFile之前调用生效
+    void setLowres(int level) {
+        lowres = std::max(0, level);
+    }
+
+    // 解码器多线程策略和在核心预算中的角色，在openFile之前调用生效
+    void setThreading(const DecoderThreadingConfig& config) {
+        threadingConfig = config;
+    }
+
+    void setRole(DecoderRole decoderRole) {
+        role = decoderRole;
+    }
+
+    // 输入的读取方式，在openFile之前调用生效
+    void setIOMode(IOMode mode) {
+        ioMode = mode;
+    }
+
+    // 输入层的读取统计（字节数、等待时间、预读命中率），每次openFile清零
+    MediaIOStats getIOStats() const {
+        return mediaIO.stats();
+    }
+
+    // 实际使用的读取方式（Auto已解析）
+    IOMode getIOMode() const {
+        return mediaIO.mode();
+    }
+
+    // 打开文件时同时播放音频流（需要SDL音频子系统已初始化），在openFile之前调用生效
+    void setAudioEnabled(bool enabled) {
+        audioEnabled = enabled;
+    }
+
+    // 帧缓存的内存上限（字节），0表示关闭
+    void setFrameCacheSize(size_t bytes) {
+        frameCache.setCapacity(bytes);
+    }
+
+    int getDecodeThreadCount() const {
+        return codecContext ? codecContext->thread_count : 0;
+    }
+
+    const char* getDecodeThreadType() const {
+        return ThreadBudget::typeName(codecContext ? codecContext->active_thread_type : 0);
+    }
+
+    // 自动调优时选中的线程数对应的实测解码帧率，未调优时为0
+    double getAutoTunedFps() const {
+        return autoTunedFps;
+    }
+
+    // 预览区域中视频的显示尺寸，UI线程每次布局时调用；尺寸不变时没有任何开销
+    void setOutputSize(int width, int height) {
+        outputWidth = width;
+        outputHeight = height;
+    }
+
+    // 拖动时间线期间关闭环路滤波并使用更快的缩放算法，画质换速度
+    void setScrubbing(bool enabled) {
+        scrubbing = enabled;
+    }
+
+    // 各线程SwsContext累计创建次数，用于确认只在尺寸变化时重建
+    uint64_t getScalerRebuilds() const {
+        return decodeScalers.rebuilds() + uploadScalers.rebuilds();
+    }
+
+    // renderer为nullptr时无窗口运行，帧照常解码和转换但不上传纹理
+    bool openFile(const std::string& filename, SDL_Renderer* renderer) {
+        if (!openInput(filename) || !attachOutput(renderer)) {
+            return false;
+        }
+        setYUVConversionMode();
+        return true;
+    }
+
+    // 打开的第一阶段：解复用器、流信息和解码器，不涉及SDL，可以在后台线程上执行
+    // 之后必须在UI线程上调用attachOutput才会开始解码
+    bool openInput(const std::string& filename) {
+        // 关闭之前打开的文件并停止其解码线程
+        cleanup();
+
+        // 打开输入文件：读取经过自定义IO（本地文件内存映射，网络挂载后台预读）
+        formatContext = avformat_alloc_context();
+        if (!formatContext || !mediaIO.open(filename, ioMode)) {
+            std::cerr << "无法打开视频文件: " << filename << std::endl;
+            cleanup();
+            return false;
+        }
+        mediaIO.attach(formatContext);
+        if (avformat_open_input(&formatContext, filename.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "无法打开视频文件: " << filename << std::endl;
+            cleanup();
+            return false;
+        }
+        std::cout << "输入: " << MediaIO::modeName(mediaIO.mode()) << std::endl;
+
+        // 获取流信息：探测缓存有效时直接填回上次探测的参数，不再读取和解码文件开头
+        if (probeCacheEnabled && probe::load(filename, probeRecord) && probe::apply(probeRecord, formatContext)) {
+            probeCached = true;
+            exactDuration = probeRecord.duration;
+            std::cout << "探测: 使用缓存，跳过avformat_find_stream_info" << std::endl;
+        } else if (avformat_find_stream_info(formatContext, nullptr) < 0) {
+            std::cerr << "无法获取流信息" << std::endl;
+            cleanup();
+            return false;
+        }
+
+        // 查找视频流；使用缓存时沿用缓存记录的视频流，缓存的关键帧表和帧时间戳属于这个流
+        if (probeCached) {
+            int index = probeRecord.videoStream;
+            if (index >= 0 && index < (int)formatContext->nb_streams &&
+                formatContext->streams[index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                videoStreamIndex = index;
+                videoStream = formatContext->streams[index];
+            }
+        } else {
+            for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
+                if (formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                    videoStreamIndex = i;
+                    videoStream = formatContext->streams[i];
+                    break;
+                }
+            }
+        }
+
+        if (videoStreamIndex == -1) {
+            std::cerr << "未找到视频流" << std::endl;
+            cleanup();
+            return false;
+        }
+        if (probeCacheEnabled && !probeCached) {
+            probe::capture(formatContext, videoStreamIndex, probeRecord);
+        }
+
+        // 获取解码器
+        const AVCodec* codec = avcodec_find_decoder(videoStream->codecpar->codec_id);
+        if (!codec) {
+            std::cerr << "未找到解码器" << std::endl;
+            cleanup();
+            return false;
+        }
+
+        // 分配解码器上下文
+        codecContext = avcodec_alloc_context3(codec);
+        if (!codecContext) {
+            std::cerr << "无法分配解码器上下文" << std::endl;
+            cleanup();
+            return false;
+        }
+
+        // 复制编解码器参数
+        if (avcodec_parameters_to_context(codecContext, videoStream->codecpar) < 0) {
+            std::cerr << "无法复制编解码器参数" << std::endl;
+            cleanup();
+            return false;
+        }
+
+        // lowres让解码器直接输出1/2、1/4...分辨率，必须在打开解码器之前设置
+        if (lowres > 0 && codec->max_lowres > 0) {
+            codecContext->lowres = std::min(lowres, (int)codec->max_lowres);
+        }
+
+        // 解码线程数：显式指定的值，或全局核心预算分配给本解码器的份额
+        budgetLease = ThreadBudget::instance().acquire(role);
+        int threadCount = threadingConfig.threadCount > 0 ? threadingConfig.threadCount : budgetLease.threads();
+        int threadType = ThreadBudget::chooseThreadType(codec, threadingConfig.type);
+        if (threadingConfig.autoTune && threadCount > 1 && threadType) {
+            threadCount = autoTuneThreadCount(codec, threadCount, threadType);
+        }
+        codecContext->thread_count = threadType ? threadCount : 1;
+        codecContext->thread_type = threadType;
+        // 调优选了更少的线程、显式指定了线程数或者解码器不支持多线程时，没用上的份额还给预算
+        budgetLease.shrink(codecContext->thread_count);
+
+        // 解码帧的缓冲区来自自己的池，稳定播放时解码输出不再分配内存
+        decodeBufferPool.attach(codecContext);
+
+        // 打开解码器
+        if (avcodec_open2(codecContext, codec, nullptr) < 0) {
+            std::cerr << "无法打开解码器" << std::endl;
+            cleanup();
+            return false;
+        }
+        std::cout << "解码线程: " << codecContext->thread_count
+                  << " (" << ThreadBudget::typeName(codecContext->active_thread_type) << ")" << std::endl;
+
+        // 分配解码线程使用的帧
+        frame = av_frame_alloc();
+        if (!frame) {
+            std::cerr << "无法分配帧" << std::endl;
+            cleanup();
+            return false;
+        }
+
+        if (audioEnabled) {
+            audioStreamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, videoStreamIndex, nullptr, 0);
+        }
+        discardUnusedStreams();
+        filePath = filename;
+        return true;
+    }
+
+    // 打开的第二阶段，在UI线程上调用：打开音频设备、创建纹理并启动解复用/解码线程
+    bool attachOutput(SDL_Renderer* renderer) {
+        if (!codecContext || outputAttached) {
+            return outputAttached;
+        }
+        openAudio();
+        outputAttached = true;
+
+        // 没有渲染器（无窗口运行）：解码、转换流程不变，只是不上传纹理
+        if (!renderer) {
+            textureFormat = nativeTextureFormat(codecContext->pix_fmt);
+            outputFormat = textureFormat == SDL_PIXELFORMAT_UNKNOWN ? AV_PIX_FMT_RGB24 :
+                           codecContext->pix_fmt == AV_PIX_FMT_NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+            startThreads();
+            startIndex();
+            return true;
+        }
+
+        // YUV420P/NV12直接创建同格式的纹理，逐平面上传，不需要swscale
+        // 渲染器不支持时退回RGB24纹理 + swscale转换
+        textureFormat = nativeTextureFormat(codecContext->pix_fmt);
+        if (textureFormat != SDL_PIXELFORMAT_UNKNOWN) {
+            texture = SDL_CreateTexture(
+                renderer,
+                textureFormat,
+                SDL_TEXTUREACCESS_STREAMING,
+                codecContext->width,
+                codecContext->height
+            );
+            if (texture) {
+                outputFormat = codecContext->pix_fmt == AV_PIX_FMT_NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+            }
+        }
+
+        // 创建SDL纹理
+        if (!texture) {
+            textureFormat = SDL_PIXELFORMAT_RGB24;
+            outputFormat = AV_PIX_FMT_RGB24;
+            texture = SDL_CreateTexture(
+                renderer,
+                SDL_PIXELFORMAT_RGB24,
+                SDL_TEXTUREACCESS_STREAMING,
+                codecContext->width,
+                codecContext->height
+            );
+        }
+
+        if (!texture) {
+            std::cerr << "无法创建SDL纹理: " << SDL_GetError() << std::endl;
+            cleanup();
+            return false;
+        }
+        textureRenderer = renderer;
+        textureWidth = codecContext->width;
+        textureHeight = codecContext->height;
+        frameBytes = av_image_get_buffer_size(outputFormat, textureWidth, textureHeight, 1);
+
+        startThreads();
+        startIndex();
+        return true;
+    }
+
+    bool isOpen() const {
+        return codecContext != nullptr;
+    }
+
+    // 打开时是否用了探测缓存（跳过了avformat_find_stream_info，关键帧索引直接就绪）
+    bool isProbeCached() const {
+        return probeCached;
+    }
+
+    // 在openFile之前调用生效；关闭时既不读也不写探测缓存
+    void setProbeCache(bool enabled) {
+        probeCacheEnabled = enabled;
+    }
+
+    bool isOutputAttached() const {
+        return outputAttached;
+    }
+
+    const std::string& getFilePath() const {
+        return filePath;
+    }
+
+    // 切到后台保温：关闭音频设备并交还核心预算。解码线程在队列填满后自然阻塞，不再占用CPU，
+    // 纹理保留着最后一帧，切回来时不用重新解码就能显示
+    void suspend() {
+        audio.releaseDevice();
+        budgetLease.release();
+    }
+
+    // 重新成为预览解码器。解码器的线程数在打开时已经确定，这里只是重新登记预算，最多领取已经在用的线程数；
+    // YUV到RGB的转换矩阵是整个进程共用的，只由当前显示的解码器设置
+    void resume() {
+        if (codecContext) {
+            budgetLease = ThreadBudget::instance().acquire(role, codecContext->thread_count);
+            setYUVConversionMode();
+            if (audioStreamIndex >= 0) {
+                audio.reopenDevice();
+            }
+        }
+    }
+
+    // 这个解码器持有的画面内存的估计：帧缓存、解码缓冲池、转换帧池和纹理
+    size_t getMemoryBytes() const {
+        return frameCache.bytes() + decodeBufferPool.bytes() + (size_t)framePool.peak() * frameBytes + frameBytes;
+    }
+
+    // 由UI线程调用：不看时钟，直接取出下一帧上传到纹理（用于seek后刷新画面）
+    // 队列暂时为空时直接返回true，不阻塞UI；只有到达文件末尾时返回false
+    bool readFrame() {
+        ProfileScope scope("readFrame");
+        QueuedFrame item;
+        while (frameQueue.tryPop(item)) {
+            // 丢弃seek之前解码出来的过期帧
+            if (item.serial != serial.load()) {
+                continue;
+            }
+
+            if (!item.frame) {
+                endOfStream = true;
+                refreshPending = false;
+                return false;
+            }
+
+            // 目标之前的帧不显示（向前解码式的seek或回填），留在帧缓存中供逐帧后退
+            if (refreshPending && item.pts + item.duration <= refreshTarget + kSeekEpsilon) {
+                retainFrame(item, refreshTarget);
+                continue;
+            }
+
+            showQueuedFrame(item);
+            refreshPending = false;
+            return true;
+        }
+
+        return !endOfStream;
+    }
+
+    enum class FrameStatus { Presented, Waiting, EndOfStream };
+
+    // 画面与主时钟相差超过该值（秒）时不再逐帧追赶，直接重新对齐时钟
+    static constexpr double kNoSyncThreshold = 1.0;
+
+    // 由UI线程调用：按主时钟决定显示哪一帧
+    // 显示区间已经过去的帧直接丢弃；下一帧还没到时间则保持当前画面
+    // delay返回距离下一帧应当显示的秒数，主循环据此决定休眠多久
+    FrameStatus presentFrame(double clockTime, double& delay) {
+        ProfileScope scope("presentFrame");
+        delay = kIdleDelay;
+
+        // 逐帧后退或倒放之后继续向前播放：紧接着的帧在帧缓存中就直接使用
+        if (const CachedFrame* cached = successorOf(currentPts, currentDuration)) {
+            // 跳过显示区间已经过去的缓存帧
+            while (const CachedFrame* after = successorOf(cached->pts, cached->duration)) {
+                if (clockTime - cached->pts <= frameDurationOf(cached->duration)) {
+                    break;
+                }
+                cached = after;
+                droppedFrames++;
+            }
+
+            double lag = clockTime - cached->pts;
+            if (lag < 0.0) {
+                delay = -lag;
+                return FrameStatus::Waiting;
+            }
+            delay = frameDurationOf(cached->duration);
+            showCachedFrame(*cached);
+            return FrameStatus::Presented;
+        }
+
+        while (QueuedFrame* next = frameQueue.front()) {
+            QueuedFrame item;
+            if (next->serial != serial.load()) {
+                frameQueue.tryPop(item);
+                continue;
+            }
+
+            if (!next->frame) {
+                frameQueue.tryPop(item);
+                endOfStream = true;
+                return FrameStatus::EndOfStream;
+            }
+
+            // 当前画面来自帧缓存时，队列中不晚于它的帧已经显示过了
+            if (cachePlayback && next->pts <= currentPts + kSeekEpsilon) {
+                frameQueue.tryPop(item);
+                continue;
+            }
+
+            double lag = clockTime - next->pts;
+            double frameDuration = next->duration > 0.0 ? next->duration : kDefaultFrameDuration;
+
+            // 落后较多时让解码线程跳过非参考帧，追上后恢复
+            skipNonRef.store(lag > kSkipDecodeThreshold);
+
+            if (lag < 0.0) {
+                // 还没到显示时间
+                delay = -lag;
+                break;
+            }
+
+            // 该帧的显示区间已经过去且后面还有帧可用：丢弃
+            // 落后超过kNoSyncThreshold时不再逐帧追赶，直接显示并由调用方重新对齐时钟
+            if (lag > frameDuration && lag < kNoSyncThreshold && frameQueue.size() > 1) {
+                frameQueue.tryPop(item);
+                retainFrame(item, clockTime);
+                droppedFrames++;
+                continue;
+            }
+
+            frameQueue.tryPop(item);
+            showQueuedFrame(item);
+            delay = frameDuration;
+            return FrameStatus::Presented;
+        }
+
+        // 没有新帧可显示，当前画面超出自身时长后继续显示，记为一次重复
+        if (hasFrame && clockTime > repeatDeadline) {
+            repeatedFrames++;
+            repeatDeadline += currentDuration > 0.0 ? currentDuration : kDefaultFrameDuration;
+        }
+
+        return endOfStream ? FrameStatus::EndOfStream : FrameStatus::Waiting;
+    }
+
+    // 不看时钟，阻塞等待下一帧并显示，用于无窗口基准测试等按最快速度消费帧的场合
+    FrameStatus nextFrame() {
+        QueuedFrame item;
+        while (frameQueue.pop(item)) {
+            if (item.serial != serial.load()) {
+                continue;
+            }
+            if (!item.frame) {
+                endOfStream = true;
+                return FrameStatus::EndOfStream;
+            }
+            showQueuedFrame(item);
+            refreshPending = false;
+            return FrameStatus::Presented;
+        }
+        return FrameStatus::EndOfStream;
+    }
+
+    // 播放统计：因迟到而丢弃的帧数 / 因下一帧未就绪而重复显示的次数
+    uint64_t getDroppedFrames() const {
+        return droppedFrames;
+    }
+
+    uint64_t getRepeatedFrames() const {
+        return repeatedFrames;
+    }
+
+    // 逐帧前进(direction>0)或后退(direction<0)，应在暂停时调用
+    // 帧缓存命中时立即显示；未命中时前进从帧队列取下一帧，后退则回填式seek，画面由readFrame刷新
+    void stepFrame(int direction) {
+        if (!formatContext || !hasFrame || refreshPending) {
+            return;
+        }
+
+        if (direction > 0) {
+            if (const CachedFrame* cached = successorOf(currentPts, currentDuration)) {
+                showCachedFrame(*cached);
+                return;
+            }
+            if (endOfStream) {
+                return;
+            }
+            // 下一帧通常已经在帧队列中：刷新为当前帧结束时刻的那一帧
+            frameCache.recordMiss();
+            refreshTarget = currentPts + frameDurationOf(currentDuration);
+            refreshPending = true;
+            return;
+        }
+
+        const CachedFrame* previous = frameCache.previous(currentPts);
+        if (previous && isAdjacent(previous->pts, previous->duration, currentPts)) {
+            showCachedFrame(*previous);
+            return;
+        }
+        frameCache.recordMiss();
+        seekToTime(std::max(0.0, currentPts - frameDurationOf(currentDuration) * 0.5), SeekMode::Backfill);
+    }
+
+    // 倒放：显示帧缓存中包含time的那一帧，未命中时回填式seek
+    // 返回false表示画面要等readFrame刷新
+    bool showFrameAt(double time) {
+        if (!formatContext || refreshPending) {
+            return false;
+        }
+        if (hasFrame && time >= currentPts && time < currentPts + frameDurationOf(currentDuration)) {
+            return true;
+        }
+        if (const CachedFrame* cached = frameCache.find(time)) {
+            showCachedFrame(*cached);
+            return true;
+        }
+        frameCache.recordMiss();
+        seekToTime(std::max(0.0, time), SeekMode::Backfill);
+        return false;
+    }
+
+    // 片段的调色效果链，在解码线程上作用于转换后的YUV帧（转换之前，预览缩放之后）
+    // 帧缓存中的画面作废，当前画面按新的效果链重新解码
+    void setColorEffects(const ColorChain& chain) {
+        colorEffects.setChain(chain);
+        if (!formatContext) {
+            return;
+        }
+        frameCache.clear();
+        if (hasFrame) {
+            seekToTime(currentPts);
+        }
+    }
+
+    ColorChain getColorEffects() const {
+        return colorEffects.chain();
+    }
+
+    // 片段的叠加图层，在调色之后混合到预览尺寸的YUV帧上；帧缓存同样作废
+    void setLayers(const LayerList& list) {
+        overlays.setLayers(list);
+        if (!formatContext) {
+            return;
+        }
+        frameCache.clear();
+        if (hasFrame) {
+            seekToTime(currentPts);
+        }
+    }
+
+    LayerList getLayers() const {
+        return overlays.layers();
+    }
+
+    // 当前显示的帧（帧缓存里的那一份），没有时返回nullptr；基准测试用来比较预览和导出的画面
+    const AVFrame* getDisplayedFrame() const {
+        const CachedFrame* cached = hasFrame ? frameCache.find(currentPts) : nullptr;
+        return cached ? cached->frame.get() : nullptr;
+    }
+
+    // 帧缓存的命中统计和内存占用
+    const FrameCache& getFrameCache() const {
+        return frameCache;
+    }
+
+    // 转换缓冲区池：实际分配次数 / 取用次数
+    uint64_t getPoolAllocations() const {
+        return framePool.allocations();
+    }
+
+    uint64_t getPoolRequests() const {
+        return framePool.requests();
+    }
+
+    // 转换缓冲区池同时在外的峰值
+    uint64_t getPoolPeak() const {
+        return framePool.peak();
+    }
+
+    // 解码输出缓冲区池：实际申请的平面缓冲区数 / 取用的帧数 / 同时在外的峰值
+    uint64_t getDecodeBufferAllocations() const {
+        return decodeBufferPool.allocations();
+    }
+
+    uint64_t getDecodeBufferRequests() const {
+        return decodeBufferPool.requests();
+    }
+
+    uint64_t getDecodeBufferPeak() const {
+        return decodeBufferPool.peak();
+    }
+
+    // 最近一帧从解码输出到纹理一共拷贝的像素字节数，以及累计值
+    uint64_t getBytesCopiedPerFrame() const {
+        return lastFrameBytesCopied;
+    }
+
+    uint64_t getTotalBytesCopied() const {
+        return totalBytesCopied;
+    }
+
+    SDL_Texture* getTexture() const {
+        return texture;
+    }
+
+    int getVideoStreamIndex() const {
+        return videoStreamIndex;
+    }
+
+    int getWidth() const {
+        return codecContext ? codecContext->width : 0;
+    }
+
+    int getHeight() const {
+        return codecContext ? codecContext->height : 0;
+    }
+
+    // 文件中视频流的高度，不受lowres影响
+    int getSourceHeight() const {
+        return videoStream ? videoStream->codecpar->height : 0;
+    }
+
+    // 将这三个方法从private移到public
+    // 有探测缓存时是扫描全部数据包得到的精确时长；否则用流的时长，流没有时长（常见于MKV）时用容器的时长
+    double getDuration() const {
+        if (exactDuration > 0.0) {
+            return exactDuration;
+        }
+        if (formatContext && videoStream) {
+            if (videoStream->duration != AV_NOPTS_VALUE) {
+                return videoStream->duration * av_q2d(videoStream->time_base);
+            }
+            if (formatContext->duration != AV_NOPTS_VALUE) {
+                return formatContext->duration / (double)AV_TIME_BASE;
+            }
+        }
+        return 0.0;
+    }
+
+    enum class SeekMode {
+        Exact,    // 显示目标时刻的那一帧
+        Keyframe, // 只解码离目标最近的关键帧，用于拖动时间线时快速出画面
+        Backfill  // 同Exact，另外把目标之前kBackfillSpan秒内的帧也解码放入帧缓存，用于逐帧后退和倒放
+    };
+
+    // 异步跳转：只登记请求，真正的av_seek_frame在解复用线程中执行
+    // 精确模式下解复用线程跳到目标之前最近的关键帧，解码线程丢弃目标时间之前的帧，最终显示的是目标时刻的那一帧
+    // 新的请求会让尚未完成的旧请求过期，旧请求剩余的数据包和帧直接丢弃
+    // 跳转后的第一帧由readFrame取出，needsRefresh()在取到之前返回true
+    bool seekToTime(double timeInSeconds, SeekMode mode = SeekMode::Exact) {
+        ProfileScope scope("seekToTime");
+        if (!formatContext || videoStreamIndex == -1) {
+            return false;
+        }
+
+        double skipUntil = timeInSeconds;
+        double decodeFrom = timeInSeconds;
+        if (mode == SeekMode::Backfill) {
+            decodeFrom = timeInSeconds - kBackfillSpan;
+        } else if (mode == SeekMode::Keyframe) {
+            // 直接显示解码出的第一帧；有索引时选择前后最近的关键帧
+            const KeyframeEntry* key = keyframeIndex.nearestKeyframe(
+                (int64_t)std::llround(timeInSeconds / av_q2d(videoStream->time_base)));
+            if (key) {
+                timeInSeconds = key->pts * av_q2d(videoStream->time_base);
+            }
+            skipUntil = std::numeric_limits<double>::lowest();
+            decodeFrom = skipUntil;
+        }
+
+        refreshTarget = skipUntil;
+        refreshPending = true;
+
+        // 目标在当前位置之后不远处：继续向前解码比重新seek到关键帧更快，队列和解码器都保留
+        // 音频缓冲区已经越过目标时只能重新定位，否则音频会比画面晚
+        if (mode == SeekMode::Exact && !keyframeOnly && !endOfStream && shouldDecodeForward(timeInSeconds) &&
+            (!audio.isOpen() || audio.canSkipTo(timeInSeconds))) {
+            skipTarget = timeInSeconds;
+            audio.skipTo(timeInSeconds);
+            forwardSeeks++;
+            return true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(seekMutex);
+            // 先清空队列再发布新序号：解复用线程在锁外读包入队，新序号的第一个（关键帧）数据包
+            // 只可能在这之后入队，不会被清掉。被唤醒的生产者补进来的旧数据由消费者按序号丢弃
+            packetQueue.flush();
+            frameQueue.flush();
+            seekTarget = timeInSeconds;
+            seekRequested = true;
+            skipTarget = decodeFrom;
+            keyframeOnly = mode == SeekMode::Keyframe;
+            serial++;
+            // 在锁内通知音频，解复用线程读到新序号时音频一方已经在丢弃旧数据包
+            if (audio.isOpen()) {
+                audio.seek(timeInSeconds, serial);
+            }
+        }
+        seekCond.notify_all();
+
+        skipNonRef = false;
+        endOfStream = false;
+        cachePlayback = false;
+        keyframeSeeks++;
+        return true;
+    }
+
+    // 关键帧索引是否已在后台建好；建好之前seek仍然可用，只是无法估算代价
+    bool isIndexReady() const {
+        return keyframeIndex.ready();
+    }
+
+    const KeyframeIndex& getKeyframeIndex() const {
+        return keyframeIndex;
+    }
+
+    // seek统计：重新定位到关键帧的次数 / 直接向前解码的次数
+    uint64_t getKeyframeSeeks() const {
+        return keyframeSeeks;
+    }
+
+    uint64_t getForwardSeeks() const {
+        return forwardSeeks;
+    }
+
+    // seek之后尚未显示新画面，暂停状态下也需要调用readFrame刷新
+    bool needsRefresh() const {
+        return refreshPending;
+    }
+
+    double getCurrentTime() const {
+        return currentPts;
+    }
+
+    bool hasAudio() const {
+        return audio.isOpen();
+    }
+
+    // 音频时钟：有音频且缓冲区中有当前位置的数据时返回true，可以作为主时钟
+    // 音频已经播放到结尾时返回false，调用方改用自己的时钟继续
+    bool getAudioClock(double& time) {
+        return audio.isOpen() && !audio.finished() && audio.clock(time);
+    }
+
+    // 只在正常速度正放时播放声音，暂停、拖动、逐帧和J/K/L穿梭时静音
+    void setAudioPlaying(bool playing) {
+        audio.setPlaying(playing);
+    }
+
+    // 不出声期间为了不阻塞解复用而丢过音频数据包：恢复正放前要重新seek，音频才是连续的
+    bool audioNeedsResync() const {
+        return audio.isOpen() && audio.needsResync();
+    }
+
+    uint64_t getAudioUnderruns() const {
+        return audio.underruns();
+    }
+
+    const AudioPlayer& getAudioPlayer() const {
+        return audio;
+    }
+
+    void cleanup() {
+        stopThreads();
+        audio.close();
+        audioStreamIndex = -1;
+        outputAttached = false;
+        filePath.clear();
+        probeRecord = probe::Record();
+        probeCached = false;
+        exactDuration = 0.0;
+        keyframeIndex.cancel();
+
+        if (texture) {
+            SDL_DestroyTexture(texture);
+            texture = nullptr;
+        }
+        textureWidth = textureHeight = 0;
+        textureRenderer = nullptr;
+
+        if (frame) {
+            av_frame_free(&frame);
+            frame = nullptr;
+        }
+
+        decodeScalers.clear();
+        uploadScalers.clear();
+        frameCache.clear();
+        frameCache.resetStats();
+        framePool.reset();
+        budgetLease.release();
+        autoTunedFps = 0.0;
+
+        if (codecContext) {
+            avcodec_free_context(&codecContext);
+            codecContext = nullptr;
+        }
+        decodeBufferPool.reset();
+
+        if (formatContext) {
+            avformat_close_input(&formatContext);
+            formatContext = nullptr;
+        }
+        mediaIO.close();
+
+        videoStream = nullptr;
+        videoStreamIndex = -1;
+        textureFormat = SDL_PIXELFORMAT_UNKNOWN;
+        outputFormat = AV_PIX_FMT_NONE;
+        skipNonRef = false;
+        currentPts = 0.0;
+        currentDuration = 0.0;
+        cachePlayback = false;
+        hasFrame = false;
+        endOfStream = false;
+        refreshPending = false;
+        droppedFrames = 0;
+        repeatedFrames = 0;
+        lastFrameBytesCopied = 0;
+        totalBytesCopied = 0;
+        keyframeSeeks = 0;
+        forwardSeeks = 0;
+    }
+
+private:
+    // 打开openInput选出的音频流；失败时只打印提示，按无音频播放
+    void openAudio() {
+        if (audioStreamIndex < 0) {
+            return;
+        }
+        if (!audio.open(formatContext->streams[audioStreamIndex], kAudioPacketQueueSize, serial.load())) {
+            audioStreamIndex = -1;
+            discardUnusedStreams();
+        }
+    }
+
+    // 关键帧索引：探测缓存里有就直接装入，否则后台扫描一遍，扫描完成后连同探测结果写入缓存
+    void startIndex() {
+        if (probeCached && !probeRecord.framePts.empty()) {
+            keyframeIndex.install(probeRecord.keyframes, probeRecord.framePts);
+            return;
+        }
+        if (!probeCacheEnabled) {
+            keyframeIndex.buildAsync(filePath, videoStreamIndex);
+            return;
+        }
+        probe::Record record = probeRecord;
+        std::string path = filePath;
+        keyframeIndex.buildAsync(filePath, videoStreamIndex, [record, path](const KeyframeIndex& index) mutable {
+            probe::setIndex(record, index);
+            probe::save(path, record);
+        });
+    }
+
+    // 不用的流（字幕、数据、其他音视频轨）直接丢弃，解复用时不再读出它们的数据包
+    void discardUnusedStreams() {
+        for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
+            if ((int)i != videoStreamIndex && (int)i != audioStreamIndex) {
+                formatContext->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+    }
+
+    void startThreads() {
+        quit = false;
+        seekRequested = false;
+        skipTarget = std::numeric_limits<double>::lowest();
+        keyframeOnly = false;
+        refreshTarget = std::numeric_limits<double>::lowest();
+        packetQueue.setCapacity(packetQueueSize);
+        frameQueue.setCapacity(frameQueueSize);
+        packetQueue.start();
+        frameQueue.start();
+        // 第一帧不看时钟直接显示，调用方以它的pts对齐主时钟
+        refreshPending = true;
+        demuxThread = std::thread(&VideoDecoder::demuxLoop, this);
+        decodeThread = std::thread(&VideoDecoder::decodeLoop, this);
+    }
+
+    void stopThreads() {
+        {
+            std::lock_guard<std::mutex> lock(seekMutex);
+            quit = true;
+        }
+        seekCond.notify_all();
+        packetQueue.abort();
+        frameQueue.abort();
+        audio.abort();
+
+        if (demuxThread.joinable()) {
+            demuxThread.join();
+        }
+        if (decodeThread.joinable()) {
+            decodeThread.join();
+        }
+    }
+
+    // 解复用线程：读取数据包放入数据包队列，并负责执行seek
+    void demuxLoop() {
+        Profiler::setThreadName("demux");
+        bool eof = false;
+
+        while (true) {
+            int readSerial;
+            bool doSeek = false;
+            double target = 0.0;
+            {
+                std::unique_lock<std::mutex> lock(seekMutex);
+                // 到达文件末尾后等待新的seek请求，而不是空转
+                if (eof) {
+                    seekCond.wait(lock, [this] { return quit || seekRequested; });
+                }
+                if (quit) {
+                    break;
+                }
+                if (seekRequested) {
+                    seekRequested = false;
+                    doSeek = true;
+                    target = seekTarget;
+                }
+                // 在锁内读取序号，保证之后发生的seek一定会让这次读到的数据包过期
+                readSerial = serial;
+            }
+
+            if (doSeek) {
+                // 有索引时直接跳到目标之前最近的关键帧，否则交给解复用器向前查找
+                int64_t targetTs = (int64_t)std::llround(target / av_q2d(videoStream->time_base));
+                const KeyframeEntry* key = keyframeIndex.keyframeAtOrBefore(targetTs);
+                if (key) {
+                    targetTs = key->dts != AV_NOPTS_VALUE ? key->dts : key->pts;
+                }
+                ProfileScope seekScope("av_seek_frame");
+                if (av_seek_frame(formatContext, videoStreamIndex, targetTs, AVSEEK_FLAG_BACKWARD) < 0) {
+                    std::cerr << "跳转失败" << std::endl;
+                }
+                eof = false;
+            }
+
+            PacketPtr packet = makePacket();
+            if (!packet) {
+                std::cerr << "无法分配数据包" << std::endl;
+                break;
+            }
+
+            int readResult;
+            {
+                ProfileScope readScope("av_read_frame");
+                readResult = av_read_frame(formatContext, packet.get());
+            }
+            if (readResult < 0) {
+                // 文件结束或错误：发送空包让解码器输出剩余的帧
+                eof = true;
+                QueuedPacket drain;
+                drain.serial = readSerial;
+                if (!packetQueue.push(std::move(drain))) {
+                    break;
+                }
+                if (audioStreamIndex >= 0 && !audio.pushPacket(nullptr, readSerial)) {
+                    break;
+                }
+                continue;
+            }
+
+            if (packet->stream_index == audioStreamIndex) {
+                if (!audio.pushPacket(std::move(packet), readSerial)) {
+                    break;
+                }
+                continue;
+            }
+            if (packet->stream_index != videoStreamIndex) {
+                continue;
+            }
+
+            QueuedPacket item;
+            item.packet = std::move(packet);
+            item.serial = readSerial;
+            if (!packetQueue.push(std::move(item))) {
+                break;
+            }
+        }
+    }
+
+    // 解码线程：解码数据包并转换为RGB24后放入帧队列
+    void decodeLoop() {
+        Profiler::setThreadName("decode");
+        int decoderSerial = -1;
+        QueuedPacket item;
+        // 精确seek时被跳过的最后一帧：目标超出最后一帧时用它代替
+        FramePtr skipped = makeFrame();
+
+        while (packetQueue.pop(item)) {
+            if (item.serial != serial.load()) {
+                continue;
+            }
+
+            // seek之后第一个数据包：清空解码器内部缓存的参考帧
+            if (item.serial != decoderSerial) {
+                avcodec_flush_buffers(codecContext);
+                av_frame_unref(skipped.get());
+                decoderSerial = item.serial;
+            }
+
+            if (keyframeOnly.load()) {
+                codecContext->skip_frame = AVDISCARD_NONKEY;
+            } else {
+                codecContext->skip_frame = skipNonRef.load() ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+            }
+            codecContext->skip_loop_filter = scrubbing.load() ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+
+            int ret;
+            {
+                ProfileScope sendScope("avcodec_send_packet");
+                ret = avcodec_send_packet(codecContext, item.packet.get());
+            }
+            if (ret < 0 && ret != AVERROR_EOF) {
+                std::cerr << "发送数据包到解码器失败" << std::endl;
+                continue;
+            }
+
+            while (true) {
+                {
+                    ProfileScope receiveScope("avcodec_receive_frame");
+                    ret = avcodec_receive_frame(codecContext, frame);
+                }
+                if (ret == AVERROR(EAGAIN)) {
+                    break;
+                }
+                if (ret == AVERROR_EOF) {
+                    // seek目标在最后一帧之后：显示最后一帧
+                    if (skipped->buf[0]) {
+                        QueuedFrame last;
+                        if (convertFrame(skipped.get(), last)) {
+                            last.serial = item.serial;
+                            if (!frameQueue.push(std::move(last))) {
+                                return;
+                            }
+                        }
+                        av_frame_unref(skipped.get());
+                    }
+
+                    // 解码器已输出全部帧，通知UI线程播放结束
+                    QueuedFrame end;
+                    end.serial = item.serial;
+                    if (!frameQueue.push(std::move(end))) {
+                        return;
+                    }
+                    // 下一个有效数据包必然来自新的seek，届时会重新flush解码器
+                    decoderSerial = -1;
+                    break;
+                }
+                if (ret < 0) {
+                    std::cerr << "从解码器接收帧失败" << std::endl;
+                    break;
+                }
+
+                // 精确seek：丢弃显示区间在目标时间之前结束的帧
+                double pts, duration;
+                frameTiming(frame, pts, duration);
+                if (pts + duration <= skipTarget.load() + kSeekEpsilon) {
+                    av_frame_unref(skipped.get());
+                    av_frame_move_ref(skipped.get(), frame);
+                    continue;
+                }
+                av_frame_unref(skipped.get());
+
+                QueuedFrame out;
+                bool converted = convertFrame(frame, out);
+                av_frame_unref(frame);
+                if (!converted) {
+                    continue;
+                }
+
+                out.serial = item.serial;
+                if (!frameQueue.push(std::move(out))) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // 用文件开头的一段数据包实测不同线程数下的解码速度，
+    // 选择达到最快速度90%所需的最少线程数，把剩余核心留给其他解码器
+    int autoTuneThreadCount(const AVCodec* codec, int maxThreads, int threadType) {
+        std::vector<PacketPtr> packets;
+        PacketPtr packet = makePacket();
+        while (packet && packets.size() < kAutoTunePackets && av_read_frame(formatContext, packet.get()) >= 0) {
+            if (packet->stream_index == videoStreamIndex) {
+                packets.push_back(makePacket());
+                av_packet_move_ref(packets.back().get(), packet.get());
+            } else {
+                av_packet_unref(packet.get());
+            }
+        }
+
+        // 回到文件开头，解复用线程从头读取
+        int64_t start = videoStream->start_time != AV_NOPTS_VALUE ? videoStream->start_time : 0;
+        av_seek_frame(formatContext, videoStreamIndex, start, AVSEEK_FLAG_BACKWARD);
+
+        if (packets.empty()) {
+            return maxThreads;
+        }
+
+        std::vector<int> candidates;
+        for (int n = 1; n < maxThreads; n *= 2) {
+            candidates.push_back(n);
+        }
+        candidates.push_back(maxThreads);
+
+        std::vector<double> results;
+        double bestFps = 0.0;
+        for (int n : candidates) {
+            double fps = measureDecodeFps(codec, n, threadType, packets);
+            results.push_back(fps);
+            bestFps = std::max(bestFps, fps);
+        }
+
+        int chosen = maxThreads;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if (results[i] >= bestFps * 0.9) {
+                chosen = candidates[i];
+                autoTunedFps = results[i];
+                break;
+            }
+        }
+
+        std::cout << "解码线程自动调优:";
+        for (size_t i = 0; i < candidates.size(); i++) {
+            std::cout << " " << candidates[i] << "线程=" << (int)results[i] << "fps";
+        }
+        std::cout << "，选择 " << chosen << std::endl;
+        return chosen;
+    }
+
+    double measureDecodeFps(const AVCodec* codec, int threads, int threadType, const std::vector<PacketPtr>& packets) {
+        AVCodecContext* trial = avcodec_alloc_context3(codec);
+        if (!trial) {
+            return 0.0;
+        }
+        if (avcodec_parameters_to_context(trial, videoStream->codecpar) < 0) {
+            avcodec_free_context(&trial);
+            return 0.0;
+        }
+        trial->lowres = codecContext->lowres;
+        trial->thread_count = threads;
+        trial->thread_type = threadType;
+        if (avcodec_open2(trial, codec, nullptr) < 0) {
+            avcodec_free_context(&trial);
+            return 0.0;
+        }
+
+        FramePtr decoded = makeFrame();
+        int frames = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for (const PacketPtr& p : packets) {
+            if (avcodec_send_packet(trial, p.get()) < 0) {
+                continue;
+            }
+            while (avcodec_receive_frame(trial, decoded.get()) >= 0) {
+                frames++;
+                av_frame_unref(decoded.get());
+            }
+        }
+        avcodec_send_packet(trial, nullptr);
+        while (avcodec_receive_frame(trial, decoded.get()) >= 0) {
+            frames++;
+            av_frame_unref(decoded.get());
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        avcodec_free_context(&trial);
+        return elapsed > 0.0 ? frames / elapsed : 0.0;
+    }
+
+    // 可以直接上传的像素格式对应的SDL纹理格式，其余格式返回UNKNOWN
+    static Uint32 nativeTextureFormat(AVPixelFormat format) {
+        switch (format) {
+            case AV_PIX_FMT_YUV420P:
+            case AV_PIX_FMT_YUVJ420P:
+                return SDL_PIXELFORMAT_IYUV;
+            case AV_PIX_FMT_NV12:
+                return SDL_PIXELFORMAT_NV12;
+            default:
+                return SDL_PIXELFORMAT_UNKNOWN;
+        }
+    }
+
+    // SDL默认按BT.601有限范围把YUV转成RGB，按源的色彩信息选择转换矩阵；只对YUV纹理有意义
+    void setYUVConversionMode() {
+        if (!texture || textureFormat == SDL_PIXELFORMAT_RGB24) {
+            return;
+        }
+        if (codecContext->color_range == AVCOL_RANGE_JPEG || codecContext->pix_fmt == AV_PIX_FMT_YUVJ420P) {
+            SDL_SetYUVConversionMode(SDL_YUV_CONVERSION_JPEG);
+        } else if (codecContext->colorspace == AVCOL_SPC_BT709) {
+            SDL_SetYUVConversionMode(SDL_YUV_CONVERSION_BT709);
+        } else {
+            SDL_SetYUVConversionMode(SDL_YUV_CONVERSION_AUTOMATIC);
+        }
+    }
+
+    // 帧是纹理使用的像素格式
+    bool isOutputFormat(const AVFrame* f) const {
+        return f->format == outputFormat ||
+               (f->format == AV_PIX_FMT_YUVJ420P && outputFormat == AV_PIX_FMT_YUV420P);
+    }
+
+    // 计算转换的目标尺寸：预览区域的实际显示尺寸，不超过源尺寸，保持偶数以便色度平面对齐
+    void targetSize(const AVFrame* src, int& width, int& height) const {
+        width = src->width;
+        height = src->height;
+        int requestedWidth = outputWidth.load();
+        int requestedHeight = outputHeight.load();
+        if (!previewScaling || requestedWidth <= 0 || requestedHeight <= 0) {
+            return;
+        }
+        if (requestedWidth < width && requestedHeight < height) {
+            width = std::max(2, requestedWidth & ~1);
+            height = std::max(2, requestedHeight & ~1);
+        }
+    }
+
+    // 缩放算法：拖动时间线时使用更快的算法
+    int scaleFlags() const {
+        return scrubbing.load() ? SWS_FAST_BILINEAR : SWS_BILINEAR;
+    }
+
+    // 将解码帧转换为纹理格式和预览尺寸，每个队列元素拥有独立的缓冲区
+    // 解码输出已经是目标格式和尺寸时只转移引用，不做任何拷贝
+    bool convertFrame(AVFrame* src, QueuedFrame& out) {
+        FramePtr converted = makeFrame();
+        if (!converted) {
+            return false;
+        }
+
+        int dstWidth, dstHeight;
+        targetSize(src, dstWidth, dstHeight);
+        bool direct = isOutputFormat(src) && src->width == dstWidth && src->height == dstHeight;
+
+        if (direct || zeroCopyUpload) {
+            // 格式一致时直接转移引用；零拷贝模式下留给UI线程转换到纹理内存
+            av_frame_move_ref(converted.get(), src);
+        } else {
+            // 缩放到预览尺寸，或源格式与纹理不一致（例如流中途改变了格式）
+            SwsContext* scaler = decodeScalers.get(
+                src->width, src->height, (AVPixelFormat)src->format,
+                dstWidth, dstHeight, outputFormat,
+                scaleFlags()
+            );
+            if (!scaler) {
+                std::cerr << "无法创建转换上下文" << std::endl;
+                return false;
+            }
+
+            // 缓冲区来自池，帧缓存淘汰或显示完的帧把缓冲区还回来
+            if (!framePool.allocate(converted.get(), outputFormat, dstWidth, dstHeight)) {
+                std::cerr << "无法分配帧缓冲区" << std::endl;
+                return false;
+            }
+
+            // 转换帧格式
+            ProfileScope scaleScope("sws_scale");
+            sws_scale(
+                scaler,
+                (const uint8_t* const*)src->data, src->linesize,
+                0, src->height,
+                converted->data, converted->linesize
+            );
+            av_frame_copy_props(converted.get(), src);
+            // sws把YUVJ的全范围压缩成了有限范围，范围标记要跟着改，否则调色会按全范围处理
+            if (src->format == AV_PIX_FMT_YUVJ420P && outputFormat != AV_PIX_FMT_YUVJ420P) {
+                converted->color_range = AVCOL_RANGE_MPEG;
+            }
+            out.bytesCopied = av_image_get_buffer_size(outputFormat, dstWidth, dstHeight, 1);
+        }
+
+        // 调色和叠加图层在预览尺寸上原地执行，顺序与导出相同；直接转移引用的解码帧可能还是解码器的参考帧，先复制一份
+        bool grade = colorEffects.active() && ColorEffectStack::supportsFormat(converted->format);
+        bool overlay = overlays.active() && LayerStack::supportsFormat(converted->format);
+        if (grade || overlay) {
+            if (av_frame_make_writable(converted.get()) < 0) {
+                std::cerr << "无法分配调色缓冲区" << std::endl;
+                return false;
+            }
+        }
+        if (grade) {
+            int sourceHeight = codecContext->coded_height > 0 ? codecContext->coded_height : codecContext->height;
+            colorEffects.apply(converted.get(), ColorEffectStack::sourceIsBt709(codecContext->colorspace, sourceHeight));
+        }
+        if (overlay) {
+            overlays.apply(converted.get());
+        }
+
+        frameTiming(converted.get(), out.pts, out.duration);
+        out.frame = std::move(converted);
+        return true;
+    }
+
+    // 帧的显示时间和时长（秒）
+    void frameTiming(const AVFrame* f, double& pts, double& duration) const {
+        double timeBase = av_q2d(videoStream->time_base);
+        int64_t timestamp = f->best_effort_timestamp;
+        pts = timestamp != AV_NOPTS_VALUE ? timestamp * timeBase : 0.0;
+        duration = 0.0;
+        if (f->duration > 0) {
+            duration = f->duration * timeBase;
+        } else if (videoStream->avg_frame_rate.num > 0) {
+            duration = 1.0 / av_q2d(videoStream->avg_frame_rate);
+        }
+    }
+
+    // 估算两种跳转方式的代价（需要解码的帧数）：
+    // 从当前位置继续向前解码 vs 跳到目标之前的关键帧再解码到目标（另加一次seek的固定开销）
+    bool shouldDecodeForward(double target) const {
+        if (!hasFrame || target <= currentPts) {
+            return false;
+        }
+
+        if (keyframeIndex.ready()) {
+            double timeBase = av_q2d(videoStream->time_base);
+            int64_t from = (int64_t)std::llround(currentPts / timeBase);
+            int64_t to = (int64_t)std::llround(target / timeBase);
+            const KeyframeEntry* key = keyframeIndex.keyframeAtOrBefore(to);
+            size_t forwardCost = keyframeIndex.framesBetween(from, to);
+            size_t seekCost = (key ? keyframeIndex.framesBetween(key->pts, to) : 0) + kSeekCostFrames;
+            return forwardCost <= seekCost;
+        }
+
+        // 索引尚未建好时只对很短的前跳继续解码
+        return target - currentPts < kShortForwardSeek;
+    }
+
+    // 纹理尺寸跟随帧尺寸，预览区域缩放后重建一次
+    bool ensureTextureSize(int width, int height) {
+        if (texture && width == textureWidth && height == textureHeight) {
+            return true;
+        }
+
+        if (texture) {
+            SDL_DestroyTexture(texture);
+        }
+        texture = SDL_CreateTexture(textureRenderer, textureFormat, SDL_TEXTUREACCESS_STREAMING, width, height);
+        if (!texture) {
+            std::cerr << "无法创建SDL纹理: " << SDL_GetError() << std::endl;
+            textureWidth = textureHeight = 0;
+            return false;
+        }
+
+        textureWidth = width;
+        textureHeight = height;
+        frameBytes = av_image_get_buffer_size(outputFormat, width, height, 1);
+        return true;
+    }
+
+    // 显示帧队列中取出的帧，之后把它移入帧缓存
+    void showQueuedFrame(QueuedFrame& item) {
+        uploadFrame(item.frame.get(), item.pts, item.duration, item.bytesCopied);
+        cachePlayback = false;
+        retainFrame(item, item.pts);
+    }
+
+    void showCachedFrame(const CachedFrame& cached) {
+        uploadFrame(cached.frame.get(), cached.pts, cached.duration, 0);
+        cachePlayback = true;
+        frameCache.recordHit();
+    }
+
+    void retainFrame(QueuedFrame& item, double focus) {
+        frameCache.insert(std::move(item.frame), item.pts, item.duration, focus);
+    }
+
+    static double frameDurationOf(double duration) {
+        return duration > 0.0 ? duration : kDefaultFrameDuration;
+    }
+
+    // 两帧在显示顺序上是否紧邻（中间没有因跳帧解码或seek而缺失的帧）
+    bool isAdjacent(double pts, double duration, double nextPts) const {
+        if (keyframeIndex.ready()) {
+            double timeBase = av_q2d(videoStream->time_base);
+            return keyframeIndex.framesBetween((int64_t)std::llround(pts / timeBase),
+                                               (int64_t)std::llround(nextPts / timeBase)) == 1;
+        }
+        return nextPts > pts && nextPts - pts < frameDurationOf(duration) * 1.5;
+    }
+
+    // 帧缓存中紧接在给定帧之后的帧
+    const CachedFrame* successorOf(double pts, double duration) const {
+        if (!hasFrame) {
+            return nullptr;
+        }
+        const CachedFrame* next = frameCache.next(pts);
+        return next && isAdjacent(pts, duration, next->pts) ? next : nullptr;
+    }
+
+    // 上传到纹理并记录当前显示帧的时间信息
+    void uploadFrame(const AVFrame* f, double pts, double duration, size_t bytesCopied) {
+        if (!textureRenderer) {
+            // 没有渲染器（无窗口运行）：只记录时间信息
+            lastFrameBytesCopied = bytesCopied;
+            totalBytesCopied += lastFrameBytesCopied;
+            markDisplayed(pts, duration);
+            return;
+        }
+
+        int width = f->width;
+        int height = f->height;
+        bool direct = isOutputFormat(f);
+        if (zeroCopyUpload) {
+            // 零拷贝模式下解码线程不做缩放，这里直接转换到预览尺寸
+            targetSize(f, width, height);
+            direct = direct && f->width == width && f->height == height;
+        }
+
+        if (!ensureTextureSize(width, height)) {
+            return;
+        }
+
+        ProfileScope scope("texture_upload");
+        if (!direct) {
+            // 零拷贝模式：原始解码帧直接转换到纹理内存
+            convertIntoTexture(f);
+        } else if (textureFormat == SDL_PIXELFORMAT_IYUV) {
+            SDL_UpdateYUVTexture(
+                texture,
+                nullptr,
+                f->data[0], f->linesize[0],
+                f->data[1], f->linesize[1],
+                f->data[2], f->linesize[2]
+            );
+        } else if (textureFormat == SDL_PIXELFORMAT_NV12) {
+            SDL_UpdateNVTexture(
+                texture,
+                nullptr,
+                f->data[0], f->linesize[0],
+                f->data[1], f->linesize[1]
+            );
+        } else {
+            SDL_UpdateTexture(
+                texture,
+                nullptr,
+                f->data[0],
+                f->linesize[0]
+            );
+        }
+
+        // 无论走哪条路径，纹理中的一帧都写入了frameBytes字节
+        lastFrameBytesCopied = bytesCopied + frameBytes;
+        totalBytesCopied += lastFrameBytesCopied;
+        markDisplayed(pts, duration);
+    }
+
+    void markDisplayed(double pts, double duration) {
+        currentPts = pts;
+        currentDuration = duration;
+        repeatDeadline = pts + frameDurationOf(duration);
+        hasFrame = true;
+    }
+
+    // 锁定纹理，让swscale把结果直接写进纹理内存（按纹理的pitch排布各平面）
+    void convertIntoTexture(const AVFrame* f) {
+        void* pixels = nullptr;
+        int pitch = 0;
+        if (SDL_LockTexture(texture, nullptr, &pixels, &pitch) < 0) {
+            std::cerr << "无法锁定SDL纹理: " << SDL_GetError() << std::endl;
+            return;
+        }
+
+        uint8_t* base = (uint8_t*)pixels;
+        int height = textureHeight;
+        uint8_t* dst[4] = { base, nullptr, nullptr, nullptr };
+        int dstLinesize[4] = { pitch, 0, 0, 0 };
+        if (textureFormat == SDL_PIXELFORMAT_IYUV) {
+            dst[1] = base + pitch * height;
+            dstLinesize[1] = pitch / 2;
+            dst[2] = dst[1] + (pitch / 2) * ((height + 1) / 2);
+            dstLinesize[2] = pitch / 2;
+        } else if (textureFormat == SDL_PIXELFORMAT_NV12) {
+            dst[1] = base + pitch * height;
+            dstLinesize[1] = pitch;
+        }
+
+        SwsContext* scaler = uploadScalers.get(
+            f->width, f->height, (AVPixelFormat)f->format,
+            textureWidth, height, outputFormat,
+            scaleFlags()
+        );
+        if (scaler) {
+            ProfileScope scaleScope("sws_scale_texture");
+            sws_scale(
+                scaler,
+                (const uint8_t* const*)f->data, f->linesize,
+                0, f->height,
+                dst, dstLinesize
+            );
+        } else {
+            std::cerr << "无法创建转换上下文" << std::endl;
+        }
+
+        SDL_UnlockTexture(texture);
+    }
+
+    static constexpr double kIdleDelay = 0.01;             // 没有待显示帧时的轮询间隔
+    static constexpr double kDefaultFrameDuration = 0.04;  // 无法得知帧时长时按25fps处理
+    static constexpr double kSkipDecodeThreshold = 0.1;    // 落后超过该值开始跳过非参考帧
+    static constexpr size_t kAutoTunePackets = 48;         // 自动调优时用于测速的数据包数
+    static constexpr size_t kSeekCostFrames = 8;           // 一次seek（清空解码器、重新读取）折合的解码帧数
+    static constexpr double kShortForwardSeek = 0.5;       // 没有索引时，小于该距离的前跳直接向前解码
+    static constexpr double kSeekEpsilon = 1e-4;           // 比较帧时间与seek目标时的容差
+    static constexpr double kBackfillSpan = 1.0;           // 回填式seek额外解码的目标之前的时长（秒）
+    static constexpr size_t kAudioPacketQueueSize = 256;   // 音频数据包小而密，队列要能容纳视频数据包队列满时对应的时长
+
+    AVFormatContext* formatContext;
+    IOMode ioMode;
+    MediaIO mediaIO;            // formatContext的自定义IO，在它关闭之后才释放
+    std::string filePath;
+    bool outputAttached;        // attachOutput之后为true，解码线程在运行
+    bool probeCacheEnabled;
+    bool probeCached;
+    probe::Record probeRecord;  // 探测结果：来自缓存，或者本次探测后记录下来等索引建好时写入缓存
+    double exactDuration;       // 来自探测缓存的精确时长，没有时为0
+    AVCodecContext* codecContext;
+    AVStream* videoStream;
+    int videoStreamIndex;
+    AVFrame* frame;             // 解码线程专用
+    ScalerCache decodeScalers;  // 解码线程专用
+    ColorEffectStack colorEffects;  // 在解码线程上执行，效果链可以在UI线程上更换
+    LayerStack overlays;            // 同上
+    FramePool framePool;        // 解码线程取用，缓冲区在UI线程归还
+    DecodeBufferPool decodeBufferPool;  // 解码器get_buffer2取用，生命周期覆盖codecContext
+    ScalerCache uploadScalers;  // 零拷贝模式下UI线程专用
+    SDL_Renderer* textureRenderer;
+    SDL_Texture* texture;
+    int textureWidth;
+    int textureHeight;
+    Uint32 textureFormat;        // SDL纹理格式
+    AVPixelFormat outputFormat;  // 帧队列中帧的像素格式，与纹理格式对应
+    size_t frameBytes;           // 纹理格式下一帧画面的字节数
+    bool zeroCopyUpload;
+    bool previewScaling;         // 是否按预览区域尺寸转换
+    int lowres;                  // 解码器lowres级别，仅部分解码器支持
+
+    // 解码器多线程
+    DecoderThreadingConfig threadingConfig;
+    DecoderRole role;
+    ThreadBudget::Lease budgetLease;
+    double autoTunedFps;
+
+    // 预览区域尺寸由UI线程设置，解码线程读取
+    std::atomic<int> outputWidth;
+    std::atomic<int> outputHeight;
+    std::atomic<bool> scrubbing;
+
+    // 流水线
+    size_t packetQueueSize;
+    size_t frameQueueSize;
+    bool audioEnabled;
+    int audioStreamIndex;
+    AudioPlayer audio;          // 音频解码和播放，有音频时作为主时钟
+    PacketQueue packetQueue;
+    FrameQueue frameQueue;
+    std::thread demuxThread;
+    std::thread decodeThread;
+
+    // seek请求，serial在seekMutex保护下递增
+    std::mutex seekMutex;
+    std::condition_variable seekCond;
+    std::atomic<int> serial;
+    bool quit;
+    bool seekRequested;
+    double seekTarget;
+    std::atomic<bool> skipNonRef;  // UI线程设置，解码线程读取
+    std::atomic<double> skipTarget; // 精确seek目标（秒），解码线程丢弃在此之前结束的帧
+    std::atomic<bool> keyframeOnly; // 关键帧seek期间只解码关键帧
+    KeyframeIndex keyframeIndex;
+
+    // 以下仅由UI线程访问
+    double currentPts;
+    double currentDuration;
+    bool cachePlayback;             // 当前画面来自帧缓存，帧队列可能落后于它
+    FrameCache frameCache;
+    double repeatDeadline;
+    bool hasFrame;
+    bool endOfStream;
+    bool refreshPending;
+    double refreshTarget;           // 刷新时丢弃在此之前结束的帧（向前解码时队列中可能还有旧帧）
+    uint64_t droppedFrames;
+    uint64_t repeatedFrames;
+    uint64_t lastFrameBytesCopied;
+    uint64_t totalBytesCopied;
+    uint64_t keyframeSeeks;
+    uint64_t forwardSeeks;
+};
@@ -0,0 +1,718 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+}
+
+#include "BlendKernels.h"
+#include "DecoderThreading.h"
+#include "MediaQueue.h"
+#include "Profiler.h"
+#include "SidecarCache.h"
+
+// 一段样本的最小值和最大值（S16）
+struct WaveformPeak {
+    int16_t min;
+    int16_t max;
+};
+
+// 对交错的S16样本求最小/最大值，结果并入min/max；count为样本数（帧数 * 声道数）
+namespace peaks {
+
+inline void minMaxScalar(const int16_t* samples, size_t count, int16_t& min, int16_t& max) {
+    int16_t low = min;
+    int16_t high = max;
+    for (size_t i = 0; i < count; i++) {
+        low = std::min(low, samples[i]);
+        high = std::max(high, samples[i]);
+    }
+    min = low;
+    max = high;
+}
+
+#ifdef BLEND_X86
+
+BLEND_TARGET_SSE2 inline void minMaxSse2(const int16_t* samples, size_t count, int16_t& min, int16_t& max) {
+    size_t i = 0;
+    if (count >= 8) {
+        __m128i low = _mm_set1_epi16(min);
+        __m128i high = _mm_set1_epi16(max);
+        for (; i + 8 <= count; i += 8) {
+            __m128i value = _mm_loadu_si128((const __m128i*)(samples + i));
+            low = _mm_min_epi16(low, value);
+            high = _mm_max_epi16(high, value);
+        }
+        int16_t lanes[2][8];
+        _mm_storeu_si128((__m128i*)lanes[0], low);
+        _mm_storeu_si128((__m128i*)lanes[1], high);
+        for (int lane = 0; lane < 8; lane++) {
+            min = std::min(min, lanes[0][lane]);
+            max = std::max(max, lanes[1][lane]);
+        }
+    }
+    minMaxScalar(samples + i, count - i, min, max);
+}
+
+BLEND_TARGET_AVX2 inline void minMaxAvx2(const int16_t* samples, size_t count, int16_t& min, int16_t& max) {
+    size_t i = 0;
+    if (count >= 16) {
+        __m256i low = _mm256_set1_epi16(min);
+        __m256i high = _mm256_set1_epi16(max);
+        for (; i + 16 <= count; i += 16) {
+            __m256i value = _mm256_loadu_si256((const __m256i*)(samples + i));
+            low = _mm256_min_epi16(low, value);
+            high = _mm256_max_epi16(high, value);
+        }
+        int16_t lanes[2][16];
+        _mm256_storeu_si256((__m256i*)lanes[0], low);
+        _mm256_storeu_si256((__m256i*)lanes[1], high);
+        for (int lane = 0; lane < 16; lane++) {
+            min = std::min(min, lanes[0][lane]);
+            max = std::max(max, lanes[1][lane]);
+        }
+    }
+    minMaxScalar(samples + i, count - i, min, max);
+}
+
+#endif  // BLEND_X86
+
+using MinMaxFunction = void (*)(const int16_t* samples, size_t count, int16_t& min, int16_t& max);
+
+// 当前CPU可用的最快实现，名字写入name
+inline MinMaxFunction bestMinMax(const char** name = nullptr) {
+    const char* chosen = "scalar";
+    MinMaxFunction function = &minMaxScalar;
+#ifdef BLEND_X86
+    if (BlendKernels::cpuHasAvx2()) {
+        chosen = "avx2";
+        function = &minMaxAvx2;
+    } else if (BlendKernels::cpuHasSse2()) {
+        chosen = "sse2";
+        function = &minMaxSse2;
+    }
+#endif
+    if (name) {
+        *name = chosen;
+    }
+    return function;
+}
+
+}  // namespace peaks
+
+// 时间线下方的音频波形
+// - 后台线程用独立的解复用器/解码器把音轨流式解码一遍，每kSamplesPerPeak个样本归约成一个最小/最大值（SIMD）
+// - 像纹理的mipmap一样逐级两两合并成金字塔，第k级每项覆盖 kSamplesPerPeak << k 个样本
+//   绘制时按每像素覆盖的样本数选级别，每列只读一两项，耗时与像素数成正比而与文件长度无关
+// - 金字塔直接写入内存映射的旁路缓存文件，完整生成后再次打开同一文件不再解码
+// - 容量按时长估计；容器没有时长或估计偏短时解码过程中按两倍扩容，金字塔照样逐项生成
+// - 生成过程中已完成的前缀立即可以绘制；关闭文件时取消并等待后台线程退出
+class WaveformTrack {
+public:
+    WaveformTrack()
+        : m_sampleRate(0), m_levelCount(0), m_peaks(nullptr), m_grown(false), m_available(false), m_complete(false),
+          m_cancel(false), m_building(false), m_decodedSeconds(0.0), m_duration(0.0), m_buildSeconds(0.0) {
+        for (std::atomic<int64_t>& count : m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~WaveformTrack() {
+        close();
+    }
+
+    WaveformTrack(const WaveformTrack&) = delete;
+    WaveformTrack& operator=(const WaveformTrack&) = delete;
+
+    // 文件打开之后调用：缓存完整时直接映射，否则在后台生成；没有音轨时后台线程直接结束
+    bool open(const std::string& filename) {
+        close();
+        m_filename = filename;
+        m_cancel = false;
+        if (openCache()) {
+            std::cout << "波形: 从缓存载入 " << m_counts[0].load() << " 个峰值，" << m_levelCount << " 级" << std::endl;
+            return true;
+        }
+        m_building = true;
+        m_thread = std::thread([this]() {
+            build();
+            m_building = false;
+        });
+        return true;
+    }
+
+    // 取消后台生成并释放映射
+    void close() {
+        m_cancel = true;
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        m_available = false;
+        m_complete = false;
+        m_file.close();
+        m_memoryFallback.clear();
+        m_peaks = nullptr;
+        m_grown = false;
+        m_levelOffsets.clear();
+        m_levelCount = 0;
+        m_sampleRate = 0;
+        m_decodedSeconds = 0.0;
+        m_duration = 0.0;
+        for (std::atomic<int64_t>& count : m_counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // 后台生成是否结束（包括没有音轨、失败和取消）
+    bool finished() const {
+        return !m_building.load();
+    }
+
+    bool complete() const {
+        return m_complete.load(std::memory_order_acquire);
+    }
+
+    // 已经生成的比例，0..1
+    double progress() const {
+        if (complete()) {
+            return 1.0;
+        }
+        double duration = m_duration.load();
+        return duration > 0.0 ? std::min(1.0, m_decodedSeconds.load() / duration) : 0.0;
+    }
+
+    int sampleRate() const {
+        return m_available.load(std::memory_order_acquire) ? m_sampleRate : 0;
+    }
+
+    int levelCount() const {
+        std::lock_guard<std::mutex> lock(m_layoutMutex);
+        return levelCountLocked();
+    }
+
+    int64_t peakCount(int level = 0) const {
+        return level >= 0 && level < levelCount() ? m_counts[level].load(std::memory_order_acquire) : 0;
+    }
+
+    // 最近一次生成的耗时（秒），从缓存载入时为0
+    double buildSeconds() const {
+        return m_buildSeconds.load();
+    }
+
+    // 每列覆盖样本数对应的金字塔级别：每列至少一项，至多不到四项
+    int levelFor(double samplesPerColumn) const {
+        std::lock_guard<std::mutex> lock(m_layoutMutex);
+        return levelForLocked(samplesPerColumn);
+    }
+
+    // 把[startTime, endTime)分成columnCount列，每列一个最小/最大值
+    // 返回从第一列开始连续有数据的列数，生成过程中只有前面一部分列可用
+    int columns(double startTime, double endTime, int columnCount, std::vector<WaveformPeak>& out) const {
+        out.clear();
+        std::lock_guard<std::mutex> lock(m_layoutMutex);  // 生成线程扩容时会换掉布局
+        int levels = levelCountLocked();
+        if (levels == 0 || columnCount <= 0 || endTime <= startTime) {
+            return 0;
+        }
+        ProfileScope scope("waveform_columns");
+        double samplesPerColumn = (endTime - startTime) * m_sampleRate / columnCount;
+        int level = levelForLocked(samplesPerColumn);
+        const WaveformPeak* entries = m_peaks + m_levelOffsets[level];
+        int64_t available = m_counts[level].load(std::memory_order_acquire);
+        int64_t basePeaks = m_counts[0].load(std::memory_order_acquire);
+        double span = (double)kSamplesPerPeak * ((int64_t)1 << level);  // 本级每项覆盖的样本数
+
+        out.reserve(columnCount);
+        for (int column = 0; column < columnCount; column++) {
+            double begin = startTime * m_sampleRate + column * samplesPerColumn;
+            double end = startTime * m_sampleRate + (column + 1) * samplesPerColumn;
+            // 按第0级判断是否已经超出音频结尾，高级别的最后一项可能只覆盖了一部分
+            int64_t firstBase = std::max<int64_t>(0, (int64_t)std::floor(begin / kSamplesPerPeak));
+            int64_t first = firstBase >> level;
+            if (firstBase >= basePeaks || first >= available) {
+                break;
+            }
+            int64_t last = std::min(available, std::max(first + 1, (int64_t)std::ceil(end / span)));
+            WaveformPeak peak = entries[first];
+            for (int64_t i = first + 1; i < last; i++) {
+                peak.min = std::min(peak.min, entries[i].min);
+                peak.max = std::max(peak.max, entries[i].max);
+            }
+            out.push_back(peak);
+        }
+        return (int)out.size();
+    }
+
+    // 在rect内画出[startTime, endTime)的波形，每列一条竖线，一次批量提交
+    bool draw(SDL_Renderer* renderer, const SDL_Rect& rect, double startTime, double endTime) {
+        if (rect.w <= 0 || rect.h <= 0) {
+            return false;
+        }
+        int count = columns(startTime, endTime, rect.w, m_columns);
+        if (count == 0) {
+            return false;
+        }
+        int middle = rect.y + rect.h / 2;
+        double scale = (rect.h / 2 - 1) / 32768.0;
+        m_bars.clear();
+        for (int i = 0; i < count; i++) {
+            int top = middle - (int)std::lround(m_columns[i].max * scale);
+            int bottom = middle - (int)std::lround(m_columns[i].min * scale);
+            m_bars.push_back({ rect.x + i, top, 1, std::max(1, bottom - top + 1) });
+        }
+        SDL_SetRenderDrawColor(renderer, 90, 170, 230, 255);
+        SDL_RenderFillRects(renderer, m_bars.data(), (int)m_bars.size());
+        return true;
+    }
+
+    static constexpr int kSamplesPerPeak = 256;  // 第0级每项覆盖的样本数（每声道）
+
+private:
+    static constexpr int kMaxLevels = 40;
+    static constexpr double kUnknownDurationSeconds = 60.0;  // 容器没有时长时的初始容量，不够再扩
+    static constexpr int kMaxChannels = 2;     // 多于两个声道时先混成立体声
+    static constexpr double kCapacitySlack = 1.02;  // 时长只是估计，容量多留一些
+    static constexpr int64_t kMinCapacity = 64;
+    static constexpr uint32_t kCacheVersion = 1;
+
+    // 旁路缓存文件布局：文件头 | 第0级 | 第1级 | ...，各级容量为 ceil(capacity / 2^k)
+    // 生成结束后写入每级的实际项数，最后写complete，所以半途退出的缓存下次会重新生成
+    struct CacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t mediaSize;
+        int64_t mediaTime;
+        int32_t sampleRate;
+        int32_t samplesPerPeak;
+        int32_t levelCount;
+        int32_t complete;
+        int64_t capacity;
+        int64_t counts[kMaxLevels];
+    };
+
+    int levelCountLocked() const {
+        return m_available.load(std::memory_order_acquire) ? m_levelCount : 0;
+    }
+
+    int levelForLocked(double samplesPerColumn) const {
+        int levels = levelCountLocked();
+        int level = 0;
+        double peaksPerColumn = samplesPerColumn / kSamplesPerPeak;
+        while (level + 1 < levels && (double)((int64_t)1 << (level + 1)) <= peaksPerColumn) {
+            level++;
+        }
+        return level;
+    }
+
+    static std::vector<int64_t> levelOffsets(int64_t capacity, int& levels) {
+        std::vector<int64_t> offsets;
+        int64_t offset = 0;
+        int64_t size = capacity;
+        while (true) {
+            offsets.push_back(offset);
+            offset += size;
+            if (size <= 1 || (int)offsets.size() == kMaxLevels) {
+                break;
+            }
+            size = (size + 1) / 2;
+        }
+        levels = (int)offsets.size();
+        offsets.push_back(offset);  // 最后一项是总项数
+        return offsets;
+    }
+
+    static size_t fileSize(int64_t totalPeaks) {
+        return sizeof(CacheHeader) + (size_t)totalPeaks * sizeof(WaveformPeak);
+    }
+
+    // 已有完整缓存时只读它，不启动后台线程
+    bool openCache() {
+        sidecar::MediaKey key;
+        if (!sidecar::mediaKey(m_filename, key)) {
+            return false;
+        }
+        std::string path = sidecar::cachePath(key, ".peaks");
+        std::error_code ec;
+        uint64_t size = (uint64_t)std::filesystem::file_size(path, ec);
+        if (ec || size < sizeof(CacheHeader) || !m_file.open(path, (size_t)size)) {
+            return false;
+        }
+        const CacheHeader* header = (const CacheHeader*)m_file.data();
+        int levels = 0;
+        std::vector<int64_t> offsets = header->capacity > 0 && header->capacity < ((int64_t)1 << 40)
+                                           ? levelOffsets(header->capacity, levels)
+                                           : std::vector<int64_t>();
+        bool valid = std::memcmp(header->magic, "VEWF", 4) == 0 && header->version == kCacheVersion &&
+                     header->mediaSize == key.size && header->mediaTime == key.mtime && header->complete == 1 &&
+                     header->samplesPerPeak == kSamplesPerPeak && header->sampleRate > 0 &&
+                     !offsets.empty() && header->levelCount == levels && fileSize(offsets.back()) == size;
+        if (!valid) {
+            m_file.close();
+            return false;
+        }
+
+        m_sampleRate = header->sampleRate;
+        m_levelCount = levels;
+        m_levelOffsets = std::move(offsets);
+        m_peaks = (WaveformPeak*)(m_file.data() + sizeof(CacheHeader));
+        for (int level = 0; level < levels; level++) {
+            m_counts[level].store(header->counts[level], std::memory_order_relaxed);
+        }
+        m_buildSeconds = 0.0;
+        m_available.store(true, std::memory_order_release);
+        m_complete.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // 按估计的时长映射可写的缓存文件并写好文件头；映射失败时退回到进程内存
+    bool mapForBuild(int sampleRate, double duration) {
+        int64_t capacity = std::max(kMinCapacity,
+                                    (int64_t)std::ceil(duration * sampleRate * kCapacitySlack / kSamplesPerPeak));
+        int levels = 0;
+        std::vector<int64_t> offsets = levelOffsets(capacity, levels);
+        size_t size = fileSize(offsets.back());
+
+        CacheHeader header = {};
+        std::memcpy(header.magic, "VEWF", 4);
+        header.version = kCacheVersion;
+        header.sampleRate = sampleRate;
+        header.samplesPerPeak = kSamplesPerPeak;
+        header.levelCount = levels;
+        header.capacity = capacity;
+
+        sidecar::MediaKey key;
+        uint8_t* data = nullptr;
+        if (sidecar::mediaKey(m_filename, key) && m_file.open(sidecar::cachePath(key, ".peaks"), size)) {
+            header.mediaSize = key.size;
+            header.mediaTime = key.mtime;
+            data = m_file.data();
+        } else {
+            std::cerr << "波形: 无法映射缓存文件，本次不保存" << std::endl;
+            m_memoryFallback.assign(size, 0);
+            data = m_memoryFallback.data();
+        }
+        std::memcpy(data, &header, sizeof(header));
+
+        m_sampleRate = sampleRate;
+        m_levelCount = levels;
+        m_levelOffsets = std::move(offsets);
+        m_peaks = (WaveformPeak*)(data + sizeof(CacheHeader));
+        m_available.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // 容量不够（时长未知或估计偏短）：按两倍容量重新布局，把各级已有的项复制过去
+    // 新布局放在进程内存里，换布局时持有m_layoutMutex，生成完成后再整块写入缓存文件
+    void grow() {
+        int64_t capacity = (m_levelOffsets[1] - m_levelOffsets[0]) * 2;
+        int levels = 0;
+        std::vector<int64_t> offsets = levelOffsets(capacity, levels);
+        std::vector<uint8_t> storage(fileSize(offsets.back()), 0);
+        CacheHeader* header = (CacheHeader*)storage.data();
+        std::memcpy(header, (const uint8_t*)m_peaks - sizeof(CacheHeader), sizeof(CacheHeader));
+        header->levelCount = levels;
+        header->capacity = capacity;
+        WaveformPeak* peaks = (WaveformPeak*)(storage.data() + sizeof(CacheHeader));
+        for (int level = 0; level < m_levelCount; level++) {
+            std::memcpy(peaks + offsets[level], m_peaks + m_levelOffsets[level],
+                        (size_t)m_counts[level].load(std::memory_order_relaxed) * sizeof(WaveformPeak));
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_layoutMutex);
+            m_memoryFallback.swap(storage);
+            m_peaks = peaks;
+            m_levelOffsets = std::move(offsets);
+            m_levelCount = levels;
+        }
+        m_file.close();
+        m_grown = true;
+    }
+
+    // 扩容过的金字塔生成完成后写入缓存文件，之后改为读映射
+    void persistGrown() {
+        sidecar::MediaKey key;
+        if (!sidecar::mediaKey(m_filename, key) ||
+            !m_file.open(sidecar::cachePath(key, ".peaks"), m_memoryFallback.size())) {
+            std::cerr << "波形: 无法写入缓存文件，本次不保存" << std::endl;
+            return;
+        }
+        std::memcpy(m_file.data(), m_memoryFallback.data(), m_memoryFallback.size());
+        CacheHeader* header = (CacheHeader*)m_file.data();
+        header->mediaSize = key.size;
+        header->mediaTime = key.mtime;
+        std::vector<uint8_t> released;
+        std::lock_guard<std::mutex> lock(m_layoutMutex);
+        m_peaks = (WaveformPeak*)(m_file.data() + sizeof(CacheHeader));
+        released.swap(m_memoryFallback);
+    }
+
+    // 追加第0级的一项；凑满一对时向上合并，各级计数在写入之后发布给UI线程
+    void appendPeak(WaveformPeak peak) {
+        int64_t index = m_counts[0].load(std::memory_order_relaxed);
+        if (index >= m_levelOffsets[1] - m_levelOffsets[0]) {
+            grow();
+        }
+        m_peaks[index] = peak;
+        m_counts[0].store(index + 1, std::memory_order_release);
+
+        for (int level = 0; level + 1 < m_levelCount && (index & 1); level++) {
+            const WaveformPeak* pair = m_peaks + m_levelOffsets[level] + index - 1;
+            index >>= 1;
+            m_peaks[m_levelOffsets[level + 1] + index] = { std::min(pair[0].min, pair[1].min),
+                                                           std::max(pair[0].max, pair[1].max) };
+            m_counts[level + 1].store(index + 1, std::memory_order_release);
+        }
+    }
+
+    // 由下往上重算各级的最后一项：它的子项可能不成对，或者本身是上一步刚补上的
+    void finishLevels() {
+        for (int level = 0; level + 1 < m_levelCount; level++) {
+            int64_t count = m_counts[level].load(std::memory_order_relaxed);
+            if (count == 0) {
+                break;
+            }
+            int64_t parent = (count - 1) / 2;
+            const WaveformPeak* children = m_peaks + m_levelOffsets[level] + parent * 2;
+            WaveformPeak peak = children[0];
+            if (parent * 2 + 1 < count) {
+                peak = { std::min(peak.min, children[1].min), std::max(peak.max, children[1].max) };
+            }
+            m_peaks[m_levelOffsets[level + 1] + parent] = peak;
+            m_counts[level + 1].store(parent + 1, std::memory_order_release);
+        }
+    }
+
+    void writeCompleteHeader() {
+        CacheHeader* header = (CacheHeader*)((uint8_t*)m_peaks - sizeof(CacheHeader));
+        for (int level = 0; level < m_levelCount; level++) {
+            header->counts[level] = m_counts[level].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        header->complete = 1;
+    }
+
+    static int interruptCallback(void* opaque) {
+        return ((WaveformTrack*)opaque)->m_cancel.load() ? 1 : 0;
+    }
+
+    void build() {
+        ThreadBudget::lowerCurrentThreadPriority();
+        Profiler::setThreadName("waveform");
+        auto begin = std::chrono::steady_clock::now();
+
+        AVFormatContext* formatContext = avformat_alloc_context();
+        if (!formatContext) {
+            return;
+        }
+        formatContext->interrupt_callback.callback = &WaveformTrack::interruptCallback;
+        formatContext->interrupt_callback.opaque = this;
+        if (avformat_open_input(&formatContext, m_filename.c_str(), nullptr, nullptr) != 0) {
+            std::cerr << "波形: 无法打开文件: " << m_filename << std::endl;
+            return;
+        }
+
+        int streamIndex = -1;
+        AVCodecContext* codecContext = nullptr;
+        SwrContext* swr = nullptr;
+        if (avformat_find_stream_info(formatContext, nullptr) >= 0) {
+            streamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+        }
+        if (streamIndex >= 0) {
+            for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
+                if ((int)i != streamIndex) {
+                    formatContext->streams[i]->discard = AVDISCARD_ALL;
+                }
+            }
+            codecContext = openDecoder(formatContext->streams[streamIndex]);
+        }
+        if (codecContext) {
+            swr = openResampler(codecContext);
+        }
+
+        if (swr) {
+            AVStream* stream = formatContext->streams[streamIndex];
+            double duration = stream->duration != AV_NOPTS_VALUE ? stream->duration * av_q2d(stream->time_base)
+                              : formatContext->duration != AV_NOPTS_VALUE ? formatContext->duration / (double)AV_TIME_BASE
+                                                                          : 0.0;
+            m_duration = duration;
+            if (mapForBuild(codecContext->sample_rate, duration > 0.0 ? duration : kUnknownDurationSeconds)) {
+                decodeAll(formatContext, codecContext, swr, streamIndex);
+            }
+        }
+
+        swr_free(&swr);
+        avcodec_free_context(&codecContext);
+        avformat_close_input(&formatContext);
+
+        if (!m_cancel && m_available.load()) {
+            finishLevels();
+            if (m_grown) {
+                persistGrown();
+            }
+            writeCompleteHeader();
+            m_buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            m_complete.store(true, std::memory_order_release);
+            std::cout << "波形: 生成完成 " << m_counts[0].load() << " 个峰值，" << m_levelCount << " 级，"
+                      << (int)(m_buildSeconds.load() * 1000) << "ms" << std::endl;
+        }
+    }
+
+    static AVCodecContext* openDecoder(AVStream* stream) {
+        const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+        if (!codec) {
+            return nullptr;
+        }
+        AVCodecContext* codecContext = avcodec_alloc_context3(codec);
+        if (!codecContext) {
+            return nullptr;
+        }
+        if (avcodec_parameters_to_context(codecContext, stream->codecpar) < 0 ||
+            avcodec_open2(codecContext, codec, nullptr) < 0) {
+            avcodec_free_context(&codecContext);
+            return nullptr;
+        }
+        return codecContext;
+    }
+
+    // 转成交错S16，采样率不变，最多两个声道
+    static SwrContext* openResampler(AVCodecContext* codecContext) {
+        AVChannelLayout inLayout;
+        if (codecContext->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+            av_channel_layout_default(&inLayout, codecContext->ch_layout.nb_channels);
+        } else {
+            av_channel_layout_copy(&inLayout, &codecContext->ch_layout);
+        }
+        AVChannelLayout outLayout;
+        av_channel_layout_default(&outLayout, std::max(1, std::min(kMaxChannels, codecContext->ch_layout.nb_channels)));
+        SwrContext* swr = nullptr;
+        int ret = swr_alloc_set_opts2(&swr, &outLayout, AV_SAMPLE_FMT_S16, codecContext->sample_rate,
+                                      &inLayout, codecContext->sample_fmt, codecContext->sample_rate, 0, nullptr);
+        av_channel_layout_uninit(&inLayout);
+        av_channel_layout_uninit(&outLayout);
+        if (ret < 0 || swr_init(swr) < 0) {
+            swr_free(&swr);
+            return nullptr;
+        }
+        return swr;
+    }
+
+    void decodeAll(AVFormatContext* formatContext, AVCodecContext* codecContext, SwrContext* swr, int streamIndex) {
+        ProfileScope scope("waveform_build");
+        peaks::MinMaxFunction minMax = peaks::bestMinMax();
+        int channels = std::max(1, std::min(kMaxChannels, codecContext->ch_layout.nb_channels));
+        std::vector<int16_t> samples;
+        PacketPtr packet = makePacket();
+        FramePtr frame = makeFrame();
+        if (!packet || !frame) {
+            return;
+        }
+
+        // 当前这一项已经累计的样本帧数和最小/最大值
+        int filled = 0;
+        WaveformPeak current = { INT16_MAX, INT16_MIN };
+        int64_t totalFrames = 0;
+        auto consume = [&](int frames) {
+            const int16_t* data = samples.data();
+            while (frames > 0) {
+                int take = std::min(frames, kSamplesPerPeak - filled);
+                minMax(data, (size_t)take * channels, current.min, current.max);
+                data += (size_t)take * channels;
+                frames -= take;
+                filled += take;
+                if (filled == kSamplesPerPeak) {
+                    appendPeak(current);
+                    filled = 0;
+                    current = { INT16_MAX, INT16_MIN };
+                }
+            }
+        };
+        auto convert = [&](const AVFrame* input) {
+            int capacity = swr_get_out_samples(swr, input ? input->nb_samples : 0);
+            if (capacity <= 0) {
+                return;
+            }
+            samples.resize((size_t)capacity * channels);
+            uint8_t* out[1] = { (uint8_t*)samples.data() };
+            int frames = swr_convert(swr, out, capacity, input ? (const uint8_t**)input->extended_data : nullptr,
+                                     input ? input->nb_samples : 0);
+            if (frames > 0) {
+                consume(frames);
+                totalFrames += frames;
+                m_decodedSeconds = (double)totalFrames / codecContext->sample_rate;
+            }
+        };
+
+        bool draining = false;
+        while (!m_cancel) {
+            if (!draining) {
+                int ret = av_read_frame(formatContext, packet.get());
+                if (ret < 0) {
+                    draining = true;
+                    avcodec_send_packet(codecContext, nullptr);
+                } else {
+                    if (packet->stream_index == streamIndex) {
+                        avcodec_send_packet(codecContext, packet.get());
+                    }
+                    av_packet_unref(packet.get());
+                }
+            }
+            int ret;
+            while ((ret = avcodec_receive_frame(codecContext, frame.get())) == 0) {
+                convert(frame.get());
+                av_frame_unref(frame.get());
+            }
+            if (draining && ret != AVERROR(EAGAIN)) {
+                break;
+            }
+        }
+        if (m_cancel) {
+            return;
+        }
+        convert(nullptr);
+        if (filled > 0) {
+            appendPeak(current);
+        }
+    }
+
+    std::string m_filename;
+    int m_sampleRate;
+    int m_levelCount;
+    std::vector<int64_t> m_levelOffsets;  // 各级在峰值区中的起始项，最后一项为总项数
+
+    sidecar::MappedFile m_file;
+    std::vector<uint8_t> m_memoryFallback;  // 缓存文件不可用时代替映射
+    WaveformPeak* m_peaks;                  // 峰值区（缓存文件头之后）
+    bool m_grown;                           // 生成中扩过容，金字塔在m_memoryFallback里
+    mutable std::mutex m_layoutMutex;       // 保护m_peaks、m_levelOffsets和m_levelCount：扩容时由生成线程替换
+    std::atomic<int64_t> m_counts[kMaxLevels];  // 各级已生成的项数，UI线程只读这个范围
+
+    std::atomic<bool> m_available;  // 映射和布局已就绪；之后布局只会在扩容时整体替换
+    std::atomic<bool> m_complete;
+    std::atomic<bool> m_cancel;
+    std::atomic<bool> m_building;
+    std::atomic<double> m_decodedSeconds;
+    std::atomic<double> m_duration;
+    std::atomic<double> m_buildSeconds;
+    std::thread m_thread;
+
+    std::vector<WaveformPeak> m_columns;  // draw()的临时数据，只在UI线程使用
+    std::vector<SDL_Rect> m_bars;
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Profiler.h"
+
+// 常驻的工作线程组，用于把一帧的处理切成若干块并行执行
+// parallelFor同一时间只能由一个线程调用；调用线程自己也领取任务，全部完成后才返回
+class WorkerPool {
+public:
+    // threads为参与计算的总线程数（包括调用线程）
+    WorkerPool(int threads, const char* name)
+        : m_name(name), m_task(nullptr), m_count(0), m_next(0), m_busy(0), m_generation(0), m_stop(false) {
+        for (int i = 1; i < std::max(1, threads); i++) {
+            m_threads.emplace_back(&WorkerPool::workerLoop, this);
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int threads() const {
+        return (int)m_threads.size() + 1;
+    }
+
+    // 对[0, count)中的每个下标调用一次task
+    void parallelFor(int count, const std::function<void(int)>& task) {
+        if (count <= 0) {
+            return;
+        }
+        if (m_threads.empty() || count == 1) {
+            for (int i = 0; i < count; i++) {
+                task(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_count = count;
+            m_next = 0;
+            m_busy = (int)m_threads.size();
+            m_generation++;
+        }
+        m_wake.notify_all();
+        runTasks(task, count);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]() { return m_busy == 0; });
+        m_task = nullptr;
+    }
+
+private:
+    void runTasks(const std::function<void(int)>& task, int count) {
+        for (int i = m_next++; i < count; i = m_next++) {
+            task(i);
+        }
+    }
+
+    void workerLoop() {
+        Profiler::setThreadName(m_name);
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_wake.wait(lock, [&]() { return m_stop || m_generation != seen; });
+            if (m_stop) {
+                return;
+            }
+            seen = m_generation;
+            const std::function<void(int)>* task = m_task;
+            int count = m_count;
+            lock.unlock();
+            runTasks(*task, count);
+            lock.lock();
+            if (--m_busy == 0) {
+                m_done.notify_one();
+            }
+        }
+    }
+
+    const char* m_name;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const std::function<void(int)>* m_task;  // 当前这一轮的任务，在锁内读写
+    int m_count;
+    std::atomic<int> m_next;                 // 下一个要领取的下标
+    int m_busy;                              // 这一轮还没做完的工作线程数
+    uint64_t m_generation;                   // 每次parallelFor加一，工作线程据此知道有新任务
+    bool m_stop;
+};
@@ -4,8 +4,17 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <cctype>
+#include <cstring>
+#include <limits>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 // FFmpeg头文件
 extern "C" {
@@ -15,325 +24,33 @@ extern "C" {
 #include <libavutil/imgutils.h>
 }
 
+#include "VideoDecoder.h"
+#include "ClipPool.h"
+#include "Benchmark.h"
+#include "MediaClock.h"
+#include "ScrubController.h"
+#include "ProxyGenerator.h"
+#include "ThumbnailStrip.h"
+#include "WaveformTrack.h"
+#include "SceneDetector.h"
+#include "UiLayer.h"
+#include "Profiler.h"
+#include "TrimExporter.h"
+#include "ChunkedExporter.h"
+
 // 前向声明
 class Application;
 
 // 全局变量
 std::unique_ptr<Application> g_app = nullptr;
 
-// 视频解码器类
-class VideoDecoder {
-public:
-    VideoDecoder() : 
-        formatContext(nullptr), 
-        codecContext(nullptr), 
-        swsContext(nullptr),
-        videoStream(nullptr),
-        videoStreamIndex(-1),
-        frame(nullptr),
-        frameRGB(nullptr),
-        buffer(nullptr),
-        texture(nullptr) {}
-
-    ~VideoDecoder() {
-        cleanup();
-    }
-
-    bool openFile(const std::string& filename, SDL_Renderer* renderer) {
-        // 打开输入文件
-        if (avformat_open_input(&formatContext, filename.c_str(), nullptr, nullptr) != 0) {
-            std::cerr << "无法打开视频文件: " << filename << std::endl;
-            return false;
-        }
-
-        // 获取流信息
-        if (avformat_find_stream_info(formatContext, nullptr) < 0) {
-            std::cerr << "无法获取流信息" << std::endl;
-            cleanup();
-            return false;
-        }
-
-        // 查找视频流
-        for (unsigned int i = 0; i < formatContext->nb_streams; i++) {
-            if (formatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-                videoStreamIndex = i;
-                videoStream = formatContext->streams[i];
-                break;
-            }
-        }
-
-        if (videoStreamIndex == -1) {
-            std::cerr << "未找到视频流" << std::endl;
-            cleanup();
-            return false;
-        }
-
-        // 获取解码器
-        const AVCodec* codec = avcodec_find_decoder(videoStream->codecpar->codec_id);
-        if (!codec) {
-            std::cerr << "未找到解码器" << std::endl;
-            cleanup();
-            return false;
-        }
-
-        // 分配解码器上下文
-        codecContext = avcodec_alloc_context3(codec);
-        if (!codecContext) {
-            std::cerr << "无法分配解码器上下文" << std::endl;
-            cleanup();
-            return false;
-        }
-
-        // 复制编解码器参数
-        if (avcodec_parameters_to_context(codecContext, videoStream->codecpar) < 0) {
-            std::cerr << "无法复制编解码器参数" << std::endl;
-            cleanup();
-            return false;
-        }
-
-        // 打开解码器
-        if (avcodec_open2(codecContext, codec, nullptr) < 0) {
-            std::cerr << "无法打开解码器" << std::endl;
-            cleanup();
-            return false;
-        }
-
-        // 分配帧
-        frame = av_frame_alloc();
-        frameRGB = av_frame_alloc();
-        if (!frame || !frameRGB) {
-            std::cerr << "无法分配帧" << std::endl;
-            cleanup();
-            return false;
-        }
-
-        // 分配缓冲区
-        int numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, codecContext->width, codecContext->height, 1);
-        buffer = (uint8_t*)av_malloc(numBytes * sizeof(uint8_t));
-        av_image_fill_arrays(frameRGB->data, frameRGB->linesize, buffer, AV_PIX_FMT_RGB24, 
-                            codecContext->width, codecContext->height, 1);
-
-        // 创建转换上下文
-        swsContext = sws_getContext(
-            codecContext->width, codecContext->height, codecContext->pix_fmt,
-            codecContext->width, codecContext->height, AV_PIX_FMT_RGB24,
-            SWS_BILINEAR, nullptr, nullptr, nullptr
-        );
-
-        if (!swsContext) {
-            std::cerr << "无法创建转换上下文" << std::endl;
-            cleanup();
-            return false;
-        }
-
-        // 创建SDL纹理
-        texture = SDL_CreateTexture(
-            renderer,
-            SDL_PIXELFORMAT_RGB24,
-            SDL_TEXTUREACCESS_STREAMING,
-            codecContext->width,
-            codecContext->height
-        );
-
-        if (!texture) {
-            std::cerr << "无法创建SDL纹理: " << SDL_GetError() << std::endl;
-            cleanup();
-            return false;
-        }
-
-        return true;
-    }
-
-    bool readFrame() {
-        AVPacket packet;
-        int ret;
-
-        // 读取下一帧
-        if (av_read_frame(formatContext, &packet) < 0) {
-            // 文件结束或错误
-            return false;
-        }
-
-        // 如果是视频帧
-        if (packet.stream_index == videoStreamIndex) {
-            // 发送数据包到解码器
-            ret = avcodec_send_packet(codecContext, &packet);
-            if (ret < 0) {
-                std::cerr << "发送数据包到解码器失败" << std::endl;
-                av_packet_unref(&packet);
-                return false;
-            }
-
-            // 从解码器接收帧
-            ret = avcodec_receive_frame(codecContext, frame);
-            if (ret < 0) {
-                std::cerr << "从解码器接收帧失败" << std::endl;
-                av_packet_unref(&packet);
-                return false;
-            }
-
-            // 转换帧格式
-            sws_scale(
-                swsContext,
-                (const uint8_t* const*)frame->data, frame->linesize,
-                0, codecContext->height,
-                frameRGB->data, frameRGB->linesize
-            );
-
-            // 更新纹理
-            SDL_UpdateTexture(
-                texture,
-                nullptr,
-                frameRGB->data[0],
-                frameRGB->linesize[0]
-            );
-        }
-
-        av_packet_unref(&packet);
-        return true;
-    }
-
-    SDL_Texture* getTexture() const {
-        return texture;
-    }
-
-    int getWidth() const {
-        return codecContext ? codecContext->width : 0;
-    }
-
-    int getHeight() const {
-        return codecContext ? codecContext->height : 0;
-    }
-
-    // 将这三个方法从private移到public
-    double getDuration() const {
-        if (formatContext && videoStream) {
-            return videoStream->duration * av_q2d(videoStream->time_base);
-        }
-        return 0.0;
-    }
-
-    bool seekToTime(double timeInSeconds) {
-        if (!formatContext || videoStreamIndex == -1) {
-            return false;
-        }
-
-        int64_t targetTs = (int64_t)(timeInSeconds / av_q2d(videoStream->time_base));
-        
-        if (av_seek_frame(formatContext, videoStreamIndex, targetTs, AVSEEK_FLAG_BACKWARD) < 0) {
-            std::cerr << "跳转失败" << std::endl;
-            return false;
-        }
-        
-        avcodec_flush_buffers(codecContext);
-        
-        // 读取并解码一帧以更新当前显示
-        AVPacket packet;
-        while (av_read_frame(formatContext, &packet) >= 0) {
-            if (packet.stream_index == videoStreamIndex) {
-                int ret = avcodec_send_packet(codecContext, &packet);
-                if (ret < 0) {
-                    av_packet_unref(&packet);
-                    continue;
-                }
-
-                ret = avcodec_receive_frame(codecContext, frame);
-                if (ret < 0) {
-                    av_packet_unref(&packet);
-                    continue;
-                }
-
-                // 转换帧格式
-                sws_scale(
-                    swsContext,
-                    (const uint8_t* const*)frame->data, frame->linesize,
-                    0, codecContext->height,
-                    frameRGB->data, frameRGB->linesize
-                );
-
-                // 更新纹理
-                SDL_UpdateTexture(
-                    texture,
-                    nullptr,
-                    frameRGB->data[0],
-                    frameRGB->linesize[0]
-                );
-                
-                av_packet_unref(&packet);
-                break;
-            }
-            av_packet_unref(&packet);
-        }
-        
-        return true;
-    }
-
-    double getCurrentTime() const {
-        if (formatContext && videoStream && frame && frame->pts != AV_NOPTS_VALUE) {
-            return frame->pts * av_q2d(videoStream->time_base);
-        }
-        return 0.0;
-    }
-
-    void cleanup() {
-        if (texture) {
-            SDL_DestroyTexture(texture);
-            texture = nullptr;
-        }
-
-        if (buffer) {
-            av_free(buffer);
-            buffer = nullptr;
-        }
-
-        if (frameRGB) {
-            av_frame_free(&frameRGB);
-            frameRGB = nullptr;
-        }
-
-        if (frame) {
-            av_frame_free(&frame);
-            frame = nullptr;
-        }
-
-        if (swsContext) {
-            sws_freeContext(swsContext);
-            swsContext = nullptr;
-        }
-
-        if (codecContext) {
-            avcodec_free_context(&codecContext);
-            codecContext = nullptr;
-        }
-
-        if (formatContext) {
-            avformat_close_input(&formatContext);
-            formatContext = nullptr;
-        }
-
-        videoStream = nullptr;
-        videoStreamIndex = -1;
-    }
-
-private:
-    AVFormatContext* formatContext;
-    AVCodecContext* codecContext;
-    SwsContext* swsContext;
-    AVStream* videoStream;
-    int videoStreamIndex;
-    AVFrame* frame;
-    AVFrame* frameRGB;
-    uint8_t* buffer;
-    SDL_Texture* texture;
-    // 删除这里的方法定义，因为已经移到public部分
-};
-
 // 应用程序类
 class Application {
 public:
-    Application() : m_running(false), m_window(nullptr), m_renderer(nullptr), 
-                   m_videoLoaded(false), m_isPlaying(false), m_frameDelay(33),
-                   m_currentTime(0.0), m_timelineDragging(false) {}
+    Application() : m_running(false), m_window(nullptr), m_renderer(nullptr), m_videoDecoder(&m_clips.active()),
+                   m_videoLoaded(false), m_isPlaying(false), m_shuttleRate(1), m_audioPlaying(false), m_frameDelay(10),
+                   m_currentTime(0.0), m_inPoint(-1.0), m_outPoint(-1.0), m_timelineDragging(false), m_usingProxy(false), m_showProfile(false),
+                   m_profileUpdated(0), m_dirty(true), m_renderedKey(0), m_layoutVersion(0) {}
     ~Application() {
         cleanup();
     }
@@ -365,12 +82,31 @@ public:
             return false;
         }
 
+        m_batch.setRenderer(m_renderer);
+        m_clips.setRenderer(m_renderer);
         m_running = true;
+
+        // 命令行指定的文件在渲染器创建之后才能加载
+        if (!m_pendingFile.empty()) {
+            loadVideo(m_pendingFile);
+            m_pendingFile.clear();
+        }
         return true;
     }
 
     void cleanup() {
-        m_videoDecoder.cleanup();
+        m_exporter.cancel();
+        m_exporter.wait();
+        m_encodeExporter.cancel();
+        m_encodeExporter.wait();
+        m_proxy.close();
+        m_thumbnails.close();
+        m_waveform.close();
+        m_scenes.close();
+        m_clips.close();
+        m_videoDecoder = &m_clips.active();
+        m_videoLoaded = false;
+        m_background.release();
 
         if (m_renderer) {
             SDL_DestroyRenderer(m_renderer);
@@ -389,112 +125,194 @@ public:
         if (!initialize()) {
             return 1;
         }
+        Profiler::setThreadName("ui");
 
         // 主循环
         while (m_running) {
             processEvents();
-            update();
-            render();
+            {
+                ProfileScope scope("update");
+                update();
+            }
+            bool idle = scheduleWakeup();
+
+            // 画面内容没有变化时不重画也不present
+            uint64_t key = frameKey();
+            if (m_dirty || key != m_renderedKey) {
+                ProfileScope scope("render");
+                render();
+                m_dirty = false;
+                m_renderedKey = key;
+            } else {
+                m_uiStats.onSkip();
+            }
+            m_uiStats.mark(idle);
 
-            // 控制帧率
-            SDL_Delay(m_frameDelay);
+            // 等到下一帧应当显示的时刻，帧率由视频pts决定而不是固定值；有输入事件时立即醒来
+            if (m_frameDelay > 0) {
+                SDL_WaitEventTimeout(nullptr, m_frameDelay);
+            }
         }
+        m_uiStats.print();
+        m_clips.printStats();
 
+        if (!m_traceFile.empty()) {
+            Profiler::instance().writeTrace(m_traceFile);
+        }
         return 0;
     }
 
-// 将drawTimeline方法添加到Application类内部
-void drawTimeline(const SDL_Rect& timelineRect) {
-    // 绘制时间线背景
-    SDL_Rect timelineBarRect = { 
-        timelineRect.x + 10, 
-        timelineRect.y + 20, 
-        timelineRect.w - 20, 
-        30 
-    };
-    SDL_SetRenderDrawColor(m_renderer, 30, 30, 30, 255);
-    SDL_RenderFillRect(m_renderer, &timelineBarRect);
-    SDL_SetRenderDrawColor(m_renderer, 80, 80, 80, 255);
-    SDL_RenderDrawRect(m_renderer, &timelineBarRect);
-    
-    // 绘制时间刻度
-    double duration = m_videoDecoder.getDuration();
-    if (duration > 0) {
-        // 每10秒绘制一个刻度
-        int numTicks = (int)(duration / 10) + 1;
-        for (int i = 0; i <= numTicks; i++) {
-            double time = i * 10.0;
-            if (time > duration) time = duration;
-            
-            double ratio = time / duration;
-            int tickX = timelineBarRect.x + (int)(ratio * timelineBarRect.w);
-            
-            // 绘制刻度线
-            SDL_SetRenderDrawColor(m_renderer, 150, 150, 150, 255);
-            SDL_RenderDrawLine(
-                m_renderer,
-                tickX, timelineBarRect.y,
-                tickX, timelineBarRect.y + timelineBarRect.h
-            );
-            
-            // 绘制时间标签（简化为小矩形）
-            SDL_Rect tickRect = { tickX - 2, timelineBarRect.y + timelineBarRect.h + 5, 4, 10 };
-            SDL_RenderFillRect(m_renderer, &tickRect);
-        }
-        
-        // 绘制当前时间指示器
-        double ratio = m_currentTime / duration;
-        int currentX = timelineBarRect.x + (int)(ratio * timelineBarRect.w);
-        
-        // 绘制指示线
-        SDL_SetRenderDrawColor(m_renderer, 255, 0, 0, 255);
-        SDL_RenderDrawLine(
-            m_renderer,
-            currentX, timelineBarRect.y - 10,
-            currentX, timelineBarRect.y + timelineBarRect.h + 10
-        );
-        
-        // 绘制指示器头部
-        SDL_Rect indicatorHead = { currentX - 5, timelineBarRect.y - 15, 10, 10 };
-        SDL_RenderFillRect(m_renderer, &indicatorHead);
-        
-        // 显示当前时间/总时间
-        char timeText[50];
-        int minutes = (int)m_currentTime / 60;
-        int seconds = (int)m_currentTime % 60;
-        int totalMinutes = (int)duration / 60;
-        int totalSeconds = (int)duration % 60;
-        
-        // 在时间线下方显示时间信息
-        SDL_Rect timeInfoRect = { 
-            timelineBarRect.x, 
-            timelineBarRect.y + timelineBarRect.h + 20, 
-            100, 
-            20 
-        };
-        SDL_SetRenderDrawColor(m_renderer, 60, 60, 60, 255);
-        SDL_RenderFillRect(m_renderer, &timeInfoRect);
-        
-        // 显示进度
-        int progressWidth = (int)(ratio * timeInfoRect.w);
-        SDL_Rect progressRect = { timeInfoRect.x, timeInfoRect.y, progressWidth, timeInfoRect.h };
-        SDL_SetRenderDrawColor(m_renderer, 100, 100, 255, 255);
-        SDL_RenderFillRect(m_renderer, &progressRect);
-    }
-}
     bool loadVideo(const std::string& filename) {
-        if (m_videoDecoder.openFile(filename, m_renderer)) {
-            m_videoLoaded = true;
-            m_isPlaying = true;
+        if (!m_renderer) {
+            // 尚未初始化，记录下来等initialize()之后再打开
+            m_pendingFile = filename;
             return true;
         }
-        return false;
+
+        if (m_videoLoaded && filename == m_currentFile) {
+            return true;
+        }
+        m_scrubber.reset();
+        m_audioPlaying = false;
+        if (m_clips.request(filename)) {
+            onClipActivated();
+            return true;
+        }
+
+        // 冷打开在后台进行，完成之前预览区显示占位画面，时间线清空
+        m_videoDecoder = &m_clips.active();
+        m_videoLoaded = false;
+        m_isPlaying = false;
+        m_proxy.close();
+        m_usingProxy = false;
+        m_thumbnails.close();
+        m_waveform.close();
+        m_scenes.close();
+        m_layoutVersion++;
+        return true;
+    }
+
+    // 片段池的当前片段换了（保温命中、冷打开完成或失败后回到之前的片段）：重建时间线上依附于文件的内容
+    void onClipActivated() {
+        m_videoDecoder = &m_clips.active();
+        const std::string& filename = m_clips.activePath();
+        m_proxy.close();
+        m_thumbnails.close();
+        m_waveform.close();
+        m_scenes.close();
+        m_thumbnails.open(filename, m_videoDecoder->getVideoStreamIndex(), m_videoDecoder->getDuration(),
+                          m_videoDecoder->getWidth(), m_videoDecoder->getHeight());
+        m_waveform.open(filename);
+        m_scenes.open(filename);
+        // 保温的解码器可能已经切到了代理；源本身不高于代理尺寸时代理没有意义，不生成
+        m_usingProxy = m_videoDecoder->getFilePath() != filename;
+        if (!m_usingProxy && m_videoDecoder->getSourceHeight() > ProxyGenerator::kProxyHeight) {
+            m_proxy.start(filename);
+        }
+        m_videoLoaded = true;
+        m_isPlaying = true;
+        m_currentFile = filename;
+        m_inPoint = -1.0;
+        m_outPoint = -1.0;
+        // 冷打开的解码器第一帧到达时再对齐时钟；保温的解码器纹理里已经是它停下时的画面
+        m_currentTime = m_videoDecoder->getCurrentTime();
+        m_clock.set(m_currentTime);
+        m_layoutVersion++;
+        m_dirty = true;
+    }
+
+    // 解码流水线的队列深度，需要在加载视频之前设置
+    void setQueueDepths(size_t packetQueueSize, size_t frameQueueSize) {
+        m_clips.settings().packetQueueSize = packetQueueSize;
+        m_clips.settings().frameQueueSize = frameQueueSize;
+    }
+
+    void setZeroCopyUpload(bool enabled) {
+        m_clips.settings().zeroCopy = enabled;
+    }
+
+    void setDecoderThreading(const DecoderThreadingConfig& config) {
+        m_clips.settings().threading = config;
+    }
+
+    void setPreviewScaling(bool enabled, int lowres) {
+        m_clips.settings().previewScaling = enabled;
+        m_clips.settings().lowres = lowres;
+    }
+
+    void setFrameCacheSize(size_t bytes) {
+        m_clips.settings().frameCacheBytes = bytes;
+    }
+
+    void setAudioEnabled(bool enabled) {
+        m_clips.settings().audio = enabled;
+    }
+
+    void setIOMode(IOMode mode) {
+        m_clips.settings().ioMode = mode;
+    }
+
+    void setProbeCache(bool enabled) {
+        m_clips.settings().probeCache = enabled;
+    }
+
+    // 每个新打开的片段默认的调色效果链；之后各片段可以单独开关
+    void setColorEffects(const ColorChain& chain) {
+        m_clips.settings().colorEffects = chain;
+    }
+
+    // 每个新打开的片段默认的叠加图层；之后各片段可以在图层面板上单独开关
+    void setLayers(const LayerList& layers) {
+        m_clips.settings().layers = layers;
+    }
+
+    // 保温片段的个数和估计画面内存的上限
+    void setClipPoolLimits(size_t clips, size_t bytes) {
+        m_clips.setMaxClips(clips);
+        m_clips.setMemoryLimit(bytes);
+    }
+
+    // 镜头切换分析的阈值和并行段数，对之后打开的片段生效
+    void setSceneOptions(const SceneOptions& options) {
+        m_scenes.setOptions(options);
+    }
+
+    // 代理缓存目录的大小上限，0为不使用代理
+    void setProxyCacheLimit(uint64_t bytes) {
+        m_proxy.setCacheLimit(bytes);
+    }
+
+    // 打开时在控制台打印叠加层的图例（SDL没有文字渲染），关闭时打印最近一秒的汇总
+    void setProfiling(bool enabled) {
+        Profiler::instance().setEnabled(enabled);
+        m_showProfile = enabled;
+        m_profileStats.clear();
+        m_profileUpdated = 0;
+        if (enabled) {
+            std::cout << "分段计时: 已打开，叠加层每行对应一个阶段（满格 = " << kFrameBudgetMs << "ms帧预算）:" << std::endl;
+            for (const ProfileStage& stage : kProfileStages) {
+                std::cout << "  " << stage.name << " rgb(" << (int)stage.r << "," << (int)stage.g << "," << (int)stage.b << ")" << std::endl;
+            }
+        } else {
+            for (const Profiler::StageStats& stage : Profiler::instance().summarize(1.0)) {
+                std::cout << "  " << stage.name << ": " << stage.count << " 次，平均 "
+                          << stage.totalMs / stage.count << "ms，最大 " << stage.maxMs << "ms" << std::endl;
+            }
+        }
+    }
+
+    void setTraceFile(const std::string& path) {
+        m_traceFile = path;
     }
 
 private:
     void processEvents() {
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
+            // 输入、窗口尺寸变化、重新显示等事件之后重画一次；没有拖动时的鼠标移动不改变画面
+            if (event.type != SDL_MOUSEMOTION) {
+                m_dirty = true;
+            }
             if (event.type == SDL_QUIT) {
                 m_running = false;
             } else if (event.type == SDL_KEYDOWN) {
@@ -510,6 +328,11 @@ private:
                 handleMouseButtonUp(event);
             } else if (event.type == SDL_MOUSEMOTION) {
                 handleMouseMotion(event);
+            } else if (event.type == SDL_RENDER_TARGETS_RESET) {
+                // 目标纹理的内容丢失，静态层下一帧重画
+                m_background.invalidate();
+            } else if (event.type == SDL_RENDER_DEVICE_RESET) {
+                m_background.release();
             }
         }
     }
@@ -523,16 +346,210 @@ private:
             case SDLK_SPACE:
                 // 播放/暂停
                 m_isPlaying = !m_isPlaying;
+                setShuttleRate(1);
+                break;
+            case SDLK_UP:
+            case SDLK_DOWN:
+                // 跳到上一个/下一个镜头切换点
+                jumpToSceneMarker(key == SDLK_DOWN ? 1 : -1);
+                break;
+            case SDLK_LEFT:
+            case SDLK_RIGHT:
+                // 逐帧后退/前进，优先从帧缓存取
+                if (m_videoLoaded) {
+                    m_isPlaying = false;
+                    setShuttleRate(1);
+                    m_videoDecoder->stepFrame(key == SDLK_RIGHT ? 1 : -1);
+                    m_currentTime = m_videoDecoder->getCurrentTime();
+                }
+                break;
+            case SDLK_j:
+                // 倒放，连按加速
+                setShuttleRate(m_isPlaying && m_shuttleRate < 0 ? std::max(m_shuttleRate * 2, -kMaxShuttleRate) : -1);
+                m_isPlaying = true;
+                break;
+            case SDLK_k:
+                // 停止穿梭
+                m_isPlaying = false;
+                setShuttleRate(1);
+                printFrameCacheStats();
+                break;
+            case SDLK_l:
+                // 正放，连按加速
+                setShuttleRate(m_isPlaying && m_shuttleRate > 0 ? std::min(m_shuttleRate * 2, kMaxShuttleRate) : 1);
+                m_isPlaying = true;
                 break;
             case SDLK_o:
                 // 打开文件对话框
                 openFileDialog();
                 break;
+            case SDLK_p:
+                // 开关分段计时和叠加层
+                setProfiling(!m_showProfile);
+                break;
+            case SDLK_t:
+                // 导出最近的分段计时为Chrome trace
+                Profiler::instance().writeTrace("trace_" + std::to_string(SDL_GetTicks()) + ".json");
+                break;
+            case SDLK_LEFTBRACKET:
+                // 在当前位置设置入点
+                if (m_videoLoaded) {
+                    m_inPoint = m_currentTime;
+                    if (m_outPoint >= 0.0 && m_outPoint <= m_inPoint) {
+                        m_outPoint = -1.0;
+                    }
+                }
+                break;
+            case SDLK_RIGHTBRACKET:
+                // 在当前位置设置出点
+                if (m_videoLoaded) {
+                    m_outPoint = m_currentTime;
+                    if (m_inPoint >= 0.0 && m_inPoint >= m_outPoint) {
+                        m_inPoint = -1.0;
+                    }
+                }
+                break;
+            case SDLK_e:
+                // 在后台导出入点到出点之间的片段
+                exportTrim();
+                break;
+            case SDLK_r:
+                // 在后台用全部核心重新编码导出入点到出点之间的片段
+                exportEncode();
+                break;
+            case SDLK_c:
+                // 开关当前片段的调色效果，对比调色前后
+                toggleColorEffects();
+                break;
             default:
                 break;
         }
     }
 
+    // 从播放头所在位置向前或向后找最近的切点，精确seek过去；分析完成之前没有切点
+    void jumpToSceneMarker(int direction) {
+        if (!m_videoLoaded) {
+            return;
+        }
+        double target = 0.0;
+        bool found = direction > 0 ? m_scenes.nextMarker(m_currentTime, target) : m_scenes.previousMarker(m_currentTime, target);
+        if (!found) {
+            return;
+        }
+        m_scrubber.reset();
+        m_videoDecoder->seekToTime(target);
+        m_currentTime = target;
+    }
+
+    // 预览改用代理：片段池在后台打开代理，期间继续播放原文件；代理打不开时一直使用原文件
+    void switchToProxy() {
+        m_usingProxy = true;  // 失败也不再重试
+        m_clips.replaceActive(m_proxy.path());
+    }
+
+    // 代理的解码器换下了原来的解码器：回到当前位置
+    void onProxyAttached() {
+        m_videoDecoder = &m_clips.active();
+        m_scrubber.reset();
+        m_audioPlaying = false;
+        std::cout << "代理: 预览切换到 " << m_videoDecoder->getFilePath() << std::endl;
+        m_videoDecoder->seekToTime(m_currentTime);
+        m_dirty = true;
+    }
+
+    // 未设置的入点/出点取文件开头/结尾；输出与源同一目录，MP4/MKV保持原格式，其余写成MP4
+    void exportTrim() {
+        if (!m_videoLoaded || m_currentFile.empty()) {
+            return;
+        }
+        if (m_exporter.isRunning()) {
+            std::cout << "导出仍在进行中" << std::endl;
+            return;
+        }
+        double inPoint = m_inPoint >= 0.0 ? m_inPoint : 0.0;
+        double outPoint = m_outPoint >= 0.0 ? m_outPoint : m_videoDecoder->getDuration();
+        std::string output = trimOutputPath(m_currentFile);
+        std::cout << "开始导出 " << inPoint << "s - " << outPoint << "s 到 " << output << std::endl;
+        if (colorChainActive(m_videoDecoder->getColorEffects()) || layerListActive(m_videoDecoder->getLayers())) {
+            std::cout << "裁剪导出直接复制数据包，不带调色效果和叠加图层；需要时请用重编码导出（R）" << std::endl;
+        }
+        m_exporter.start(m_currentFile, inPoint, outPoint, output);
+    }
+
+    // 与exportTrim相同的区间，按关键帧分段并行重编码，输出为源文件旁的 *_export.mp4
+    void exportEncode() {
+        if (!m_videoLoaded || m_currentFile.empty()) {
+            return;
+        }
+        if (m_encodeExporter.isRunning()) {
+            std::cout << "导出仍在进行中（" << (int)(m_encodeExporter.progress() * 100) << "%）" << std::endl;
+            return;
+        }
+        double inPoint = m_inPoint >= 0.0 ? m_inPoint : 0.0;
+        double outPoint = m_outPoint >= 0.0 ? m_outPoint : m_videoDecoder->getDuration();
+        size_t dot = m_currentFile.find_last_of('.');
+        size_t slash = m_currentFile.find_last_of("/\\");
+        std::string stem = dot == std::string::npos || (slash != std::string::npos && dot < slash) ? m_currentFile
+                                                                                                  : m_currentFile.substr(0, dot);
+        std::string output = stem + "_export.mp4";
+        std::cout << "开始重编码导出 " << inPoint << "s - " << outPoint << "s 到 " << output << std::endl;
+        ChunkedExportOptions options;
+        options.colorEffects = m_videoDecoder->getColorEffects();
+        options.layers = m_videoDecoder->getLayers();
+        m_encodeExporter.start(m_currentFile, inPoint, outPoint, output, options);
+    }
+
+    // 当前片段的效果链整体启用/停用，效果参数保留
+    void toggleColorEffects() {
+        if (!m_videoLoaded) {
+            return;
+        }
+        ColorChain chain = m_videoDecoder->getColorEffects();
+        if (chain.empty()) {
+            std::cout << "调色: 当前片段没有效果（用 --brightness/--contrast/--saturation/--gamma/--lut 设置）" << std::endl;
+            return;
+        }
+        bool enable = !colorChainActive(chain);
+        for (ColorEffect& effect : chain) {
+            effect.enabled = enable;
+        }
+        m_videoDecoder->setColorEffects(chain);
+        std::cout << "调色: " << (enable ? "开启" : "关闭") << " " << m_clips.activePath() << std::endl;
+        m_dirty = true;
+    }
+
+    static std::string trimOutputPath(const std::string& input) {
+        size_t dot = input.find_last_of('.');
+        size_t slash = input.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return input + "_trim.mp4";
+        }
+        std::string extension = input.substr(dot);
+        std::string lower = extension;
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (lower != ".mp4" && lower != ".mov" && lower != ".mkv") {
+            extension = ".mp4";
+        }
+        return input.substr(0, dot) + "_trim" + extension;
+    }
+
+    // J/K/L穿梭速率：正数正放，负数倒放
+    void setShuttleRate(int rate) {
+        m_shuttleRate = rate;
+        m_clock.setRate(rate);
+    }
+
+    void printFrameCacheStats() {
+        const FrameCache& cache = m_videoDecoder->getFrameCache();
+        std::cout << "帧缓存: 命中 " << cache.hits()
+                  << "，未命中 " << cache.misses()
+                  << "（命中率 " << (int)(cache.hitRate() * 100) << "%）"
+                  << "，缓存 " << cache.size() << " 帧 / "
+                  << cache.bytes() / (1024 * 1024) << "MB（上限 " << cache.capacity() / (1024 * 1024) << "MB）"
+                  << "，缓冲区分配 " << m_videoDecoder->getPoolAllocations()
+                  << " / 取用 " << m_videoDecoder->getPoolRequests() << std::endl;
+    }
+
     // 添加openFileDialog方法
     void openFileDialog() {
         // 在实际应用中，这里应该打开一个文件对话框
@@ -563,14 +580,45 @@ private:
             if (mouseX >= timelineBarRect.x && mouseX <= timelineBarRect.x + timelineBarRect.w &&
                 mouseY >= timelineBarRect.y && mouseY <= timelineBarRect.y + timelineBarRect.h) {
                 m_timelineDragging = true;
+                m_scrubber.begin();
                 updateTimelinePosition(mouseX, timelineBarRect);
             }
+
+            // 点击图层面板中的一行：开关这个图层
+            SDL_Rect layersRect = { windowWidth * 3 / 4, 0, windowWidth / 4, windowHeight };
+            SDL_Point point = { mouseX, mouseY };
+            if (m_videoLoaded && SDL_PointInRect(&point, &layersRect)) {
+                LayerList layers = m_videoDecoder->getLayers();
+                for (size_t row = 0; row < layers.size(); row++) {
+                    SDL_Rect rowRect = layerRowRect(layersRect, row);
+                    if (SDL_PointInRect(&point, &rowRect)) {
+                        toggleLayer(layers, layers.size() - 1 - row);
+                        break;
+                    }
+                }
+            }
         }
     }
 
+    // 开关当前片段的一个叠加图层，预览立即按新的图层重画
+    void toggleLayer(LayerList& layers, size_t index) {
+        OverlayLayer& layer = layers[index];
+        layer.visible = !layer.visible;
+        m_videoDecoder->setLayers(layers);
+        std::cout << "图层: " << (layer.visible ? "显示" : "隐藏") << " " << layer.image->name << std::endl;
+        m_layoutVersion++;
+        m_dirty = true;
+    }
+
+    // 图层面板的第row行，最上面的图层在第0行
+    static SDL_Rect layerRowRect(const SDL_Rect& layersRect, size_t row) {
+        return { layersRect.x + 8, layersRect.y + 8 + (int)row * (kLayerRowHeight + 4), layersRect.w - 16, kLayerRowHeight };
+    }
+
     void handleMouseButtonUp(const SDL_Event& event) {
-        if (event.button.button == SDL_BUTTON_LEFT) {
+        if (event.button.button == SDL_BUTTON_LEFT && m_timelineDragging) {
             m_timelineDragging = false;
+            m_scrubber.end();
         }
     }
 
@@ -601,55 +649,386 @@ private:
         if (ratio < 0.0) ratio = 0.0;
         if (ratio > 1.0) ratio = 1.0;
         
-        double duration = m_videoDecoder.getDuration();
+        double duration = m_videoDecoder->getDuration();
         double newTime = ratio * duration;
         
-        // 跳转到新时间
-        m_videoDecoder.seekToTime(newTime);
+        // 只登记目标，由update()合并后发出seek，播放头立即跟随鼠标
+        m_scrubber.request(newTime);
         m_currentTime = newTime;
     }
 
+    // 没有画面需要推进时延长休眠：后台任务在跑时按进度条的刷新间隔醒来，否则只等输入事件
+    // 返回这一轮是否空闲（计入空闲CPU占用的统计）
+    bool scheduleWakeup() {
+        if (m_videoLoaded && (m_isPlaying || m_timelineDragging || m_videoDecoder->needsRefresh())) {
+            return false;
+        }
+        bool busy = m_clips.isLoading() || m_clips.isReplacing() || m_proxy.isRunning() || m_exporter.isRunning() || m_encodeExporter.isRunning() ||
+                    m_thumbnails.isGenerating() || !m_waveform.finished() || !m_scenes.finished() || m_showProfile;
+        m_frameDelay = busy ? kBackgroundFrameDelay : kIdleWaitMs;
+        return !busy;
+    }
+
     void update() {
-        // 更新应用程序状态
-        if (m_videoLoaded && m_isPlaying && !m_timelineDragging) {
-            // 读取下一帧
-            if (!m_videoDecoder.readFrame()) {
-                // 视频结束，重新开始
+        m_frameDelay = kIdleFrameDelay;
+        switch (m_clips.poll()) {
+            case ClipPool::Event::Ready:
+                onClipActivated();
+                break;
+            case ClipPool::Event::Failed:
+                m_videoDecoder = &m_clips.active();
+                if (m_clips.hasActive()) {
+                    onClipActivated();
+                }
+                m_dirty = true;
+                break;
+            case ClipPool::Event::Replaced:
+                onProxyAttached();
+                break;
+            default:
+                break;
+        }
+        if (!m_videoLoaded) {
+            return;
+        }
+
+        // 代理生成好之后预览切换过去；拖动时间线的过程中不切换
+        if (!m_usingProxy && !m_timelineDragging && m_proxy.ready()) {
+            switchToProxy();
+        }
+
+        // 暂停或拖动时间线时主时钟停止走动
+        m_clock.setPaused(!m_isPlaying || m_timelineDragging);
+        m_videoDecoder->setScrubbing(m_timelineDragging);
+
+        // 有音频时只在正常速度正放时出声，此时音频时钟是主时钟，m_clock跟随它
+        bool audioPlayback = m_isPlaying && !m_timelineDragging && m_shuttleRate == 1 && m_videoDecoder->hasAudio();
+        double audioTime = 0.0;
+        if (audioPlayback && !m_audioPlaying && !m_videoDecoder->needsRefresh()) {
+            // 逐帧、倒放或穿梭之后画面已经离开音频的位置，或者期间丢过音频数据包：重新定位让两者对齐
+            bool audioValid = m_videoDecoder->getAudioClock(audioTime);
+            if (!audioValid || m_videoDecoder->audioNeedsResync() ||
+                std::abs(audioTime - m_videoDecoder->getCurrentTime()) > kAudioResyncThreshold) {
+                m_videoDecoder->seekToTime(m_videoDecoder->getCurrentTime());
+            }
+            m_audioPlaying = true;
+        } else if (!audioPlayback) {
+            m_audioPlaying = false;
+        }
+        m_videoDecoder->setAudioPlaying(audioPlayback);
+        bool audioMaster = audioPlayback && !m_videoDecoder->needsRefresh() && m_videoDecoder->getAudioClock(audioTime);
+        if (audioMaster) {
+            m_clock.set(audioTime);
+        }
+
+        // 拖动时间线：合并这一帧内的所有鼠标事件，最多发出一次seek
+        double scrubTarget = 0.0;
+        ScrubController::Action action = m_scrubber.poll(scrubTarget);
+        if (action == ScrubController::Action::Keyframe) {
+            m_videoDecoder->seekToTime(scrubTarget, VideoDecoder::SeekMode::Keyframe);
+        } else if (action == ScrubController::Action::Exact) {
+            m_videoDecoder->seekToTime(scrubTarget);
+        }
+
+        if (m_videoDecoder->needsRefresh()) {
+            // 刚打开文件或seek之后：直接显示第一帧，并以它的pts对齐主时钟
+            bool presented = m_videoDecoder->readFrame();
+            m_dirty = m_dirty || presented;
+            if (!m_videoDecoder->needsRefresh()) {
+                m_scrubber.onFrameDisplayed();
+                if (presented) {
+                    m_clock.set(m_videoDecoder->getCurrentTime());
+                    if (!m_timelineDragging) {
+                        m_currentTime = m_videoDecoder->getCurrentTime();
+                    }
+                }
+            }
+            m_frameDelay = 1;
+        } else if (m_isPlaying && !m_timelineDragging && m_shuttleRate < 0) {
+            // 倒放：按倒走的时钟从帧缓存取帧，未命中时解码器回填一段再继续
+            double target = m_clock.get();
+            if (target <= 0.0) {
+                m_isPlaying = false;
+                setShuttleRate(1);
+                printFrameCacheStats();
+                target = 0.0;
+            }
+            if (m_videoDecoder->showFrameAt(target)) {
+                m_currentTime = m_videoDecoder->getCurrentTime();
+            }
+        } else if (m_isPlaying && !m_timelineDragging) {
+            double delay = 0.0;
+            VideoDecoder::FrameStatus status = m_videoDecoder->presentFrame(m_clock.get(), delay);
+
+            if (status == VideoDecoder::FrameStatus::EndOfStream) {
+                // 视频结束
                 m_isPlaying = false;
+                setShuttleRate(1);
+                std::cout << "播放结束，丢帧: " << m_videoDecoder->getDroppedFrames()
+                          << "，重复帧: " << m_videoDecoder->getRepeatedFrames()
+                          << "，每帧拷贝字节: " << m_videoDecoder->getBytesCopiedPerFrame();
+                if (m_videoDecoder->hasAudio()) {
+                    std::cout << "，音频欠载: " << m_videoDecoder->getAudioUnderruns();
+                }
+                std::cout << std::endl;
+                printFrameCacheStats();
             } else {
-                // 更新当前时间
-                m_currentTime = m_videoDecoder.getCurrentTime();
+                if (status == VideoDecoder::FrameStatus::Presented) {
+                    // 更新当前时间
+                    m_currentTime = m_videoDecoder->getCurrentTime();
+                    // 音频为主时钟时由presentFrame丢帧追赶，不能反过来拉动时钟
+                    if (!audioMaster && std::abs(m_clock.get() - m_currentTime) > VideoDecoder::kNoSyncThreshold) {
+                        m_clock.set(m_currentTime);
+                    }
+                }
+                m_frameDelay = std::min(kIdleFrameDelay, (int)(delay * 1000));
             }
         }
     }
 
     void render() {
-        // 清除屏幕
-        SDL_SetRenderDrawColor(m_renderer, 40, 40, 40, 255);
-        SDL_RenderClear(m_renderer);
+        int windowWidth, windowHeight;
+        SDL_GetWindowSize(m_window, &windowWidth, &windowHeight);
+        m_batch.resetCalls();
+
+        // 静态层：面板、时间线刻度、缩略图和波形，只在窗口尺寸或内容变化时重画
+        if (m_background.begin(m_renderer, windowWidth, windowHeight, backgroundKey(windowWidth, windowHeight))) {
+            ProfileScope scope("render_background");
+            drawBackground(windowWidth, windowHeight);
+            m_batch.flush();
+            m_background.end();
+        }
+        if (m_background.draw(m_renderer)) {
+            m_batch.countCall();
+        }
 
-        // 绘制UI布局
-        drawUILayout();
+        // 动态层：视频画面、播放头、进度条和状态
+        drawUILayout(windowWidth, windowHeight);
+        m_batch.flush();
+        m_uiStats.onRender(m_batch.calls());
 
         // 更新屏幕
+        ProfileScope scope("present");
         SDL_RenderPresent(m_renderer);
     }
 
-    // 将drawTimeline方法添加到Application类内部
-    void drawUILayout() {
+    // 时间线条在时间线区域中的位置
+    static SDL_Rect timelineBarRectOf(const SDL_Rect& timelineRect) {
+        return { timelineRect.x + 10, timelineRect.y + 20, timelineRect.w - 20, 30 };
+    }
+
+    static uint64_t doubleBits(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // 静态层的内容键：窗口尺寸、打开的文件，以及缩略图和波形的生成进度
+    uint64_t backgroundKey(int windowWidth, int windowHeight) const {
+        uint64_t key = CachedLayer::mixKey(0, ((uint64_t)(uint32_t)windowWidth << 32) | (uint32_t)windowHeight);
+        key = CachedLayer::mixKey(key, m_layoutVersion);
+        key = CachedLayer::mixKey(key, m_videoLoaded ? doubleBits(m_videoDecoder->getDuration()) : 0);
+        key = CachedLayer::mixKey(key, (uint64_t)m_thumbnails.readyCount());
+        key = CachedLayer::mixKey(key, (uint64_t)m_waveform.peakCount());
+        key = CachedLayer::mixKey(key, (uint64_t)m_scenes.markerCount());
+        return key;
+    }
+
+    // 整个画面的内容键：与上次渲染相同且期间没有事件、没有新画面时跳过这一帧
+    uint64_t frameKey() const {
         int windowWidth, windowHeight;
         SDL_GetWindowSize(m_window, &windowWidth, &windowHeight);
+        uint64_t key = backgroundKey(windowWidth, windowHeight);
+        key = CachedLayer::mixKey(key, doubleBits(m_currentTime));
+        key = CachedLayer::mixKey(key, doubleBits(m_videoDecoder->getCurrentTime()));
+        key = CachedLayer::mixKey(key, (m_isPlaying ? 1 : 0) | (m_usingProxy ? 2 : 0) | (m_showProfile ? 4 : 0));
+        key = CachedLayer::mixKey(key, doubleBits(m_inPoint));
+        key = CachedLayer::mixKey(key, doubleBits(m_outPoint));
+        key = CachedLayer::mixKey(key, m_proxy.isRunning() ? (uint64_t)(m_proxy.progress() * kProgressSteps) + 1 : 0);
+        key = CachedLayer::mixKey(key, m_encodeExporter.isRunning() ? (uint64_t)(m_encodeExporter.progress() * kProgressSteps) + 1 : 0);
+        key = CachedLayer::mixKey(key, !m_scenes.finished() ? (uint64_t)(m_scenes.progress() * kProgressSteps) + 1 : 0);
+        if (m_showProfile) {
+            key = CachedLayer::mixKey(key, SDL_GetTicks() / kProfileRefreshMs);
+        }
+        if (m_clips.isLoading()) {
+            key = CachedLayer::mixKey(key, SDL_GetTicks() / kBackgroundFrameDelay);
+        }
+        return key;
+    }
+
+    void drawBackground(int windowWidth, int windowHeight) {
+        // 清除屏幕
+        SDL_SetRenderDrawColor(m_renderer, 40, 40, 40, 255);
+        SDL_RenderClear(m_renderer);
+        m_batch.countCall();
 
-        // 绘制预览窗口区域
+        // 预览窗口区域，视频画面和边框在动态层
         SDL_Rect previewRect = { 0, 0, windowWidth * 3 / 4, windowHeight / 2 };
-        SDL_SetRenderDrawColor(m_renderer, 0, 0, 0, 255);
-        SDL_RenderFillRect(m_renderer, &previewRect);
-        
+        m_batch.fill(previewRect, 0, 0, 0);
+
+        // 时间线区域
+        SDL_Rect timelineRect = { 0, windowHeight / 2, windowWidth * 3 / 4, windowHeight / 2 };
+        m_batch.fill(timelineRect, 50, 50, 50);
+        if (m_videoLoaded) {
+            drawTimelineBackground(timelineBarRectOf(timelineRect));
+        }
+        m_batch.outline(timelineRect, 100, 100, 100);
+
+        // 图层面板区域
+        SDL_Rect layersRect = { windowWidth * 3 / 4, 0, windowWidth / 4, windowHeight };
+        m_batch.fill(layersRect, 60, 60, 60);
+        if (m_videoLoaded) {
+            drawLayerRows(layersRect);
+        }
+        m_batch.outline(layersRect, 100, 100, 100);
+    }
+
+    // 当前片段的叠加图层，从上往下一行一个：左侧方块表示是否显示，底部的条是不透明度，颜色区分混合模式
+    void drawLayerRows(const SDL_Rect& layersRect) {
+        static const Uint8 kModeColors[][3] = { { 200, 200, 200 }, { 255, 200, 80 }, { 120, 180, 255 }, { 160, 255, 160 } };
+        LayerList layers = m_videoDecoder->getLayers();
+        for (size_t row = 0; row < layers.size(); row++) {
+            const OverlayLayer& layer = layers[layers.size() - 1 - row];
+            SDL_Rect rowRect = layerRowRect(layersRect, row);
+            Uint8 shade = layer.visible ? 85 : 70;
+            m_batch.fill(rowRect, shade, shade, shade);
+            m_batch.outline(rowRect, 110, 110, 110);
+            SDL_Rect visibleBox = { rowRect.x + 6, rowRect.y + 6, 10, 10 };
+            if (layer.visible) {
+                m_batch.fill(visibleBox, 230, 230, 230);
+            } else {
+                m_batch.outline(visibleBox, 150, 150, 150);
+            }
+            const Uint8* color = kModeColors[(int)layer.mode];
+            SDL_Rect opacityBar = { rowRect.x, rowRect.y + rowRect.h - 4, (int)(layer.opacity * rowRect.w), 4 };
+            m_batch.fill(opacityBar, color[0], color[1], color[2]);
+        }
+    }
+
+    // 时间线中不随播放变化的部分：背景、缩略图、刻度和波形
+    void drawTimelineBackground(const SDL_Rect& timelineBarRect) {
+        m_batch.fill(timelineBarRect, 30, 30, 30);
+        m_batch.flush();
+        m_batch.countCall(m_thumbnails.draw(m_renderer, timelineBarRect));
+        m_batch.outline(timelineBarRect, 80, 80, 80);
+
+        double duration = m_videoDecoder->getDuration();
+        if (duration <= 0) {
+            return;
+        }
+
+        // 每10秒一个刻度；刻度线和下方的标签（简化为小矩形）各自合并成一次提交
+        int numTicks = (int)(duration / 10) + 1;
+        auto tickX = [&](int i) {
+            double time = std::min(i * 10.0, duration);
+            return timelineBarRect.x + (int)(time / duration * timelineBarRect.w);
+        };
+        for (int i = 0; i <= numTicks; i++) {
+            m_batch.line(tickX(i), timelineBarRect.y, tickX(i), timelineBarRect.y + timelineBarRect.h, 150, 150, 150);
+        }
+        for (int i = 0; i <= numTicks; i++) {
+            SDL_Rect tickRect = { tickX(i) - 2, timelineBarRect.y + timelineBarRect.h + 5, 4, 10 };
+            m_batch.fill(tickRect, 150, 150, 150);
+        }
+
+        // 镜头切换点：贯穿时间线的竖线，上方一个小方块
+        for (double marker : m_scenes.markers()) {
+            int x = timelineBarRect.x + (int)(std::min(marker, duration) / duration * timelineBarRect.w);
+            m_batch.line(x, timelineBarRect.y, x, timelineBarRect.y + timelineBarRect.h, 230, 120, 200);
+            SDL_Rect markerHead = { x - 2, timelineBarRect.y - 4, 5, 4 };
+            m_batch.fill(markerHead, 230, 120, 200);
+        }
+
+        // 时间线下方的音频波形，生成过程中已完成的部分先显示
+        SDL_Rect waveformRect = { timelineBarRect.x, timelineBarRect.y + timelineBarRect.h + 45, timelineBarRect.w, 40 };
+        m_batch.fill(waveformRect, 30, 30, 30);
+        m_batch.flush();
+        if (m_waveform.draw(m_renderer, waveformRect, 0.0, duration)) {
+            m_batch.countCall();
+        }
+        m_batch.outline(waveformRect, 80, 80, 80);
+    }
+
+    // 时间线上随播放和编辑变化的部分
+    void drawTimelineOverlay(const SDL_Rect& timelineBarRect) {
+        double duration = m_videoDecoder->getDuration();
+        if (duration <= 0) {
+            return;
+        }
+
+        // 绘制入点/出点之间的导出区间
+        if (m_inPoint >= 0.0 || m_outPoint >= 0.0) {
+            double rangeIn = m_inPoint >= 0.0 ? m_inPoint : 0.0;
+            double rangeOut = m_outPoint >= 0.0 ? m_outPoint : duration;
+            int inX = timelineBarRect.x + (int)(rangeIn / duration * timelineBarRect.w);
+            int outX = timelineBarRect.x + (int)(rangeOut / duration * timelineBarRect.w);
+            SDL_Rect rangeRect = { inX, timelineBarRect.y, std::max(1, outX - inX), timelineBarRect.h };
+            m_batch.fill(rangeRect, 255, 200, 0, 60);
+            m_batch.line(inX, timelineBarRect.y - 5, inX, timelineBarRect.y + timelineBarRect.h + 5, 255, 200, 0);
+            m_batch.line(outX, timelineBarRect.y - 5, outX, timelineBarRect.y + timelineBarRect.h + 5, 255, 200, 0);
+        }
+
+        // 代理生成进度画在时间线上沿；预览已经切换到代理时在右上角标一个小方块
+        if (m_proxy.isRunning()) {
+            SDL_Rect proxyBar = { timelineBarRect.x, timelineBarRect.y, (int)(m_proxy.progress() * timelineBarRect.w), 3 };
+            m_batch.fill(proxyBar, 90, 140, 255);
+        } else if (m_usingProxy) {
+            SDL_Rect proxyMark = { timelineBarRect.x + timelineBarRect.w - 8, timelineBarRect.y - 10, 8, 8 };
+            m_batch.fill(proxyMark, 90, 140, 255);
+        }
+
+        // 重编码导出的进度条，画在时间线下沿
+        if (m_encodeExporter.isRunning()) {
+            SDL_Rect progressBar = { timelineBarRect.x, timelineBarRect.y + timelineBarRect.h - 4,
+                                     (int)(m_encodeExporter.progress() * timelineBarRect.w), 4 };
+            m_batch.fill(progressBar, 80, 220, 120);
+        }
+
+        // 镜头切换分析的进度条，画在波形上方
+        if (!m_scenes.finished()) {
+            SDL_Rect sceneBar = { timelineBarRect.x, timelineBarRect.y + timelineBarRect.h + 41,
+                                  (int)(m_scenes.progress() * timelineBarRect.w), 3 };
+            m_batch.fill(sceneBar, 230, 120, 200);
+        }
+
+        // 绘制当前时间指示器：指示线和头部
+        double ratio = m_currentTime / duration;
+        int currentX = timelineBarRect.x + (int)(ratio * timelineBarRect.w);
+        m_batch.line(currentX, timelineBarRect.y - 10, currentX, timelineBarRect.y + timelineBarRect.h + 10, 255, 0, 0);
+        SDL_Rect indicatorHead = { currentX - 5, timelineBarRect.y - 15, 10, 10 };
+        m_batch.fill(indicatorHead, 255, 0, 0);
+
+        // 显示当前时间/总时间
+        char timeText[50];
+        int minutes = (int)m_currentTime / 60;
+        int seconds = (int)m_currentTime % 60;
+        int totalMinutes = (int)duration / 60;
+        int totalSeconds = (int)duration % 60;
+
+        // 在时间线下方显示时间信息
+        SDL_Rect timeInfoRect = {
+            timelineBarRect.x,
+            timelineBarRect.y + timelineBarRect.h + 20,
+            100,
+            20
+        };
+        m_batch.fill(timeInfoRect, 60, 60, 60);
+
+        // 显示进度
+        int progressWidth = (int)(ratio * timeInfoRect.w);
+        SDL_Rect progressRect = { timeInfoRect.x, timeInfoRect.y, progressWidth, timeInfoRect.h };
+        m_batch.fill(progressRect, 100, 100, 255);
+    }
+
+    void drawUILayout(int windowWidth, int windowHeight) {
+        // 预览窗口区域
+        SDL_Rect previewRect = { 0, 0, windowWidth * 3 / 4, windowHeight / 2 };
+
         // 如果视频已加载，绘制视频帧
-        if (m_videoLoaded && m_videoDecoder.getTexture()) {
+        if (m_videoLoaded && m_videoDecoder->getTexture()) {
             // 计算视频在预览窗口中的位置和大小
-            int videoWidth = m_videoDecoder.getWidth();
-            int videoHeight = m_videoDecoder.getHeight();
+            int videoWidth = m_videoDecoder->getWidth();
+            int videoHeight = m_videoDecoder->getHeight();
             
             // 保持宽高比
             float videoAspect = (float)videoWidth / videoHeight;
@@ -670,36 +1049,38 @@ private:
                 destRect.y = previewRect.y;
             }
             
-            SDL_RenderCopy(m_renderer, m_videoDecoder.getTexture(), nullptr, &destRect);
+            // 解码线程按这个尺寸转换，避免全分辨率转换后再由渲染器缩小
+            m_videoDecoder->setOutputSize(destRect.w, destRect.h);
+            SDL_RenderCopy(m_renderer, m_videoDecoder->getTexture(), nullptr, &destRect);
+            m_batch.countCall();
+        } else if (m_clips.isLoading()) {
+            drawPlaceholder(previewRect);
         }
         
-        SDL_SetRenderDrawColor(m_renderer, 100, 100, 100, 255);
-        SDL_RenderDrawRect(m_renderer, &previewRect);
+        m_batch.outline(previewRect, 100, 100, 100);
 
-        // 绘制时间线区域
-        SDL_Rect timelineRect = { 0, windowHeight / 2, windowWidth * 3 / 4, windowHeight / 2 };
-        SDL_SetRenderDrawColor(m_renderer, 50, 50, 50, 255);
-        SDL_RenderFillRect(m_renderer, &timelineRect);
-        
-        // 添加时间轴绘制代码
+        // 时间线上的播放头、入出点和进度条
         if (m_videoLoaded) {
-            drawTimeline(timelineRect);
+            SDL_Rect timelineRect = { 0, windowHeight / 2, windowWidth * 3 / 4, windowHeight / 2 };
+            drawTimelineOverlay(timelineBarRectOf(timelineRect));
         }
-        
-        SDL_SetRenderDrawColor(m_renderer, 100, 100, 100, 255);
-        SDL_RenderDrawRect(m_renderer, &timelineRect);
 
-        // 绘制图层面板区域
-        SDL_Rect layersRect = { windowWidth * 3 / 4, 0, windowWidth / 4, windowHeight };
-        SDL_SetRenderDrawColor(m_renderer, 60, 60, 60, 255);
-        SDL_RenderFillRect(m_renderer, &layersRect);
-        SDL_SetRenderDrawColor(m_renderer, 100, 100, 100, 255);
-        SDL_RenderDrawRect(m_renderer, &layersRect);
-        
         // 绘制状态信息
         drawStatusInfo(windowWidth, windowHeight);
     }
     
+    // 冷打开期间的占位画面：暗色底板上一段来回移动的细条
+    void drawPlaceholder(const SDL_Rect& previewRect) {
+        SDL_Rect panel = { previewRect.x + 1, previewRect.y + 1, previewRect.w - 2, previewRect.h - 2 };
+        m_batch.fill(panel, 28, 28, 32);
+        int barWidth = std::max(1, panel.w / 4);
+        int travel = std::max(1, panel.w - barWidth);
+        int phase = (int)(SDL_GetTicks() / kBackgroundFrameDelay % (2 * kPlaceholderSteps));
+        int step = phase < kPlaceholderSteps ? phase : 2 * kPlaceholderSteps - phase;
+        SDL_Rect bar = { panel.x + travel * step / kPlaceholderSteps, panel.y + panel.h / 2 - 2, barWidth, 4 };
+        m_batch.fill(bar, 90, 140, 220);
+    }
+
     void drawStatusInfo(int windowWidth, int windowHeight) {
         // 在实际应用中，这里应该绘制状态信息，如播放状态、当前时间等
         // 由于SDL没有内置的文本渲染功能，这里简化为绘制一个状态指示器
@@ -708,34 +1089,272 @@ private:
         SDL_Rect statusRect = { windowWidth - 50, windowHeight - 50, 30, 30 };
         if (m_isPlaying) {
             // 绘制暂停图标
-            SDL_SetRenderDrawColor(m_renderer, 0, 255, 0, 255);
-            SDL_RenderFillRect(m_renderer, &statusRect);
+            m_batch.fill(statusRect, 0, 255, 0);
         } else {
             // 绘制播放图标
-            SDL_SetRenderDrawColor(m_renderer, 255, 0, 0, 255);
             SDL_Rect playIcon = { statusRect.x + 5, statusRect.y + 5, 20, 20 };
-            SDL_RenderFillRect(m_renderer, &playIcon);
+            m_batch.fill(playIcon, 255, 0, 0);
+        }
+
+        if (m_showProfile) {
+            drawProfileOverlay();
+        }
+    }
+
+    // 分段计时叠加层：每个阶段一行，条长为最近一秒的平均耗时，细线为最大耗时，满格为一帧的预算
+    void drawProfileOverlay() {
+        Uint32 now = SDL_GetTicks();
+        if (m_profileUpdated == 0 || now - m_profileUpdated >= kProfileRefreshMs) {
+            m_profileStats = Profiler::instance().summarize(1.0);
+            m_profileUpdated = now;
+        }
+
+        const int rowHeight = 8;
+        const int barWidth = 200;
+        int rows = (int)(sizeof(kProfileStages) / sizeof(kProfileStages[0]));
+        SDL_Rect background = { 10, 10, barWidth + 8, rows * rowHeight + 8 };
+        m_batch.fill(background, 0, 0, 0, 160);
+
+        for (int row = 0; row < rows; row++) {
+            const ProfileStage& stage = kProfileStages[row];
+            auto found = std::find_if(m_profileStats.begin(), m_profileStats.end(),
+                                      [&](const Profiler::StageStats& stats) { return std::string(stats.name) == stage.name; });
+            if (found == m_profileStats.end() || found->count == 0) {
+                continue;
+            }
+
+            int y = background.y + 4 + row * rowHeight;
+            double average = found->totalMs / found->count;
+            SDL_Rect bar = { background.x + 4, y, std::min(barWidth, (int)(average / kFrameBudgetMs * barWidth)), rowHeight - 2 };
+            m_batch.fill(bar, stage.r, stage.g, stage.b);
+
+            int peakX = background.x + 4 + std::min(barWidth, (int)(found->maxMs / kFrameBudgetMs * barWidth));
+            m_batch.line(peakX, y, peakX, y + rowHeight - 3, stage.r, stage.g, stage.b);
         }
     }
 
     bool m_running;
     SDL_Window* m_window;
     SDL_Renderer* m_renderer;
-    VideoDecoder m_videoDecoder;
+    ClipPool m_clips; // 打开着的片段，最近用过的保温以便立即切回
+    VideoDecoder* m_videoDecoder; // m_clips的当前片段，冷打开期间是一个未打开的解码器
     bool m_videoLoaded;
     bool m_isPlaying;
-    int m_frameDelay; // 毫秒
+    int m_shuttleRate; // J/K/L穿梭速率，负数为倒放
+    bool m_audioPlaying; // 是否处于出声播放状态（进入时已检查过音画对齐）
+    int m_frameDelay; // 主循环本次休眠的毫秒数，由下一帧的显示时间决定
+    MediaClock m_clock; // 播放主时钟
     double m_currentTime; // 当前播放时间（秒）
+    std::string m_currentFile; // 当前打开的文件
+    double m_inPoint; // 导出入点（秒），负数为未设置
+    double m_outPoint; // 导出出点（秒），负数为未设置
+    TrimExporter m_exporter; // 后台裁剪导出
+    ChunkedExporter m_encodeExporter; // 后台并行重编码导出
     bool m_timelineDragging; // 是否正在拖动时间线
+    ScrubController m_scrubber; // 拖动时间线时的seek调度
+    std::string m_pendingFile; // 初始化之前请求加载的文件
+    ProxyGenerator m_proxy; // 后台生成的预览代理
+    bool m_usingProxy; // 预览是否已经切换到代理（导出始终读取m_currentFile）
+    ThumbnailStrip m_thumbnails; // 时间线缩略图
+    WaveformTrack m_waveform; // 时间线下方的音频波形
+    SceneDetector m_scenes; // 镜头切换点，画在时间线上
+    bool m_showProfile; // 是否显示分段计时叠加层
+    std::vector<Profiler::StageStats> m_profileStats; // 叠加层显示的最近一秒汇总
+    Uint32 m_profileUpdated; // 上次汇总的时刻（毫秒）
+    DrawBatch m_batch; // 界面图元的批量提交
+    CachedLayer m_background; // 保留模式的静态层（面板、刻度、缩略图、波形）
+    UiStats m_uiStats; // 渲染次数、绘制调用数和空闲CPU占用
+    bool m_dirty; // 有事件或新画面，下一轮必须重画
+    uint64_t m_renderedKey; // 上次渲染时的画面内容键
+    uint64_t m_layoutVersion; // 每打开一个文件加一，使静态层失效
+    std::string m_traceFile; // 退出时导出trace的路径
+
+    struct ProfileStage {
+        const char* name;
+        Uint8 r, g, b;
+    };
+    // 叠加层的行顺序和颜色，按流水线从前到后排列
+    static constexpr ProfileStage kProfileStages[] = {
+        { "av_read_frame", 120, 120, 255 },
+        { "avcodec_send_packet", 255, 160, 60 },
+        { "avcodec_receive_frame", 255, 220, 60 },
+        { "sws_scale", 80, 220, 80 },
+        { "readFrame", 60, 200, 200 },
+        { "presentFrame", 160, 255, 160 },
+        { "texture_upload", 220, 100, 220 },
+        { "sws_scale_texture", 150, 80, 200 },
+        { "update", 200, 200, 200 },
+        { "render", 255, 120, 120 },
+        { "present", 255, 60, 60 },
+    };
+    static constexpr double kFrameBudgetMs = 1000.0 / 60.0; // 叠加层满格对应的耗时
+    static constexpr Uint32 kProfileRefreshMs = 500;        // 叠加层汇总的刷新间隔
+
+    static constexpr int kIdleFrameDelay = 10; // 没有帧等待显示时的最长休眠（毫秒）
+    static constexpr int kBackgroundFrameDelay = 50; // 暂停但后台任务在跑时的唤醒间隔，用于刷新进度条（毫秒）
+    static constexpr int kIdleWaitMs = 500; // 完全空闲时最长阻塞等待输入事件的时间（毫秒）
+    static constexpr int kPlaceholderSteps = 30; // 占位画面的细条走完一趟的步数，每步一个kBackgroundFrameDelay
+    static constexpr double kProgressSteps = 1000.0; // 进度条变化到这个精度才重画
+    static constexpr int kMaxShuttleRate = 8;  // J/L连按的最高倍速
+    static constexpr int kLayerRowHeight = 28;  // 图层面板每行的高度
+    static constexpr double kAudioResyncThreshold = 0.1; // 开始出声时音频与画面相差超过该值（秒）则重新对齐
 };
 
 int main(int argc, char* argv[]) {
     try {
+        // --bench [参数...] 不打开窗口，运行解码/seek基准测试并输出JSON报告
+        if (argc > 1 && std::string(argv[1]) == "--bench") {
+            return runBenchmark(argc, argv, 2);
+        }
+
+        // --export-trim IN OUT OUTPUT INPUT 不打开窗口，把INPUT的[IN, OUT)秒导出到OUTPUT（.mp4/.mkv）
+        if (argc == 6 && std::string(argv[1]) == "--export-trim") {
+            TrimExporter exporter;
+            TrimExportStats stats;
+            if (!exporter.exportRange(argv[5], std::atof(argv[2]), std::atof(argv[3]), argv[4], stats)) {
+                return 1;
+            }
+            TrimExporter::printStats(argv[4], stats);
+            return 0;
+        }
+
+        // --export-encode IN OUT OUTPUT INPUT [--workers N] [--scale WxH] [--encoder NAME] [--bitrate-kbps N]
+        //                 [--gop N] [--worker-memory-mb N] [--verify] [--brightness F ... 调色效果、--layer FILE ... 叠加图层，同界面]
+        // 不打开窗口，按关键帧分段并行重编码导出；OUT不大于IN时导出到结尾，--verify 与串行编码比较时间戳
+        if (argc >= 6 && std::string(argv[1]) == "--export-encode") {
+            ChunkedExportOptions options;
+            options.printProgress = true;
+            if (!ChunkedExportOptions::parseArgs(argc, argv, 6, options)) {
+                return 1;
+            }
+            ChunkedExporter exporter;
+            ChunkedExportStats stats;
+            if (!exporter.exportRange(argv[5], std::atof(argv[2]), std::atof(argv[3]), argv[4], options, stats)) {
+                return 1;
+            }
+            ChunkedExporter::printStats(argv[4], stats);
+            return stats.verified && !stats.verifyPassed ? 1 : 0;
+        }
+
         g_app = std::make_unique<Application>();
-        
+
+        // 解析命令行参数：--packet-queue N / --frame-queue N 设置解码队列深度
+        // --zero-copy 需要格式转换时直接转换到锁定的纹理内存
+        // --full-res-preview 按解码分辨率转换，不缩放到预览尺寸；--lowres N 解码器lowres级别
+        // --decode-threads N 解码线程数（默认按核心预算分配）；--thread-type auto|frame|slice
+        // --core-budget N 所有解码器共享的核心数；--autotune-threads 打开文件时实测选择线程数
+        // --frame-cache-mb N 最近解码帧缓存的内存上限，0为关闭
+        // --profile 启动时打开分段计时叠加层；--trace-out FILE 退出时导出Chrome trace（隐含--profile）
+        // --no-audio 不播放音频，画面按系统时钟播放
+        // --no-proxy 不生成预览代理；--proxy-cache-mb N 代理缓存目录的大小上限
+        // --io auto|ffmpeg|prefetch|mmap 读取源文件的方式（默认网络盘预读、本地盘内存映射）
+        // --warm-clips N 最多保温的片段数；--clip-pool-mb N 保温片段的画面内存上限
+        // --no-probe-cache 每次打开都重新探测，不读写探测缓存
+        // --scene-threshold F 镜头切换的最小平均亮度差（0..255）；--scene-workers N 并行分析的线程数
+        // --brightness F / --contrast F / --saturation F / --gamma F / --lut FILE.cube 片段默认的调色效果链，按顺序执行
+        // --layer FILE [--layer-rect X,Y,W,H] [--layer-opacity F] [--layer-blend normal|add|multiply|screen] 叠加图层，可以重复
+        std::string filename;
+        bool audio = true;
+        bool profile = false;
+        std::string traceFile;
+        DecoderThreadingConfig threading;
+        size_t packetQueueSize = 64;
+        size_t frameQueueSize = 4;
+        bool zeroCopy = false;
+        bool previewScaling = true;
+        int lowres = 0;
+        long frameCacheMB = 256;
+        IOMode ioMode = IOMode::Auto;
+        bool probeCache = true;
+        long warmClips = (long)ClipPool::kDefaultMaxClips;
+        long clipPoolMB = (long)(ClipPool::kDefaultMemoryLimit / (1024 * 1024));
+        long proxyCacheMB = (long)(ProxyGenerator::kDefaultCacheLimit / (1024 * 1024));
+        ColorChain colorEffects;
+        bool colorOk = true;
+        LayerList layers;
+        bool layersOk = true;
+        SceneOptions sceneOptions;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--zero-copy") {
+                zeroCopy = true;
+            } else if (arg == "--full-res-preview") {
+                previewScaling = false;
+            } else if (arg == "--lowres" && i + 1 < argc) {
+                lowres = std::atoi(argv[++i]);
+            } else if (arg == "--decode-threads" && i + 1 < argc) {
+                threading.threadCount = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--thread-type" && i + 1 < argc) {
+                if (!ThreadBudget::parseThreadType(argv[++i], threading.type)) {
+                    std::cerr << "未知的线程类型: " << argv[i] << std::endl;
+                }
+            } else if (arg == "--core-budget" && i + 1 < argc) {
+                ThreadBudget::instance().setTotalCores(std::atoi(argv[++i]));
+            } else if (arg == "--autotune-threads") {
+                threading.autoTune = true;
+            } else if (arg == "--frame-cache-mb" && i + 1 < argc) {
+                frameCacheMB = std::max(0L, std::atol(argv[++i]));
+            } else if (arg == "--no-audio") {
+                audio = false;
+            } else if (arg == "--profile") {
+                profile = true;
+            } else if (arg == "--trace-out" && i + 1 < argc) {
+                traceFile = argv[++i];
+                profile = true;
+            } else if (arg == "--io" && i + 1 < argc) {
+                if (!MediaIO::parseMode(argv[++i], ioMode)) {
+                    std::cerr << "未知的读取方式: " << argv[i] << std::endl;
+                }
+            } else if (arg == "--warm-clips" && i + 1 < argc) {
+                warmClips = std::max(1L, std::atol(argv[++i]));
+            } else if (arg == "--clip-pool-mb" && i + 1 < argc) {
+                clipPoolMB = std::max(0L, std::atol(argv[++i]));
+            } else if (arg == "--no-probe-cache") {
+                probeCache = false;
+            } else if (arg == "--scene-threshold" && i + 1 < argc) {
+                sceneOptions.minDifference = std::max(0.0f, (float)std::atof(argv[++i]));
+            } else if (arg == "--scene-workers" && i + 1 < argc) {
+                sceneOptions.workers = std::max(0, std::atoi(argv[++i]));
+            } else if (arg == "--no-proxy") {
+                proxyCacheMB = 0;
+            } else if (arg == "--proxy-cache-mb" && i + 1 < argc) {
+                proxyCacheMB = std::max(0L, std::atol(argv[++i]));
+            } else if (arg == "--packet-queue" && i + 1 < argc) {
+                packetQueueSize = (size_t)std::max(1, std::atoi(argv[++i]));
+            } else if (arg == "--frame-queue" && i + 1 < argc) {
+                frameQueueSize = (size_t)std::max(1, std::atoi(argv[++i]));
+            } else if (i + 1 < argc && parseColorEffectArg(arg, argv[i + 1], colorEffects, colorOk)) {
+                i++;
+            } else if (i + 1 < argc && parseLayerArg(arg, argv[i + 1], layers, layersOk)) {
+                i++;
+            } else {
+                filename = arg;
+            }
+        }
+        if (!colorOk || !layersOk) {
+            return 1;
+        }
+        g_app->setQueueDepths(packetQueueSize, frameQueueSize);
+        g_app->setZeroCopyUpload(zeroCopy);
+        g_app->setPreviewScaling(previewScaling, lowres);
+        g_app->setDecoderThreading(threading);
+        g_app->setFrameCacheSize((size_t)frameCacheMB * 1024 * 1024);
+        g_app->setAudioEnabled(audio);
+        g_app->setIOMode(ioMode);
+        g_app->setProbeCache(probeCache);
+        g_app->setColorEffects(colorEffects);
+        g_app->setLayers(layers);
+        g_app->setClipPoolLimits((size_t)warmClips, (size_t)clipPoolMB * 1024 * 1024);
+        g_app->setProxyCacheLimit((uint64_t)proxyCacheMB * 1024 * 1024);
+        g_app->setSceneOptions(sceneOptions);
+        g_app->setTraceFile(traceFile);
+        if (profile) {
+            g_app->setProfiling(true);
+        }
+
         // 如果有命令行参数，尝试加载视频文件
-        if (argc > 1) {
-            g_app->loadVideo(argv[1]);
+        if (!filename.empty()) {
+            g_app->loadVideo(filename);
         }
         
         return g_app->run();
@@ -21,3 +21,20 @@ target("VideoEditor")
     
     -- 添加定义，解决SDL main问题
     add_defines("SDL_MAIN_HANDLED")
+
+    -- 基准测试读取进程内存峰值
+    if is_plat("windows", "mingw") then
+        add_syslinks("psapi")
+    end
+
+-- 无窗口基准测试：本地生成测试视频，输出解码帧率、帧延迟、seek延迟和内存峰值的JSON报告
+-- xmake run VideoEditor-bench --output bench.json
+target("VideoEditor-bench")
+    set_kind("binary")
+    add_files("bench/*.cpp")
+    add_packages("libsdl2", "ffmpeg")
+    add_includedirs("src")
+    add_defines("SDL_MAIN_HANDLED")
+    if is_plat("windows", "mingw") then
+        add_syslinks("psapi")
+    end